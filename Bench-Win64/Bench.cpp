@@ -0,0 +1,35 @@
+#include "pch.h"
+#include "Bench.h"
+#include <Ngine.hpp>
+#include <cstdio>
+#include <vector>
+
+#pragma warning(disable : 4996)
+
+void Bench::WriteBMP(const std::string& path, unsigned int width, unsigned int height, unsigned int bpp, const std::function<void(unsigned int y, unsigned char* row)>& fill)
+{
+	//Rows are padded to 4 bytes
+	unsigned int rowBytes = (width * (bpp / 8) + 3) & ~3u, imageSize = rowBytes * height;
+	unsigned char header[54] = { 'B', 'M' };
+	auto u32 = [&](int at, unsigned int v) { for (int i = 0; i < 4; ++i) header[at + i] = (unsigned char)(v >> (8 * i)); };
+	u32(0x02, 54 + imageSize);
+	u32(0x0A, 54);
+	u32(0x0E, 40);
+	u32(0x12, width);
+	u32(0x16, height);
+	header[0x1A] = 1;
+	header[0x1C] = (unsigned char)bpp;
+	u32(0x22, imageSize);
+
+	FILE* file = fopen(path.c_str(), "wb");
+	if (!file)
+		throw Ngine::Exception(__LINE__, __FILE__, "Could not create benchmark image");
+	fwrite(header, 1, sizeof(header), file);
+
+	std::vector<unsigned char> row(rowBytes);
+	for (unsigned int y = 0; y < height; ++y) {
+		fill(y, row.data());
+		fwrite(row.data(), 1, row.size(), file);
+	}
+	fclose(file);
+}
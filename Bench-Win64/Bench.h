@@ -0,0 +1,71 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace Bench {
+
+	//Counted by the global operator new replacement in main.cpp
+	extern std::atomic<size_t> allocations, allocatedBytes;
+
+	struct Result {
+		std::string name;
+		double seconds; //Fastest run
+		double bytes; //Processed per run, 0 when throughput makes no sense
+		size_t allocations; //Heap allocations per run
+		size_t iterations;
+		size_t allocatedBytes = 0; //Per run
+		size_t peakRss = 0; //Process peak after the run, in bytes
+		std::vector<std::pair<std::string, double>> metrics; //Suite specific figures, reported and written as they are
+	};
+
+	using Results = std::vector<Result>;
+
+	//Runs fn once to warm up and then iterations times, keeping the fastest run
+	Result Measure(const std::string& name, size_t iterations, double bytes, const std::function<void()>& fn);
+
+	void Report(const Result& r);
+	bool WriteJson(const Results& results, const char* path);
+
+	//Peak resident set of the process so far
+	size_t PeakRss();
+	//Directory holding the shipped assets, set with --assets
+	const std::string& AssetDir();
+	//Value of --name on the command line
+	int Option(const char* name, int fallback);
+	const char* Option(const char* name, const char* fallback);
+
+	//xorshift, the same data every run. Good enough to defeat compression and caching tricks.
+	struct Noise {
+		uint32_t state = 2463534242u;
+
+		uint32_t Next()
+		{
+			state ^= state << 13;
+			state ^= state >> 17;
+			state ^= state << 5;
+			return state;
+		}
+
+		//In [0, 1)
+		float Unit() { return (Next() >> 8) / 16777216.0f; }
+	};
+
+	//Uncompressed bottom-up BMP of 24 or 32 bpp, fill gets each row in turn so big images don't inflate peak RSS
+	void WriteBMP(const std::string& path, unsigned int width, unsigned int height, unsigned int bpp, const std::function<void(unsigned int y, unsigned char* row)>& fill);
+
+	//Suites, one per file
+	void IniSuite(Results& results);
+	void JobsSuite(Results& results);
+	void LoaderSuite(Results& results);
+	void RenderSuite(Results& results);
+	void RaycastSuite(Results& results);
+	void BroadphaseSuite(Results& results);
+	void CookSuite(Results& results);
+	void VfsSuite(Results& results);
+	void IoSuite(Results& results);
+	void LightsSuite(Results& results);
+}
@@ -0,0 +1,93 @@
+#include "pch.h"
+#include "Bench.h"
+#include <Ngine.hpp>
+#include <cstdio>
+#include <thread>
+
+namespace {
+
+	struct Body {
+		glm::vec3 position, half, velocity;
+		Ngine::BodyId id;
+	};
+
+	//A 20 m wide strip of track, 10% cars driving along it and props standing on both sides
+	std::vector<Body> MakeScene(Ngine::Broadphase& broadphase, int count)
+	{
+		const float length = count * 0.5f;
+
+		Bench::Noise noise;
+		std::vector<Body> bodies(count);
+		for (int i = 0; i < count; ++i) {
+			Body& b = bodies[i];
+			if (i % 10 == 0) {
+				b.half = glm::vec3(2.25f, 0.75f, 1.0f);
+				b.position = glm::vec3(noise.Unit() * length, 0.75f, noise.Unit() * 16.0f - 8.0f);
+				b.velocity = glm::vec3(25.0f + noise.Unit() * 20.0f, 0.0f, 0.0f);
+			}
+			else {
+				b.half = glm::vec3(0.3f + noise.Unit(), 0.5f + noise.Unit() * 2.0f, 0.3f + noise.Unit());
+				b.position = glm::vec3(noise.Unit() * length, b.half.y, (noise.Unit() < 0.5f ? -11.0f : 11.0f) + noise.Unit() * 2.0f - 1.0f);
+				b.velocity = glm::vec3(0.0f);
+			}
+			b.id = broadphase.Add(b.position - b.half, b.position + b.half);
+		}
+		broadphase.Update();
+		return bodies;
+	}
+
+	void Tick(Ngine::Broadphase& broadphase, std::vector<Body>& bodies, float length, float dt)
+	{
+		for (Body& b : bodies) {
+			if (b.velocity.x == 0.0f)
+				continue;
+			b.position += b.velocity * dt;
+			if (b.position.x > length)
+				b.position.x -= length; //Lap around, the worst case for the incremental sort
+			broadphase.Move(b.id, b.position - b.half, b.position + b.half);
+		}
+		broadphase.Update();
+	}
+}
+
+//Options: --bodies N runs one scene size instead of the default ladder
+void Bench::BroadphaseSuite(Results& results)
+{
+	std::vector<int> counts = { 1000, 10000, 50000 };
+	if (int bodies = Option("bodies", 0))
+		counts = { bodies };
+
+	//Single threaded, then every core when there is more than one
+	std::vector<int> threadCounts = { 1 };
+	if (std::thread::hardware_concurrency() > 1)
+		threadCounts.push_back((int)std::thread::hardware_concurrency());
+
+	for (int threads : threadCounts) {
+		Ngine::JobScope jobs(threads - 1);
+
+		for (int count : counts) {
+			Ngine::Broadphase broadphase;
+			std::vector<Body> bodies = MakeScene(broadphase, count);
+			const float length = count * 0.5f;
+
+			//Pairs and events add up over the timed ticks, reported per tick
+			size_t ticks = 0, pairs = 0, events = 0, swaps = 0;
+			Result r = Measure("broadphase/" + std::to_string(count) + " bodies, " + std::to_string(threads) + " threads", 120, 0.0, [&]() {
+				Tick(broadphase, bodies, length, 1.0f / 60.0f);
+				Ngine::Broadphase::Stats s = broadphase.GetStats();
+				++ticks;
+				pairs += s.pairs;
+				events += s.added + s.removed;
+				swaps += s.swaps;
+				});
+
+			r.metrics = {
+				{ "pairs", (double)pairs / ticks },
+				{ "events", (double)events / ticks },
+				{ "swaps", (double)swaps / ticks },
+			};
+			printf("%-40s %12.0f pairs, %.1f events, %.0f swaps per tick\n", "", (double)pairs / ticks, (double)events / ticks, (double)swaps / ticks);
+			results.push_back(std::move(r));
+		}
+	}
+}
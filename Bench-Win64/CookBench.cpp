@@ -0,0 +1,93 @@
+#include "pch.h"
+#include "Bench.h"
+#include <Ngine.hpp>
+#include <spdlog/spdlog.h>
+#include <cstdio>
+#include <filesystem>
+
+#pragma warning(disable : 4996)
+
+namespace fs = std::filesystem;
+
+namespace {
+
+	//Rolling grid of n * n verticies without normals, so cooking has to generate them
+	void WriteGrid(const fs::path& path, int n)
+	{
+		FILE* file = fopen(path.string().c_str(), "wb");
+		for (int z = 0; z < n; ++z)
+			for (int x = 0; x < n; ++x)
+				fprintf(file, "v %d %.3f %d\n", x, 0.5f * ((x * 7 + z * 13) % 11), z);
+		for (int z = 0; z < n; ++z)
+			for (int x = 0; x < n; ++x)
+				fprintf(file, "vt %.4f %.4f\n", (float)x / n, (float)z / n);
+		for (int z = 0; z + 1 < n; ++z) {
+			for (int x = 0; x + 1 < n; ++x) {
+				int a = z * n + x + 1, b = a + 1, c = a + n, d = c + 1;
+				fprintf(file, "f %d/%d %d/%d %d/%d\nf %d/%d %d/%d %d/%d\n", a, a, c, c, b, b, b, b, c, c, d, d);
+			}
+		}
+		fclose(file);
+	}
+
+	//Opaque 24-bit gradient
+	void WriteGradient(const fs::path& path, unsigned int dim)
+	{
+		Bench::WriteBMP(path.string(), dim, dim, 24, [dim](unsigned int y, unsigned char* row) {
+			for (unsigned int x = 0; x < dim * 3; ++x)
+				row[x] = (unsigned char)((x + y * 3) ^ (y >> 2));
+			});
+	}
+
+	Bench::Result Cook(const std::string& name, const fs::path& source, const fs::path& output, bool force, const std::function<void()>& before = {})
+	{
+		Ngine::CookSettings settings;
+		settings.force = force;
+
+		Ngine::CookStats stats{};
+		Bench::Result r = Bench::Measure("cook/" + name, 3, 0.0, [&]() {
+			if (before)
+				before();
+			stats = Ngine::AssetCooker::Cook(source.string().c_str(), output.string().c_str(), settings);
+			});
+
+		printf("%-40s %12zu cooked, %zu up to date, hash %.1f ms, cook %.1f ms\n", "", stats.cooked, stats.upToDate, stats.hashMs, stats.cookMs);
+		r.metrics = { { "cooked", (double)stats.cooked }, { "upToDate", (double)stats.upToDate }, { "hashMs", stats.hashMs }, { "cookMs", stats.cookMs } };
+		return r;
+	}
+}
+
+//Shipped assets plus a generated mesh and texture, cooked from scratch, again unchanged and again with one shader edited
+void Bench::CookSuite(Results& results)
+{
+	spdlog::set_level(spdlog::level::warn);
+
+	fs::path source = fs::temp_directory_path() / "ngine_bench_cook_src";
+	fs::path output = fs::temp_directory_path() / "ngine_bench_cook_out";
+	std::error_code ec;
+	fs::remove_all(source, ec);
+	fs::remove_all(output, ec);
+	fs::create_directories(source / "Shader");
+
+	if (fs::exists(AssetDir() + "Test.obj"))
+		fs::copy(AssetDir(), source, fs::copy_options::recursive | fs::copy_options::overwrite_existing, ec);
+	else
+		printf("%sTest.obj not found, pass --assets with the Game-Win64 directory\n", AssetDir().c_str());
+	WriteGrid(source / "grid.obj", Option("grid", 256));
+	WriteGradient(source / "gradient.bmp", (unsigned int)Option("texture", 1024));
+
+	Ngine::JobScope jobs;
+	results.push_back(Cook("full, " + std::to_string(Ngine::Jobs::Workers() + 1) + " threads", source, output, true));
+	results.push_back(Cook("incremental, nothing changed", source, output, false));
+
+	int edit = 0;
+	results.push_back(Cook("incremental, one shader changed", source, output, false, [&]() {
+		FILE* file = fopen((source / "Shader" / "edited.glsl").string().c_str(), "wb");
+		fprintf(file, "#version 330 core\nconst int Edit = %d;\nvoid main() {}\n", ++edit);
+		fclose(file);
+		}));
+
+	fs::remove_all(source, ec);
+	fs::remove_all(output, ec);
+	spdlog::set_level(spdlog::level::info);
+}
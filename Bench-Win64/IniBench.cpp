@@ -0,0 +1,73 @@
+#include "pch.h"
+#include "Bench.h"
+#include <IniView.h>
+#include <filesystem>
+#include <fstream>
+#include <random>
+
+namespace {
+
+	//Track style file: many spawn point and prop sections, about 10 MB
+	std::string MakeTrackIni(size_t targetBytes, std::vector<std::pair<std::string, std::string>>& keys)
+	{
+		std::string path = (std::filesystem::temp_directory_path() / "ngine_bench_track.ini").string();
+		std::ofstream out(path, std::ios::binary);
+
+		std::mt19937 rng(1234);
+		std::uniform_real_distribution<float> pos(-1000.0f, 1000.0f);
+
+		size_t written = 0;
+		for (int s = 0; written < targetBytes; ++s) {
+			std::string section = (s % 4 == 0 ? "Spawn" : "Props") + std::to_string(s);
+			std::string block = "; generated section\n[" + section + "]\n";
+			for (int k = 0; k < 32; ++k) {
+				std::string key = "Prop" + std::to_string(k);
+				block += key + " = Trunk1.obj " + std::to_string(pos(rng)) + " " + std::to_string(pos(rng)) + " " + std::to_string(pos(rng)) + "\n";
+				if (k % 7 == 0)
+					keys.emplace_back(section, key);
+			}
+			out << block;
+			written += block.size();
+		}
+
+		std::shuffle(keys.begin(), keys.end(), rng);
+		return path;
+	}
+}
+
+void Bench::IniSuite(Results& results)
+{
+	std::vector<std::pair<std::string, std::string>> keys;
+	std::string path = MakeTrackIni(10 * 1024 * 1024, keys);
+	double size = (double)std::filesystem::file_size(path);
+
+	results.push_back(Measure("ini/mINI read", 5, size, [&]() {
+		mINI::INIFile file(path);
+		mINI::INIStructure ini;
+		file.read(ini);
+		}));
+
+	results.push_back(Measure("ini/IniView parse", 5, size, [&]() {
+		Ngine::IniView view(path.c_str());
+		}));
+
+	//Lookups with const char* keys, the way game code asks for values
+	mINI::INIFile file(path);
+	mINI::INIStructure ini;
+	file.read(ini);
+	Ngine::IniView view(path.c_str());
+
+	size_t found = 0;
+	results.push_back(Measure("ini/mINI lookup x" + std::to_string(keys.size()), 5, 0.0, [&]() {
+		for (const auto& [section, key] : keys)
+			found += ini.get(section.c_str()).get(key.c_str()).size();
+		}));
+
+	results.push_back(Measure("ini/IniView lookup x" + std::to_string(keys.size()), 5, 0.0, [&]() {
+		for (const auto& [section, key] : keys)
+			found += view.Get(section.c_str(), key.c_str()).size();
+		}));
+
+	printf("IniView arena: %zu bytes in %zu heap allocations (%zu lookup bytes)\n", view.ArenaBytes(), view.ArenaAllocations(), found);
+	std::filesystem::remove(path);
+}
@@ -0,0 +1,211 @@
+#include "pch.h"
+#include "Bench.h"
+#include <Ngine.hpp>
+#include <spdlog/spdlog.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <random>
+#include <string>
+#include <vector>
+
+#if !defined _WIN32 && !defined _WIN64
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#pragma warning(disable : 4996)
+
+namespace fs = std::filesystem;
+
+namespace {
+
+	struct Block {
+		uint64_t offset;
+		size_t size;
+	};
+
+	//Removes the test file however the suite ends
+	struct TempFile {
+		fs::path path;
+
+		~TempFile()
+		{
+			std::error_code ec;
+			fs::remove(path, ec);
+		}
+	};
+
+	//fseek takes a long, only 32 bits on Windows
+	int Seek(FILE* file, uint64_t offset)
+	{
+#if defined _WIN32 || defined _WIN64
+		return _fseeki64(file, (__int64)offset, SEEK_SET);
+#else
+		return fseeko(file, (off_t)offset, SEEK_SET);
+#endif
+	}
+
+	void WriteFile(const fs::path& path, size_t bytes)
+	{
+		FILE* file = fopen(path.string().c_str(), "wb");
+		std::vector<uint32_t> chunk(1 << 18);
+		std::mt19937 random(7);
+		for (size_t written = 0; written < bytes; written += chunk.size() * 4) {
+			for (auto& word : chunk)
+				word = random();
+			fwrite(chunk.data(), 4, std::min(chunk.size(), (bytes - written) / 4), file);
+		}
+		fclose(file);
+	}
+
+	//Drops the file from the page cache so every run reads from the device. Only POSIX has a way without admin rights.
+	void Evict(const fs::path& path, bool cold)
+	{
+#if !defined _WIN32 && !defined _WIN64
+		if (!cold)
+			return;
+		int fd = open(path.string().c_str(), O_RDONLY);
+		fdatasync(fd);
+		posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+		close(fd);
+#else
+		(void)path;
+		(void)cold;
+#endif
+	}
+
+	double Percentile(std::vector<double> ms, double p)
+	{
+		if (ms.empty())
+			return 0.0;
+		std::sort(ms.begin(), ms.end());
+		return ms[std::min(ms.size() - 1, (size_t)(p * ms.size()))];
+	}
+
+	void Latency(Bench::Result& r, const std::vector<double>& ms)
+	{
+		r.metrics = { { "p50Ms", Percentile(ms, 0.5) }, { "p99Ms", Percentile(ms, 0.99) } };
+	}
+
+	//All blocks queued at once and submitted in batches, like a streamer asking for a frame's worth of mips
+	Bench::Result AsyncReads(const std::string& name, const fs::path& path, const std::vector<Block>& blocks, double total, bool cold, bool registered)
+	{
+		Ngine::IoFile file = Ngine::AsyncIo::Open(path.string().c_str());
+		std::vector<char> buffer(blocks.front().size * blocks.size());
+		std::vector<double> latency(blocks.size());
+		std::atomic<size_t> failures = 0;
+
+		Bench::Result r = Bench::Measure(name, 5, total, [&]() {
+			Evict(path, cold);
+			Ngine::JobCounter counter;
+			for (size_t i = 0; i < blocks.size(); ++i) {
+				void* dst = registered ? Ngine::AsyncIo::AcquireBuffer() : nullptr;
+				//Pool exhausted, wait for reads in flight to hand theirs back
+				while (registered && !dst) {
+					Ngine::AsyncIo::Submit();
+					Ngine::Jobs::Wait(counter);
+					dst = Ngine::AsyncIo::AcquireBuffer();
+				}
+				if (!dst)
+					dst = buffer.data() + i * blocks[i].size;
+
+				Ngine::AsyncIo::Read(file, blocks[i].offset, blocks[i].size, dst, [&, i, registered](const Ngine::IoResult& result) {
+					latency[i] = result.ms;
+					if (result.error || result.read != result.requested)
+						failures.fetch_add(1, std::memory_order_relaxed);
+					if (registered)
+						Ngine::AsyncIo::ReleaseBuffer(result.buffer);
+					}, &counter);
+				if (i % 64 == 63)
+					Ngine::AsyncIo::Submit();
+			}
+			Ngine::AsyncIo::Submit();
+			Ngine::Jobs::Wait(counter);
+			});
+
+		Ngine::AsyncIo::Close(file);
+		Latency(r, latency);
+		r.metrics.push_back({ "failed", (double)failures.load() });
+		return r;
+	}
+}
+
+//Random block reads from one big file, blocking fread and ifstream against AsyncIo on each backend it has here
+void Bench::IoSuite(Results& results)
+{
+	spdlog::set_level(spdlog::level::warn);
+
+	TempFile temp{ fs::temp_directory_path() / "ngine_bench_io.bin" };
+	const fs::path& path = temp.path;
+	const size_t fileBytes = (size_t)Option("mb", 256) * 1024 * 1024;
+	const size_t blockBytes = (size_t)Option("block", 64 * 1024);
+	const size_t count = (size_t)Option("reads", 2048);
+	const bool cold = Option("cold", 1) != 0;
+	WriteFile(path, fileBytes);
+
+	std::vector<Block> blocks(count);
+	std::mt19937_64 random(11);
+	for (auto& block : blocks)
+		block = { random() % (fileBytes / blockBytes) * blockBytes, blockBytes };
+	const double total = (double)(count * blockBytes);
+	const std::string suffix = cold ? ", cold" : ", cached";
+
+	std::vector<char> buffer(blockBytes);
+	std::vector<double> latency(count);
+	double sum = 0.0;
+	auto timed = [&](size_t i, auto&& read) {
+		auto start = std::chrono::steady_clock::now();
+		read();
+		latency[i] = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+		sum += (unsigned char)buffer[i % blockBytes];
+	};
+
+	FILE* file = fopen(path.string().c_str(), "rb");
+	results.push_back(Measure("io/fseek+fread" + suffix, 5, total, [&]() {
+		Evict(path, cold);
+		for (size_t i = 0; i < count; ++i)
+			timed(i, [&]() {
+				Seek(file, blocks[i].offset);
+				fread(buffer.data(), 1, blocks[i].size, file);
+				});
+		}));
+	Latency(results.back(), latency);
+	fclose(file);
+
+	std::ifstream stream(path, std::ios::binary);
+	results.push_back(Measure("io/ifstream seekg+read" + suffix, 5, total, [&]() {
+		Evict(path, cold);
+		for (size_t i = 0; i < count; ++i)
+			timed(i, [&]() {
+				stream.seekg((std::streamoff)blocks[i].offset);
+				stream.read(buffer.data(), (std::streamsize)blocks[i].size);
+				});
+		}));
+	Latency(results.back(), latency);
+	stream.close();
+
+	Ngine::JobScope jobs;
+	for (bool threads : { false, true }) {
+		Ngine::IoSettings settings;
+		settings.forceThreads = threads;
+		settings.bufferSize = blockBytes;
+		Ngine::IoScope io(settings);
+
+		//Without io_uring both passes would measure the same pool
+		const std::string backend = Ngine::AsyncIo::Backend();
+		if (!threads && backend != "io_uring") {
+			printf("%-40s io_uring not available, skipped\n", "io/AsyncIo io_uring");
+			continue;
+		}
+
+		results.push_back(AsyncReads("io/AsyncIo " + backend + suffix, path, blocks, total, cold, false));
+		results.push_back(AsyncReads("io/AsyncIo " + backend + " AcquireBuffer" + suffix, path, blocks, total, cold, true));
+	}
+
+	printf("%-40s checksum %.0f\n", "", sum);
+	spdlog::set_level(spdlog::level::info);
+}
@@ -0,0 +1,66 @@
+#include "pch.h"
+#include "Bench.h"
+#include <Jobs.h>
+#include <cmath>
+#include <thread>
+
+namespace {
+
+	struct Particle {
+		float position[3];
+		float velocity[3];
+	};
+
+	//Transform update style workload, a bit of math per element so memory bandwidth isn't the only limit
+	void Integrate(std::vector<Particle>& particles, size_t first, size_t last, float dt)
+	{
+		for (size_t i = first; i < last; ++i) {
+			Particle& p = particles[i];
+			for (int k = 0; k < 3; ++k) {
+				p.velocity[k] += std::sin(p.position[k]) * dt;
+				p.position[k] += p.velocity[k] * dt;
+			}
+		}
+	}
+}
+
+void Bench::JobsSuite(Results& results)
+{
+	std::vector<Particle> particles(1 << 20);
+	for (size_t i = 0; i < particles.size(); ++i)
+		particles[i] = { { (float)i, (float)(i * 7 % 13), 0.0f }, { 0.0f, 0.0f, 1.0f } };
+
+	//1, 2, 3, 4, then doubling, always ending at every core
+	unsigned int cores = std::max(std::thread::hardware_concurrency(), 1u);
+	std::vector<unsigned int> counts;
+	for (unsigned int n = 1; n < cores; n = n < 4 ? n + 1 : n * 2)
+		counts.push_back(n);
+	counts.push_back(cores);
+
+	//Threads counts the calling thread, it helps while waiting
+	double single = 0.0;
+	for (unsigned int threads : counts) {
+		Ngine::Jobs::Initialize(threads - 1);
+
+		Result r = Measure("jobs/integrate 1M, " + std::to_string(threads) + " threads", 10, (double)particles.size() * sizeof(Particle), [&]() {
+			Ngine::Jobs::ParallelFor(0, particles.size(), 4096, [&](size_t first, size_t last) {
+				Integrate(particles, first, last, 0.016f);
+				});
+			});
+
+		if (threads == 1)
+			single = r.seconds;
+		printf("%-40s %12.2fx\n", "  speedup", single / r.seconds);
+		results.push_back(r);
+
+		//Cost of one job round trip with nothing to do
+		Ngine::JobCounter counter;
+		results.push_back(Measure("jobs/100k empty jobs, " + std::to_string(threads) + " threads", 5, 0.0, [&]() {
+			for (int i = 0; i < 100000; ++i)
+				Ngine::Jobs::Run([]() {}, &counter);
+			Ngine::Jobs::Wait(counter);
+			}));
+
+		Ngine::Jobs::Shutdown();
+	}
+}
@@ -0,0 +1,60 @@
+#include "pch.h"
+#include "Bench.h"
+#include <Ngine.hpp>
+#include <cstdio>
+#include <thread>
+
+namespace {
+
+	//Lamps and markers along 400 m of road ahead of the camera, a few bigger ones off to the sides
+	std::vector<Ngine::PointLight> MakeLights(int count)
+	{
+		Bench::Noise noise;
+		std::vector<Ngine::PointLight> lights(count);
+		for (Ngine::PointLight& l : lights) {
+			float side = noise.Unit() < 0.5f ? -1.0f : 1.0f;
+			if (noise.Unit() < 0.2f)
+				l = { glm::vec3(side * (6.0f + noise.Unit() * 60.0f), 6.0f, -noise.Unit() * 400.0f), 10.0f + noise.Unit() * 10.0f, glm::vec3(2.0f, 1.5f, 0.9f) };
+			else
+				l = { glm::vec3(side * (4.0f + noise.Unit()), 0.3f, -noise.Unit() * 400.0f), 1.5f + noise.Unit() * 2.0f, glm::vec3(1.0f, 0.4f, 0.1f) };
+		}
+		return lights;
+	}
+}
+
+//Options: --lights N runs one count instead of the default ladder
+void Bench::LightsSuite(Results& results)
+{
+	std::vector<int> counts = { 1000, 4000, 16000 };
+	if (int lights = Option("lights", 0))
+		counts = { lights };
+
+	std::vector<int> threadCounts = { 1 };
+	if (std::thread::hardware_concurrency() > 1)
+		threadCounts.push_back((int)std::thread::hardware_concurrency());
+
+	const glm::mat4 view = glm::lookAt(glm::vec3(0.0f, 3.0f, 8.0f), glm::vec3(0.0f, 0.0f, -10.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+	const glm::mat4 projection = glm::perspective(glm::radians(70.0f), 16.0f / 9.0f, 0.1f, 400.0f);
+
+	for (int threads : threadCounts) {
+		Ngine::JobScope jobs(threads - 1);
+
+		for (int count : counts) {
+			std::vector<Ngine::PointLight> lights = MakeLights(count);
+			Ngine::LightClusters clusters;
+
+			Result r = Measure("lights/" + std::to_string(count) + " lights, " + std::to_string(threads) + " threads", 60, 0.0, [&]() {
+				clusters.Build(lights, view, projection);
+				});
+
+			Ngine::LightClusters::Stats s = clusters.GetStats();
+			r.metrics = {
+				{ "references", (double)s.references },
+				{ "maxPerCluster", (double)s.maxPerCluster },
+				{ "overflow", (double)s.overflow },
+			};
+			printf("%-40s %12zu references, %zu most per cluster, %zu over the limit\n", "", s.references, s.maxPerCluster, s.overflow);
+			results.push_back(std::move(r));
+		}
+	}
+}
@@ -0,0 +1,219 @@
+#include "pch.h"
+#include "Bench.h"
+#include <Ngine.hpp>
+#include <spdlog/spdlog.h>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <memory>
+
+#pragma warning(disable : 4996)
+
+namespace {
+
+	std::string TempPath(const char* name)
+	{
+		return (std::filesystem::temp_directory_path() / name).string();
+	}
+
+	//Grid terrain with positions, UVs and normals, about targetBytes of text
+	std::string MakeOBJ(size_t targetBytes)
+	{
+		std::string path = TempPath("ngine_bench_mesh.obj");
+		FILE* file = fopen(path.c_str(), "wb");
+
+		//A grid vertex costs about 155 bytes of text once its two triangles are counted
+		int n = std::max(2, (int)std::sqrt((double)targetBytes / 155.0));
+		Bench::Noise noise;
+		for (int y = 0; y < n; ++y)
+			for (int x = 0; x < n; ++x)
+				fprintf(file, "v %.4f %.4f %.4f\n", (float)x, (noise.Next() & 1023) / 1024.0f, (float)y);
+		for (int y = 0; y < n; ++y)
+			for (int x = 0; x < n; ++x)
+				fprintf(file, "vt %.5f %.5f\n", (float)x / n, (float)y / n);
+		for (int y = 0; y < n; ++y)
+			for (int x = 0; x < n; ++x)
+				fprintf(file, "vn %.4f %.4f %.4f\n", 0.0f, 1.0f, 0.0f);
+
+		for (int y = 0; y + 1 < n; ++y) {
+			for (int x = 0; x + 1 < n; ++x) {
+				int a = y * n + x + 1, b = a + 1, c = a + n, d = c + 1;
+				fprintf(file, "f %d/%d/%d %d/%d/%d %d/%d/%d\n", a, a, a, c, c, c, b, b, b);
+				fprintf(file, "f %d/%d/%d %d/%d/%d %d/%d/%d\n", b, b, b, c, c, c, d, d, d);
+			}
+		}
+
+		fclose(file);
+		return path;
+	}
+
+	//Uncompressed 32bpp noise
+	std::string MakeBMP(unsigned int dim)
+	{
+		std::string path = TempPath("ngine_bench_texture.bmp");
+		Bench::Noise noise;
+		Bench::WriteBMP(path, dim, dim, 32, [&](unsigned int, unsigned char* row) {
+			for (unsigned int x = 0; x < dim; ++x) {
+				uint32_t p = noise.Next();
+				memcpy(row + x * 4, &p, 4);
+			}
+			});
+		return path;
+	}
+
+	//DXT5 with a full mip chain, random blocks are valid blocks
+	std::string MakeDDS(unsigned int dim)
+	{
+		std::string path = TempPath("ngine_bench_texture.dds");
+		FILE* file = fopen(path.c_str(), "wb");
+
+		unsigned int levels = 1;
+		while ((dim >> levels) > 0)
+			++levels;
+
+		unsigned char header[128] = { 'D', 'D', 'S', ' ' };
+		*(unsigned int*)&header[4] = 124;
+		*(unsigned int*)&header[12] = dim;
+		*(unsigned int*)&header[16] = dim;
+		*(unsigned int*)&header[20] = (dim / 4) * (dim / 4) * 16;
+		*(unsigned int*)&header[28] = levels;
+		*(unsigned int*)&header[84] = 0x35545844; //"DXT5"
+		fwrite(header, 1, sizeof(header), file);
+
+		Bench::Noise noise;
+		std::vector<uint32_t> blocks;
+		for (unsigned int level = 0; level < levels; ++level) {
+			unsigned int side = std::max(1u, dim >> level);
+			unsigned int rowBlocks = (side + 3) / 4;
+			blocks.resize(rowBlocks * 4);
+			for (unsigned int y = 0; y < rowBlocks; ++y) {
+				for (auto& b : blocks)
+					b = noise.Next();
+				fwrite(blocks.data(), 16, rowBlocks, file);
+			}
+		}
+
+		fclose(file);
+		return path;
+	}
+
+	void Remove(const std::string& path)
+	{
+		std::error_code ec;
+		std::filesystem::remove(path, ec);
+	}
+
+	//Uploads need a context, benchmarks of them are skipped where no window can be created
+	std::unique_ptr<Ngine::Window> CreateContext()
+	{
+		try {
+			Ngine::Settings::Load((Bench::AssetDir() + "Game.ini").c_str());
+			return std::make_unique<Ngine::Window>(64, 64, "Bench", Ngine::WindowMode::Headless);
+		}
+		catch (const Ngine::Exception&) {
+			printf("No GL context, skipping texture uploads\n");
+			return nullptr;
+		}
+	}
+
+	void MeshCases(Bench::Results& results, const std::string& name, const std::string& path, const std::string& mtlDir, size_t iterations)
+	{
+		double size = (double)std::filesystem::file_size(path);
+		std::vector<glm::vec3> verticies, normals;
+		std::vector<glm::vec2> uvs;
+
+		results.push_back(Bench::Measure("loader/LoadOBJ " + name, iterations, size, [&]() {
+			verticies.clear(); uvs.clear(); normals.clear();
+			Ngine::Gfx::LoadOBJ(path.c_str(), mtlDir.c_str(), verticies, uvs, normals);
+			}));
+
+		//Everything a file without normals costs on top of parsing
+		std::vector<glm::vec4> tangents;
+		results.push_back(Bench::Measure("loader/MeshProcessing " + name, iterations, 0.0, [&]() {
+			normals.clear();
+			Ngine::MeshProcessing::Complete(verticies, uvs, normals, &tangents);
+			}));
+
+		results.push_back(Bench::Measure("loader/LoadOBJLegacy " + name, iterations, size, [&]() {
+			verticies.clear(); uvs.clear(); normals.clear();
+			Ngine::Gfx::LoadOBJLegacy(path.c_str(), verticies, uvs, normals, false);
+			}));
+	}
+}
+
+void Bench::LoaderSuite(Results& results)
+{
+	//Loaders log every file, which would drown the table
+	spdlog::set_level(spdlog::level::warn);
+
+	//Shipped assets
+	for (const char* asset : { "Test.obj", "Trunk1.obj" }) {
+		std::string path = AssetDir() + asset;
+		if (std::filesystem::exists(path))
+			MeshCases(results, asset, path, AssetDir(), 20);
+		else
+			printf("%s not found, pass --assets with the Game-Win64 directory\n", path.c_str());
+	}
+
+	//Synthetic meshes, small to large so the peak RSS column grows with them
+	for (size_t mb : { 16, 64, 256 }) {
+		std::string path = MakeOBJ(mb * 1024 * 1024);
+		MeshCases(results, "grid " + std::to_string(mb) + " MB", path, ".", mb > 16 ? 3 : 5);
+		Remove(path);
+	}
+
+	auto context = CreateContext();
+
+	//4 MB to 256 MB of pixels
+	for (unsigned int dim : { 1024u, 4096u, 8192u }) {
+		std::string path = MakeBMP(dim);
+		double size = (double)std::filesystem::file_size(path);
+		std::string name = " " + std::to_string(dim) + "x" + std::to_string(dim);
+		size_t iterations = dim > 1024 ? 3 : 10;
+
+		results.push_back(Measure("loader/ReadBMP" + name, iterations, size, [&]() {
+			unsigned int width, height, channels;
+			Ngine::Gfx::ReadBMP(path.c_str(), width, height, channels);
+			}));
+
+		if (context) {
+			results.push_back(Measure("loader/LoadBMP" + name, iterations, size, [&]() {
+				GLuint texture = Ngine::Gfx::LoadBMP(path.c_str());
+				glFinish();
+				glDeleteTextures(1, &texture);
+				}));
+		}
+		Remove(path);
+	}
+
+	//DXT5 chains of about 1.3 MB to 341 MB
+	for (unsigned int dim : { 1024u, 8192u, 16384u }) {
+		std::string path = MakeDDS(dim);
+		double size = (double)std::filesystem::file_size(path);
+		std::string name = " " + std::to_string(dim) + "x" + std::to_string(dim);
+		size_t iterations = dim > 1024 ? 3 : 10;
+
+		//What the streamer pays before an upload: header parse plus touching every level
+		results.push_back(Measure("loader/ReadDDS" + name, iterations, size, [&]() {
+			Ngine::DDSInfo info = Ngine::Gfx::ReadDDSInfo(path.c_str());
+			Ngine::MappedFile file(path.c_str());
+			volatile unsigned char sum = 0;
+			for (const auto& mip : info.mips)
+				for (size_t i = 0; i < mip.size; i += 4096)
+					sum = sum + (unsigned char)file.Data()[mip.offset + i];
+			}));
+
+		if (context) {
+			results.push_back(Measure("loader/LoadDDS" + name, iterations, size, [&]() {
+				GLuint texture = Ngine::Gfx::LoadDDS(path.c_str());
+				glFinish();
+				glDeleteTextures(1, &texture);
+				}));
+		}
+		Remove(path);
+	}
+
+	spdlog::set_level(spdlog::level::info);
+}
@@ -0,0 +1,155 @@
+#include "pch.h"
+#include "Bench.h"
+#include <Ngine.hpp>
+#include <spdlog/spdlog.h>
+#include <cmath>
+#include <cstdio>
+#include <filesystem>
+
+namespace {
+
+	//Rolling terrain of 2 * (n - 1)^2 triangles, about what a long stretch of track with its surroundings comes to
+	std::vector<glm::vec3> MakeTerrain(int n)
+	{
+		auto height = [](int x, int z) { return 2.0f * std::sin(x * 0.05f) * std::cos(z * 0.07f) + 0.3f * std::sin(x * 0.9f + z * 0.4f); };
+
+		std::vector<glm::vec3> verticies;
+		verticies.reserve((size_t)(n - 1) * (n - 1) * 6);
+		for (int z = 0; z + 1 < n; ++z) {
+			for (int x = 0; x + 1 < n; ++x) {
+				glm::vec3 a((float)x, height(x, z), (float)z), b((float)x + 1, height(x + 1, z), (float)z);
+				glm::vec3 c((float)x, height(x, z + 1), (float)z + 1), d((float)x + 1, height(x + 1, z + 1), (float)z + 1);
+				verticies.insert(verticies.end(), { a, c, b, b, c, d });
+			}
+		}
+		return verticies;
+	}
+
+	struct Bounds {
+		glm::vec3 min, max;
+	};
+
+	Bounds BoundsOf(const std::vector<glm::vec3>& verticies)
+	{
+		Bounds b{ verticies.front(), verticies.front() };
+		for (const auto& v : verticies) {
+			b.min = glm::min(b.min, v);
+			b.max = glm::max(b.max, v);
+		}
+		return b;
+	}
+
+	//Four wheels per car straight down from above the mesh, what wheel contact asks for every tick
+	std::vector<Ngine::Ray> WheelRays(const Bounds& b, size_t count)
+	{
+		const glm::vec3 wheels[] = { { -0.8f, 0.0f, -1.3f }, { 0.8f, 0.0f, -1.3f }, { -0.8f, 0.0f, 1.3f }, { 0.8f, 0.0f, 1.3f } };
+
+		Bench::Noise noise;
+		std::vector<Ngine::Ray> rays(count);
+		glm::vec3 car;
+		for (size_t i = 0; i < count; ++i) {
+			if (i % 4 == 0)
+				car = glm::vec3(b.min.x + (b.max.x - b.min.x) * noise.Unit(), b.max.y + 1.0f, b.min.z + (b.max.z - b.min.z) * noise.Unit());
+			rays[i].origin = car + wheels[i % 4];
+			rays[i].direction = glm::vec3(0.0f, -1.0f, 0.0f);
+			rays[i].maxDistance = b.max.y - b.min.y + 2.0f;
+		}
+		return rays;
+	}
+
+	//Random origins inside the bounds and random directions, the worst case for packets
+	std::vector<Ngine::Ray> ScatteredRays(const Bounds& b, size_t count)
+	{
+		Bench::Noise noise;
+		std::vector<Ngine::Ray> rays(count);
+		for (auto& r : rays) {
+			r.origin = b.min + (b.max - b.min) * glm::vec3(noise.Unit(), noise.Unit(), noise.Unit());
+			r.direction = glm::normalize(glm::vec3(noise.Unit() - 0.5f, noise.Unit() - 0.5f, noise.Unit() - 0.5f) + glm::vec3(0.0f, 0.0f, 1e-3f));
+		}
+		return rays;
+	}
+
+	void AddRate(Bench::Result& r, size_t rays, const std::vector<Ngine::RayHit>& hits)
+	{
+		size_t hit = 0;
+		for (const auto& h : hits)
+			hit += h.Hit();
+
+		double rate = rays / r.seconds / 1e6;
+		printf("%-40s %12.2f Mrays/s, %.1f%% hit\n", "  rate", rate, 100.0 * hit / rays);
+		r.metrics = { { "mraysPerSecond", rate }, { "hitRate", (double)hit / rays } };
+	}
+
+	void Cases(Bench::Results& results, const std::string& name, const std::vector<glm::vec3>& verticies)
+	{
+		Ngine::Bvh bvh;
+		Bench::Result build = Bench::Measure("raycast/build " + name, 3, 0.0, [&]() { bvh.Build(verticies); });
+		build.metrics = { { "triangles", (double)bvh.Triangles() }, { "nodes", (double)bvh.Nodes() }, { "bvhBytes", (double)bvh.Bytes() } };
+		results.push_back(build);
+
+		const size_t count = (size_t)Bench::Option("rays", 1 << 18);
+		Bounds bounds = BoundsOf(verticies);
+
+		struct Set {
+			const char* name;
+			std::vector<Ngine::Ray> rays;
+		};
+		Set sets[] = { { "wheel", WheelRays(bounds, count) }, { "scattered", ScatteredRays(bounds, count) } };
+		std::vector<Ngine::RayHit> hits(count);
+
+		for (const Set& set : sets) {
+			std::string prefix = "raycast/" + name + " " + set.name;
+
+			Bench::Result single = Bench::Measure(prefix + " single", 3, 0.0, [&]() {
+				for (size_t i = 0; i < count; ++i)
+					hits[i] = bvh.Cast(set.rays[i]);
+				});
+			AddRate(single, count, hits);
+			results.push_back(single);
+
+			Bench::Result packet = Bench::Measure(prefix + " packet", 3, 0.0, [&]() {
+				bvh.Cast(set.rays.data(), hits.data(), count);
+				});
+			AddRate(packet, count, hits);
+			results.push_back(packet);
+
+			Bench::Result any = Bench::Measure(prefix + " packet any", 3, 0.0, [&]() {
+				bvh.Cast(set.rays.data(), hits.data(), count, Ngine::RayQuery::Any);
+				});
+			AddRate(any, count, hits);
+			results.push_back(any);
+
+			//Whole batch over every core
+			Ngine::JobScope jobs;
+			Bench::Result parallel = Bench::Measure(prefix + " packet, " + std::to_string(Ngine::Jobs::Workers() + 1) + " threads", 3, 0.0, [&]() {
+				bvh.Cast(set.rays.data(), hits.data(), count);
+				});
+			AddRate(parallel, count, hits);
+			results.push_back(parallel);
+		}
+	}
+}
+
+//Options: --rays N, --grid N (verticies per side of the synthetic terrain)
+void Bench::RaycastSuite(Results& results)
+{
+	//Build logs every tree
+	spdlog::set_level(spdlog::level::warn);
+
+	std::string path = AssetDir() + "Test.obj";
+	if (std::filesystem::exists(path)) {
+		std::vector<glm::vec3> verticies, normals;
+		std::vector<glm::vec2> uvs;
+		Ngine::Gfx::LoadOBJ(path.c_str(), AssetDir().c_str(), verticies, uvs, normals);
+		Cases(results, "Test.obj", verticies);
+	}
+	else {
+		printf("%s not found, pass --assets with the Game-Win64 directory\n", path.c_str());
+	}
+
+	int grid = Option("grid", 709);
+	std::vector<glm::vec3> terrain = MakeTerrain(grid);
+	Cases(results, std::to_string(terrain.size() / 3 / 1000) + "k triangles", terrain);
+
+	spdlog::set_level(spdlog::level::info);
+}
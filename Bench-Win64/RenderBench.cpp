@@ -0,0 +1,154 @@
+#include "pch.h"
+#include "Bench.h"
+#include <Ngine.hpp>
+#include <spdlog/spdlog.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <filesystem>
+#include <memory>
+
+#pragma warning(disable : 4996)
+
+namespace {
+
+	//Closed loop around the scene, a pure function of the frame so every run renders the same images
+	glm::mat4 CameraPath(int frame, int frames, float radius, float aspect)
+	{
+		float t = (float)frame / (float)frames * 6.2831853f;
+		glm::vec3 eye(std::cos(t) * radius, 4.0f + 2.0f * std::sin(2.0f * t), std::sin(t) * radius);
+		glm::mat4 projection = glm::perspective(glm::radians(70.0f), aspect, 0.1f, radius * 4.0f);
+		return projection * glm::lookAt(eye, glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+	}
+
+	//Shipped assets carry no textures, a checker board keeps sampling in the measured cost
+	std::string MakeChecker()
+	{
+		std::string path = (std::filesystem::temp_directory_path() / "ngine_bench_checker.bmp").string();
+
+		constexpr unsigned int dim = 256;
+		Bench::WriteBMP(path, dim, dim, 24, [](unsigned int y, unsigned char* row) {
+			for (unsigned int x = 0; x < dim; ++x) {
+				unsigned char c = ((x / 32) ^ (y / 32)) & 1 ? 220 : 40;
+				row[x * 3] = c;
+				row[x * 3 + 1] = c;
+				row[x * 3 + 2] = (unsigned char)(255 - c);
+			}
+			});
+		return path;
+	}
+}
+
+//Options: --objects N, --frames N, --width N, --height N, --hashes file, --hashEvery N
+void Bench::RenderSuite(Results& results)
+{
+	const int count = Option("objects", 1000);
+	const int frames = Option("frames", 600);
+	const int width = Option("width", 1280), height = Option("height", 720);
+	const char* hashes = Option("hashes", nullptr);
+	const int hashEvery = std::max(1, Option("hashEvery", 60));
+
+	spdlog::set_level(spdlog::level::warn);
+
+	std::unique_ptr<Ngine::Window> window;
+	try {
+		Ngine::Settings::Load((AssetDir() + "Game.ini").c_str());
+		window = std::make_unique<Ngine::Window>(width, height, "Bench", Ngine::WindowMode::Headless);
+	}
+	catch (const Ngine::Exception&) {
+		printf("No headless GL context, skipping render suite\n");
+		spdlog::set_level(spdlog::level::info);
+		return;
+	}
+
+	{
+		Ngine::JobScope jobs(Ngine::Settings::Get()->workers);
+		Ngine::RenderStats loadStart = Ngine::Gfx::Stats();
+
+		//Resources die at the end of this scope, before the context they live in
+		std::string checker = MakeChecker();
+		Ngine::ProgramRef program = Ngine::Resources::LoadProgram<Ngine::MeshLayout>((AssetDir() + "Shader/TTV.glsl").c_str(), (AssetDir() + "Shader/TTF.glsl").c_str());
+		Ngine::TextureRef texture = Ngine::Resources::LoadTexture(checker.c_str());
+		Ngine::MeshRef mesh = Ngine::Resources::LoadMesh((AssetDir() + "Trunk1.obj").c_str(), AssetDir().c_str());
+		std::filesystem::remove(checker);
+
+		//Square grid of trunks centred on the origin
+		const int side = (int)std::ceil(std::sqrt((double)count));
+		const float spacing = 3.0f;
+		std::vector<Ngine::Object> objects(count);
+		std::vector<Ngine::Object*> pointers;
+		pointers.reserve(count);
+		for (int i = 0; i < count; ++i) {
+			Ngine::Object& obj = objects[i];
+			obj.program = Ngine::Resources::Get(program);
+			obj.texture = Ngine::Resources::Get(texture);
+			obj.mesh = mesh;
+			obj.mat.Initialize(obj.program);
+			obj.UpdateBounds();
+			obj.position = glm::vec3((i % side - side / 2) * spacing, 0.0f, (i / side - side / 2) * spacing);
+			pointers.push_back(&obj);
+		}
+
+		FILE* hashFile = hashes ? fopen(hashes, "w") : nullptr;
+		if (hashes && !hashFile)
+			printf("Could not write %s\n", hashes);
+
+		const float radius = side * spacing * 0.6f + 5.0f;
+		const float aspect = (float)width / (float)height;
+
+		Ngine::FramePacket packet;
+		Ngine::FrameHistogram histogram;
+		Ngine::RenderStats frameStart = Ngine::Gfx::Stats();
+		size_t allocationsStart = allocations.load();
+		uint64_t culled = 0;
+
+		for (int frame = 0; frame < frames; ++frame) {
+			auto start = std::chrono::steady_clock::now();
+			Ngine::Memory::NextFrame();
+
+			glm::mat4 VP = CameraPath(frame, frames, radius, aspect);
+			for (auto& obj : objects)
+				obj.mat.MVP = glm::translate(VP, obj.position);
+
+			packet.Clear();
+			packet.VP = VP;
+			packet.Add(pointers);
+			culled += packet.culled;
+
+			window->StartRender();
+			for (const Ngine::DrawCommand& cmd : packet.draws)
+				cmd.object->Draw(cmd);
+			window->Present();
+
+			auto end = std::chrono::steady_clock::now();
+			histogram.Add((uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count());
+
+			//Reading back waits for the GPU, so it stays outside the measured frame
+			if (hashFile && frame % hashEvery == 0)
+				fprintf(hashFile, "%d %016llx\n", frame, (unsigned long long)window->FrameHash());
+		}
+
+		if (hashFile)
+			fclose(hashFile);
+
+		Ngine::RenderStats frameEnd = Ngine::Gfx::Stats();
+		Result r{ "render/" + std::to_string(count) + " objects", histogram.Percentile(50) / 1e9, 0.0, 0, (size_t)frames };
+		r.allocations = (allocations.load() - allocationsStart) / frames;
+		r.peakRss = PeakRss();
+		r.metrics = {
+			{ "p95Ms", histogram.Percentile(95) / 1e6 },
+			{ "p99Ms", histogram.Percentile(99) / 1e6 },
+			{ "drawCalls", (double)(frameEnd.drawCalls - frameStart.drawCalls) / frames },
+			{ "uploadedBytes", (double)(frameEnd.uploadedBytes - frameStart.uploadedBytes) / frames },
+			{ "loadUploadedBytes", (double)(frameStart.uploadedBytes - loadStart.uploadedBytes) },
+			{ "culled", (double)culled / frames },
+		};
+
+		Report(r);
+		results.push_back(std::move(r));
+	}
+
+	window.reset();
+	spdlog::set_level(spdlog::level::info);
+}
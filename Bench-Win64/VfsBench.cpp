@@ -0,0 +1,114 @@
+#include "pch.h"
+#include "Bench.h"
+#include <Ngine.hpp>
+#include <spdlog/spdlog.h>
+#include <cstdio>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+#pragma warning(disable : 4996)
+
+namespace fs = std::filesystem;
+
+namespace {
+
+	//Shader sized text files, repetitive enough to compress like real sources do
+	std::vector<std::string> WriteFiles(const fs::path& dir, int count, size_t bytes)
+	{
+		std::vector<std::string> names;
+		for (int i = 0; i < count; ++i) {
+			std::string name = "Shader/S" + std::to_string(i / 64) + "/file" + std::to_string(i) + ".glsl";
+			fs::create_directories((dir / name).parent_path());
+
+			FILE* file = fopen((dir / name).string().c_str(), "wb");
+			size_t written = 0;
+			for (int line = 0; written < bytes; ++line)
+				written += (size_t)fprintf(file, "uniform vec4 Light%d_%d; //Colour and range of light %d\n", i, line, line * 7 % 113);
+			fclose(file);
+			names.push_back(name);
+		}
+		return names;
+	}
+
+	double Checksum(const char* data, size_t size)
+	{
+		double sum = 0.0;
+		for (size_t i = 0; i < size; i += 64)
+			sum += (unsigned char)data[i];
+		return sum;
+	}
+}
+
+//Many small files opened one by one: fopen and fread, the VFS on loose files, and the VFS on stored and compressed packs
+void Bench::VfsSuite(Results& results)
+{
+	spdlog::set_level(spdlog::level::warn);
+
+	fs::path dir = fs::temp_directory_path() / "ngine_bench_vfs";
+	fs::path stored = fs::temp_directory_path() / "ngine_bench_vfs_stored.npak";
+	fs::path compressed = fs::temp_directory_path() / "ngine_bench_vfs_compressed.npak";
+	std::error_code ec;
+	fs::remove_all(dir, ec);
+
+	const int count = Option("files", 2000);
+	const size_t bytes = (size_t)Option("bytes", 8192);
+	std::vector<std::string> names = WriteFiles(dir, count, bytes);
+
+	size_t total = 0;
+	for (const auto& name : names)
+		total += (size_t)fs::file_size(dir / name);
+
+	Ngine::JobScope jobs;
+	Ngine::PackSettings raw;
+	raw.compress = false;
+	Ngine::PackStats packed;
+	results.push_back(Measure("vfs/pack " + std::to_string(count) + " files", 3, (double)total, [&]() {
+		packed = Ngine::Vfs::Pack(dir.string().c_str(), compressed.string().c_str());
+		}));
+	results.back().metrics = { { "ratio", (double)packed.storedBytes / packed.bytes } };
+	Ngine::Vfs::Pack(dir.string().c_str(), stored.string().c_str(), raw);
+
+	std::vector<std::string> paths;
+	for (const auto& name : names)
+		paths.push_back((dir / name).string());
+
+	double sum = 0.0;
+	std::vector<char> buffer(bytes * 2);
+	results.push_back(Measure("vfs/fopen+fread loose", 5, (double)total, [&]() {
+		for (const auto& path : paths) {
+			FILE* file = fopen(path.c_str(), "rb");
+			size_t read = fread(buffer.data(), 1, buffer.size(), file);
+			fclose(file);
+			sum += Checksum(buffer.data(), read);
+		}
+		}));
+
+	const bool looseOverride = Ngine::Vfs::LooseOverride();
+	Ngine::Vfs::SetLooseOverride(false);
+	auto open = [&]() {
+		for (const auto& path : paths) {
+			Ngine::VfsFile file = Ngine::Vfs::Open(path.c_str());
+			sum += Checksum(file.Data(), file.Size());
+		}
+	};
+
+	Ngine::Vfs::UnmountAll();
+	results.push_back(Measure("vfs/Vfs::Open loose", 5, (double)total, open));
+
+	Ngine::Vfs::Mount(stored.string().c_str(), dir.string().c_str());
+	results.push_back(Measure("vfs/Vfs::Open pack, stored", 5, (double)total, open));
+
+	Ngine::Vfs::UnmountAll();
+	Ngine::Vfs::Mount(compressed.string().c_str(), dir.string().c_str());
+	results.push_back(Measure("vfs/Vfs::Open pack, compressed", 5, (double)total, open));
+
+	Ngine::Vfs::UnmountAll();
+	Ngine::Vfs::SetLooseOverride(looseOverride);
+	printf("%-40s checksum %.0f\n", "", sum);
+
+	fs::remove_all(dir, ec);
+	fs::remove(stored, ec);
+	fs::remove(compressed, ec);
+	spdlog::set_level(spdlog::level::info);
+}
@@ -0,0 +1,198 @@
+#include "pch.h"
+#include "Bench.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <new>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+#pragma warning(disable : 4996)
+
+std::atomic<size_t> Bench::allocations{ 0 }, Bench::allocatedBytes{ 0 };
+
+namespace {
+	std::string assetDir = "../Game-Win64/"; //Working directory is the project directory when started from Visual Studio
+	std::map<std::string, std::string> options;
+}
+
+//Every allocation made by the benchmark binary goes through here
+void* operator new(size_t size)
+{
+	Bench::allocations.fetch_add(1, std::memory_order_relaxed);
+	Bench::allocatedBytes.fetch_add(size, std::memory_order_relaxed);
+	if (void* p = std::malloc(size ? size : 1))
+		return p;
+	throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept
+{
+	std::free(p);
+}
+
+void operator delete(void* p, size_t) noexcept
+{
+	std::free(p);
+}
+
+Bench::Result Bench::Measure(const std::string& name, size_t iterations, double bytes, const std::function<void()>& fn)
+{
+	fn();
+
+	Result r{ name, 1e30, bytes, 0, iterations };
+	for (size_t i = 0; i < iterations; ++i) {
+		size_t before = allocations.load();
+		size_t beforeBytes = allocatedBytes.load();
+		auto start = std::chrono::steady_clock::now();
+		fn();
+		auto end = std::chrono::steady_clock::now();
+
+		r.seconds = std::min(r.seconds, std::chrono::duration<double>(end - start).count());
+		r.allocations = allocations.load() - before;
+		r.allocatedBytes = allocatedBytes.load() - beforeBytes;
+	}
+	r.peakRss = PeakRss();
+
+	Report(r);
+	return r;
+}
+
+void Bench::Report(const Result& r)
+{
+	printf("%-40s %12.3f ms", r.name.c_str(), r.seconds * 1e3);
+	if (r.bytes > 0.0)
+		printf(" %10.1f MB/s", r.bytes / r.seconds / (1024.0 * 1024.0));
+	printf(" %10zu allocs", r.allocations);
+	if (r.peakRss > 0)
+		printf(" %8.1f MB peak", r.peakRss / (1024.0 * 1024.0));
+	for (const auto& [key, value] : r.metrics)
+		printf(" %s %.6g", key.c_str(), value);
+	printf("\n");
+}
+
+bool Bench::WriteJson(const Results& results, const char* path)
+{
+	FILE* file = fopen(path, "wb");
+	if (!file) {
+		printf("Could not write %s\n", path);
+		return false;
+	}
+
+	//Names are generated by the suites and never need escaping
+	fprintf(file, "{\n\t\"results\": [");
+	for (size_t i = 0; i < results.size(); ++i) {
+		const Result& r = results[i];
+		fprintf(file, "%s\n\t\t{ \"name\": \"%s\", \"seconds\": %.9g, \"bytes\": %.0f, \"mbPerSecond\": %.3f, "
+			"\"allocations\": %zu, \"allocatedBytes\": %zu, \"peakRss\": %zu, \"iterations\": %zu",
+			i ? "," : "", r.name.c_str(), r.seconds, r.bytes, r.bytes > 0.0 ? r.bytes / r.seconds / (1024.0 * 1024.0) : 0.0,
+			r.allocations, r.allocatedBytes, r.peakRss, r.iterations);
+		for (const auto& [key, value] : r.metrics)
+			fprintf(file, ", \"%s\": %.9g", key.c_str(), value);
+		fprintf(file, " }");
+	}
+	fprintf(file, "\n\t]\n}\n");
+	fclose(file);
+	return true;
+}
+
+size_t Bench::PeakRss()
+{
+#ifdef _WIN32
+	PROCESS_MEMORY_COUNTERS counters;
+	if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+		return counters.PeakWorkingSetSize;
+	return 0;
+#else
+	rusage usage;
+	if (getrusage(RUSAGE_SELF, &usage) == 0)
+		return (size_t)usage.ru_maxrss * 1024; //Kilobytes on Linux
+	return 0;
+#endif
+}
+
+const std::string& Bench::AssetDir()
+{
+	return assetDir;
+}
+
+int Bench::Option(const char* name, int fallback)
+{
+	auto it = options.find(name);
+	return it != options.end() ? atoi(it->second.c_str()) : fallback;
+}
+
+const char* Bench::Option(const char* name, const char* fallback)
+{
+	auto it = options.find(name);
+	return it != options.end() ? it->second.c_str() : fallback;
+}
+
+//Usage: Bench-Win64 [--json file] [--assets dir] [--option value...] [suite...], runs everything when no suite is named
+int main(int argc, char** argv) try {
+	struct Suite {
+		const char* name;
+		void (*run)(Bench::Results&);
+	};
+
+	const Suite suites[] = {
+		{ "ini", Bench::IniSuite },
+		{ "jobs", Bench::JobsSuite },
+		{ "loader", Bench::LoaderSuite },
+		{ "render", Bench::RenderSuite },
+		{ "raycast", Bench::RaycastSuite },
+		{ "broadphase", Bench::BroadphaseSuite },
+		{ "cook", Bench::CookSuite },
+		{ "vfs", Bench::VfsSuite },
+		{ "io", Bench::IoSuite },
+		{ "lights", Bench::LightsSuite },
+	};
+
+	std::vector<const char*> names;
+	for (int i = 1; i < argc; ++i) {
+		if (strncmp(argv[i], "--", 2) == 0 && i + 1 < argc) {
+			options[argv[i] + 2] = argv[i + 1];
+			++i;
+		}
+		else
+			names.push_back(argv[i]);
+	}
+
+	const char* json = Bench::Option("json", nullptr);
+	if (options.count("assets")) {
+		assetDir = options["assets"];
+		if (assetDir.back() != '/' && assetDir.back() != '\\')
+			assetDir += '/';
+	}
+
+	Bench::Results results;
+	for (const auto& suite : suites) {
+		bool selected = names.empty();
+		for (const char* name : names)
+			selected = selected || strcmp(name, suite.name) == 0;
+
+		if (selected) {
+			printf("== %s ==\n", suite.name);
+			suite.run(results);
+		}
+	}
+
+	if (json && !Bench::WriteJson(results, json))
+		return EXIT_FAILURE;
+
+	return EXIT_SUCCESS;
+}
+catch (const Ngine::Exception& e) {
+	printf("%s", e.what());
+	return EXIT_FAILURE;
+}
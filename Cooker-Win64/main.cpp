@@ -0,0 +1,61 @@
+#include "pch.h"
+#include <Ngine.hpp>
+#include <charconv>
+#include <cstring>
+#include <string>
+#include <spdlog/spdlog.h>
+
+//Offline asset cooker, turns the source assets into the formats the engine loads fastest.
+//Only inputs whose content or dependencies changed since the last run are rebuilt, see Ngine::AssetCooker.
+int main(int argc, char** argv) try {
+	if (argc < 3) {
+		printf("Usage: %s <asset dir> <output dir> [--force] [--threads N] [--pack file]\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	Ngine::CookSettings settings;
+	int threads = 0;
+	const char* pack = nullptr;
+	for (int i = 3; i < argc; ++i) {
+		if (strcmp(argv[i], "--force") == 0)
+			settings.force = true;
+		else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+			const char* value = argv[++i];
+			auto [end, error] = std::from_chars(value, value + strlen(value), threads);
+			if (error != std::errc() || *end)
+				throw Ngine::Exception(__LINE__, __FILE__, "Thread count is not a number");
+		}
+		else if (strcmp(argv[i], "--pack") == 0 && i + 1 < argc)
+			pack = argv[++i];
+		else
+			throw Ngine::Exception(__LINE__, __FILE__, "Unknown option");
+	}
+
+	//Calling thread works too, so N threads means N - 1 workers
+	Ngine::LogScope log;
+	Ngine::JobScope jobs(threads > 0 ? threads - 1 : -1);
+
+	Ngine::CookStats stats = Ngine::AssetCooker::Cook(argv[1], argv[2], settings);
+
+	//Full when nothing could be reused
+	const char* kind = stats.upToDate == 0 ? "Full" : "Incremental";
+	spdlog::info("{} cook: {} of {} assets rebuilt, {} up to date, {} failed, {} stale outputs removed",
+		kind, stats.cooked, stats.assets, stats.upToDate, stats.failed, stats.removed);
+	spdlog::info("Hashed {} bytes, wrote {} bytes in {:.1f} ms (scan {:.1f} ms, hash {:.1f} ms, cook {:.1f} ms) on {} threads",
+		stats.hashedBytes, stats.writtenBytes, stats.totalMs, stats.scanMs, stats.hashMs, stats.cookMs, Ngine::Jobs::Workers() + 1);
+
+	//Runtime pack of the outputs, the cook database stays behind
+	if (pack && !stats.failed) {
+		Ngine::PackSettings packSettings;
+		packSettings.exclude = { "cook.db" };
+		Ngine::PackStats packed = Ngine::Vfs::Pack(argv[2], pack, packSettings);
+		spdlog::info("Packed {} files into {}, {} compressed, {} bytes stored as {} in {:.1f} ms",
+			packed.files, pack, packed.compressed, packed.bytes, packed.storedBytes, packed.ms);
+	}
+
+	return stats.failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+catch (const Ngine::Exception& e) {
+	printf("%s", e.what());
+	return EXIT_FAILURE;
+}
@@ -0,0 +1,12 @@
+//Transform Array Fragment
+#version 410 core
+
+in vec2 UV;
+out vec3 color;
+
+uniform sampler2DArray TexSmp;
+uniform int Layer;
+
+void main() {
+	color = texture(TexSmp, vec3(UV, Layer)).rgb;
+}
\ No newline at end of file
@@ -1,8 +1,8 @@
 //Transform Color Vertex
 #version 410 core
 
-layout(location = 0) in vec3 vPos;
-layout(location = 1) in vec3 vCol;
+in vec3 vPos;
+in vec3 vCol;
 
 out vec3 fCol;
 
@@ -1,7 +1,7 @@
 //Transform Debug Vertex
 #version 410 core
 
-layout(location = 0) in vec3 vPos;
+in vec3 vPos;
 
 uniform mat4 MVP;
 
@@ -0,0 +1,42 @@
+//Transform Lit Fragment, clustered point lights over the texture
+#version 410 core
+
+in vec2 UV;
+out vec3 color;
+
+uniform sampler2D TexSmp;
+
+//Filled by ClusteredLighting
+uniform usamplerBuffer ClusterSmp; //Offset and count per cluster
+uniform usamplerBuffer LightIndexSmp;
+uniform samplerBuffer LightSmp; //View space position and radius, then colour
+uniform ivec3 ClusterGrid;
+uniform vec2 ClusterDepth; //Near and slices per unit of log(depth / near)
+uniform vec4 Projection; //P[0][0], P[1][1], P[2][2], P[3][2]
+uniform vec2 Viewport;
+uniform vec3 Ambient;
+
+void main() {
+	//View space position from window coordinates and depth
+	vec3 ndc = vec3(gl_FragCoord.xy / Viewport, gl_FragCoord.z) * 2.0 - 1.0;
+	float depth = Projection.w / (ndc.z + Projection.z);
+	vec3 p = vec3(ndc.xy * depth / Projection.xy, -depth);
+	//Flat face normal, the vertex stage has no model view matrix to turn normals with
+	vec3 n = normalize(cross(dFdx(p), dFdy(p)));
+
+	ivec2 tile = min(ivec2(gl_FragCoord.xy / Viewport * vec2(ClusterGrid.xy)), ClusterGrid.xy - 1);
+	int slice = clamp(int(floor(log(depth / ClusterDepth.x) * ClusterDepth.y)), 0, ClusterGrid.z - 1);
+	uvec2 cluster = texelFetch(ClusterSmp, (slice * ClusterGrid.y + tile.y) * ClusterGrid.x + tile.x).xy;
+
+	vec3 light = Ambient;
+	for (uint i = 0u; i < cluster.y; ++i) {
+		int index = int(texelFetch(LightIndexSmp, int(cluster.x + i)).x) * 2;
+		vec4 sphere = texelFetch(LightSmp, index);
+		vec3 toLight = sphere.xyz - p;
+		float dist = length(toLight);
+		float falloff = clamp(1.0 - dist / sphere.w, 0.0, 1.0);
+		light += texelFetch(LightSmp, index + 1).rgb * falloff * falloff * max(dot(n, toLight / max(dist, 1e-4)), 0.0);
+	}
+
+	color = texture(TexSmp, UV).rgb * light;
+}
\ No newline at end of file
@@ -1,8 +1,8 @@
 //Transform Texture Vertex
 #version 410 core
 
-layout(location = 0) in vec3 vPos;
-layout(location = 2) in vec2 vUV;
+in vec3 vPos;
+in vec2 vUV;
 
 out vec2 UV;
 uniform mat4 MVP;
@@ -1,28 +1,76 @@
 #include <Ngine.hpp>
 
 int main(void) try {
-	mINI::INIFile file("Game.ini");
-	mINI::INIStructure ini;
-	if (!file.read(ini))
-		throw Ngine::Exception(__LINE__, __FILE__, "Could not read configuration file");
-
-	Ngine::Window wnd(std::stoi(ini["Game"]["Width"]), std::stoi(ini["Game"]["Height"]), "NightDrive test build");
-
-	Ngine::Object obj;
-	
-
-	obj.program = Ngine::Gfx::CompileShader("Shader/TTV.glsl", "Shader/TTF.glsl");
-	Ngine::Gfx::LoadOBJ("Test.obj", ".", obj.verticies, obj.uvs, obj.normals);
-	obj.texture = Ngine::Gfx::LoadBMP("road.bmp");
-	obj.InitMatrix();
-
-	while (!wnd.ShouldClose())
-	{
-		wnd.StartRender();
-		obj.Tanslate(glm::vec3(0.0f, -0.001f, 0.0f));
-		obj.Draw();
-		wnd.EndRender();
+	Ngine::LogScope log;
+	Ngine::Settings::Load("Game.ini");
+	//Cooked assets when a pack was built, Game.ini stays a loose file so it can be edited and saved
+	Ngine::Vfs::Mount("Game.npak");
+	auto settings = Ngine::Settings::Get();
+
+	Ngine::JobScope jobs(settings->workers);
+	Ngine::IoScope io;
+	Ngine::Window wnd(settings->width, settings->height, "NightDrive test build");
+
+	//Kept alive until the end of main, objects only borrow the GL names
+	Ngine::ProgramRef program = Ngine::Resources::LoadProgram<Ngine::MeshLayout>("Shader/TTV.glsl", "Shader/TLF.glsl");
+	Ngine::TextureRef texture = Ngine::Resources::LoadTexture("road.bmp");
+
+	//Closed loop of hills and bends, banked into the corners
+	std::vector<Ngine::RoadPoint> points;
+	for (int i = 0; i < 24; ++i) {
+		float a = (float)i / 24.0f * 6.2831853f;
+		float r = 600.0f + 150.0f * std::sin(3.0f * a) + 60.0f * std::cos(5.0f * a);
+		points.push_back({ glm::vec3(std::cos(a) * r, 12.0f * std::sin(4.0f * a), std::sin(a) * r), 0.08f * std::cos(3.0f * a) });
+	}
+	Ngine::RoadStreamer road(Ngine::RoadSpline(points, true), Ngine::RoadProfile{}, Ngine::Resources::Get(program), Ngine::Resources::Get(texture));
+
+	//Street lamps on both kerbs every 24 m and small markers between them, close to two thousand lights around the loop
+	std::vector<Ngine::PointLight> lights;
+	const float kerb = Ngine::RoadProfile{}.width * 0.5f;
+	for (float d = 0.0f; d < road.Spline().Length(); d += 4.0f) {
+		Ngine::RoadSpline::Frame f = road.Spline().At(d);
+		for (float side : { -1.0f, 1.0f }) {
+			if (std::fmod(d, 24.0f) < 4.0f)
+				lights.push_back({ f.position + f.right * side * (kerb + 1.5f) + f.up * 6.0f, 14.0f, glm::vec3(2.0f, 1.5f, 0.9f) });
+			else
+				lights.push_back({ f.position + f.right * side * (kerb + 0.3f) + f.up * 0.3f, 2.5f, side < 0.0f ? glm::vec3(0.9f, 0.4f, 0.1f) : glm::vec3(0.2f, 0.5f, 1.0f) });
+		}
 	}
+	const size_t staticLights = lights.size();
+
+	const float aspect = (float)settings->width / (float)settings->height;
+	const glm::mat4 projection = glm::perspective(glm::radians(70.0f), aspect, 0.1f, 400.0f);
+
+	//Car follows the centre line, the camera sits behind and above it
+	float distance = 0.0f, previousDistance = 0.0f;
+	road.Update(road.Spline().At(distance).position);
+
+	Ngine::Loop loop(wnd);
+	Ngine::RenderThread renderer(wnd);
+	loop.Run([&](double dt) {
+		previousDistance = distance;
+		distance += 30.0f * (float)dt;
+		road.Update(road.Spline().At(distance).position);
+		}, [&](Ngine::FramePacket& packet, float alpha) {
+		Ngine::RoadSpline::Frame car = road.Spline().At(previousDistance + (distance - previousDistance) * alpha);
+		glm::vec3 eye = car.position - car.tangent * 8.0f + glm::vec3(0.0f, 3.0f, 0.0f);
+		glm::mat4 view = glm::lookAt(eye, car.position + car.tangent * 10.0f, glm::vec3(0.0f, 1.0f, 0.0f));
+		packet.VP = projection * view;
+
+		//Headlights and tail lights move with the car
+		lights.resize(staticLights);
+		for (float side : { -1.0f, 1.0f }) {
+			lights.push_back({ car.position + car.tangent * 6.0f + car.right * side * 0.8f + car.up * 0.7f, 30.0f, glm::vec3(3.0f, 2.9f, 2.6f) });
+			lights.push_back({ car.position - car.tangent * 2.2f + car.right * side * 0.7f + car.up * 0.8f, 4.0f, glm::vec3(1.5f, 0.05f, 0.02f) });
+		}
+		packet.lighting.Build(lights, view, projection);
+		road.Submit(packet);
+		}, renderer);
+	renderer.Stop();
+
+	auto& frames = loop.FrameTimes();
+	road.LogStats();
+	printf("Frame time p50 %.2f ms, p99 %.2f ms, max %.2f ms\n", frames.Percentile(50) / 1e6, frames.Percentile(99) / 1e6, frames.Max() / 1e6);
 
 	return EXIT_SUCCESS;
 }
@@ -0,0 +1,757 @@
+#include "pch.h"
+#include "AssetCooker.h"
+#include "Gfx.h"
+#include "Jobs.h"
+#include "Log.h"
+#include "MappedFile.h"
+#include "Profiler.h"
+#include "TextureCompressor.h"
+#include "Vfs.h"
+#include <spdlog/spdlog.h>
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <limits>
+#include <string_view>
+#include <unordered_map>
+
+#pragma warning(disable : 4996)
+
+namespace fs = std::filesystem;
+
+namespace {
+
+	constexpr uint32_t CookerVersion = 1; //Bump when a conversion changes, every output gets rebuilt
+	constexpr uint32_t MeshVersion = 1;
+	constexpr char MeshMagic[4] = { 'N', 'M', 'S', 'H' };
+	constexpr int CacheSize = 32; //Post-transform cache modelled when ordering triangles
+	constexpr size_t FifoSize = 16; //Cache measured for the log, about what GPUs have
+
+	enum MeshFlags : uint32_t {
+		HasUVs = 1,
+		HasTangents = 2
+	};
+
+	struct MeshHeader {
+		char magic[4];
+		uint32_t version;
+		uint32_t vertexCount, indexCount;
+		uint32_t flags;
+		float boundsMin[3], boundsMax[3];
+	};
+
+	enum class Kind {
+		Mesh,
+		Material,
+		Texture,
+		CompressedTexture,
+		Shader
+	};
+
+	struct Asset {
+		std::string source, output; //Relative, with forward slashes
+		Kind kind;
+		size_t bytes = 0;
+		uint64_t content = 0;
+		std::vector<std::string> dependencies; //Relative to the source directory, may name missing files
+		uint64_t key = 0;
+		bool dirty = false, failed = false;
+	};
+
+	struct Record {
+		uint64_t key;
+		std::string output;
+	};
+
+	uint64_t Fnv(const void* data, size_t size, uint64_t hash = 14695981039346656037ull)
+	{
+		const unsigned char* bytes = (const unsigned char*)data;
+		for (size_t i = 0; i < size; ++i) {
+			hash ^= bytes[i];
+			hash *= 1099511628211ull;
+		}
+		return hash;
+	}
+
+	uint64_t Mix(uint64_t hash, uint64_t value)
+	{
+		return Fnv(&value, sizeof(value), hash);
+	}
+
+	bool KindOf(const fs::path& path, Kind& kind, std::string& extension)
+	{
+		std::string e = path.extension().string();
+		std::transform(e.begin(), e.end(), e.begin(), [](char c) { return (char)std::tolower(c); });
+
+		if (e == ".obj") { kind = Kind::Mesh; extension = ".nmesh"; }
+		else if (e == ".mtl") { kind = Kind::Material; extension = e; }
+		else if (e == ".bmp") { kind = Kind::Texture; extension = ".dds"; }
+		else if (e == ".dds") { kind = Kind::CompressedTexture; extension = e; }
+		else if (e == ".glsl") { kind = Kind::Shader; extension = e; }
+		else return false;
+		return true;
+	}
+
+	//Calls fn for each line without its line break
+	template<typename F>
+	void ForEachLine(std::string_view text, const F& fn)
+	{
+		while (!text.empty()) {
+			size_t end = text.find('\n');
+			std::string_view line = text.substr(0, end);
+			if (!line.empty() && line.back() == '\r')
+				line.remove_suffix(1);
+			fn(line);
+			if (end == std::string_view::npos)
+				break;
+			text.remove_prefix(end + 1);
+		}
+	}
+
+	std::string_view TrimLeft(std::string_view s)
+	{
+		while (!s.empty() && (s.front() == ' ' || s.front() == '\t'))
+			s.remove_prefix(1);
+		return s;
+	}
+
+	//File name of #include "name", empty for any other line
+	std::string_view IncludeOf(std::string_view line)
+	{
+		line = TrimLeft(line);
+		if (line.substr(0, 8) != "#include")
+			return {};
+		size_t open = line.find('"'), close = line.rfind('"');
+		if (open == std::string_view::npos || close <= open)
+			return {};
+		return line.substr(open + 1, close - open - 1);
+	}
+
+	std::string Resolve(const std::string& from, std::string_view name)
+	{
+		return (fs::path(from).parent_path() / fs::path(std::string(name))).lexically_normal().generic_string();
+	}
+
+	//mtllib of meshes and #include of shaders, the files an output is built from besides its source
+	void ParseDependencies(Asset& asset, std::string_view text)
+	{
+		if (asset.kind == Kind::Mesh) {
+			ForEachLine(text, [&](std::string_view line) {
+				line = TrimLeft(line);
+				if (line.substr(0, 7) != "mtllib ")
+					return;
+				line.remove_prefix(7);
+				while (!(line = TrimLeft(line)).empty()) {
+					size_t end = std::min(line.find(' '), line.size());
+					asset.dependencies.push_back(Resolve(asset.source, line.substr(0, end)));
+					line.remove_prefix(end);
+				}
+				});
+		}
+		else if (asset.kind == Kind::Shader) {
+			ForEachLine(text, [&](std::string_view line) {
+				if (std::string_view name = IncludeOf(line); !name.empty())
+					asset.dependencies.push_back(Resolve(asset.source, name));
+				});
+		}
+		std::sort(asset.dependencies.begin(), asset.dependencies.end());
+		asset.dependencies.erase(std::unique(asset.dependencies.begin(), asset.dependencies.end()), asset.dependencies.end());
+	}
+
+	//Content of the asset and, transitively, of everything it depends on
+	uint64_t KeyOf(std::vector<Asset>& assets, const std::unordered_map<std::string, size_t>& bySource, size_t index, std::vector<uint8_t>& state)
+	{
+		Asset& asset = assets[index];
+		if (state[index] == 2)
+			return asset.key;
+
+		state[index] = 1;
+		uint64_t key = Mix(Mix(14695981039346656037ull, CookerVersion), (uint64_t)asset.kind);
+		key = Mix(key, asset.content);
+		for (const auto& dependency : asset.dependencies) {
+			auto it = bySource.find(dependency);
+			if (it == bySource.end())
+				key = Fnv(dependency.data(), dependency.size(), Mix(key, 0)); //Missing, appearing later changes the key
+			else if (state[it->second] == 1)
+				key = Mix(key, assets[it->second].content); //Include cycle, the cook reports it
+			else
+				key = Mix(key, KeyOf(assets, bySource, it->second, state));
+		}
+
+		asset.key = key;
+		state[index] = 2;
+		return key;
+	}
+
+	std::unordered_map<std::string, Record> ReadDatabase(const fs::path& path)
+	{
+		std::unordered_map<std::string, Record> records;
+		std::ifstream file(path);
+		std::string line;
+		while (std::getline(file, line)) {
+			//key, output and source separated by tabs, paths may contain spaces
+			size_t first = line.find('\t'), second = line.find('\t', first + 1);
+			if (first == std::string::npos || second == std::string::npos)
+				continue;
+			Record record{ std::strtoull(line.substr(0, first).c_str(), nullptr, 16), line.substr(first + 1, second - first - 1) };
+			records[line.substr(second + 1)] = std::move(record);
+		}
+		return records;
+	}
+
+	void WriteDatabase(const fs::path& path, const std::vector<Asset>& assets)
+	{
+		fs::path temp = path;
+		temp += ".tmp";
+		{
+			std::ofstream file(temp, std::ios::trunc);
+			for (const auto& asset : assets) {
+				if (asset.failed)
+					continue; //No record, the next run tries again
+				char key[17];
+				snprintf(key, sizeof(key), "%016llx", (unsigned long long)asset.key);
+				file << key << '\t' << asset.output << '\t' << asset.source << '\n';
+			}
+			if (!file) {
+				spdlog::error("Could not write {}", temp.string());
+				throw Ngine::Exception(__LINE__, __FILE__, "Could not write cook database");
+			}
+		}
+		std::error_code ec;
+		fs::rename(temp, path, ec);
+	}
+
+	void WriteFile(const fs::path& path, const void* data, size_t size)
+	{
+		FILE* fp = fopen(path.string().c_str(), "wb");
+		if (fp == NULL) {
+			spdlog::error("Could not open {}", path.string());
+			throw Ngine::Exception(__LINE__, __FILE__, "Could not open output file");
+		}
+		bool ok = size == 0 || fwrite(data, 1, size, fp) == size;
+		fclose(fp);
+
+		if (!ok) {
+			spdlog::error("Could not write {}", path.string());
+			throw Ngine::Exception(__LINE__, __FILE__, "Could not write output file");
+		}
+	}
+
+	bool HasAlpha(const Ngine::Image& img)
+	{
+		for (size_t i = 3; i < img.rgba.size(); i += 4) {
+			if (img.rgba[i] != 255)
+				return true;
+		}
+		return false;
+	}
+
+	//Tom Forsyth's linear-speed vertex cache optimisation: verticies score higher the more recently they were used
+	//and the fewer triangles still need them, the next triangle is the best scoring one touching the cache.
+	float VertexScore(int position, uint32_t live)
+	{
+		if (live == 0)
+			return -1.0f;
+
+		float score = 0.0f;
+		if (position >= 0)
+			score = position < 3 ? 0.75f : std::pow(1.0f - (position - 3) / (float)(CacheSize - 3), 1.5f);
+		return score + 2.0f / std::sqrt((float)live);
+	}
+
+	std::vector<uint32_t> OptimizeCache(const std::vector<uint32_t>& indices, size_t vertexCount)
+	{
+		NGINE_ZONE("AssetCooker::OptimizeCache");
+
+		const size_t triangles = indices.size() / 3;
+		if (triangles == 0)
+			return indices;
+
+		//Triangles of each vertex, the first live[v] entries are the ones not emitted yet
+		std::vector<uint32_t> offsets(vertexCount + 1, 0), live(vertexCount, 0), adjacency(triangles * 3);
+		for (size_t i = 0; i < triangles * 3; ++i)
+			++offsets[indices[i] + 1];
+		for (size_t v = 0; v < vertexCount; ++v)
+			offsets[v + 1] += offsets[v];
+		for (size_t i = 0; i < triangles * 3; ++i) {
+			uint32_t v = indices[i];
+			adjacency[offsets[v] + live[v]++] = (uint32_t)(i / 3);
+		}
+
+		std::vector<int> position(vertexCount, -1);
+		std::vector<float> vertexScore(vertexCount), triangleScore(triangles);
+		std::vector<uint8_t> emitted(triangles, 0);
+		for (size_t v = 0; v < vertexCount; ++v)
+			vertexScore[v] = VertexScore(-1, live[v]);
+
+		size_t best = 0;
+		for (size_t t = 0; t < triangles; ++t) {
+			triangleScore[t] = vertexScore[indices[t * 3]] + vertexScore[indices[t * 3 + 1]] + vertexScore[indices[t * 3 + 2]];
+			if (triangleScore[t] > triangleScore[best])
+				best = t;
+		}
+
+		std::vector<uint32_t> result, cache, next;
+		result.reserve(triangles * 3);
+		size_t cursor = 0;
+		for (size_t n = 0; n < triangles; ++n) {
+			//Nothing in the cache has triangles left, continue with the first unemitted one
+			if (best == std::numeric_limits<size_t>::max()) {
+				while (emitted[cursor])
+					++cursor;
+				best = cursor;
+			}
+
+			const uint32_t* tri = &indices[best * 3];
+			emitted[best] = 1;
+			result.insert(result.end(), tri, tri + 3);
+
+			for (int k = 0; k < 3; ++k) {
+				uint32_t v = tri[k];
+				uint32_t* first = &adjacency[offsets[v]];
+				uint32_t* last = first + live[v];
+				*std::find(first, last, (uint32_t)best) = *(last - 1);
+				--live[v];
+			}
+
+			//Used verticies move to the front, the ones pushed past the end drop out
+			next.assign(tri, tri + 3);
+			for (uint32_t v : cache)
+				if (v != tri[0] && v != tri[1] && v != tri[2])
+					next.push_back(v);
+			for (size_t i = CacheSize; i < next.size(); ++i)
+				position[next[i]] = -1;
+			for (size_t i = 0; i < next.size() && i < (size_t)CacheSize; ++i)
+				position[next[i]] = (int)i;
+			for (uint32_t v : next)
+				vertexScore[v] = VertexScore(position[v], live[v]);
+
+			best = std::numeric_limits<size_t>::max();
+			float bestScore = -1.0f;
+			for (uint32_t v : next) {
+				for (uint32_t i = offsets[v]; i < offsets[v] + live[v]; ++i) {
+					uint32_t t = adjacency[i];
+					float score = vertexScore[indices[t * 3]] + vertexScore[indices[t * 3 + 1]] + vertexScore[indices[t * 3 + 2]];
+					triangleScore[t] = score;
+					if (score > bestScore) {
+						bestScore = score;
+						best = t;
+					}
+				}
+			}
+
+			if (next.size() > (size_t)CacheSize)
+				next.resize(CacheSize);
+			cache.swap(next);
+		}
+		return result;
+	}
+
+	//Average cache misses per triangle with a FIFO cache, 3 is the worst, about 0.5 to 0.7 is good
+	double Acmr(const std::vector<uint32_t>& indices, size_t vertexCount)
+	{
+		std::vector<size_t> stamp(vertexCount, 0);
+		size_t misses = 0;
+		for (uint32_t v : indices) {
+			if (stamp[v] == 0 || misses - stamp[v] >= FifoSize) {
+				++misses;
+				stamp[v] = misses;
+			}
+		}
+		return indices.empty() ? 0.0 : (double)misses / (indices.size() / 3);
+	}
+
+	struct Vertex {
+		glm::vec3 position, normal;
+		glm::vec2 uv;
+		glm::vec4 tangent;
+
+		bool operator==(const Vertex& other) const noexcept { return std::memcmp(this, &other, sizeof(Vertex)) == 0; }
+	};
+
+	struct VertexHash {
+		size_t operator()(const Vertex& v) const noexcept { return (size_t)Fnv(&v, sizeof(Vertex)); }
+	};
+
+	//Welds identical verticies, orders triangles for the post-transform cache and verticies by first use
+	Ngine::Mesh CookMesh(const fs::path& path)
+	{
+		NGINE_ZONE("AssetCooker::CookMesh");
+
+		std::vector<glm::vec3> verticies, normals;
+		std::vector<glm::vec2> uvs;
+		std::vector<glm::vec4> tangents;
+		Ngine::Gfx::LoadOBJ(path.string().c_str(), path.parent_path().string().c_str(), verticies, uvs, normals, &tangents);
+
+		std::vector<Vertex> unique;
+		std::vector<uint32_t> indices;
+		indices.reserve(verticies.size());
+		std::unordered_map<Vertex, uint32_t, VertexHash> lookup;
+		lookup.reserve(verticies.size());
+		for (size_t i = 0; i < verticies.size(); ++i) {
+			Vertex v{ verticies[i], normals[i], uvs.empty() ? glm::vec2(0.0f) : uvs[i], tangents[i] };
+			auto [it, inserted] = lookup.emplace(v, (uint32_t)unique.size());
+			if (inserted)
+				unique.push_back(v);
+			indices.push_back(it->second);
+		}
+
+		double before = Acmr(indices, unique.size());
+		indices = OptimizeCache(indices, unique.size());
+
+		std::vector<uint32_t> remap(unique.size(), std::numeric_limits<uint32_t>::max());
+		uint32_t used = 0;
+		for (uint32_t& i : indices) {
+			if (remap[i] == std::numeric_limits<uint32_t>::max())
+				remap[i] = used++;
+			i = remap[i];
+		}
+
+		Ngine::Mesh mesh;
+		mesh.verticies.resize(used);
+		mesh.normals.resize(used);
+		mesh.tangents.resize(used);
+		if (!uvs.empty())
+			mesh.uvs.resize(used);
+		for (size_t v = 0; v < unique.size(); ++v) {
+			uint32_t to = remap[v];
+			mesh.verticies[to] = unique[v].position;
+			mesh.normals[to] = unique[v].normal;
+			mesh.tangents[to] = unique[v].tangent;
+			if (!uvs.empty())
+				mesh.uvs[to] = unique[v].uv;
+		}
+		mesh.indices = std::move(indices);
+
+		NGINE_LOG_INFO("Cooked mesh {} {} {} {:.3f} {:.3f}", Ngine::Field("path", path.string()), Ngine::Field("verticies", used), Ngine::Field("triangles", mesh.indices.size() / 3),
+			Ngine::Field("acmrBefore", before), Ngine::Field("acmrAfter", Acmr(mesh.indices, used)));
+		return mesh;
+	}
+
+	void CookTexture(const fs::path& source, const fs::path& output)
+	{
+		NGINE_ZONE("AssetCooker::CookTexture");
+
+		Ngine::Image img = Ngine::TextureCompressor::LoadBMP(source.string().c_str());
+		Ngine::BCFormat format = HasAlpha(img) ? Ngine::BCFormat::BC3 : Ngine::BCFormat::BC1;
+
+		std::vector<std::vector<unsigned char>> levels;
+		for (const auto& level : Ngine::TextureCompressor::BuildMipChain(img))
+			levels.push_back(Ngine::TextureCompressor::Encode(level, format));
+		Ngine::TextureCompressor::WriteDDS(output.string().c_str(), levels, img.width, img.height, format);
+	}
+
+	std::string ReadText(const fs::path& path)
+	{
+		Ngine::MappedFile file(path.string().c_str());
+		return std::string(file.View());
+	}
+
+	//Inlines includes and drops comments, blank lines and trailing whitespace
+	void Preprocess(const fs::path& path, std::vector<fs::path>& stack, std::string& out)
+	{
+		if (std::find(stack.begin(), stack.end(), path) != stack.end()) {
+			spdlog::error("Shader {} includes itself", path.string());
+			throw Ngine::Exception(__LINE__, __FILE__, "Could not preprocess shader");
+		}
+		stack.push_back(path);
+
+		std::string text = ReadText(path);
+		bool inComment = false;
+		ForEachLine(text, [&](std::string_view line) {
+			if (std::string_view name = IncludeOf(line); !name.empty() && !inComment) {
+				Preprocess((path.parent_path() / fs::path(std::string(name))).lexically_normal(), stack, out);
+				return;
+			}
+
+			std::string kept;
+			for (size_t i = 0; i < line.size(); ++i) {
+				if (inComment) {
+					if (line.compare(i, 2, "*/") == 0) {
+						inComment = false;
+						++i;
+					}
+				}
+				else if (line.compare(i, 2, "/*") == 0) {
+					inComment = true;
+					++i;
+				}
+				else if (line.compare(i, 2, "//") == 0) {
+					break;
+				}
+				else {
+					kept += line[i];
+				}
+			}
+
+			while (!kept.empty() && (kept.back() == ' ' || kept.back() == '\t'))
+				kept.pop_back();
+			if (!TrimLeft(kept).empty()) {
+				out += kept;
+				out += '\n';
+			}
+			});
+
+		stack.pop_back();
+	}
+
+	//Writes next to the output and renames, an interrupted cook never leaves a complete looking file behind
+	void CookAsset(const fs::path& sourceDir, const fs::path& outputDir, const Asset& asset)
+	{
+		fs::path source = sourceDir / asset.source;
+		fs::path output = outputDir / asset.output;
+		fs::path temp = output;
+		temp += ".tmp";
+
+		std::error_code ec;
+		fs::create_directories(output.parent_path(), ec);
+
+		switch (asset.kind) {
+		case Kind::Mesh:
+			Ngine::AssetCooker::WriteMesh(temp.string().c_str(), CookMesh(source));
+			break;
+		case Kind::Texture:
+			CookTexture(source, temp);
+			break;
+		case Kind::Shader: {
+			std::vector<fs::path> stack;
+			std::string text;
+			Preprocess(source, stack, text);
+			WriteFile(temp, text.data(), text.size());
+			break;
+		}
+		case Kind::Material:
+		case Kind::CompressedTexture: {
+			Ngine::MappedFile file(source.string().c_str());
+			WriteFile(temp, file.Data(), file.Size());
+			break;
+		}
+		}
+
+		fs::rename(temp, output, ec);
+		if (ec) {
+			spdlog::error("Could not move {} into place: {}", output.string(), ec.message());
+			throw Ngine::Exception(__LINE__, __FILE__, "Could not write output file");
+		}
+	}
+}
+
+Ngine::CookStats Ngine::AssetCooker::Cook(const char* sourceDir, const char* outputDir, const CookSettings& settings)
+{
+	NGINE_ZONE("AssetCooker::Cook");
+	Ngine::LogTimer total;
+
+	fs::path sourceRoot = fs::weakly_canonical(fs::absolute(sourceDir));
+	fs::path outputRoot = fs::weakly_canonical(fs::absolute(outputDir));
+	if (!fs::is_directory(sourceRoot)) {
+		spdlog::error("Asset directory {} not found", sourceDir);
+		throw Ngine::Exception(__LINE__, __FILE__, "Could not find asset directory");
+	}
+	fs::create_directories(outputRoot);
+
+	CookStats stats{};
+
+	//Scan, skipping the output directory when it lives inside the sources
+	Ngine::LogTimer phase;
+	std::vector<Asset> assets;
+	for (auto it = fs::recursive_directory_iterator(sourceRoot); it != fs::recursive_directory_iterator(); ++it) {
+		if (it->is_directory() && fs::equivalent(it->path(), outputRoot)) {
+			it.disable_recursion_pending();
+			continue;
+		}
+
+		Asset asset;
+		std::string extension;
+		if (!it->is_regular_file() || !KindOf(it->path(), asset.kind, extension))
+			continue;
+
+		asset.source = fs::relative(it->path(), sourceRoot).generic_string();
+		asset.output = fs::path(asset.source).replace_extension(extension).generic_string();
+		assets.push_back(std::move(asset));
+	}
+	std::sort(assets.begin(), assets.end(), [](const Asset& a, const Asset& b) { return a.source < b.source; });
+
+	//X.bmp and X.dds both cook to X.dds, one would silently overwrite the other. Case blind like the Windows file system.
+	std::unordered_map<std::string, size_t> byOutput;
+	for (size_t i = 0; i < assets.size(); ++i) {
+		std::string key = assets[i].output;
+		std::transform(key.begin(), key.end(), key.begin(), [](char c) { return (char)std::tolower((unsigned char)c); });
+		auto [it, added] = byOutput.emplace(std::move(key), i);
+		if (!added) {
+			spdlog::error("{} and {} both cook to {}", assets[it->second].source, assets[i].source, assets[i].output);
+			throw Ngine::Exception(__LINE__, __FILE__, "Two assets cook to the same output");
+		}
+	}
+	stats.assets = assets.size();
+	stats.scanMs = phase.Ms();
+
+	//Hash contents and find dependencies, one file per job
+	phase = Ngine::LogTimer();
+	Jobs::ParallelFor(0, assets.size(), 1, [&](size_t first, size_t last) {
+		for (size_t i = first; i < last; ++i) {
+			Asset& asset = assets[i];
+			MappedFile file((sourceRoot / asset.source).string().c_str());
+			asset.bytes = file.Size();
+			asset.content = Fnv(file.Data(), file.Size());
+			ParseDependencies(asset, file.View());
+		}
+		});
+
+	std::unordered_map<std::string, size_t> bySource;
+	for (size_t i = 0; i < assets.size(); ++i) {
+		bySource.emplace(assets[i].source, i);
+		stats.hashedBytes += assets[i].bytes;
+	}
+
+	std::vector<uint8_t> state(assets.size(), 0);
+	for (size_t i = 0; i < assets.size(); ++i)
+		KeyOf(assets, bySource, i, state);
+
+	fs::path databasePath = outputRoot / "cook.db";
+	auto records = ReadDatabase(databasePath);
+	std::vector<size_t> dirty;
+	for (size_t i = 0; i < assets.size(); ++i) {
+		Asset& asset = assets[i];
+		auto it = records.find(asset.source);
+		asset.dirty = settings.force || it == records.end() || it->second.key != asset.key || it->second.output != asset.output || !fs::exists(outputRoot / asset.output);
+		if (asset.dirty)
+			dirty.push_back(i);
+		else
+			++stats.upToDate;
+	}
+
+	//Outputs whose source is gone
+	for (const auto& [source, record] : records) {
+		if (bySource.count(source))
+			continue;
+		std::error_code ec;
+		if (fs::remove(outputRoot / record.output, ec))
+			++stats.removed;
+	}
+	stats.hashMs = phase.Ms();
+
+	//Independent outputs, every dirty asset is its own job
+	phase = Ngine::LogTimer();
+	std::atomic<size_t> failed = 0;
+	JobCounter counter;
+	for (size_t i : dirty) {
+		Jobs::Run([&, i]() {
+			Asset& asset = assets[i];
+			try {
+				CookAsset(sourceRoot, outputRoot, asset);
+			}
+			catch (const std::exception& e) {
+				spdlog::error("Could not cook {}: {}", asset.source, e.what());
+				asset.failed = true;
+				failed.fetch_add(1, std::memory_order_relaxed);
+			}
+			}, &counter);
+	}
+	Jobs::Wait(counter);
+
+	stats.failed = failed.load();
+	stats.cooked = dirty.size() - stats.failed;
+	for (size_t i : dirty) {
+		std::error_code ec;
+		if (!assets[i].failed)
+			stats.writtenBytes += (size_t)fs::file_size(outputRoot / assets[i].output, ec);
+	}
+	stats.cookMs = phase.Ms();
+
+	WriteDatabase(databasePath, assets);
+	stats.totalMs = total.Ms();
+
+	NGINE_LOG_INFO("Cooked {} into {} {} {} {} {} {} {:.1f} {:.1f} {:.1f} {:.1f}", Field("source", sourceDir), Field("output", outputDir), Field("assets", stats.assets),
+		Field("cooked", stats.cooked), Field("upToDate", stats.upToDate), Field("failed", stats.failed), Field("removed", stats.removed),
+		Field("scanMs", stats.scanMs), Field("hashMs", stats.hashMs), Field("cookMs", stats.cookMs), Field("ms", stats.totalMs));
+	return stats;
+}
+
+void Ngine::AssetCooker::WriteMesh(const char* path, const Mesh& mesh)
+{
+	MeshHeader header{};
+	std::memcpy(header.magic, MeshMagic, sizeof(MeshMagic));
+	header.version = MeshVersion;
+	header.vertexCount = (uint32_t)mesh.verticies.size();
+	header.indexCount = (uint32_t)mesh.indices.size();
+	header.flags = (mesh.uvs.empty() ? 0 : HasUVs) | (mesh.tangents.empty() ? 0 : HasTangents);
+
+	glm::vec3 boundsMin(0.0f), boundsMax(0.0f);
+	if (!mesh.verticies.empty()) {
+		boundsMin = boundsMax = mesh.verticies.front();
+		for (const auto& v : mesh.verticies) {
+			boundsMin = glm::min(boundsMin, v);
+			boundsMax = glm::max(boundsMax, v);
+		}
+	}
+	std::memcpy(header.boundsMin, &boundsMin, sizeof(header.boundsMin));
+	std::memcpy(header.boundsMax, &boundsMax, sizeof(header.boundsMax));
+
+	if (mesh.normals.size() != mesh.verticies.size() || (!mesh.uvs.empty() && mesh.uvs.size() != mesh.verticies.size()) ||
+		(!mesh.tangents.empty() && mesh.tangents.size() != mesh.verticies.size())) {
+		spdlog::error("Mesh {} has attribute arrays of different lengths", path);
+		throw Ngine::Exception(__LINE__, __FILE__, "Could not write mesh file");
+	}
+
+	FILE* fp = fopen(path, "wb");
+	if (fp == NULL) {
+		spdlog::error("Could not open {}", path);
+		throw Ngine::Exception(__LINE__, __FILE__, "Could not open mesh file");
+	}
+
+	auto write = [fp](const void* data, size_t size) { return size == 0 || fwrite(data, 1, size, fp) == size; };
+	bool ok = write(&header, sizeof(header)) &&
+		write(mesh.verticies.data(), sizeof(glm::vec3) * mesh.verticies.size()) &&
+		write(mesh.normals.data(), sizeof(glm::vec3) * mesh.normals.size()) &&
+		write(mesh.uvs.data(), sizeof(glm::vec2) * mesh.uvs.size()) &&
+		write(mesh.tangents.data(), sizeof(glm::vec4) * mesh.tangents.size()) &&
+		write(mesh.indices.data(), sizeof(uint32_t) * mesh.indices.size());
+	fclose(fp);
+
+	if (!ok) {
+		spdlog::error("Could not write {}", path);
+		throw Ngine::Exception(__LINE__, __FILE__, "Could not write mesh file");
+	}
+}
+
+void Ngine::AssetCooker::ReadMesh(const char* path, Mesh& mesh)
+{
+	NGINE_ZONE("AssetCooker::ReadMesh");
+	Ngine::LogTimer timer;
+
+	VfsFile file = Vfs::Open(path);
+	MeshHeader header;
+	if (file.Size() < sizeof(header)) {
+		spdlog::error("{} is too small for a mesh file", path);
+		throw Ngine::Exception(__LINE__, __FILE__, "Could not read mesh file");
+	}
+	std::memcpy(&header, file.Data(), sizeof(header));
+
+	const size_t vertexCount = header.vertexCount, indexCount = header.indexCount;
+	const size_t expected = sizeof(header) + vertexCount * (sizeof(glm::vec3) * 2 + (header.flags & HasUVs ? sizeof(glm::vec2) : 0) + (header.flags & HasTangents ? sizeof(glm::vec4) : 0)) + indexCount * sizeof(uint32_t);
+	if (std::memcmp(header.magic, MeshMagic, sizeof(MeshMagic)) != 0 || header.version != MeshVersion || file.Size() != expected) {
+		spdlog::error("{} is not a version {} mesh file, cook it again", path, MeshVersion);
+		throw Ngine::Exception(__LINE__, __FILE__, "Could not read mesh file");
+	}
+
+	const char* cursor = file.Data() + sizeof(header);
+	auto read = [&cursor](auto& vector, size_t count) {
+		vector.resize(count);
+		if (count)
+			std::memcpy(vector.data(), cursor, sizeof(vector[0]) * count);
+		cursor += sizeof(vector[0]) * count;
+	};
+	read(mesh.verticies, vertexCount);
+	read(mesh.normals, vertexCount);
+	read(mesh.uvs, header.flags & HasUVs ? vertexCount : 0);
+	read(mesh.tangents, header.flags & HasTangents ? vertexCount : 0);
+	read(mesh.indices, indexCount);
+	std::memcpy(&mesh.boundsMin, header.boundsMin, sizeof(header.boundsMin));
+	std::memcpy(&mesh.boundsMax, header.boundsMax, sizeof(header.boundsMax));
+
+	NGINE_LOG_INFO("Loaded mesh {} {} {} {:.2f}", Field("path", path), Field("verticies", vertexCount), Field("indices", indexCount), Field("ms", timer.Ms()));
+}
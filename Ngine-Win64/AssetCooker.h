@@ -0,0 +1,35 @@
+#pragma once
+#include "Resources.h"
+#include <cstddef>
+
+namespace Ngine {
+
+	struct NAPI CookSettings {
+		bool force = false; //Rebuild everything, ignoring what cook.db says
+	};
+
+	struct NAPI CookStats {
+		size_t assets; //Inputs found
+		size_t cooked, upToDate, failed;
+		size_t removed; //Outputs of inputs that are gone
+		size_t hashedBytes, writtenBytes;
+		double scanMs, hashMs, cookMs, totalMs;
+	};
+
+	//Turns a directory of source assets into runtime formats under an output directory, keeping relative paths:
+	//  .obj  -> .nmesh  welded and indexed, vertex cache and fetch ordered, with normals and tangents
+	//  .bmp  -> .dds    BC1, or BC3 when there is alpha, with the full mip chain
+	//  .glsl -> .glsl   #include "file" resolved, comments and blank lines stripped
+	//  .mtl and .dds are copied as they are
+	//Each output is keyed by the content hash of its input and of everything the input pulls in (mtllib, #include).
+	//Keys are kept in cook.db next to the outputs, so the next run only redoes inputs whose key changed.
+	//Assets cook in parallel on the job system.
+	class NAPI AssetCooker {
+	public:
+		static CookStats Cook(const char* sourceDir, const char* outputDir, const CookSettings& settings = CookSettings());
+
+		//.nmesh, separate attribute streams followed by 32-bit indices
+		static void WriteMesh(const char* path, const Mesh& mesh);
+		static void ReadMesh(const char* path, Mesh& mesh);
+	};
+}
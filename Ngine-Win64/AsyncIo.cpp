@@ -0,0 +1,658 @@
+#include "pch.h"
+#include "AsyncIo.h"
+#include "Log.h"
+#include "Profiler.h"
+#include <spdlog/spdlog.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#if defined _WIN32 || defined _WIN64
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <Windows.h>
+#else
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef __linux__
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#endif
+
+namespace {
+
+	enum class Mode {
+		Blocking,
+		Ring,
+		Threads
+	};
+
+	struct Request {
+		Ngine::IoFile file;
+		uint64_t offset;
+		size_t size, done;
+		char* dst;
+		int bufferIndex; //Registered buffer dst points into, -1 for any other memory
+		Ngine::IoCallback callback;
+		Ngine::JobCounter* counter;
+		std::chrono::steady_clock::time_point start;
+	};
+
+	std::atomic<Mode> mode = Mode::Blocking;
+	Ngine::IoSettings config;
+	std::atomic<uint64_t> reads = 0, bytesRead = 0, failed = 0, inFlight = 0;
+
+	//Buffers for AcquireBuffer, one page aligned block
+	char* pool = nullptr;
+	std::vector<void*> freeBuffers;
+	std::mutex poolMutex;
+	bool poolRegistered = false;
+
+	//Blocking positioned read, the whole range unless the file ends first. Returns 0 or the error.
+#if defined _WIN32 || defined _WIN64
+	//Event the overlapped reads of this thread wait on, closed with the thread
+	struct ReadEvent {
+		HANDLE event = CreateEventA(NULL, TRUE, FALSE, NULL);
+		~ReadEvent() { if (event) CloseHandle(event); }
+	};
+#endif
+
+	int ReadAt(Request& request)
+	{
+#if defined _WIN32 || defined _WIN64
+		thread_local ReadEvent wait;
+		if (!wait.event)
+			return (int)GetLastError();
+#endif
+		while (request.done < request.size) {
+			const uint64_t offset = request.offset + request.done;
+#if defined _WIN32 || defined _WIN64
+			OVERLAPPED overlapped{};
+			overlapped.Offset = (DWORD)offset;
+			overlapped.OffsetHigh = (DWORD)(offset >> 32);
+			overlapped.hEvent = wait.event;
+			DWORD read = 0;
+			DWORD chunk = (DWORD)std::min<size_t>(request.size - request.done, 1u << 30);
+			//The handle is overlapped, the read may finish later even when it could have been done right away
+			if (!ReadFile((HANDLE)request.file.handle, request.dst + request.done, chunk, NULL, &overlapped)) {
+				DWORD error = GetLastError();
+				if (error == ERROR_HANDLE_EOF)
+					return 0;
+				if (error != ERROR_IO_PENDING)
+					return (int)error;
+			}
+			if (!GetOverlappedResult((HANDLE)request.file.handle, &overlapped, &read, TRUE)) {
+				DWORD error = GetLastError();
+				return error == ERROR_HANDLE_EOF ? 0 : (int)error;
+			}
+#else
+			ssize_t read = pread((int)request.file.handle, request.dst + request.done, request.size - request.done, (off_t)offset);
+			if (read < 0) {
+				if (errno == EINTR)
+					continue;
+				return errno;
+			}
+#endif
+			if (read == 0)
+				break;
+			request.done += (size_t)read;
+		}
+		return 0;
+	}
+
+	//Hands the result to the callback as a job, the counter stays raised until that job is done
+	void Complete(Request* request, int error)
+	{
+		Ngine::IoResult result{ request->dst, request->size, request->done, error,
+			std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - request->start).count() };
+
+		reads.fetch_add(1, std::memory_order_relaxed);
+		bytesRead.fetch_add(result.read, std::memory_order_relaxed);
+		if (error)
+			failed.fetch_add(1, std::memory_order_relaxed);
+
+		Ngine::JobCounter* counter = request->counter;
+		if (request->callback)
+			Ngine::Jobs::Run([callback = std::move(request->callback), result]() { callback(result); }, counter);
+		delete request;
+
+		if (counter)
+			counter->value.fetch_sub(1, std::memory_order_acq_rel);
+		inFlight.fetch_sub(1, std::memory_order_acq_rel);
+	}
+
+	//Fallback backend, a few threads blocking in pread or ReadFile
+	namespace Pool {
+		std::vector<std::thread> threads;
+		std::deque<Request*> queue;
+		std::mutex mutex;
+		std::condition_variable signal;
+		bool stopping = false;
+
+		void Work()
+		{
+			while (true) {
+				Request* request;
+				{
+					std::unique_lock<std::mutex> lock(mutex);
+					signal.wait(lock, []() { return stopping || !queue.empty(); });
+					if (queue.empty())
+						return;
+					request = queue.front();
+					queue.pop_front();
+				}
+				Complete(request, ReadAt(*request));
+			}
+		}
+
+		void Start(int count)
+		{
+			stopping = false;
+			for (int i = 0; i < std::max(count, 1); ++i)
+				threads.emplace_back(Work);
+		}
+
+		//Queued reads are still done
+		void Stop()
+		{
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				stopping = true;
+			}
+			signal.notify_all();
+			for (auto& thread : threads)
+				thread.join();
+			threads.clear();
+		}
+
+		void Push(Request* request)
+		{
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				queue.push_back(request);
+			}
+			signal.notify_one();
+		}
+	}
+
+#ifdef __linux__
+	//io_uring through its system calls. Without SQPOLL the kernel only sees queued entries on io_uring_enter,
+	//which Submit makes once for the whole batch. The submission side is serialised by a mutex, the completion
+	//side belongs to the reaper thread alone.
+	namespace Ring {
+		int fd = -1;
+		void* sqMap = nullptr;
+		void* cqMap = nullptr;
+		size_t sqMapSize = 0, cqMapSize = 0, sqesSize = 0;
+		unsigned* sqHead;
+		unsigned* sqTail;
+		unsigned* sqArray;
+		unsigned sqMask, sqEntries;
+		unsigned* cqHead;
+		unsigned* cqTail;
+		unsigned cqMask;
+		io_uring_sqe* sqes;
+		io_uring_cqe* cqes;
+
+		std::mutex mutex;
+		unsigned queued = 0; //Since the last io_uring_enter
+		std::thread reaper;
+		std::atomic<bool> stopping = false;
+		std::atomic<bool> backlog = false; //A Flush was refused, the reaper retries it
+		constexpr uint64_t Wake = 0; //user_data of the NOP Stop sends
+
+		int Setup(unsigned entries, io_uring_params& params) { return (int)syscall(__NR_io_uring_setup, entries, &params); }
+		int Enter(unsigned submit, unsigned wait, unsigned flags) { return (int)syscall(__NR_io_uring_enter, fd, submit, wait, flags, nullptr, 0); }
+		int Register(unsigned opcode, void* arg, unsigned count) { return (int)syscall(__NR_io_uring_register, fd, opcode, arg, count); }
+
+		unsigned Load(unsigned* index) { return std::atomic_ref<unsigned>(*index).load(std::memory_order_acquire); }
+		void Store(unsigned* index, unsigned value) { std::atomic_ref<unsigned>(*index).store(value, std::memory_order_release); }
+
+		void Close()
+		{
+			if (sqes)
+				munmap(sqes, sqesSize);
+			if (cqMap && cqMap != sqMap)
+				munmap(cqMap, cqMapSize);
+			if (sqMap)
+				munmap(sqMap, sqMapSize);
+			if (fd >= 0)
+				close(fd);
+			fd = -1;
+			sqMap = cqMap = nullptr;
+			sqes = nullptr;
+		}
+
+		//Every opcode used here has to be known to the kernel, IORING_OP_READ only exists since 5.6
+		bool Supported()
+		{
+			std::vector<char> storage(sizeof(io_uring_probe) + 256 * sizeof(io_uring_probe_op));
+			auto* probe = (io_uring_probe*)storage.data();
+			if (Register(IORING_REGISTER_PROBE, probe, 256) < 0)
+				return false;
+			for (unsigned op : { IORING_OP_NOP, IORING_OP_READ, IORING_OP_READ_FIXED })
+				if (op > probe->last_op || !(probe->ops[op].flags & IO_URING_OP_SUPPORTED))
+					return false;
+			return true;
+		}
+
+		//False where io_uring is missing, too old or blocked, as it often is in containers
+		bool Open(unsigned entries)
+		{
+			io_uring_params params{};
+			fd = Setup(entries, params);
+			if (fd < 0)
+				return false;
+
+			//Without NODROP completions could be lost when the completion queue overflows
+			if (!(params.features & IORING_FEAT_NODROP) || !Supported()) {
+				Close();
+				return false;
+			}
+
+			sqMapSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+			cqMapSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+			if (params.features & IORING_FEAT_SINGLE_MMAP)
+				sqMapSize = cqMapSize = std::max(sqMapSize, cqMapSize);
+
+			sqMap = mmap(nullptr, sqMapSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+			if (sqMap == MAP_FAILED) {
+				sqMap = nullptr;
+				Close();
+				return false;
+			}
+			cqMap = sqMap;
+			if (!(params.features & IORING_FEAT_SINGLE_MMAP)) {
+				cqMap = mmap(nullptr, cqMapSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+				if (cqMap == MAP_FAILED) {
+					cqMap = nullptr;
+					Close();
+					return false;
+				}
+			}
+			sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+			void* entriesMap = mmap(nullptr, sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+			if (entriesMap == MAP_FAILED) {
+				Close();
+				return false;
+			}
+			sqes = (io_uring_sqe*)entriesMap;
+
+			char* sq = (char*)sqMap;
+			sqHead = (unsigned*)(sq + params.sq_off.head);
+			sqTail = (unsigned*)(sq + params.sq_off.tail);
+			sqArray = (unsigned*)(sq + params.sq_off.array);
+			sqMask = *(unsigned*)(sq + params.sq_off.ring_mask);
+			sqEntries = *(unsigned*)(sq + params.sq_off.ring_entries);
+
+			char* cq = (char*)cqMap;
+			cqHead = (unsigned*)(cq + params.cq_off.head);
+			cqTail = (unsigned*)(cq + params.cq_off.tail);
+			cqMask = *(unsigned*)(cq + params.cq_off.ring_mask);
+			cqes = (io_uring_cqe*)(cq + params.cq_off.cqes);
+			queued = 0;
+			return true;
+		}
+
+		//Caller holds mutex. False when the kernel refused with the completion queue backed up: the entries stay
+		//queued and the reaper submits them once it has made room, nobody spins here holding the mutex.
+		bool Flush()
+		{
+			while (queued > 0) {
+				int submitted = Enter(queued, 0, 0);
+				if (submitted < 0) {
+					if (errno == EINTR)
+						continue;
+					if (errno == EAGAIN || errno == EBUSY) {
+						backlog.store(true, std::memory_order_release);
+						return false;
+					}
+					spdlog::error("io_uring_enter failed with {}", errno);
+					throw Ngine::Exception(__LINE__, __FILE__, "Could not submit reads");
+				}
+				queued -= (unsigned)submitted;
+			}
+			return true;
+		}
+
+		//Caller holds mutex
+		bool Room()
+		{
+			return *sqTail - Load(sqHead) < sqEntries;
+		}
+
+		//Caller holds mutex, which is let go while waiting for the reaper to drain completions
+		void Reserve(std::unique_lock<std::mutex>& lock)
+		{
+			while (!Room() && !Flush()) {
+				lock.unlock();
+				std::this_thread::yield();
+				lock.lock();
+			}
+		}
+
+		//Caller holds mutex and made sure there is room
+		void Push(uint8_t opcode, Request* request)
+		{
+			const unsigned tail = *sqTail;
+			const unsigned index = tail & sqMask;
+			io_uring_sqe& sqe = sqes[index];
+			std::memset(&sqe, 0, sizeof(sqe));
+			sqe.opcode = opcode;
+			sqe.user_data = (uint64_t)(uintptr_t)request;
+			if (request) {
+				sqe.fd = (int)request->file.handle;
+				sqe.off = request->offset + request->done;
+				sqe.addr = (uint64_t)(uintptr_t)(request->dst + request->done);
+				sqe.len = (uint32_t)(request->size - request->done);
+				sqe.buf_index = (uint16_t)std::max(request->bufferIndex, 0);
+			}
+			sqArray[index] = index;
+			Store(sqTail, tail + 1);
+			++queued;
+		}
+
+		void Push(Request* request)
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			Reserve(lock);
+			Push(request->bufferIndex >= 0 ? IORING_OP_READ_FIXED : IORING_OP_READ, request);
+		}
+
+		void Submit()
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			Flush();
+		}
+
+		//True when a read came back short before the end of the file and has to go back for the rest
+		bool Finish(Request* request, int result)
+		{
+			if (result < 0) {
+				Complete(request, -result);
+				return false;
+			}
+			request->done += (size_t)result;
+			if (result == 0 || request->done == request->size) {
+				Complete(request, 0);
+				return false;
+			}
+			return true;
+		}
+
+		//Short reads go back into the ring, only after the completions before them were handed back to the kernel.
+		//What doesn't fit waits for the next pass, the reaper never waits for room it alone can make.
+		//False when entries are still waiting for the kernel.
+		bool Resubmit(std::vector<Request*>& pending)
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			size_t pushed = 0;
+			while (pushed < pending.size() && (Room() || (Flush() && Room()))) {
+				Request* request = pending[pushed++];
+				Push(request->bufferIndex >= 0 ? IORING_OP_READ_FIXED : IORING_OP_READ, request);
+			}
+			pending.erase(pending.begin(), pending.begin() + pushed);
+			return Flush() && pending.empty();
+		}
+
+		void Reap()
+		{
+			NGINE_LOG_INFO("I/O reaper started");
+			std::vector<Request*> pending;
+			while (true) {
+				unsigned head = *cqHead;
+				const unsigned tail = Load(cqTail);
+				if (head == tail) {
+					//Entries a submitter couldn't get in, there is room now that the queue is drained
+					if ((backlog.exchange(false, std::memory_order_acq_rel) || !pending.empty()) && !Resubmit(pending)) {
+						std::this_thread::yield();
+						continue;
+					}
+					if (stopping.load(std::memory_order_acquire) && inFlight.load(std::memory_order_acquire) == 0)
+						break;
+					if (Enter(0, 1, IORING_ENTER_GETEVENTS) < 0 && errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+						spdlog::error("io_uring_enter failed with {} waiting for completions", errno);
+						break;
+					}
+					continue;
+				}
+
+				for (; head != tail; ++head) {
+					const io_uring_cqe& cqe = cqes[head & cqMask];
+					if (cqe.user_data != Wake && Finish((Request*)(uintptr_t)cqe.user_data, cqe.res))
+						pending.push_back((Request*)(uintptr_t)cqe.user_data);
+				}
+				Store(cqHead, head);
+
+				if (!pending.empty())
+					Resubmit(pending);
+			}
+		}
+
+		void Start()
+		{
+			stopping = false;
+			backlog = false;
+			reaper = std::thread(Reap);
+		}
+
+		//Reads in flight are still completed, the NOP wakes the reaper when there are none
+		void Stop()
+		{
+			stopping.store(true, std::memory_order_release);
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				Reserve(lock);
+				Push(IORING_OP_NOP, nullptr);
+				Flush();
+			}
+			reaper.join();
+			if (poolRegistered)
+				Register(IORING_UNREGISTER_BUFFERS, nullptr, 0);
+			Close();
+		}
+
+		//Pins the pool once, READ_FIXED then skips mapping the pages on every read.
+		//Fails when the pool is above RLIMIT_MEMLOCK, reads into it then go the usual way.
+		bool RegisterPool(size_t buffers, size_t size)
+		{
+			std::vector<iovec> vectors(buffers);
+			for (size_t i = 0; i < buffers; ++i)
+				vectors[i] = { pool + i * size, size };
+			return Register(IORING_REGISTER_BUFFERS, vectors.data(), (unsigned)buffers) == 0;
+		}
+	}
+#endif
+
+	void CreatePool(size_t buffers, size_t size)
+	{
+		if (buffers == 0 || size == 0)
+			return;
+		pool = (char*)::operator new(buffers * size, std::align_val_t(4096));
+		freeBuffers.reserve(buffers);
+		for (size_t i = buffers; i-- > 0;)
+			freeBuffers.push_back(pool + i * size);
+	}
+
+	void DestroyPool()
+	{
+		if (pool)
+			::operator delete(pool, std::align_val_t(4096));
+		pool = nullptr;
+		freeBuffers.clear();
+		poolRegistered = false;
+	}
+}
+
+void Ngine::AsyncIo::Initialize(const IoSettings& settings)
+{
+	if (mode.load() != Mode::Blocking) {
+		spdlog::error("Async I/O is already initialized");
+		throw Ngine::Exception(__LINE__, __FILE__, "Async I/O initialized twice");
+	}
+
+	config = settings;
+	config.queueDepth = std::clamp(config.queueDepth, 1u, 4096u);
+	config.bufferSize = (config.bufferSize + 4095) & ~(size_t)4095;
+	reads = bytesRead = failed = inFlight = 0;
+	CreatePool(config.buffers, config.bufferSize);
+
+	Mode chosen = Mode::Threads;
+#ifdef __linux__
+	if (!config.forceThreads && Ring::Open(config.queueDepth)) {
+		poolRegistered = pool && Ring::RegisterPool(config.buffers, config.bufferSize);
+		if (pool && !poolRegistered)
+			NGINE_LOG_WARN("Could not register I/O buffers {} {}", Field("bytes", config.buffers * config.bufferSize), Field("errno", errno));
+		Ring::Start();
+		chosen = Mode::Ring;
+	}
+#endif
+	if (chosen == Mode::Threads)
+		Pool::Start(config.threads);
+
+	mode.store(chosen, std::memory_order_release);
+	NGINE_LOG_INFO("Async I/O initialized {} {} {}", Field("backend", Backend()), Field("queueDepth", config.queueDepth), Field("registered", poolRegistered));
+}
+
+void Ngine::AsyncIo::Shutdown()
+{
+	const Mode current = mode.exchange(Mode::Blocking);
+#ifdef __linux__
+	if (current == Mode::Ring)
+		Ring::Stop();
+#endif
+	if (current == Mode::Threads)
+		Pool::Stop();
+	DestroyPool();
+}
+
+bool Ngine::AsyncIo::Running() noexcept
+{
+	return mode.load(std::memory_order_acquire) != Mode::Blocking;
+}
+
+const char* Ngine::AsyncIo::Backend() noexcept
+{
+	switch (mode.load(std::memory_order_acquire)) {
+	case Mode::Ring: return "io_uring";
+	case Mode::Threads: return "threads";
+	default: return "blocking";
+	}
+}
+
+Ngine::IoFile Ngine::AsyncIo::Open(const char* path)
+{
+	IoFile file;
+#if defined _WIN32 || defined _WIN64
+	HANDLE handle = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_RANDOM_ACCESS | FILE_FLAG_OVERLAPPED, NULL);
+	if (handle == INVALID_HANDLE_VALUE) {
+		spdlog::error("Could not open {}", path);
+		throw Ngine::Exception(__LINE__, __FILE__, "Could not open file");
+	}
+	LARGE_INTEGER size;
+	GetFileSizeEx(handle, &size);
+	file.handle = (intptr_t)handle;
+	file.size = (uint64_t)size.QuadPart;
+#else
+	int fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0) {
+		spdlog::error("Could not open {}", path);
+		throw Ngine::Exception(__LINE__, __FILE__, "Could not open file");
+	}
+	struct stat st;
+	fstat(fd, &st);
+	file.handle = fd;
+	file.size = (uint64_t)st.st_size;
+#endif
+	return file;
+}
+
+void Ngine::AsyncIo::Close(IoFile& file)
+{
+	if (!file.Valid())
+		return;
+#if defined _WIN32 || defined _WIN64
+	CloseHandle((HANDLE)file.handle);
+#else
+	close((int)file.handle);
+#endif
+	file = IoFile();
+}
+
+void Ngine::AsyncIo::Read(const IoFile& file, uint64_t offset, size_t size, void* dst, IoCallback callback, JobCounter* counter)
+{
+	auto* request = new Request{ file, offset, size, 0, (char*)dst, -1, std::move(callback), counter, std::chrono::steady_clock::now() };
+	if (poolRegistered && request->dst >= pool && request->dst + size <= pool + config.buffers * config.bufferSize) {
+		const size_t index = (size_t)(request->dst - pool) / config.bufferSize;
+		if (request->dst + size <= pool + (index + 1) * config.bufferSize)
+			request->bufferIndex = (int)index;
+	}
+
+	if (counter)
+		counter->value.fetch_add(1, std::memory_order_relaxed);
+	inFlight.fetch_add(1, std::memory_order_relaxed);
+
+	switch (mode.load(std::memory_order_acquire)) {
+#ifdef __linux__
+	case Mode::Ring:
+		Ring::Push(request);
+		break;
+#endif
+	case Mode::Threads:
+		Pool::Push(request);
+		break;
+	default:
+		Complete(request, ReadAt(*request));
+		break;
+	}
+}
+
+void Ngine::AsyncIo::Submit()
+{
+#ifdef __linux__
+	if (mode.load(std::memory_order_acquire) == Mode::Ring) {
+		NGINE_ZONE("AsyncIo::Submit");
+		Ring::Submit();
+	}
+#endif
+}
+
+void* Ngine::AsyncIo::AcquireBuffer() noexcept
+{
+	std::lock_guard<std::mutex> lock(poolMutex);
+	if (freeBuffers.empty())
+		return nullptr;
+	void* buffer = freeBuffers.back();
+	freeBuffers.pop_back();
+	return buffer;
+}
+
+void Ngine::AsyncIo::ReleaseBuffer(void* buffer) noexcept
+{
+	if (!buffer)
+		return;
+	std::lock_guard<std::mutex> lock(poolMutex);
+	freeBuffers.push_back(buffer);
+}
+
+size_t Ngine::AsyncIo::BufferSize() noexcept
+{
+	return pool ? config.bufferSize : 0;
+}
+
+Ngine::IoStats Ngine::AsyncIo::Stats() noexcept
+{
+	return { reads.load(std::memory_order_relaxed), bytesRead.load(std::memory_order_relaxed), failed.load(std::memory_order_relaxed), inFlight.load(std::memory_order_relaxed) };
+}
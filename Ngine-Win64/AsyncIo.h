@@ -0,0 +1,80 @@
+#pragma once
+#include "Jobs.h"
+#include <cstdint>
+#include <functional>
+
+namespace Ngine {
+
+	//Open file for positioned reads, an fd on POSIX and an overlapped HANDLE on Windows
+	struct NAPI IoFile {
+		intptr_t handle = -1;
+		uint64_t size = 0;
+
+		bool Valid() const noexcept { return handle != -1; }
+	};
+
+	//Handed to the callback of a read
+	struct NAPI IoResult {
+		void* buffer;
+		size_t requested, read; //read is short only at end of file or on error
+		int error; //0, errno or GetLastError
+		double ms; //From Read to completion, before the callback was scheduled
+	};
+
+	using IoCallback = std::function<void(const IoResult& result)>;
+
+	struct NAPI IoSettings {
+		unsigned int queueDepth = 128; //Submission queue entries, a full queue is submitted on its own
+		size_t buffers = 32; //Registered buffers of bufferSize bytes, handed out by AcquireBuffer
+		size_t bufferSize = 256 * 1024;
+		int threads = 4; //Of the fallback pool
+		bool forceThreads = false; //Skip io_uring even where it is available
+	};
+
+	//Totals since Initialize
+	struct NAPI IoStats {
+		uint64_t reads, bytes, failed;
+		uint64_t inFlight;
+	};
+
+	//Asynchronous positioned reads for streaming. On Linux they go through io_uring: reads are queued into the
+	//submission ring and sent to the kernel in one batch by Submit, a reaper thread collects completions.
+	//Elsewhere, or where io_uring is missing or blocked, a small thread pool calls pread or ReadFile.
+	//Callbacks run as jobs, with 0 job workers on the thread that completed the read.
+	class NAPI AsyncIo {
+	public:
+		static void Initialize(const IoSettings& settings = IoSettings());
+		//Waits for every read in flight and their callbacks to be scheduled
+		static void Shutdown();
+		static bool Running() noexcept;
+		//"io_uring", "threads", or "blocking" before Initialize, when reads complete on the calling thread
+		static const char* Backend() noexcept;
+
+		//Throws when the file can't be opened
+		static IoFile Open(const char* path);
+		//Only after its reads have completed, a queued read would find the handle closed or reused
+		static void Close(IoFile& file);
+
+		//Reads size bytes at offset into dst. Counter, when given, is counted until the callback has run.
+		//With io_uring the read waits in the queue until Submit.
+		static void Read(const IoFile& file, uint64_t offset, size_t size, void* dst, IoCallback callback, JobCounter* counter = nullptr);
+		static void Submit();
+
+		//Buffer of BufferSize bytes registered with the kernel, reads into it skip pinning pages every time.
+		//nullptr when all are in use.
+		static void* AcquireBuffer() noexcept;
+		static void ReleaseBuffer(void* buffer) noexcept;
+		static size_t BufferSize() noexcept;
+
+		static IoStats Stats() noexcept;
+	};
+
+	//Keeps the I/O backend running for the lifetime of a scope, after the JobScope it calls back into
+	struct NAPI IoScope {
+		explicit IoScope(const IoSettings& settings = IoSettings()) { AsyncIo::Initialize(settings); }
+		~IoScope() { AsyncIo::Shutdown(); }
+
+		IoScope(const IoScope&) = delete;
+		IoScope& operator=(const IoScope&) = delete;
+	};
+}
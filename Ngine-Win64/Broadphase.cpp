@@ -0,0 +1,223 @@
+#include "pch.h"
+#include "Broadphase.h"
+#include "Jobs.h"
+#include "Profiler.h"
+#include <algorithm>
+#include <iterator>
+#include <limits>
+
+#if defined(_M_X64) || defined(__SSE2__)
+#include <emmintrin.h>
+#define NGINE_SSE2
+#endif
+
+namespace {
+
+	constexpr size_t Padding = 4; //One SSE load past the last body
+	constexpr size_t InsertionLimit = 64; //More new bodies than this and a full sort is cheaper
+	constexpr size_t ParallelBodies = 4096;
+	constexpr size_t Grain = 1024;
+
+	Ngine::BodyPair MakePair(Ngine::BodyId a, Ngine::BodyId b)
+	{
+		return a < b ? Ngine::BodyPair{ a, b } : Ngine::BodyPair{ b, a };
+	}
+}
+
+Ngine::BodyId Ngine::Broadphase::Add(const glm::vec3& min, const glm::vec3& max)
+{
+	BodyId id;
+	if (!m_Free.empty()) {
+		id = m_Free.back();
+		m_Free.pop_back();
+	}
+	else {
+		id = (BodyId)m_Bodies.size();
+		m_Bodies.emplace_back();
+	}
+
+	m_Bodies[id] = Body{ min, max, true };
+	m_New.push_back(id);
+	++m_Alive;
+	return id;
+}
+
+Ngine::BodyId Ngine::Broadphase::Add(const Object& obj)
+{
+	return Add(obj.boundsMin + obj.position, obj.boundsMax + obj.position);
+}
+
+void Ngine::Broadphase::Move(BodyId id, const glm::vec3& min, const glm::vec3& max)
+{
+	if (id < m_Bodies.size() && m_Bodies[id].alive) {
+		m_Bodies[id].min = min;
+		m_Bodies[id].max = max;
+	}
+}
+
+void Ngine::Broadphase::Move(BodyId id, const Object& obj)
+{
+	Move(id, obj.boundsMin + obj.position, obj.boundsMax + obj.position);
+}
+
+void Ngine::Broadphase::Remove(BodyId id)
+{
+	if (id >= m_Bodies.size() || !m_Bodies[id].alive)
+		return;
+
+	m_Bodies[id].alive = false;
+	m_Dead.push_back(id);
+	m_Compact = true;
+	--m_Alive;
+}
+
+void Ngine::Broadphase::Sort()
+{
+	NGINE_ZONE("Broadphase::Sort");
+
+	if (m_Compact) {
+		m_Order.erase(std::remove_if(m_Order.begin(), m_Order.end(), [this](BodyId id) { return !m_Bodies[id].alive; }), m_Order.end());
+		m_Compact = false;
+	}
+
+	//Added and removed again before this Update
+	size_t added = 0;
+	for (BodyId id : m_New) {
+		if (m_Bodies[id].alive) {
+			m_Order.push_back(id);
+			++added;
+		}
+	}
+	m_New.clear();
+
+	const size_t n = m_Order.size();
+	m_Swaps = 0;
+	if (added > InsertionLimit) {
+		std::sort(m_Order.begin(), m_Order.end(), [this](BodyId a, BodyId b) { return m_Bodies[a].min.x < m_Bodies[b].min.x; });
+		m_Swaps = n;
+	}
+	else {
+		//Keys copied out so the sort walks one array instead of hopping through bodies
+		m_MinX.resize(n);
+		for (size_t i = 0; i < n; ++i)
+			m_MinX[i] = m_Bodies[m_Order[i]].min.x;
+
+		for (size_t i = 1; i < n; ++i) {
+			float key = m_MinX[i];
+			BodyId id = m_Order[i];
+			size_t j = i;
+			while (j > 0 && m_MinX[j - 1] > key) {
+				m_MinX[j] = m_MinX[j - 1];
+				m_Order[j] = m_Order[j - 1];
+				--j;
+			}
+			m_MinX[j] = key;
+			m_Order[j] = id;
+			m_Swaps += i - j;
+		}
+	}
+
+	m_MinX.resize(n + Padding);
+	m_MaxX.resize(n + Padding);
+	m_MinY.resize(n + Padding);
+	m_MaxY.resize(n + Padding);
+	m_MinZ.resize(n + Padding);
+	m_MaxZ.resize(n + Padding);
+	for (size_t i = 0; i < n; ++i) {
+		const Body& b = m_Bodies[m_Order[i]];
+		m_MinX[i] = b.min.x;
+		m_MaxX[i] = b.max.x;
+		m_MinY[i] = b.min.y;
+		m_MaxY[i] = b.max.y;
+		m_MinZ[i] = b.min.z;
+		m_MaxZ[i] = b.max.z;
+	}
+
+	//Padding starts past everything, so the sweep stops there without a bounds check
+	for (size_t i = n; i < n + Padding; ++i) {
+		m_MinX[i] = m_MinY[i] = m_MinZ[i] = std::numeric_limits<float>::max();
+		m_MaxX[i] = m_MaxY[i] = m_MaxZ[i] = -std::numeric_limits<float>::max();
+	}
+}
+
+void Ngine::Broadphase::Sweep(size_t first, size_t last, std::vector<BodyPair>& out) const
+{
+	for (size_t i = first; i < last; ++i) {
+		const BodyId a = m_Order[i];
+		size_t j = i + 1;
+#ifdef NGINE_SSE2
+		const __m128 maxX = _mm_set1_ps(m_MaxX[i]);
+		const __m128 minY = _mm_set1_ps(m_MinY[i]), maxY = _mm_set1_ps(m_MaxY[i]);
+		const __m128 minZ = _mm_set1_ps(m_MinZ[i]), maxZ = _mm_set1_ps(m_MaxZ[i]);
+		while (true) {
+			__m128 inX = _mm_cmple_ps(_mm_loadu_ps(&m_MinX[j]), maxX);
+			int x = _mm_movemask_ps(inX);
+			if (!x)
+				break;
+
+			__m128 y = _mm_and_ps(_mm_cmple_ps(_mm_loadu_ps(&m_MinY[j]), maxY), _mm_cmpge_ps(_mm_loadu_ps(&m_MaxY[j]), minY));
+			__m128 z = _mm_and_ps(_mm_cmple_ps(_mm_loadu_ps(&m_MinZ[j]), maxZ), _mm_cmpge_ps(_mm_loadu_ps(&m_MaxZ[j]), minZ));
+			int overlap = _mm_movemask_ps(_mm_and_ps(inX, _mm_and_ps(y, z)));
+			for (int lane = 0; overlap; ++lane, overlap >>= 1)
+				if (overlap & 1)
+					out.push_back(MakePair(a, m_Order[j + lane]));
+
+			//Sorted by min.x, the first body starting past this one ends the sweep
+			if (x != 0xF)
+				break;
+			j += 4;
+		}
+#else
+		const Body& body = m_Bodies[a];
+		for (; m_MinX[j] <= body.max.x; ++j) {
+			if (m_MinY[j] <= body.max.y && m_MaxY[j] >= body.min.y && m_MinZ[j] <= body.max.z && m_MaxZ[j] >= body.min.z)
+				out.push_back(MakePair(a, m_Order[j]));
+		}
+#endif
+	}
+}
+
+void Ngine::Broadphase::Update()
+{
+	NGINE_ZONE("Broadphase::Update");
+
+	Sort();
+
+	m_Previous.swap(m_Pairs);
+	m_Pairs.clear();
+
+	const size_t n = m_Order.size();
+	if (n < ParallelBodies || Jobs::SingleThreaded()) {
+		Sweep(0, n, m_Pairs);
+	}
+	else {
+		//One list per thread, nothing shared while sweeping. Slot 0 is for a caller outside the pool (index -1),
+		//the thread that started the job system has its own.
+		m_ThreadPairs.resize(Jobs::Workers() + 2);
+		for (auto& pairs : m_ThreadPairs)
+			pairs.clear();
+		Jobs::ParallelFor(0, n, Grain, [this](size_t first, size_t last) {
+			Sweep(first, last, m_ThreadPairs[Jobs::ThreadIndex() + 1]);
+			});
+		for (const auto& pairs : m_ThreadPairs)
+			m_Pairs.insert(m_Pairs.end(), pairs.begin(), pairs.end());
+	}
+
+	{
+		NGINE_ZONE("Broadphase::Diff");
+		std::sort(m_Pairs.begin(), m_Pairs.end());
+		m_Added.clear();
+		m_Removed.clear();
+		std::set_difference(m_Pairs.begin(), m_Pairs.end(), m_Previous.begin(), m_Previous.end(), std::back_inserter(m_Added));
+		std::set_difference(m_Previous.begin(), m_Previous.end(), m_Pairs.begin(), m_Pairs.end(), std::back_inserter(m_Removed));
+	}
+
+	//Removed pairs of dead bodies were just reported, their ids are free now
+	m_Free.insert(m_Free.end(), m_Dead.begin(), m_Dead.end());
+	m_Dead.clear();
+}
+
+Ngine::Broadphase::Stats Ngine::Broadphase::GetStats() const noexcept
+{
+	return Stats{ m_Alive, m_Pairs.size(), m_Added.size(), m_Removed.size(), m_Swaps };
+}
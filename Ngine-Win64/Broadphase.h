@@ -0,0 +1,72 @@
+#pragma once
+#include "Gfx.h"
+#include <cstdint>
+#include <vector>
+
+namespace Ngine {
+
+	using BodyId = uint32_t;
+
+	//Lower id first, pairs come out sorted by (a, b)
+	struct NAPI BodyPair {
+		BodyId a, b;
+
+		bool operator==(const BodyPair& other) const noexcept { return a == other.a && b == other.b; }
+		bool operator<(const BodyPair& other) const noexcept { return a < other.a || (a == other.a && b < other.b); }
+	};
+
+	//Sweep and prune over world space boxes. Bodies stay sorted along X between updates, so a tick
+	//where things moved a little costs an insertion sort pass plus the sweep.
+	//Add, Move and Remove only record changes, Update applies them and works out the pairs.
+	class NAPI Broadphase {
+	public:
+		struct Stats {
+			size_t bodies;
+			size_t pairs;
+			size_t added, removed; //Pair events of the last Update
+			size_t swaps; //Moves made by the sort, grows when bodies overtake each other
+		};
+
+		BodyId Add(const glm::vec3& min, const glm::vec3& max);
+		//Bounds of obj at its current position, from UpdateBounds
+		BodyId Add(const Object& obj);
+		void Move(BodyId id, const glm::vec3& min, const glm::vec3& max);
+		void Move(BodyId id, const Object& obj);
+		//Pairs of the body are reported as removed by the next Update, its id is reused after that
+		void Remove(BodyId id);
+
+		//Once per tick, big sets sweep on the job system
+		void Update();
+
+		//All overlapping pairs as of the last Update
+		const std::vector<BodyPair>& Pairs() const noexcept { return m_Pairs; }
+		//Pairs that started or stopped overlapping in the last Update
+		const std::vector<BodyPair>& Added() const noexcept { return m_Added; }
+		const std::vector<BodyPair>& Removed() const noexcept { return m_Removed; }
+
+		size_t Bodies() const noexcept { return m_Alive; }
+		Stats GetStats() const noexcept;
+
+	private:
+		struct Body {
+			glm::vec3 min, max;
+			bool alive = false;
+		};
+
+		void Sort();
+		void Sweep(size_t first, size_t last, std::vector<BodyPair>& out) const;
+
+		std::vector<Body> m_Bodies; //By id
+		std::vector<BodyId> m_Order; //Alive bodies by min.x as of the last Update
+		std::vector<BodyId> m_New; //Added since
+		std::vector<BodyId> m_Free, m_Dead; //Dead ids become free after the Update that reported their pairs
+		bool m_Compact = false; //Order still holds removed bodies
+
+		//Sorted copy of the bounds, structure of arrays for the sweep, padded past the end
+		std::vector<float> m_MinX, m_MaxX, m_MinY, m_MaxY, m_MinZ, m_MaxZ;
+
+		std::vector<BodyPair> m_Pairs, m_Previous, m_Added, m_Removed;
+		std::vector<std::vector<BodyPair>> m_ThreadPairs;
+		size_t m_Alive = 0, m_Swaps = 0;
+	};
+}
@@ -0,0 +1,482 @@
+#include "pch.h"
+#include "Bvh.h"
+#include "Jobs.h"
+#include "Log.h"
+#include "Profiler.h"
+#include <algorithm>
+#include <cmath>
+
+#if defined(_M_X64) || defined(__SSE2__)
+#include <emmintrin.h>
+#define NGINE_SSE2
+#endif
+
+namespace {
+
+	constexpr int Bins = 16;
+	constexpr uint32_t MaxLeaf = 8; //Larger ranges are split even when SAH says a leaf is cheaper
+	constexpr uint32_t MaxSahDepth = 28; //Deeper ranges are halved at the median, at most 32 more levels for 2^32 triangles
+	constexpr int StackSize = 64; //Traversal never holds more than one entry per level plus one
+	static_assert(MaxSahDepth + 32 + 1 <= StackSize, "Traversal stack can't hold the deepest tree");
+	constexpr size_t ParallelRays = 1024; //Smaller batches aren't worth waking workers for
+	constexpr float Epsilon = 1e-9f;
+
+	struct Box {
+		glm::vec3 min = glm::vec3(std::numeric_limits<float>::max());
+		glm::vec3 max = glm::vec3(-std::numeric_limits<float>::max());
+
+		void Grow(const glm::vec3& p)
+		{
+			min = glm::min(min, p);
+			max = glm::max(max, p);
+		}
+
+		void Grow(const Box& b)
+		{
+			min = glm::min(min, b.min);
+			max = glm::max(max, b.max);
+		}
+
+		float Area() const
+		{
+			glm::vec3 e = max - min;
+			return e.x < 0.0f ? 0.0f : e.x * e.y + e.y * e.z + e.z * e.x;
+		}
+	};
+
+	//1/d without infinities, so 0 * inf can't turn a slab test into NaN
+	float SafeInverse(float d)
+	{
+		return 1.0f / (std::fabs(d) > 1e-20f ? d : std::copysign(1e-20f, d));
+	}
+
+	glm::vec3 SafeInverse(const glm::vec3& d)
+	{
+		return glm::vec3(SafeInverse(d.x), SafeInverse(d.y), SafeInverse(d.z));
+	}
+
+	//Entry distance or max float when the ray misses the box before limit
+	float Slab(const glm::vec3& min, const glm::vec3& max, const glm::vec3& origin, const glm::vec3& inverse, float limit)
+	{
+		float tx1 = (min.x - origin.x) * inverse.x, tx2 = (max.x - origin.x) * inverse.x;
+		float ty1 = (min.y - origin.y) * inverse.y, ty2 = (max.y - origin.y) * inverse.y;
+		float tz1 = (min.z - origin.z) * inverse.z, tz2 = (max.z - origin.z) * inverse.z;
+		float enter = std::max(std::max(std::min(tx1, tx2), std::min(ty1, ty2)), std::max(std::min(tz1, tz2), 0.0f));
+		float exit = std::min(std::min(std::max(tx1, tx2), std::max(ty1, ty2)), std::min(std::max(tz1, tz2), limit));
+		return enter <= exit ? enter : std::numeric_limits<float>::max();
+	}
+}
+
+namespace Ngine {
+
+	//Binned SAH over triangle centroids, writes nodes in depth first order
+	struct BvhBuilder {
+		struct Ref {
+			Box bounds;
+			glm::vec3 centre;
+		};
+
+		std::vector<Ref> refs;
+		std::vector<uint32_t> indices;
+		std::vector<Bvh::Node>& nodes;
+
+		explicit BvhBuilder(std::vector<Bvh::Node>& nodes) : nodes(nodes) {}
+
+		void Subdivide(uint32_t index, uint32_t first, uint32_t count, uint32_t depth)
+		{
+			Box bounds, centres;
+			for (uint32_t i = first; i < first + count; ++i) {
+				bounds.Grow(refs[indices[i]].bounds);
+				centres.Grow(refs[indices[i]].centre);
+			}
+			nodes[index].min = bounds.min;
+			nodes[index].max = bounds.max;
+
+			//Degenerate input can make SAH peel off a few triangles per level, past the limit halve instead
+			if (depth >= MaxSahDepth) {
+				if (count <= MaxLeaf) {
+					Leaf(index, first, count);
+					return;
+				}
+				glm::vec3 extent = centres.max - centres.min;
+				int axis = extent.x >= extent.y && extent.x >= extent.z ? 0 : extent.y >= extent.z ? 1 : 2;
+				std::nth_element(indices.begin() + first, indices.begin() + first + count / 2, indices.begin() + first + count, [&](uint32_t a, uint32_t b) {
+					return refs[a].centre[axis] < refs[b].centre[axis];
+					});
+				Split(index, first, count / 2, count, axis, depth);
+				return;
+			}
+
+			//Cost of a traversal step against one triangle test, both taken as 1
+			float leafCost = (float)count;
+			float bestCost = std::numeric_limits<float>::max();
+			int bestAxis = -1, bestSplit = 0;
+
+			for (int axis = 0; axis < 3 && count > 2; ++axis) {
+				float lo = centres.min[axis], extent = centres.max[axis] - lo;
+				if (extent <= 0.0f)
+					continue;
+
+				Box binBounds[Bins];
+				uint32_t binCount[Bins] = {};
+				float scale = Bins / extent;
+				for (uint32_t i = first; i < first + count; ++i) {
+					const Ref& r = refs[indices[i]];
+					int b = std::min(Bins - 1, (int)((r.centre[axis] - lo) * scale));
+					binBounds[b].Grow(r.bounds);
+					++binCount[b];
+				}
+
+				//Sweep from the right first, then evaluate every plane from the left
+				float rightArea[Bins - 1];
+				uint32_t rightCount[Bins - 1];
+				Box box;
+				uint32_t n = 0;
+				for (int b = Bins - 1; b > 0; --b) {
+					box.Grow(binBounds[b]);
+					n += binCount[b];
+					rightArea[b - 1] = box.Area();
+					rightCount[b - 1] = n;
+				}
+
+				box = Box();
+				n = 0;
+				for (int b = 0; b < Bins - 1; ++b) {
+					box.Grow(binBounds[b]);
+					n += binCount[b];
+					if (n == 0 || rightCount[b] == 0)
+						continue;
+					float cost = 1.0f + (n * box.Area() + rightCount[b] * rightArea[b]) / std::max(bounds.Area(), Epsilon);
+					if (cost < bestCost) {
+						bestCost = cost;
+						bestAxis = axis;
+						bestSplit = b;
+					}
+				}
+			}
+
+			if (bestAxis < 0 || (bestCost >= leafCost && count <= MaxLeaf)) {
+				//More than a leaf can count only comes from that many identical centroids, halved without SAH
+				if (count > UINT16_MAX) {
+					Split(index, first, count / 2, count, 0, depth);
+					return;
+				}
+				Leaf(index, first, count);
+				return;
+			}
+
+			float lo = centres.min[bestAxis], scale = Bins / (centres.max[bestAxis] - lo);
+			auto middle = std::partition(indices.begin() + first, indices.begin() + first + count, [&](uint32_t i) {
+				return std::min(Bins - 1, (int)((refs[i].centre[bestAxis] - lo) * scale)) <= bestSplit;
+				});
+			Split(index, first, (uint32_t)(middle - indices.begin()) - first, count, bestAxis, depth);
+		}
+
+		void Leaf(uint32_t index, uint32_t first, uint32_t count)
+		{
+			nodes[index].first = first;
+			nodes[index].count = (uint16_t)count;
+			nodes[index].axis = 0;
+		}
+
+		void Split(uint32_t index, uint32_t first, uint32_t leftCount, uint32_t count, int axis, uint32_t depth)
+		{
+			nodes[index].count = 0;
+			nodes[index].axis = (uint16_t)axis;
+
+			uint32_t left = (uint32_t)nodes.size();
+			nodes.emplace_back();
+			Subdivide(left, first, leftCount, depth + 1);
+
+			uint32_t right = (uint32_t)nodes.size();
+			nodes.emplace_back();
+			nodes[index].first = right;
+			Subdivide(right, first + leftCount, count - leftCount, depth + 1);
+		}
+	};
+}
+
+void Ngine::Bvh::Build(const std::vector<glm::vec3>& verticies)
+{
+	NGINE_ZONE("Bvh::Build");
+	LogTimer timer;
+
+	m_Nodes.clear();
+	m_Triangles.clear();
+	m_Ids.clear();
+
+	uint32_t count = (uint32_t)(verticies.size() / 3);
+	if (count == 0)
+		return;
+
+	BvhBuilder builder(m_Nodes);
+	builder.refs.resize(count);
+	builder.indices.resize(count);
+	for (uint32_t i = 0; i < count; ++i) {
+		BvhBuilder::Ref& r = builder.refs[i];
+		for (int k = 0; k < 3; ++k)
+			r.bounds.Grow(verticies[i * 3 + k]);
+		r.centre = (r.bounds.min + r.bounds.max) * 0.5f;
+		builder.indices[i] = i;
+	}
+
+	//A binary tree with leaves of at least one triangle never needs more
+	m_Nodes.reserve(count * 2);
+	m_Nodes.emplace_back();
+	builder.Subdivide(0, 0, count, 0);
+	m_Nodes.shrink_to_fit();
+
+	m_Triangles.resize(count);
+	m_Ids = std::move(builder.indices);
+	for (uint32_t i = 0; i < count; ++i) {
+		const glm::vec3* v = &verticies[m_Ids[i] * 3];
+		m_Triangles[i] = { v[0], v[1] - v[0], v[2] - v[0] };
+	}
+
+	NGINE_LOG_INFO("Built BVH {} {} {:.2f}", Field("triangles", count), Field("nodes", m_Nodes.size()), Field("ms", timer.Ms()));
+}
+
+size_t Ngine::Bvh::Bytes() const noexcept
+{
+	return m_Nodes.capacity() * sizeof(Node) + m_Triangles.capacity() * sizeof(Triangle) + m_Ids.capacity() * sizeof(uint32_t);
+}
+
+Ngine::RayHit Ngine::Bvh::Cast(const Ray& ray, RayQuery query) const
+{
+	RayHit hit;
+	if (m_Nodes.empty())
+		return hit;
+
+	const glm::vec3 inverse = SafeInverse(ray.direction);
+	float closest = ray.maxDistance;
+	uint32_t found = UINT32_MAX;
+
+	if (Slab(m_Nodes[0].min, m_Nodes[0].max, ray.origin, inverse, closest) == std::numeric_limits<float>::max())
+		return hit;
+
+	uint32_t stack[StackSize];
+	int depth = 0;
+	uint32_t index = 0;
+	while (true) {
+		const Node& node = m_Nodes[index];
+		if (node.count > 0) {
+			for (uint32_t i = node.first; i < node.first + node.count; ++i) {
+				const Triangle& tri = m_Triangles[i];
+				glm::vec3 p = glm::cross(ray.direction, tri.e2);
+				float det = glm::dot(tri.e1, p);
+				if (std::fabs(det) < Epsilon)
+					continue;
+				float inv = 1.0f / det;
+				glm::vec3 s = ray.origin - tri.v0;
+				float u = glm::dot(s, p) * inv;
+				if (u < 0.0f || u > 1.0f)
+					continue;
+				glm::vec3 q = glm::cross(s, tri.e1);
+				float v = glm::dot(ray.direction, q) * inv;
+				if (v < 0.0f || u + v > 1.0f)
+					continue;
+				float t = glm::dot(tri.e2, q) * inv;
+				if (t < 0.0f || t >= closest)
+					continue;
+
+				closest = t;
+				found = i;
+				hit.u = u;
+				hit.v = v;
+				if (query == RayQuery::Any)
+					break;
+			}
+
+			if ((query == RayQuery::Any && found != UINT32_MAX) || depth == 0)
+				break;
+			index = stack[--depth];
+			continue;
+		}
+
+		//Nearer child first, the farther one is often culled by the hit found in it
+		uint32_t nearChild = index + 1, farChild = node.first;
+		if (ray.direction[node.axis] < 0.0f)
+			std::swap(nearChild, farChild);
+
+		float tNear = Slab(m_Nodes[nearChild].min, m_Nodes[nearChild].max, ray.origin, inverse, closest);
+		float tFar = Slab(m_Nodes[farChild].min, m_Nodes[farChild].max, ray.origin, inverse, closest);
+		if (tNear > tFar) {
+			std::swap(nearChild, farChild);
+			std::swap(tNear, tFar);
+		}
+
+		if (tNear == std::numeric_limits<float>::max()) {
+			if (depth == 0)
+				break;
+			index = stack[--depth];
+			continue;
+		}
+		if (tFar != std::numeric_limits<float>::max())
+			stack[depth++] = farChild;
+		index = nearChild;
+	}
+
+	if (found != UINT32_MAX) {
+		const Triangle& tri = m_Triangles[found];
+		glm::vec3 n = glm::normalize(glm::cross(tri.e1, tri.e2));
+		hit.normal = glm::dot(n, ray.direction) > 0.0f ? -n : n;
+		hit.distance = closest;
+		hit.triangle = m_Ids[found];
+	}
+	return hit;
+}
+
+void Ngine::Bvh::CastPacket(const Ray* rays, RayHit* hits, size_t count, RayQuery query) const
+{
+	count = std::min(count, PacketSize);
+#ifdef NGINE_SSE2
+	for (size_t i = 0; i < count; ++i)
+		hits[i] = RayHit();
+	if (m_Nodes.empty() || count == 0)
+		return;
+
+	//Rays as structure of arrays, missing lanes repeat the first ray and start inactive
+	alignas(16) float o[3][4], d[3][4], inv[3][4], limit[4];
+	int active = 0;
+	for (size_t lane = 0; lane < PacketSize; ++lane) {
+		const Ray& r = rays[lane < count ? lane : 0];
+		glm::vec3 iv = SafeInverse(r.direction);
+		for (int k = 0; k < 3; ++k) {
+			o[k][lane] = r.origin[k];
+			d[k][lane] = r.direction[k];
+			inv[k][lane] = iv[k];
+		}
+		limit[lane] = r.maxDistance;
+		if (lane < count)
+			active |= 1 << lane;
+	}
+
+	const __m128 ox = _mm_load_ps(o[0]), oy = _mm_load_ps(o[1]), oz = _mm_load_ps(o[2]);
+	const __m128 dx = _mm_load_ps(d[0]), dy = _mm_load_ps(d[1]), dz = _mm_load_ps(d[2]);
+	const __m128 ix = _mm_load_ps(inv[0]), iy = _mm_load_ps(inv[1]), iz = _mm_load_ps(inv[2]);
+	const __m128 zero = _mm_setzero_ps(), one = _mm_set1_ps(1.0f), epsilon = _mm_set1_ps(Epsilon);
+	const __m128 signMask = _mm_castsi128_ps(_mm_set1_epi32(0x7FFFFFFF));
+	__m128 closest = _mm_load_ps(limit);
+	__m128i found = _mm_set1_epi32(-1);
+	__m128 hitU = zero, hitV = zero;
+
+	//Lanes whose ray enters the box before its current closest hit
+	auto boxMask = [&](const Node& node) {
+		__m128 tx1 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.min.x), ox), ix), tx2 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.max.x), ox), ix);
+		__m128 ty1 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.min.y), oy), iy), ty2 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.max.y), oy), iy);
+		__m128 tz1 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.min.z), oz), iz), tz2 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.max.z), oz), iz);
+		__m128 enter = _mm_max_ps(_mm_max_ps(_mm_min_ps(tx1, tx2), _mm_min_ps(ty1, ty2)), _mm_max_ps(_mm_min_ps(tz1, tz2), zero));
+		__m128 exit = _mm_min_ps(_mm_min_ps(_mm_max_ps(tx1, tx2), _mm_max_ps(ty1, ty2)), _mm_min_ps(_mm_max_ps(tz1, tz2), closest));
+		return _mm_movemask_ps(_mm_cmple_ps(enter, exit)) & active;
+	};
+
+	uint32_t stack[StackSize];
+	int depth = 0;
+	if (boxMask(m_Nodes[0]))
+		stack[depth++] = 0;
+
+	while (depth > 0 && active) {
+		uint32_t index = stack[--depth];
+		const Node& node = m_Nodes[index];
+		if (!boxMask(node))
+			continue;
+
+		if (node.count == 0) {
+			//Children are tested when popped, the far one goes on the stack first
+			uint32_t nearChild = index + 1, farChild = node.first;
+			if (d[node.axis][0] < 0.0f)
+				std::swap(nearChild, farChild);
+			stack[depth++] = farChild;
+			stack[depth++] = nearChild;
+			continue;
+		}
+
+		for (uint32_t i = node.first; i < node.first + node.count; ++i) {
+			const Triangle& tri = m_Triangles[i];
+			__m128 e1x = _mm_set1_ps(tri.e1.x), e1y = _mm_set1_ps(tri.e1.y), e1z = _mm_set1_ps(tri.e1.z);
+			__m128 e2x = _mm_set1_ps(tri.e2.x), e2y = _mm_set1_ps(tri.e2.y), e2z = _mm_set1_ps(tri.e2.z);
+
+			//p = d x e2
+			__m128 px = _mm_sub_ps(_mm_mul_ps(dy, e2z), _mm_mul_ps(dz, e2y));
+			__m128 py = _mm_sub_ps(_mm_mul_ps(dz, e2x), _mm_mul_ps(dx, e2z));
+			__m128 pz = _mm_sub_ps(_mm_mul_ps(dx, e2y), _mm_mul_ps(dy, e2x));
+			__m128 det = _mm_add_ps(_mm_add_ps(_mm_mul_ps(e1x, px), _mm_mul_ps(e1y, py)), _mm_mul_ps(e1z, pz));
+			__m128 invDet = _mm_div_ps(one, det);
+
+			__m128 sx = _mm_sub_ps(ox, _mm_set1_ps(tri.v0.x)), sy = _mm_sub_ps(oy, _mm_set1_ps(tri.v0.y)), sz = _mm_sub_ps(oz, _mm_set1_ps(tri.v0.z));
+			__m128 u = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(sx, px), _mm_mul_ps(sy, py)), _mm_mul_ps(sz, pz)), invDet);
+
+			//q = s x e1
+			__m128 qx = _mm_sub_ps(_mm_mul_ps(sy, e1z), _mm_mul_ps(sz, e1y));
+			__m128 qy = _mm_sub_ps(_mm_mul_ps(sz, e1x), _mm_mul_ps(sx, e1z));
+			__m128 qz = _mm_sub_ps(_mm_mul_ps(sx, e1y), _mm_mul_ps(sy, e1x));
+			__m128 v = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, qx), _mm_mul_ps(dy, qy)), _mm_mul_ps(dz, qz)), invDet);
+			__m128 t = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(e2x, qx), _mm_mul_ps(e2y, qy)), _mm_mul_ps(e2z, qz)), invDet);
+
+			__m128 mask = _mm_cmpgt_ps(_mm_and_ps(det, signMask), epsilon);
+			mask = _mm_and_ps(mask, _mm_and_ps(_mm_cmpge_ps(u, zero), _mm_cmpge_ps(v, zero)));
+			mask = _mm_and_ps(mask, _mm_cmple_ps(_mm_add_ps(u, v), one));
+			mask = _mm_and_ps(mask, _mm_and_ps(_mm_cmpge_ps(t, zero), _mm_cmplt_ps(t, closest)));
+
+			int lanes = _mm_movemask_ps(mask) & active;
+			if (!lanes)
+				continue;
+
+			//Only active lanes may take the hit, inactive ones keep what they had
+			const __m128 activeMask = _mm_castsi128_ps(_mm_set_epi32(active & 8 ? -1 : 0, active & 4 ? -1 : 0, active & 2 ? -1 : 0, active & 1 ? -1 : 0));
+			mask = _mm_and_ps(mask, activeMask);
+			closest = _mm_or_ps(_mm_and_ps(mask, t), _mm_andnot_ps(mask, closest));
+			hitU = _mm_or_ps(_mm_and_ps(mask, u), _mm_andnot_ps(mask, hitU));
+			hitV = _mm_or_ps(_mm_and_ps(mask, v), _mm_andnot_ps(mask, hitV));
+			__m128i m = _mm_castps_si128(mask);
+			found = _mm_or_si128(_mm_and_si128(m, _mm_set1_epi32((int)i)), _mm_andnot_si128(m, found));
+
+			if (query == RayQuery::Any)
+				active &= ~lanes;
+		}
+	}
+
+	alignas(16) float distances[4], us[4], vs[4];
+	alignas(16) int32_t triangles[4];
+	_mm_store_ps(distances, closest);
+	_mm_store_ps(us, hitU);
+	_mm_store_ps(vs, hitV);
+	_mm_store_si128((__m128i*)triangles, found);
+
+	for (size_t lane = 0; lane < count; ++lane) {
+		if (triangles[lane] < 0)
+			continue;
+		const Triangle& tri = m_Triangles[triangles[lane]];
+		glm::vec3 n = glm::normalize(glm::cross(tri.e1, tri.e2));
+		hits[lane].normal = glm::dot(n, rays[lane].direction) > 0.0f ? -n : n;
+		hits[lane].distance = distances[lane];
+		hits[lane].triangle = m_Ids[triangles[lane]];
+		hits[lane].u = us[lane];
+		hits[lane].v = vs[lane];
+	}
+#else
+	for (size_t i = 0; i < count; ++i)
+		hits[i] = Cast(rays[i], query);
+#endif
+}
+
+void Ngine::Bvh::Cast(const Ray* rays, RayHit* hits, size_t count, RayQuery query) const
+{
+	NGINE_ZONE("Bvh::Cast");
+
+	auto packets = [&](size_t first, size_t last) {
+		for (size_t i = first; i < last; i += PacketSize)
+			CastPacket(rays + i, hits + i, std::min(PacketSize, last - i), query);
+	};
+
+	if (count < ParallelRays || Jobs::SingleThreaded()) {
+		packets(0, count);
+		return;
+	}
+
+	//Split on packet boundaries so no packet is cut in two
+	size_t total = (count + PacketSize - 1) / PacketSize;
+	Jobs::ParallelFor(0, total, 64, [&](size_t first, size_t last) {
+		packets(first * PacketSize, std::min(last * PacketSize, count));
+		});
+}
@@ -0,0 +1,74 @@
+#pragma once
+#include "Macro.h"
+#include <glm/glm.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+namespace Ngine {
+
+	struct NAPI Ray {
+		glm::vec3 origin;
+		glm::vec3 direction; //Doesn't have to be normalized, distances are then in units of its length
+		float maxDistance = std::numeric_limits<float>::max();
+	};
+
+	struct NAPI RayHit {
+		float distance = std::numeric_limits<float>::max();
+		uint32_t triangle = UINT32_MAX; //Index in the triangle list the BVH was built from
+		float u = 0.0f, v = 0.0f; //Barycentrics of the 2nd and 3rd vertex
+		glm::vec3 normal = glm::vec3(0.0f); //Geometric, facing the ray origin
+
+		bool Hit() const noexcept { return triangle != UINT32_MAX; }
+	};
+
+	enum class RayQuery {
+		Closest,
+		Any //Stops at the first hit, for occlusion and "is there ground" checks
+	};
+
+	//Static triangle BVH split by binned SAH. Nodes are 32 bytes in depth first order, the left child follows its parent.
+	//Queries are const and safe from any number of threads.
+	class NAPI Bvh {
+	public:
+		static constexpr size_t PacketSize = 4;
+
+		Bvh() = default;
+		//Triangle list with 3 verticies per triangle, as LoadOBJ returns them
+		explicit Bvh(const std::vector<glm::vec3>& verticies) { Build(verticies); }
+
+		void Build(const std::vector<glm::vec3>& verticies);
+
+		RayHit Cast(const Ray& ray, RayQuery query = RayQuery::Closest) const;
+		//Up to PacketSize rays traverse together, boxes and triangles are tested for all of them at once
+		void CastPacket(const Ray* rays, RayHit* hits, size_t count, RayQuery query = RayQuery::Closest) const;
+		//Any number of rays in packets, big batches are spread over the job system
+		void Cast(const Ray* rays, RayHit* hits, size_t count, RayQuery query = RayQuery::Closest) const;
+
+		size_t Triangles() const noexcept { return m_Triangles.size(); }
+		size_t Nodes() const noexcept { return m_Nodes.size(); }
+		size_t Bytes() const noexcept;
+		bool Empty() const noexcept { return m_Nodes.empty(); }
+
+	private:
+		struct Node {
+			glm::vec3 min;
+			uint32_t first; //First triangle of a leaf, right child of an inner node
+			glm::vec3 max;
+			uint16_t count; //Triangles, 0 for inner nodes
+			uint16_t axis; //Split axis of inner nodes, picks the child to visit first
+		};
+
+		//Precomputed for Moller-Trumbore
+		struct Triangle {
+			glm::vec3 v0, e1, e2;
+		};
+
+		friend struct BvhBuilder;
+
+		std::vector<Node> m_Nodes;
+		std::vector<Triangle> m_Triangles; //In leaf order
+		std::vector<uint32_t> m_Ids; //Original index of every triangle
+	};
+}
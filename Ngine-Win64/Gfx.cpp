@@ -1,6 +1,13 @@
 #include "pch.h"
 #include "Gfx.h"
-#include <fstream>
+#include "Memory.h"
+#include "Profiler.h"
+#include "Log.h"
+#include "MeshProcessing.h"
+#include "Vfs.h"
+#include <atomic>
+#include <cstring>
+#include <filesystem>
 #include <spdlog/spdlog.h>
 #include <glm/matrix.hpp>
 #include <glm/gtc/matrix_transform.hpp>
@@ -11,37 +18,129 @@
 
 #pragma warning(disable : 4996)
 
+namespace {
+	std::atomic<uint64_t> drawCalls = 0, uploadedBytes = 0;
+
+	Ngine::DDSInfo ParseDDS(const char* ipath, const Ngine::VfsFile& file)
+	{
+		unsigned char header[124];
+
+		if (file.Size() < 128 || strncmp(file.Data(), "DDS ", 4) != 0) {
+			spdlog::error("{} is corrupted", ipath);
+			throw Ngine::Exception(__LINE__, __FILE__, "Could not handle texture file");
+		}
+		memcpy(header, file.Data() + 4, sizeof(header));
+
+		//Needed to catch truncated files before any level is read
+		long fileSize = (long)file.Size();
+
+		Ngine::DDSInfo info;
+		info.height = *(unsigned int*)&(header[8]);
+		info.width = *(unsigned int*)&(header[12]);
+		unsigned int mipMapCount = *(unsigned int*)&(header[24]);
+		unsigned int fourCC = *(unsigned int*)&(header[80]);
+
+		//Try to detect format
+		switch (fourCC)
+		{
+		case FOURCC_DXT1:
+			info.format = GL_COMPRESSED_RGBA_S3TC_DXT1_EXT;
+			break;
+		case FOURCC_DXT3:
+			info.format = GL_COMPRESSED_RGBA_S3TC_DXT3_EXT;
+			break;
+		case FOURCC_DXT5:
+			info.format = GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+			break;
+		default:
+			spdlog::error("Could not establish format of {}", ipath);
+			throw Ngine::Exception(__LINE__, __FILE__, "Could not handle texture file");
+		}
+
+		info.blockSize = (info.format == GL_COMPRESSED_RGBA_S3TC_DXT1_EXT) ? 8 : 16;
+
+		//Files without DDSD_MIPMAPCOUNT still carry the top level
+		if (mipMapCount == 0) mipMapCount = 1;
+
+		//Levels are stored back to back right after the 128 byte header, largest first
+		unsigned int width = info.width;
+		unsigned int height = info.height;
+		long offset = 128;
+		for (unsigned int level = 0; level < mipMapCount && (width || height); ++level)
+		{
+			Ngine::DDSInfo::Mip mip;
+			mip.width = width;
+			mip.height = height;
+			mip.offset = offset;
+			mip.size = ((width + 3) / 4) * ((height + 3) / 4) * info.blockSize;
+
+			if (offset + (long)mip.size > fileSize) {
+				NGINE_LOG_WARN("{} is truncated, only {} of {} mip levels are usable", ipath, level, mipMapCount);
+				break;
+			}
+
+			info.mips.push_back(mip);
+			offset += mip.size;
+			width /= 2;
+			height /= 2;
+
+			// Deal with Non-Power-Of-Two textures. This code is not included in the webpage to reduce clutter.
+			if (width < 1) width = 1;
+			if (height < 1) height = 1;
+		}
+
+		if (info.mips.empty()) {
+			spdlog::error("{} is corrupted", ipath);
+			throw Ngine::Exception(__LINE__, __FILE__, "Could not handle texture file");
+		}
+
+		return info;
+	}
+
+	//Names after mtllib, tinyobj gets their text instead of opening them itself
+	std::vector<std::string> MaterialLibraries(std::string_view text)
+	{
+		std::vector<std::string> names;
+		while (!text.empty()) {
+			size_t end = std::min(text.find('\n'), text.size());
+			std::string_view line = text.substr(0, end);
+			text.remove_prefix(std::min(end + 1, text.size()));
+
+			size_t first = line.find_first_not_of(" \t");
+			if (first == std::string_view::npos || line.compare(first, 7, "mtllib ") != 0)
+				continue;
+			line.remove_prefix(first + 7);
+			while (!line.empty()) {
+				size_t start = line.find_first_not_of(" \t\r");
+				if (start == std::string_view::npos)
+					break;
+				line.remove_prefix(start);
+				size_t length = std::min(line.find_first_of(" \t\r"), line.size());
+				names.emplace_back(line.substr(0, length));
+				line.remove_prefix(length);
+			}
+		}
+		return names;
+	}
+}
+
 GLuint Ngine::Gfx::CompileShader(const char* vertex_file_path, const char* fragment_file_path)
 {
+	NGINE_ZONE("Gfx::CompileShader");
+	Ngine::LogTimer timer;
+
 	// Create the shaders
 	GLuint VertexShaderID = glCreateShader(GL_VERTEX_SHADER);
 	GLuint FragmentShaderID = glCreateShader(GL_FRAGMENT_SHADER);
 
-	// Read the Vertex Shader code from the file
-	std::string VertexShaderCode;
-	std::ifstream VertexShaderStream(vertex_file_path, std::ios::in);
-	if (VertexShaderStream.is_open()) {
-		std::stringstream sstr;
-		sstr << VertexShaderStream.rdbuf();
-		VertexShaderCode = sstr.str();
-		VertexShaderStream.close();
-	}
-	else {
+	// Read the shader code, from a mounted pack or from disk
+	VfsFile VertexShaderFile, FragmentShaderFile;
+	if (!Vfs::TryOpen(vertex_file_path, VertexShaderFile)) {
 		spdlog::error("Impossible to open {}. Are you in the right directory ? Don't forget to read the FAQ !", vertex_file_path);
 		throw Ngine::Exception(__LINE__, __FILE__, "Could not open shader file");
 	}
-
-	// Read the Fragment Shader code from the file
-	std::string FragmentShaderCode;
-	std::ifstream FragmentShaderStream(fragment_file_path, std::ios::in);
-	if (FragmentShaderStream.is_open()) {
-		std::stringstream sstr;
-		sstr << FragmentShaderStream.rdbuf();
-		FragmentShaderCode = sstr.str();
-		FragmentShaderStream.close();
-	}
-	else {
-		spdlog::error("Impossible to open {}. Are you in the right directory ? Don't forget to read the FAQ !", vertex_file_path);
+	if (!Vfs::TryOpen(fragment_file_path, FragmentShaderFile)) {
+		spdlog::error("Impossible to open {}. Are you in the right directory ? Don't forget to read the FAQ !", fragment_file_path);
 		throw Ngine::Exception(__LINE__, __FILE__, "Could not open shader file");
 	}
 
@@ -50,9 +149,10 @@ GLuint Ngine::Gfx::CompileShader(const char* vertex_file_path, const char* fragm
 
 
 	// Compile Vertex Shader
-	spdlog::info("Compiling shader: {}", vertex_file_path);
-	char const* VertexSourcePointer = VertexShaderCode.c_str();
-	glShaderSource(VertexShaderID, 1, &VertexSourcePointer, NULL);
+	NGINE_LOG_DEBUG("Compiling shader {}", Field("path", vertex_file_path));
+	char const* VertexSourcePointer = VertexShaderFile.Data();
+	GLint VertexSourceLength = (GLint)VertexShaderFile.Size();
+	glShaderSource(VertexShaderID, 1, &VertexSourcePointer, &VertexSourceLength);
 	glCompileShader(VertexShaderID);
 
 	// Check Vertex Shader
@@ -67,9 +167,10 @@ GLuint Ngine::Gfx::CompileShader(const char* vertex_file_path, const char* fragm
 
 
 	// Compile Fragment Shader
-	spdlog::info("Compiling shader: {}", fragment_file_path);
-	char const* FragmentSourcePointer = FragmentShaderCode.c_str();
-	glShaderSource(FragmentShaderID, 1, &FragmentSourcePointer, NULL);
+	NGINE_LOG_DEBUG("Compiling shader {}", Field("path", fragment_file_path));
+	char const* FragmentSourcePointer = FragmentShaderFile.Data();
+	GLint FragmentSourceLength = (GLint)FragmentShaderFile.Size();
+	glShaderSource(FragmentShaderID, 1, &FragmentSourcePointer, &FragmentSourceLength);
 	glCompileShader(FragmentShaderID);
 
 	// Check Fragment Shader
@@ -84,10 +185,11 @@ GLuint Ngine::Gfx::CompileShader(const char* vertex_file_path, const char* fragm
 
 
 	// Link the program
-	spdlog::info("Linking program");
+	NGINE_LOG_DEBUG("Linking program");
 	GLuint ProgramID = glCreateProgram();
 	glAttachShader(ProgramID, VertexShaderID);
 	glAttachShader(ProgramID, FragmentShaderID);
+	VertexInputs::BindLocations(ProgramID);
 	glLinkProgram(ProgramID);
 
 	// Check the program
@@ -106,34 +208,40 @@ GLuint Ngine::Gfx::CompileShader(const char* vertex_file_path, const char* fragm
 	glDeleteShader(VertexShaderID);
 	glDeleteShader(FragmentShaderID);
 
+	//Inputs have to be known semantics, a program reading a wrong type would get garbage silently
+	if (Result == GL_TRUE) {
+		try {
+			VertexInputs::Read(ProgramID, vertex_file_path);
+		}
+		catch (...) {
+			glDeleteProgram(ProgramID);
+			throw;
+		}
+	}
+
+	NGINE_LOG_INFO("Compiled program {} {} {:.2f}", Field("vertex", vertex_file_path), Field("fragment", fragment_file_path), Field("ms", timer.Ms()));
 	return ProgramID;
 }
 
-GLuint Ngine::Gfx::LoadBMP(const char* ipath)
+std::vector<unsigned char> Ngine::Gfx::ReadBMP(const char* ipath, unsigned int& width, unsigned int& height, unsigned int& channels)
 {
-	spdlog::info("Loading texture in BMP format: {}", ipath);
-
 	//Date read from the header of the BMP file
 	unsigned char header[54];
 	unsigned int dataPos;
-	unsigned int imageSize;
-	unsigned int width, height;
-
-	//Actual RGB data
-	unsigned char* data;
 
-	//Open the file
-	FILE* file = fopen(ipath, "rb");
-	if (!file) {
+	//Open the file, from a mounted pack or from disk
+	VfsFile file;
+	if (!Vfs::TryOpen(ipath, file)) {
 		spdlog::error("Could not open {}", ipath);
 		throw Ngine::Exception(__LINE__, __FILE__, "Could not open texture file");
 	}
 
 	//If file contain less than 54 bytes of data it's corrupted
-	if (fread(header, 1, 54, file) != 54) {
+	if (file.Size() < 54) {
 		spdlog::error("{} is corrupted", ipath);
 		throw Ngine::Exception(__LINE__, __FILE__, "Could not handle texture file");
 	}
+	memcpy(header, file.Data(), sizeof(header));
 
 	//BMP file always starts with letters BM
 	if (header[0] != 'B' || header[1] != 'M') {
@@ -141,32 +249,50 @@ GLuint Ngine::Gfx::LoadBMP(const char* ipath)
 		throw Ngine::Exception(__LINE__, __FILE__, "Could not handle texture file");
 	}
 
-	// Make sure this is a 24bpp file
+	// Make sure this is an uncompressed 24bpp or 32bpp file
 	if (*(int*)&(header[0x1E]) != 0) {
 		spdlog::error("{} is corrupted", ipath);
 		throw Ngine::Exception(__LINE__, __FILE__, "Could not handle texture file");
 	}
 
-	if (*(int*)&(header[0x1C]) != 24) {
+	int bpp = *(short*)&(header[0x1C]);
+	if (bpp != 24 && bpp != 32) {
 		spdlog::error("{} is corrupted", ipath);
 		throw Ngine::Exception(__LINE__, __FILE__, "Could not handle texture file");
 	}
 
 	// Read the information about the image
 	dataPos = *(int*)&(header[0x0A]);
-	imageSize = *(int*)&(header[0x22]);
 	width = *(int*)&(header[0x12]);
 	height = *(int*)&(header[0x16]);
+	channels = bpp / 8;
 
 	// Some BMP files are misformatted, guess missing information
-	if (imageSize == 0)    imageSize = width * height * 3; // 3 : one byte for each Red, Green and Blue component
 	if (dataPos == 0)      dataPos = 54; // The BMP header is done that way
 
-	// Create a buffer
-	data = new unsigned char[imageSize];
-	fread(data, 1, imageSize, file);
+	//Rows in the file are padded to 4 bytes, drop the padding while copying
+	unsigned int rowSize = width * channels;
+	unsigned int stride = (rowSize + 3) & ~3u;
+	if (height > 0 && (size_t)dataPos + (size_t)stride * (height - 1) + rowSize > file.Size()) {
+		spdlog::error("{} is corrupted", ipath);
+		throw Ngine::Exception(__LINE__, __FILE__, "Could not handle texture file");
+	}
+
+	std::vector<unsigned char> data((size_t)rowSize * height);
+	for (unsigned int y = 0; y < height; ++y)
+		memcpy(data.data() + (size_t)y * rowSize, file.Data() + dataPos + (size_t)y * stride, rowSize);
 
-	fclose(file);
+	return data;
+}
+
+GLuint Ngine::Gfx::LoadBMP(const char* ipath)
+{
+	NGINE_ZONE("Gfx::LoadBMP");
+	Ngine::LogTimer timer;
+
+	unsigned int width, height, channels;
+	std::vector<unsigned char> data = ReadBMP(ipath, width, height, channels);
+	TrackScope staging(MemoryCategory::TextureStaging, data.size());
 
 	// Create one OpenGL texture
 	GLuint textureID;
@@ -175,11 +301,13 @@ GLuint Ngine::Gfx::LoadBMP(const char* ipath)
 	// "Bind" the newly created texture : all future texture functions will modify this texture
 	glBindTexture(GL_TEXTURE_2D, textureID);
 
-	// Give the image to OpenGL
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_BGR, GL_UNSIGNED_BYTE, data);
-
-	// OpenGL has now copied the data. Free our own version
-	delete[] data;
+	// Give the image to OpenGL, rows are tightly packed
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	if (channels == 4)
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_BGRA, GL_UNSIGNED_BYTE, data.data());
+	else
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_BGR, GL_UNSIGNED_BYTE, data.data());
+	CountUpload(data.size());
 
 	//Enable trilinear filtering
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
@@ -189,65 +317,40 @@ GLuint Ngine::Gfx::LoadBMP(const char* ipath)
 
 	//Generate mipmaps
 	glGenerateMipmap(GL_TEXTURE_2D);
+
+	NGINE_LOG_INFO("Loaded BMP texture {} {} {:.2f}", Field("path", ipath), Field("bytes", data.size()), Field("ms", timer.Ms()));
 	return textureID;
 }
 
-GLuint Ngine::Gfx::LoadDDS(const char* ipath)
+Ngine::DDSInfo Ngine::Gfx::ReadDDSInfo(const char* ipath)
 {
-	unsigned char header[124];
-
-	FILE* fp;
-
 	//Open texture file
-	fp = fopen(ipath, "rb");
-	if (fp == NULL) {
+	VfsFile file;
+	if (!Vfs::TryOpen(ipath, file)) {
 		spdlog::error("Could not open {}", ipath);
 		throw Ngine::Exception(__LINE__, __FILE__, "Could not open texture file");
 	}
 
-	char filecode[4];
-	fread(filecode, 1, 4, fp);
-	if (strncmp(filecode, "DDS ", 4) != 0) {
-		spdlog::error("{} is corrupted", ipath);
-		throw Ngine::Exception(__LINE__, __FILE__, "Could not handle texture file");
-	}
-
-	fread(&header, 124, 1, fp);
-
-	unsigned int height = *(unsigned int*)&(header[8]);
-	unsigned int width = *(unsigned int*)&(header[12]);
-	unsigned int linearSize = *(unsigned int*)&(header[16]);
-	unsigned int mipMapCount = *(unsigned int*)&(header[24]);
-	unsigned int fourCC = *(unsigned int*)&(header[80]);
-	unsigned char* buffer;
-	unsigned int bufsize;
-
-	//Read mipmap levels
-	bufsize = mipMapCount > 1 ? linearSize * 2 : linearSize;
-	buffer = (unsigned char*)malloc(bufsize * sizeof(unsigned char));
-	fread(buffer, 1, bufsize, fp);
-	fclose(fp);
+	return ParseDDS(ipath, file);
+}
 
-	unsigned int components = (fourCC == FOURCC_DXT1) ? 3 : 4;
-	unsigned int format;
+GLuint Ngine::Gfx::LoadDDS(const char* ipath)
+{
+	NGINE_ZONE("Gfx::LoadDDS");
+	Ngine::LogTimer timer;
 
-	//Try to detect format
-	switch (fourCC)
-	{
-	case FOURCC_DXT1:
-		format = GL_COMPRESSED_RGBA_S3TC_DXT1_EXT;
-		break;
-	case FOURCC_DXT3:
-		format = GL_COMPRESSED_RGBA_S3TC_DXT3_EXT;
-		break;
-	case FOURCC_DXT5:
-		format = GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
-		break;
-	default:
-		spdlog::error("Could not establish format of {}", ipath);
-		free(buffer);
-		throw Ngine::Exception(__LINE__, __FILE__, "Could not handle texture file");
+	VfsFile file;
+	if (!Vfs::TryOpen(ipath, file)) {
+		spdlog::error("Could not open {}", ipath);
+		throw Ngine::Exception(__LINE__, __FILE__, "Could not open texture file");
 	}
+	DDSInfo info = ParseDDS(ipath, file);
+
+	//Levels go to the driver straight from the mapping, only decompressed pack entries take staging memory
+	const DDSInfo::Mip& first = info.mips.front();
+	const DDSInfo::Mip& last = info.mips.back();
+	const size_t bytes = last.offset + last.size - first.offset;
+	TrackScope staging(MemoryCategory::TextureStaging, file.Decompressed() ? file.Size() : 0);
 
 	// Create one OpenGL texture
 	GLuint textureID;
@@ -257,81 +360,86 @@ GLuint Ngine::Gfx::LoadDDS(const char* ipath)
 	glBindTexture(GL_TEXTURE_2D, textureID);
 	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
 
-	unsigned int blockSize = (format == GL_COMPRESSED_RGBA_S3TC_DXT1_EXT) ? 8 : 16;
-	unsigned int offset = 0;
-
 	/* load the mipmaps */
-	for (unsigned int level = 0; level < mipMapCount && (width || height); ++level)
+	for (unsigned int level = 0; level < info.mips.size(); ++level)
 	{
-		unsigned int size = ((width + 3) / 4) * ((height + 3) / 4) * blockSize;
-		glCompressedTexImage2D(GL_TEXTURE_2D, level, format, width, height,
-			0, size, buffer + offset);
-
-		offset += size;
-		width /= 2;
-		height /= 2;
-
-		// Deal with Non-Power-Of-Two textures. This code is not included in the webpage to reduce clutter.
-		if (width < 1) width = 1;
-		if (height < 1) height = 1;
-
+		const DDSInfo::Mip& mip = info.mips[level];
+		glCompressedTexImage2D(GL_TEXTURE_2D, level, info.format, mip.width, mip.height,
+			0, mip.size, file.Data() + mip.offset);
 	}
+	CountUpload(bytes);
 
-	free(buffer);
+	//Keep the texture complete when the file carries a partial chain
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, (GLint)info.mips.size() - 1);
 
+	NGINE_LOG_INFO("Loaded DDS texture {} {} {:.2f}", Field("path", ipath), Field("bytes", bytes), Field("ms", timer.Ms()));
 	return textureID;
 }
 
 void Ngine::Gfx::LoadOBJLegacy(const char* opath, std::vector<glm::vec3>& verticies, std::vector<glm::vec2>& uvs, std::vector<glm::vec3>& normals, bool dds)
 {
-	spdlog::info("Loading mesh in OBJ format: {}", opath);
-
-	std::vector<unsigned int> vertexIndices, uvIndices, normalIndices;
-	std::vector<glm::vec3> temp_vertices;
-	std::vector<glm::vec2> temp_uvs;
-	std::vector<glm::vec3> temp_normals;
-
-	FILE* file = fopen(opath, "r");
-	if (file == NULL) {
+	NGINE_ZONE("Gfx::LoadOBJLegacy");
+	Ngine::LogTimer timer;
+
+	//Temporaries live in the thread's scratch arena and go away with the scope
+	Ngine::ScratchScope scratch;
+	Ngine::ArenaVector<unsigned int> vertexIndices(scratch.Arena()), uvIndices(scratch.Arena()), normalIndices(scratch.Arena());
+	Ngine::ArenaVector<glm::vec3> temp_vertices(scratch.Arena());
+	Ngine::ArenaVector<glm::vec2> temp_uvs(scratch.Arena());
+	Ngine::ArenaVector<glm::vec3> temp_normals(scratch.Arena());
+
+	VfsFile file;
+	if (!Vfs::TryOpen(opath, file)) {
 		spdlog::error("Could not open {}", opath);
 		throw Ngine::Exception(__LINE__, __FILE__, "Could not open mesh file");
 	}
 
-	while (1) {
+	//One statement per line, scanned from a null terminated copy of it
+	std::string_view text = file.View();
+	char line[1000];
+	while (!text.empty()) {
+		size_t end = std::min(text.find('\n'), text.size());
+		if (end >= sizeof(line)) {
+			//A cut statement would parse as a shorter valid one, e.g. a face missing corners
+			spdlog::error("{} has a line longer than {} characters", opath, sizeof(line) - 1);
+			throw Ngine::Exception(__LINE__, __FILE__, "Could not parse mesh file");
+		}
+		memcpy(line, text.data(), end);
+		line[end] = '\0';
+		text.remove_prefix(std::min(end + 1, text.size()));
 
 		char lineHeader[128];
 		// read the first word of the line
-		int res = fscanf(file, "%s", lineHeader);
-		if (res == EOF)
-			break; // EOF = End Of File. Quit the loop.
+		int used = 0;
+		if (sscanf(line, "%127s%n", lineHeader, &used) != 1)
+			continue; // Blank line
+		const char* rest = line + used;
 
 		// else : parse lineHeader
 
 		if (strcmp(lineHeader, "v") == 0) {
 			glm::vec3 vertex;
-			fscanf(file, "%f %f %f\n", &vertex.x, &vertex.y, &vertex.z);
+			sscanf(rest, "%f %f %f", &vertex.x, &vertex.y, &vertex.z);
 			temp_vertices.push_back(vertex);
 		}
 		else if (strcmp(lineHeader, "vt") == 0) {
 			glm::vec2 uv;
-			fscanf(file, "%f %f\n", &uv.x, &uv.y);
+			sscanf(rest, "%f %f", &uv.x, &uv.y);
 			if(dds)
 				uv.y = -uv.y; // Invert V coordinate since we will only use DDS texture, which are inverted. Remove if you want to use TGA or BMP loaders.
 			temp_uvs.push_back(uv);
 		}
 		else if (strcmp(lineHeader, "vn") == 0) {
 			glm::vec3 normal;
-			fscanf(file, "%f %f %f\n", &normal.x, &normal.y, &normal.z);
+			sscanf(rest, "%f %f %f", &normal.x, &normal.y, &normal.z);
 			temp_normals.push_back(normal);
 		}
 		else if (strcmp(lineHeader, "f") == 0) {
-			std::string vertex1, vertex2, vertex3;
 			unsigned int vertexIndex[3], uvIndex[3], normalIndex[3];
-			int matches = fscanf(file, "%d/%d/%d %d/%d/%d %d/%d/%d\n", &vertexIndex[0], &uvIndex[0], &normalIndex[0], &vertexIndex[1], &uvIndex[1], &normalIndex[1], &vertexIndex[2], &uvIndex[2], &normalIndex[2]);
+			int matches = sscanf(rest, "%d/%d/%d %d/%d/%d %d/%d/%d", &vertexIndex[0], &uvIndex[0], &normalIndex[0], &vertexIndex[1], &uvIndex[1], &normalIndex[1], &vertexIndex[2], &uvIndex[2], &normalIndex[2]);
 			if (matches != 9) {
 				spdlog::info("File can't be read by our simple parser");
 				throw Ngine::Exception(__LINE__, __FILE__, "Could not prase mesh file");
-				fclose(file);
 			}
 			vertexIndices.push_back(vertexIndex[0]);
 			vertexIndices.push_back(vertexIndex[1]);
@@ -343,13 +451,15 @@ void Ngine::Gfx::LoadOBJLegacy(const char* opath, std::vector<glm::vec3>& vertic
 			normalIndices.push_back(normalIndex[1]);
 			normalIndices.push_back(normalIndex[2]);
 		}
-		else {
-			// Probably a comment, eat up the rest of the line
-			char stupidBuffer[1000];
-			fgets(stupidBuffer, 1000, file);
-		}
+		// Anything else is probably a comment, the rest of the line is already skipped
 	}
 
+	verticies.reserve(verticies.size() + vertexIndices.size());
+	if (!temp_uvs.empty())
+		uvs.reserve(uvs.size() + vertexIndices.size());
+	if (!temp_normals.empty())
+		normals.reserve(normals.size() + vertexIndices.size());
+
 	// For each vertex of each triangle
 	for (unsigned int i = 0; i < vertexIndices.size(); i++) {
 
@@ -375,19 +485,39 @@ void Ngine::Gfx::LoadOBJLegacy(const char* opath, std::vector<glm::vec3>& vertic
 		}
 
 	}
-	fclose(file);
+
+	NGINE_LOG_INFO("Loaded OBJ mesh {} {} {:.2f}", Field("path", opath), Field("verticies", verticies.size()), Field("ms", timer.Ms()));
 }
 
-void Ngine::Gfx::LoadOBJ(const char* opath, const char* mpath, std::vector<glm::vec3>& verticies, std::vector<glm::vec2>& uvs, std::vector<glm::vec3>& normals)
+void Ngine::Gfx::LoadOBJ(const char* opath, const char* mpath, std::vector<glm::vec3>& verticies, std::vector<glm::vec2>& uvs, std::vector<glm::vec3>& normals, std::vector<glm::vec4>* tangents)
 {
-	spdlog::info("Loading mesh in OBJ format: {}", opath);
-	spdlog::info("Loading mesh material in : {}", mpath);
+	NGINE_ZONE("Gfx::LoadOBJ");
+	Ngine::LogTimer timer;
+
+	VfsFile file;
+	if (!Vfs::TryOpen(opath, file)) {
+		spdlog::error("Could not open {}", opath);
+		throw Ngine::Exception(__LINE__, __FILE__, "Could not open mesh file");
+	}
+
+	//Material libraries are looked up in mpath through the VFS as well, tinyobj parses both from memory
+	std::string mtlText;
+	for (const std::string& name : MaterialLibraries(file.View())) {
+		std::string mtlPath = (std::filesystem::path(mpath) / name).string();
+		VfsFile mtl;
+		if (Vfs::TryOpen(mtlPath.c_str(), mtl)) {
+			mtlText.append(mtl.View());
+			mtlText += '\n';
+		}
+		else {
+			NGINE_LOG_WARN("Material library {} not found", mtlPath);
+		}
+	}
 
 	tinyobj::ObjReaderConfig reader_config;
-	reader_config.mtl_search_path = mpath;
 	tinyobj::ObjReader reader;
 
-	if (!reader.ParseFromFile(opath, reader_config)) {
+	if (!reader.ParseFromString(std::string(file.View()), mtlText, reader_config)) {
 		if (!reader.Error().empty())
 		{
 			spdlog::error("Cannot load OBJ file: {}", reader.Error());
@@ -396,16 +526,26 @@ void Ngine::Gfx::LoadOBJ(const char* opath, const char* mpath, std::vector<glm::
 	}
 
 	if (!reader.Warning().empty()) {
-		spdlog::warn("TinyObjReader: {}", reader.Warning());
+		NGINE_LOG_WARN("TinyObjReader: {}", reader.Warning());
 	}
 
 	auto& attrib = reader.GetAttrib();
 	auto& shapes = reader.GetShapes();
 	auto& materials = reader.GetMaterials();
 
+	//Every face vertex becomes one output vertex, so sizes are known up front.
+	//Attributes a vertex lacks are left zero, MeshProcessing fills them in below.
+	size_t count = 0;
+	for (const auto& shape : shapes)
+		count += shape.mesh.indices.size();
+
+	const bool hasUVs = !attrib.texcoords.empty();
 	std::vector<glm::vec3> vv;
 	std::vector<glm::vec2> uvv;
 	std::vector<glm::vec3> nv;
+	vv.reserve(count);
+	uvv.reserve(hasUVs ? count : 0);
+	nv.reserve(count);
 
 	// Loop over shapes
 	for (size_t s = 0; s < shapes.size(); s++) {
@@ -424,19 +564,21 @@ void Ngine::Gfx::LoadOBJ(const char* opath, const char* mpath, std::vector<glm::
 				vv.push_back(vert);
 
 				// Check if `normal_index` is zero or positive. negative = no normal data
+				glm::vec3 norm(0.0f);
 				if (idx.normal_index >= 0) {
-					glm::vec3 norm;
 					norm.x = attrib.normals[3 * size_t(idx.normal_index) + 0];
 					norm.y = attrib.normals[3 * size_t(idx.normal_index) + 1];
 					norm.z = attrib.normals[3 * size_t(idx.normal_index) + 2];
-					nv.push_back(norm);
 				}
+				nv.push_back(norm);
 
 				// Check if `texcoord_index` is zero or positive. negative = no texcoord data
-				if (idx.texcoord_index >= 0) {
-					glm::vec2 uv;
-					uv.x = attrib.texcoords[2 * size_t(idx.texcoord_index) + 0];
-					uv.y = attrib.texcoords[2 * size_t(idx.texcoord_index) + 1];
+				if (hasUVs) {
+					glm::vec2 uv(0.0f);
+					if (idx.texcoord_index >= 0) {
+						uv.x = attrib.texcoords[2 * size_t(idx.texcoord_index) + 0];
+						uv.y = attrib.texcoords[2 * size_t(idx.texcoord_index) + 1];
+					}
 					uvv.push_back(uv);
 				}
 
@@ -452,89 +594,130 @@ void Ngine::Gfx::LoadOBJ(const char* opath, const char* mpath, std::vector<glm::
 		}
 	}
 
-	verticies = vv;
-	normals = nv;
-	uvs = uvv;
+	MeshProcessStats processed = MeshProcessing::Complete(vv, uvv, nv, tangents);
+
+	verticies = std::move(vv);
+	normals = std::move(nv);
+	uvs = std::move(uvv);
+
+	NGINE_LOG_INFO("Loaded OBJ mesh {} {} {} {:.2f} {} {:.2f}", Field("path", opath), Field("materials", mpath), Field("verticies", verticies.size()), Field("ms", timer.Ms()),
+		Field("generatedNormals", processed.generatedNormals), Field("processMs", processed.ms));
 }
 
-void Ngine::Object::Draw()
+Ngine::RenderStats Ngine::Gfx::Stats() noexcept
 {
+	return RenderStats{ drawCalls.load(std::memory_order_relaxed), uploadedBytes.load(std::memory_order_relaxed) };
+}
 
-	//Enable associated program
-	glUseProgram(program);
+void Ngine::Gfx::CountDraw() noexcept
+{
+	drawCalls.fetch_add(1, std::memory_order_relaxed);
+}
 
-	glUniformMatrix4fv(mat.matrixID, 1, GL_FALSE, &mat.MVP[0][0]);
+void Ngine::Gfx::CountUpload(size_t bytes) noexcept
+{
+	uploadedBytes.fetch_add(bytes, std::memory_order_relaxed);
+}
 
-	//Generate VAO
-	glGenVertexArrays(1, &VAO);
-	glBindVertexArray(VAO);
+Ngine::DrawCommand Ngine::Object::Command()
+{
+	DrawCommand cmd{ this, program, texture, layer, (GLint)mat.matrixID, layerID, mat.MVP, false, MeshState() };
+	if (mesh)
+		cmd.resident = Resources::Describe(mesh, cmd.mesh);
+	return cmd;
+}
 
-	//Generate VBO
-	glGenBuffers(1, &VBO);
-	glBindBuffer(GL_ARRAY_BUFFER, VBO);
-	glBufferData(GL_ARRAY_BUFFER, sizeof(glm::vec3) * verticies.size(), verticies.data(), GL_STATIC_DRAW);
-	
-	//Generate CBO
-	if (!color.empty()) {
-		glGenBuffers(1, &CBO);
-		glBindBuffer(GL_ARRAY_BUFFER, CBO);
-		glBufferData(GL_ARRAY_BUFFER, sizeof(glm::vec3) * color.size(), color.data(), GL_STATIC_DRAW);
-	}
+void Ngine::Object::Draw(const DrawCommand& cmd)
+{
+	NGINE_ZONE("Object::Draw");
 
-	//Generate UBO
-	if (!uvs.empty()) {
-		glGenBuffers(1, &UBO);
-		glBindBuffer(GL_ARRAY_BUFFER, UBO);
-		glBufferData(GL_ARRAY_BUFFER, sizeof(glm::vec2) * uvs.size(), uvs.data(), GL_STATIC_DRAW);
-	}
+	//Enable associated program
+	glUseProgram(cmd.program);
 
-	//Draw object
-	glEnableVertexAttribArray(0);
-	glBindBuffer(GL_ARRAY_BUFFER, VBO);
-	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, (void*)0);
+	glUniformMatrix4fv(cmd.matrixID, 1, GL_FALSE, &cmd.MVP[0][0]);
 
-	if (!color.empty()) {
-		glEnableVertexAttribArray(1);
-		glBindBuffer(GL_ARRAY_BUFFER, CBO);
-		glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 0, (void*)0);
+	//Bind associated texture, layers of shared arrays are picked by the shader
+	if (cmd.layer >= 0) {
+		glBindTexture(GL_TEXTURE_2D_ARRAY, cmd.texture);
+		glUniform1i(cmd.layerID, cmd.layer);
+	}
+	else if (cmd.texture) {
+		glBindTexture(GL_TEXTURE_2D, cmd.texture);
 	}
 
-	if (!uvs.empty()) {
-		glEnableVertexAttribArray(2);
-		glBindBuffer(GL_ARRAY_BUFFER, UBO);
-		glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 0, (void*)0);
+	//Shared meshes are uploaded once at load, created ones a frame or so later
+	if (cmd.resident) {
+		if (!cmd.mesh.VAO)
+			return;
+		glBindVertexArray(cmd.mesh.VAO);
+		if (cmd.mesh.indexed)
+			glDrawElements(GL_TRIANGLES, cmd.mesh.count, GL_UNSIGNED_INT, (void*)0);
+		else
+			glDrawArrays(GL_TRIANGLES, 0, cmd.mesh.count);
+		Gfx::CountDraw();
+		glBindVertexArray(0);
+		return;
 	}
 
-	glDrawArrays(GL_TRIANGLES, 0, verticies.size());
-	glDisableVertexAttribArray(0);	
+	//Immediate geometry, interleaved and uploaded for this draw only
+	VertexSources sources;
+	sources.count = verticies.size();
+	sources.positions = verticies.data();
+	sources.colours = color.size() == sources.count ? color.data() : nullptr;
+	sources.uvs = uvs.size() == sources.count ? uvs.data() : nullptr;
 
-	//Delete buffers
-	if(!uvs.empty())
-		glDeleteBuffers(1, &UBO);
+	ScratchScope scratch;
+	ArenaVector<unsigned char> vertices((size_t)ObjectLayout::Stride * sources.count, scratch.Arena());
+	ObjectLayout::Interleave(sources, vertices.data());
+
+	glGenVertexArrays(1, &VAO);
+	glBindVertexArray(VAO);
 
-	if(!color.empty())
-		glDeleteBuffers(1, &CBO);
+	glGenBuffers(1, &VBO);
+	glBindBuffer(GL_ARRAY_BUFFER, VBO);
+	glBufferData(GL_ARRAY_BUFFER, vertices.size(), vertices.data(), GL_STREAM_DRAW);
+	ObjectLayout::Bind(VBO);
+
+	//Draw object
+	glDrawArrays(GL_TRIANGLES, 0, (GLsizei)verticies.size());
+	Gfx::CountDraw();
+	Gfx::CountUpload(vertices.size());
+	glBindVertexArray(0);
 
+	//Delete buffers
 	glDeleteBuffers(1, &VBO);
 	glDeleteVertexArrays(1, &VAO);
 }
 
+void Ngine::Object::UpdateBounds()
+{
+	if (MeshState state; Resources::Describe(mesh, state)) {
+		boundsMin = state.boundsMin;
+		boundsMax = state.boundsMax;
+		return;
+	}
+
+	boundsMin = boundsMax = verticies.empty() ? glm::vec3(0.0f) : verticies.front();
+	for (const auto& v : verticies) {
+		boundsMin = glm::min(boundsMin, v);
+		boundsMax = glm::max(boundsMax, v);
+	}
+}
+
 void Ngine::Object::InitMatrix()
 {
 	mat.Initialize(program);
+	layerID = glGetUniformLocation(program, "Layer");
 }
 
 void Ngine::Matrix::Initialize(GLuint program)
 {
 	matrixID = glGetUniformLocation(program, "MVP");
 
-	mINI::INIFile file("Game.ini");
-	mINI::INIStructure ini;
-	if (!file.read(ini))
-		throw Ngine::Exception(__LINE__, __FILE__, "Could not read configuration file");
+	auto settings = Ngine::Settings::Get();
 
 	//45 Field of View, dynamic ratio, display range : 0.1 unit <-> 100 units
-	glm::mat4 Projection = glm::perspective(glm::radians(90.0f), (float)std::stoi(ini["Game"]["Width"]) / (float)std::stoi(ini["Game"]["Height"]), 0.1f, 100.0f);
+	glm::mat4 Projection = glm::perspective(glm::radians(90.0f), (float)settings->width / (float)settings->height, 0.1f, 100.0f);
 
 	//Camera matrix
 	glm::mat4 View = glm::lookAt(glm::vec3(4, 3, 3), glm::vec3(0, 0, 0), glm::vec3(0, 1, 0));
@@ -542,5 +725,6 @@ void Ngine::Matrix::Initialize(GLuint program)
 	//Model matrix
 	glm::mat4 Model = glm::mat4(1.0f);
 
-	MVP = Projection * View * Model;
+	VP = Projection * View;
+	MVP = VP * Model;
 }
@@ -1,9 +1,11 @@
 #pragma once
 #include "Window.h"
+#include "Resources.h"
 #include <glm/mat4x4.hpp>
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include <tiny_obj_loader.h>
+#include <cstdint>
 #include <vector>
 
 namespace Ngine {
@@ -13,30 +15,87 @@ namespace Ngine {
 		void Initialize(GLuint program);
 
 		GLuint matrixID;
+		glm::mat4 VP; //Projection * View, model part is added by Object::Interpolate
 		glm::mat4 MVP;
 	};
 
+	//Layout of a block compressed DDS file, read without touching pixel data
+	struct NAPI DDSInfo {
+		struct Mip {
+			unsigned int width, height;
+			long offset; //Byte offset of the level inside the file
+			unsigned int size;
+		};
+
+		unsigned int width, height;
+		unsigned int format, blockSize;
+		std::vector<Mip> mips;
+	};
+
+	struct Object;
+
+	//Per-object state copied at submit time, so the game may keep changing the object while the frame renders
+	struct NAPI DrawCommand {
+		Object* object; //Immediate geometry, has to stay unchanged while a packet referencing it is in flight
+		GLuint program, texture;
+		GLint layer, matrixID, layerID;
+		glm::mat4 MVP;
+		//Resident mesh as it was at submit time, Draw never looks into the resource table
+		bool resident;
+		MeshState mesh;
+	};
+
+	//Format of the geometry objects carry themselves
+	using ObjectLayout = VertexLayout<Position3f, Colour3f, UV2f>;
+
 	struct NAPI Object {
 		std::vector<glm::vec3> verticies;
 		std::vector<glm::vec3> color;
 		std::vector<glm::vec3> normals;
 		std::vector<glm::vec2> uvs;
-		GLuint program, texture;
-		GLuint VAO, VBO, CBO, UBO;
+		GLuint program = 0, texture = 0;
+		GLint layer = -1, layerID = -1; //Array layer of texture when it's a GL_TEXTURE_2D_ARRAY
+		GLuint VAO, VBO;
+		MeshRef mesh; //Resident geometry, when set Draw ignores the vectors above
 		Matrix mat;
+		glm::vec3 boundsMin = glm::vec3(0.0f), boundsMax = glm::vec3(0.0f); //Model space bounding box, filled by UpdateBounds
+		glm::vec3 position = glm::vec3(0.0f), previousPosition = glm::vec3(0.0f); //At the last two simulation ticks
 
-		void Draw();
+		void Draw() { Draw(Command()); };
+		void Draw(const DrawCommand& cmd); //Uses state from cmd, and the geometry of this object when it has no mesh
+		DrawCommand Command();
 		void InitMatrix();
-		void Tanslate(glm::vec3 v) { mat.MVP = glm::translate(mat.MVP, v); };
+		void UpdateBounds();
+		void Tanslate(glm::vec3 v) { position += v; };
+
+		//Call at the start of every simulation tick, before moving the object
+		void BeginTick() { previousPosition = position; };
+		//Builds MVP for a frame that lies alpha of the way between the last two ticks
+		void Interpolate(float alpha) { mat.MVP = glm::translate(mat.VP, glm::mix(previousPosition, position, alpha)); };
+	};
+
+	//Totals since start, diff two readings for a frame
+	struct NAPI RenderStats {
+		uint64_t drawCalls;
+		uint64_t uploadedBytes; //Texture and buffer data handed to the driver
 	};
 
 	class NAPI Gfx {
 	public:
 		static GLuint CompileShader(const char* vpath, const char* fpath);
 		static GLuint LoadBMP(const char* ipath);
+		//Tightly packed BGR or BGRA rows, bottom row first, exactly as OpenGL expects them
+		static std::vector<unsigned char> ReadBMP(const char* ipath, unsigned int& width, unsigned int& height, unsigned int& channels);
 		static GLuint LoadDDS(const char* ipath);
+		static DDSInfo ReadDDSInfo(const char* ipath);
 		static void LoadOBJLegacy(const char* opath, std::vector<glm::vec3>& verticies, std::vector<glm::vec2>& uvs, std::vector<glm::vec3>& normals, bool dds);
-		static void LoadOBJ(const char* opath, const char* mpath, std::vector<glm::vec3>& verticies, std::vector<glm::vec2>& uvs, std::vector<glm::vec3>& normals);
+		//Normals, and tangents when asked for, always come out one per vertex, generated where the file has none.
+		//UVs too, or empty when the file has no texture coordinates at all.
+		static void LoadOBJ(const char* opath, const char* mpath, std::vector<glm::vec3>& verticies, std::vector<glm::vec2>& uvs, std::vector<glm::vec3>& normals, std::vector<glm::vec4>* tangents = nullptr);
+
+		static RenderStats Stats() noexcept;
+		static void CountDraw() noexcept;
+		static void CountUpload(size_t bytes) noexcept;
 	};
 }
 
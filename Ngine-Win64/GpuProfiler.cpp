@@ -0,0 +1,252 @@
+#include "pch.h"
+#include "GpuProfiler.h"
+#include <spdlog/spdlog.h>
+#include <atomic>
+#include <cstring>
+#include <mutex>
+
+namespace {
+
+	constexpr int Frames = Ngine::GpuProfiler::Latency + 1;
+	constexpr int History = 60; //Samples in a rolling average
+	constexpr int SyncInterval = 120; //Frames between clock resyncs, GPU and CPU clocks drift apart
+
+	//Begin and end stamp of every scope, slot i uses queries 2i and 2i+1
+	struct Frame {
+		GLuint queries[Ngine::GpuProfiler::MaxScopes * 2] = {};
+		const char* names[Ngine::GpuProfiler::MaxScopes] = {};
+		bool ended[Ngine::GpuProfiler::MaxScopes] = {};
+		int count = 0;
+		GLuint last = 0; //Most recently issued query, results arrive in order
+		bool pending = false;
+	};
+
+	struct Average {
+		const char* name;
+		double samples[History];
+		int count = 0, next = 0;
+		double sum = 0.0, last = 0.0;
+
+		void Add(double ms)
+		{
+			if (count == History)
+				sum -= samples[next];
+			else
+				++count;
+			samples[next] = ms;
+			next = (next + 1) % History;
+			sum += ms;
+			last = ms;
+		}
+	};
+
+	bool enabled = false;
+	int track = 0;
+	Frame frames[Frames];
+	uint64_t current = 0;
+
+	int stack[Ngine::GpuProfiler::MaxScopes];
+	int depth = 0;
+	int skipped = 0; //Scopes opened after the frame ran out of slots
+
+	//GPU time stamp paired with the profiler clock
+	uint64_t syncTicks = 0;
+	GLint64 syncGpu = 0;
+	double ticksPerNs = 1.0;
+
+	std::mutex averagesMutex; //Averages are read from any thread
+	std::vector<Average> averages;
+	std::atomic<uint64_t> dropped = 0;
+
+	void Sync()
+	{
+		glGetInteger64v(GL_TIMESTAMP, &syncGpu);
+		syncTicks = Ngine::Profiler::Now();
+		ticksPerNs = Ngine::Profiler::TicksPerNanosecond();
+	}
+
+	uint64_t ToTicks(GLuint64 gpu)
+	{
+		return syncTicks + (uint64_t)(int64_t)((double)((int64_t)gpu - syncGpu) * ticksPerNs);
+	}
+
+	void AddSample(const char* name, double ms)
+	{
+		std::lock_guard<std::mutex> lock(averagesMutex);
+		for (auto& a : averages) {
+			if (a.name == name || strcmp(a.name, name) == 0) {
+				a.Add(ms);
+				return;
+			}
+		}
+		averages.push_back(Average{ name });
+		averages.back().Add(ms);
+	}
+
+	//False while the GPU is still behind, never waits
+	bool Resolve(Frame& frame)
+	{
+		if (!frame.pending)
+			return true;
+
+		GLint available = 0;
+		glGetQueryObjectiv(frame.last, GL_QUERY_RESULT_AVAILABLE, &available);
+		if (!available)
+			return false;
+
+		for (int i = 0; i < frame.count; ++i) {
+			if (!frame.ended[i])
+				continue;
+
+			GLuint64 begin = 0, end = 0;
+			glGetQueryObjectui64v(frame.queries[i * 2], GL_QUERY_RESULT, &begin);
+			glGetQueryObjectui64v(frame.queries[i * 2 + 1], GL_QUERY_RESULT, &end);
+			if (end < begin)
+				continue;
+
+			Ngine::Profiler::Record(track, frame.names[i], ToTicks(begin), ToTicks(end));
+			AddSample(frame.names[i], (double)(end - begin) / 1e6);
+		}
+
+		frame.pending = false;
+		return true;
+	}
+}
+
+void Ngine::GpuProfiler::Initialize()
+{
+	if (enabled)
+		return;
+
+	if (!GLEW_VERSION_3_3 && !GLEW_ARB_timer_query) {
+		spdlog::warn("Timer queries are not supported, GPU scopes are disabled");
+		return;
+	}
+
+	GLint bits = 0;
+	glGetQueryiv(GL_TIMESTAMP, GL_QUERY_COUNTER_BITS, &bits);
+	if (bits == 0) {
+		spdlog::warn("Driver reports 0 bit timestamps, GPU scopes are disabled");
+		return;
+	}
+
+	for (auto& frame : frames) {
+		glGenQueries(MaxScopes * 2, frame.queries);
+		frame.count = 0;
+		frame.pending = false;
+	}
+
+	if (!track)
+		track = Ngine::Profiler::Track("GPU");
+
+	current = 0;
+	depth = skipped = 0;
+	Sync();
+	enabled = true;
+}
+
+void Ngine::GpuProfiler::Shutdown()
+{
+	if (!enabled)
+		return;
+
+	for (auto& frame : frames) {
+		glDeleteQueries(MaxScopes * 2, frame.queries);
+		frame.pending = false;
+	}
+	enabled = false;
+}
+
+bool Ngine::GpuProfiler::Enabled() noexcept
+{
+	return enabled;
+}
+
+void Ngine::GpuProfiler::BeginFrame()
+{
+	if (!enabled)
+		return;
+
+	while (depth > 0 || skipped > 0)
+		End();
+
+	++current;
+	if (current % SyncInterval == 0)
+		Sync();
+
+	//Slot about to be reused holds the oldest frame, if the GPU still isn't done with it the results are lost
+	Frame& next = frames[current % Frames];
+	if (!Resolve(next)) {
+		next.pending = false;
+		dropped.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	for (uint64_t i = current >= Frames - 1 ? current - (Frames - 1) : 0; i < current; ++i)
+		if (!Resolve(frames[i % Frames]))
+			break;
+
+	next.count = 0;
+}
+
+void Ngine::GpuProfiler::Begin(const char* name)
+{
+	if (!enabled)
+		return;
+
+	Frame& frame = frames[current % Frames];
+	if (skipped > 0 || frame.count == MaxScopes) {
+		++skipped;
+		return;
+	}
+
+	int i = frame.count++;
+	frame.names[i] = name;
+	frame.ended[i] = false;
+	glQueryCounter(frame.queries[i * 2], GL_TIMESTAMP);
+	frame.last = frame.queries[i * 2];
+	frame.pending = true;
+	stack[depth++] = i;
+}
+
+void Ngine::GpuProfiler::End()
+{
+	if (!enabled)
+		return;
+
+	if (skipped > 0) {
+		--skipped;
+		return;
+	}
+	if (depth == 0)
+		return;
+
+	Frame& frame = frames[current % Frames];
+	int i = stack[--depth];
+	glQueryCounter(frame.queries[i * 2 + 1], GL_TIMESTAMP);
+	frame.ended[i] = true;
+	frame.last = frame.queries[i * 2 + 1];
+}
+
+std::vector<Ngine::GpuTiming> Ngine::GpuProfiler::Averages()
+{
+	std::lock_guard<std::mutex> lock(averagesMutex);
+	std::vector<GpuTiming> result;
+	result.reserve(averages.size());
+	for (const auto& a : averages)
+		result.push_back(GpuTiming{ a.name, a.sum / a.count, a.last, a.count });
+	return result;
+}
+
+void Ngine::GpuProfiler::LogAverages()
+{
+	for (const auto& t : Averages())
+		spdlog::info("GPU {}: {:.3f} ms average, {:.3f} ms last", t.name, t.average, t.last);
+
+	if (uint64_t lost = Dropped())
+		spdlog::info("GPU timings of {} frames were not ready in time", lost);
+}
+
+uint64_t Ngine::GpuProfiler::Dropped() noexcept
+{
+	return dropped.load(std::memory_order_relaxed);
+}
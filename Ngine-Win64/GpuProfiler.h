@@ -0,0 +1,55 @@
+#pragma once
+#include "Macro.h"
+#include "Profiler.h"
+#include <gl/glew.h>
+#include <string>
+#include <vector>
+
+namespace Ngine {
+
+	struct NAPI GpuTiming {
+		std::string name;
+		double average; //Milliseconds over the last samples
+		double last;
+		int samples;
+	};
+
+	//Timestamp queries around named GPU scopes. Results are read a few frames later so the CPU never waits for the GPU,
+	//then placed on a "GPU" track of the CPU profiler. Every call needs the thread that owns the context.
+	class NAPI GpuProfiler {
+	public:
+		static constexpr int Latency = 3; //Frames in flight before a result is read
+		static constexpr int MaxScopes = 64; //Per frame, deeper frames drop the rest
+
+		//Needs GL 3.3 or ARB_timer_query, otherwise scopes do nothing
+		static void Initialize();
+		static void Shutdown();
+		static bool Enabled() noexcept;
+
+		//Starts a new frame of scopes and collects the frames that finished on the GPU
+		static void BeginFrame();
+
+		//name has to outlive the profiler, scopes nest
+		static void Begin(const char* name);
+		static void End();
+
+		static std::vector<GpuTiming> Averages();
+		static void LogAverages();
+		static uint64_t Dropped() noexcept; //Frames whose results weren't ready in time
+	};
+
+	class GpuZone {
+	public:
+		explicit GpuZone(const char* name) { GpuProfiler::Begin(name); }
+		~GpuZone() { GpuProfiler::End(); }
+
+		GpuZone(const GpuZone&) = delete;
+		GpuZone& operator=(const GpuZone&) = delete;
+	};
+}
+
+#if NGINE_PROFILE
+#define NGINE_GPU_ZONE(name) Ngine::GpuZone NGINE_ZONE_JOIN(gpuZone, __LINE__)(name)
+#else
+#define NGINE_GPU_ZONE(name)
+#endif
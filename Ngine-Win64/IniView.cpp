@@ -0,0 +1,146 @@
+#include "pch.h"
+#include "IniView.h"
+#include <cstring>
+#include <new>
+
+namespace {
+
+	std::string_view Trim(std::string_view s)
+	{
+		const char* whitespace = " \t\n\r\f\v";
+		size_t first = s.find_first_not_of(whitespace);
+		if (first == std::string_view::npos)
+			return {};
+		size_t last = s.find_last_not_of(whitespace);
+		return s.substr(first, last - first + 1);
+	}
+
+	//First '=' that is not escaped as "\="
+	size_t FindEquals(std::string_view line)
+	{
+		for (size_t i = 0; i < line.size(); ++i) {
+			if (line[i] == '\\' && i + 1 < line.size() && line[i + 1] == '=')
+				++i;
+			else if (line[i] == '=')
+				return i;
+		}
+		return std::string_view::npos;
+	}
+}
+
+void* Ngine::IniView::CountingResource::do_allocate(size_t size, size_t align)
+{
+	bytes += size;
+	++allocations;
+	if (align > __STDCPP_DEFAULT_NEW_ALIGNMENT__)
+		return ::operator new(size, std::align_val_t(align));
+	return ::operator new(size);
+}
+
+void Ngine::IniView::CountingResource::do_deallocate(void* p, size_t size, size_t align)
+{
+	if (align > __STDCPP_DEFAULT_NEW_ALIGNMENT__)
+		::operator delete(p, std::align_val_t(align));
+	else
+		::operator delete(p);
+}
+
+std::string_view Ngine::IniView::Section::Get(std::string_view key) const noexcept
+{
+	auto it = m_Index.find(key);
+	return it == m_Index.end() ? std::string_view() : m_Entries[it->second].second;
+}
+
+Ngine::IniView::IniView(const char* path) : m_File(Vfs::Open(path)), m_Arena(m_File.Size() / 2 + 1024, &m_Upstream), m_Sections(&m_Arena), m_SectionIndex(&m_Arena)
+{
+	Parse(m_File.View());
+}
+
+Ngine::IniView::IniView(std::string_view buffer) : m_Arena(buffer.size() / 2 + 1024, &m_Upstream), m_Sections(&m_Arena), m_SectionIndex(&m_Arena)
+{
+	Parse(buffer);
+}
+
+const Ngine::IniView::Section* Ngine::IniView::Find(std::string_view section) const noexcept
+{
+	auto it = m_SectionIndex.find(Trim(section));
+	return it == m_SectionIndex.end() ? nullptr : &m_Sections[it->second];
+}
+
+std::string_view Ngine::IniView::Get(std::string_view section, std::string_view key) const noexcept
+{
+	const Section* s = Find(section);
+	return s ? s->Get(Trim(key)) : std::string_view();
+}
+
+bool Ngine::IniView::Has(std::string_view section, std::string_view key) const noexcept
+{
+	const Section* s = Find(section);
+	return s && s->Has(Trim(key));
+}
+
+void Ngine::IniView::Parse(std::string_view text)
+{
+	//Skip UTF-8 byte order mark
+	if (text.size() >= 3 && text.compare(0, 3, "\xEF\xBB\xBF") == 0)
+		text.remove_prefix(3);
+
+	Section* current = nullptr;
+
+	while (!text.empty()) {
+		size_t eol = text.find('\n');
+		std::string_view line = Trim(text.substr(0, eol));
+		text.remove_prefix(eol == std::string_view::npos ? text.size() : eol + 1);
+
+		if (line.empty() || line[0] == ';')
+			continue;
+
+		//Same rules as mINI::INIParser::parseLine, a bracket line without ']' is tried as key=value
+		if (line[0] == '[') {
+			std::string_view header = line.substr(0, line.find(';'));
+			size_t closing = header.rfind(']');
+			if (closing != std::string_view::npos) {
+				std::string_view name = Trim(header.substr(1, closing - 1));
+				auto it = m_SectionIndex.find(name);
+				if (it == m_SectionIndex.end()) {
+					it = m_SectionIndex.emplace(name, m_Sections.size()).first;
+					m_Sections.emplace_back(name, &m_Arena);
+				}
+				current = &m_Sections[it->second];
+				continue;
+			}
+		}
+
+		size_t equals = FindEquals(line);
+		if (equals == std::string_view::npos || !current)
+			continue;
+
+		std::string_view key = Unescape(Trim(line.substr(0, equals)));
+		std::string_view value = Trim(line.substr(equals + 1));
+
+		auto it = current->m_Index.find(key);
+		if (it != current->m_Index.end()) {
+			current->m_Entries[it->second].second = value; //Later assignments win, like in mINI
+		}
+		else {
+			current->m_Index.emplace(key, current->m_Entries.size());
+			current->m_Entries.emplace_back(key, value);
+		}
+	}
+}
+
+std::string_view Ngine::IniView::Unescape(std::string_view key)
+{
+	if (key.find("\\=") == std::string_view::npos)
+		return key;
+
+	//Rare case, the rewritten key has to live somewhere so it goes to the arena
+	char* out = (char*)m_Arena.allocate(key.size(), 1);
+	size_t n = 0;
+	for (size_t i = 0; i < key.size(); ++i) {
+		if (key[i] == '\\' && i + 1 < key.size() && key[i + 1] == '=')
+			continue;
+		out[n++] = key[i];
+	}
+	return std::string_view(out, n);
+}
@@ -0,0 +1,107 @@
+#pragma once
+#include "Vfs.h"
+#include <memory_resource>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace Ngine {
+
+	//Case insensitive hash and compare so string_view and const char* lookups never build a std::string
+	struct IniKeyHash {
+		using is_transparent = void;
+
+		size_t operator()(std::string_view key) const noexcept {
+			size_t hash = 14695981039346656037ull; //FNV-1a over lower cased ASCII
+			for (char c : key) {
+				hash ^= (unsigned char)(c >= 'A' && c <= 'Z' ? c + ('a' - 'A') : c);
+				hash *= 1099511628211ull;
+			}
+			return hash;
+		}
+	};
+
+	struct IniKeyEqual {
+		using is_transparent = void;
+
+		bool operator()(std::string_view a, std::string_view b) const noexcept {
+			if (a.size() != b.size())
+				return false;
+			for (size_t i = 0; i < a.size(); ++i) {
+				char x = a[i] >= 'A' && a[i] <= 'Z' ? a[i] + ('a' - 'A') : a[i];
+				char y = b[i] >= 'A' && b[i] <= 'Z' ? b[i] + ('a' - 'A') : b[i];
+				if (x != y)
+					return false;
+			}
+			return true;
+		}
+	};
+
+	//Read-only INI parser following mINI's syntax, meant for big per-track files.
+	//Names and values are views into the mapped or packed file, all bookkeeping lives in one arena.
+	class NAPI IniView {
+	public:
+		using Index = std::pmr::unordered_map<std::string_view, size_t, IniKeyHash, IniKeyEqual>;
+		using Entry = std::pair<std::string_view, std::string_view>;
+
+		class NAPI Section {
+		public:
+			explicit Section(std::string_view name, std::pmr::memory_resource* arena) : m_Name(name), m_Entries(arena), m_Index(arena) {}
+
+			std::string_view Name() const noexcept { return m_Name; }
+			std::string_view Get(std::string_view key) const noexcept; //Empty when missing
+			bool Has(std::string_view key) const noexcept { return m_Index.find(key) != m_Index.end(); }
+
+			//Entries in file order
+			size_t Size() const noexcept { return m_Entries.size(); }
+			std::pmr::vector<Entry>::const_iterator begin() const noexcept { return m_Entries.begin(); }
+			std::pmr::vector<Entry>::const_iterator end() const noexcept { return m_Entries.end(); }
+
+		private:
+			friend class IniView;
+
+			std::string_view m_Name;
+			std::pmr::vector<Entry> m_Entries;
+			Index m_Index;
+		};
+
+		//Through the VFS, so packed files parse in place
+		explicit IniView(const char* path);
+		//Parses memory owned by the caller, it has to outlive the view
+		explicit IniView(std::string_view buffer);
+
+		IniView(const IniView&) = delete;
+		IniView& operator=(const IniView&) = delete;
+
+		const Section* Find(std::string_view section) const noexcept;
+		std::string_view Get(std::string_view section, std::string_view key) const noexcept;
+		bool Has(std::string_view section, std::string_view key) const noexcept;
+
+		size_t Size() const noexcept { return m_Sections.size(); }
+		std::pmr::vector<Section>::const_iterator begin() const noexcept { return m_Sections.begin(); }
+		std::pmr::vector<Section>::const_iterator end() const noexcept { return m_Sections.end(); }
+
+		//Bytes the arena requested from the heap and how many times it did so
+		size_t ArenaBytes() const noexcept { return m_Upstream.bytes; }
+		size_t ArenaAllocations() const noexcept { return m_Upstream.allocations; }
+
+	private:
+		struct CountingResource : std::pmr::memory_resource {
+			size_t bytes = 0, allocations = 0;
+
+			void* do_allocate(size_t size, size_t align) override;
+			void do_deallocate(void* p, size_t size, size_t align) override;
+			bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override { return this == &other; }
+		};
+
+		void Parse(std::string_view text);
+		std::string_view Unescape(std::string_view key);
+
+		VfsFile m_File;
+		CountingResource m_Upstream;
+		std::pmr::monotonic_buffer_resource m_Arena;
+		std::pmr::vector<Section> m_Sections;
+		Index m_SectionIndex;
+	};
+}
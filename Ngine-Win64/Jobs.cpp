@@ -0,0 +1,321 @@
+#include "pch.h"
+#include "Jobs.h"
+#include "Memory.h"
+#include "Profiler.h"
+#include <spdlog/spdlog.h>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+	struct Job {
+		Ngine::JobFunction fn;
+		Ngine::JobCounter* counter;
+		int owner; //Thread whose pool the job came from, -1 for the shared one
+		Job* next; //Link in the owner's returned list
+	};
+
+	//Chase-Lev deque, the owner pushes and pops at the bottom while thieves take from the top
+	class WorkDeque {
+	public:
+		bool Push(Job* job) noexcept
+		{
+			int64_t b = m_Bottom.load(std::memory_order_relaxed);
+			int64_t t = m_Top.load(std::memory_order_acquire);
+			if (b - t >= Capacity)
+				return false;
+
+			m_Jobs[b & (Capacity - 1)].store(job, std::memory_order_relaxed);
+			m_Bottom.store(b + 1, std::memory_order_release);
+			return true;
+		}
+
+		Job* Pop() noexcept
+		{
+			int64_t b = m_Bottom.load(std::memory_order_relaxed) - 1;
+			m_Bottom.store(b, std::memory_order_relaxed);
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+			int64_t t = m_Top.load(std::memory_order_relaxed);
+
+			if (t > b) {
+				m_Bottom.store(b + 1, std::memory_order_relaxed);
+				return nullptr;
+			}
+
+			Job* job = m_Jobs[b & (Capacity - 1)].load(std::memory_order_relaxed);
+			if (t == b) {
+				//Last job, race a thief for it
+				if (!m_Top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+					job = nullptr;
+				m_Bottom.store(b + 1, std::memory_order_relaxed);
+			}
+			return job;
+		}
+
+		Job* Steal() noexcept
+		{
+			int64_t t = m_Top.load(std::memory_order_acquire);
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+			int64_t b = m_Bottom.load(std::memory_order_acquire);
+			if (t >= b)
+				return nullptr;
+
+			Job* job = m_Jobs[t & (Capacity - 1)].load(std::memory_order_relaxed);
+			if (!m_Top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+				return nullptr;
+			return job;
+		}
+
+	private:
+		static constexpr int64_t Capacity = 4096;
+
+		alignas(64) std::atomic<int64_t> m_Top = 0;
+		alignas(64) std::atomic<int64_t> m_Bottom = 0;
+		std::atomic<Job*> m_Jobs[Capacity] = {};
+	};
+
+	std::vector<std::unique_ptr<WorkDeque>> deques; //Index 0 belongs to the thread that called Initialize
+	std::vector<std::thread> workers;
+	std::atomic<bool> running = false;
+	std::atomic<uint32_t> signal = 0; //Bumped on every submission, idle workers wait for it to change
+
+	//Jobs submitted by threads without a deque, eg. the render thread
+	std::mutex injectedMutex;
+	std::deque<Job*> injected;
+
+	thread_local int threadIndex = -1;
+
+	//Every pool thread allocates jobs from its own pool without a lock. A job run on another thread is handed back
+	//through the owner's returned list, a lock free stack the owner empties whole on its next allocation.
+	struct JobPool {
+		Ngine::Pool<Job, 1024> pool;
+		alignas(64) std::atomic<Job*> returned = nullptr;
+
+		void Reclaim()
+		{
+			Job* job = returned.exchange(nullptr, std::memory_order_acquire);
+			while (job) {
+				Job* next = job->next;
+				pool.Destroy(job);
+				job = next;
+			}
+		}
+	};
+
+	std::vector<std::unique_ptr<JobPool>> pools; //Same index as deques
+
+	//Threads outside the pool share one behind a lock
+	std::mutex sharedMutex;
+	Ngine::Pool<Job, 1024> shared;
+
+	Job* CreateJob(Ngine::JobFunction&& fn, Ngine::JobCounter* counter)
+	{
+		if (threadIndex >= 0 && (size_t)threadIndex < pools.size()) {
+			JobPool& own = *pools[threadIndex];
+			if (own.returned.load(std::memory_order_relaxed))
+				own.Reclaim();
+			return own.pool.Create(Job{ std::move(fn), counter, threadIndex, nullptr });
+		}
+
+		std::lock_guard<std::mutex> lock(sharedMutex);
+		return shared.Create(Job{ std::move(fn), counter, -1, nullptr });
+	}
+
+	void DestroyJob(Job* job)
+	{
+		if (job->owner < 0) {
+			std::lock_guard<std::mutex> lock(sharedMutex);
+			shared.Destroy(job);
+			return;
+		}
+
+		JobPool& owner = *pools[job->owner];
+		if (job->owner == threadIndex) {
+			owner.pool.Destroy(job);
+			return;
+		}
+
+		//Captures go now, only the slot waits for the owner
+		job->fn = Ngine::JobFunction();
+		job->next = owner.returned.load(std::memory_order_relaxed);
+		while (!owner.returned.compare_exchange_weak(job->next, job, std::memory_order_release, std::memory_order_relaxed));
+	}
+
+	void Execute(Job* job)
+	{
+		NGINE_ZONE("Job");
+
+		try {
+			job->fn();
+		}
+		catch (...) {
+			Ngine::JobCounter* counter = job->counter;
+			if (counter && !counter->failed.exchange(true))
+				counter->error = std::current_exception();
+			else if (!counter)
+				spdlog::error("Job without a counter threw an exception");
+		}
+
+		Ngine::JobCounter* counter = job->counter;
+		DestroyJob(job);
+		if (counter)
+			counter->value.fetch_sub(1, std::memory_order_acq_rel);
+	}
+
+	Job* Steal(int self)
+	{
+		//Start after self on every thread so thieves don't all hit the same deque. self is -1 off the pool, every deque is a victim then.
+		size_t count = deques.size();
+		size_t start = (size_t)(self + 1);
+		for (size_t i = 0; i < count; ++i) {
+			size_t victim = (start + i) % count;
+			if (self >= 0 && victim == (size_t)self)
+				continue;
+			if (Job* job = deques[victim]->Steal())
+				return job;
+		}
+
+		std::lock_guard<std::mutex> lock(injectedMutex);
+		if (injected.empty())
+			return nullptr;
+		Job* job = injected.front();
+		injected.pop_front();
+		return job;
+	}
+
+	void WorkerMain(int index)
+	{
+		threadIndex = index;
+		Ngine::Profiler::SetThreadName(("Worker " + std::to_string(index)).c_str());
+
+		//Leaves only once shut down and every queue is empty
+		while (true) {
+			uint32_t seen = signal.load(std::memory_order_acquire);
+			Job* job = deques[index]->Pop();
+			if (!job)
+				job = Steal(index);
+
+			if (job) {
+				Execute(job);
+				continue;
+			}
+
+			if (!running.load(std::memory_order_acquire))
+				break;
+			signal.wait(seen, std::memory_order_acquire);
+		}
+	}
+}
+
+void Ngine::Jobs::Initialize(int count)
+{
+	if (running)
+		Shutdown();
+
+	if (count < 0)
+		count = (int)std::max(std::thread::hardware_concurrency(), 1u) - 1;
+
+	threadIndex = 0;
+	deques.clear();
+	pools.clear();
+	for (int i = 0; i <= count; ++i) {
+		deques.push_back(std::make_unique<WorkDeque>());
+		pools.push_back(std::make_unique<JobPool>());
+	}
+
+	running = true;
+	for (int i = 1; i <= count; ++i)
+		workers.emplace_back(WorkerMain, i);
+
+	spdlog::info("Job system started with {} workers", count);
+}
+
+void Ngine::Jobs::Shutdown()
+{
+	if (!running)
+		return;
+
+	//Jobs left in the caller's deque can only be popped by the caller
+	while (RunOne());
+
+	running = false;
+	signal.fetch_add(1, std::memory_order_release);
+	signal.notify_all();
+	for (auto& t : workers)
+		t.join();
+	workers.clear();
+	deques.clear();
+
+	//Every job has run, hand the slots still waiting in returned lists back before the pools go
+	for (auto& p : pools)
+		p->Reclaim();
+	pools.clear();
+}
+
+int Ngine::Jobs::Workers() noexcept
+{
+	return running.load(std::memory_order_acquire) ? (int)workers.size() : 0;
+}
+
+int Ngine::Jobs::ThreadIndex() noexcept
+{
+	return threadIndex;
+}
+
+void Ngine::Jobs::Run(JobFunction fn, JobCounter* counter)
+{
+	if (counter)
+		counter->value.fetch_add(1, std::memory_order_relaxed);
+
+	Job* job = CreateJob(std::move(fn), counter);
+
+	if (SingleThreaded()) {
+		Execute(job);
+		return;
+	}
+
+	if (threadIndex >= 0) {
+		//A full deque means plenty of work is queued, running inline is as good as anything
+		if (!deques[threadIndex]->Push(job)) {
+			Execute(job);
+			return;
+		}
+	}
+	else {
+		std::lock_guard<std::mutex> lock(injectedMutex);
+		injected.push_back(job);
+	}
+
+	signal.fetch_add(1, std::memory_order_release);
+	signal.notify_one();
+}
+
+void Ngine::Jobs::Wait(JobCounter& counter)
+{
+	while (!counter.Done()) {
+		if (!RunOne())
+			std::this_thread::yield();
+	}
+
+	if (counter.failed.exchange(false))
+		std::rethrow_exception(std::exchange(counter.error, nullptr));
+}
+
+bool Ngine::Jobs::RunOne()
+{
+	if (!running.load(std::memory_order_acquire))
+		return false;
+
+	Job* job = threadIndex >= 0 ? deques[threadIndex]->Pop() : nullptr;
+	if (!job)
+		job = Steal(threadIndex);
+	if (!job)
+		return false;
+
+	Execute(job);
+	return true;
+}
@@ -0,0 +1,151 @@
+#pragma once
+#include "Macro.h"
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <exception>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace Ngine {
+
+	//Move-only callable keeping captures up to 56 bytes inline, so submitting a job doesn't allocate
+	class NAPI JobFunction {
+	public:
+		JobFunction() = default;
+
+		template<typename F, typename = std::enable_if_t<!std::is_same_v<std::decay_t<F>, JobFunction>>>
+		JobFunction(F&& fn)
+		{
+			using T = std::decay_t<F>;
+			if constexpr (sizeof(T) <= Size && alignof(T) <= alignof(std::max_align_t) && std::is_nothrow_move_constructible_v<T>) {
+				new (m_Storage) T(std::forward<F>(fn));
+				m_Ops = &InlineOps<T>;
+			}
+			else {
+				*reinterpret_cast<T**>(m_Storage) = new T(std::forward<F>(fn));
+				m_Ops = &HeapOps<T>;
+			}
+		}
+
+		JobFunction(JobFunction&& other) noexcept { *this = std::move(other); }
+		JobFunction& operator=(JobFunction&& other) noexcept
+		{
+			if (this != &other) {
+				Reset();
+				if (other.m_Ops) {
+					other.m_Ops->move(m_Storage, other.m_Storage);
+					m_Ops = std::exchange(other.m_Ops, nullptr);
+				}
+			}
+			return *this;
+		}
+		~JobFunction() { Reset(); }
+
+		void operator()() { m_Ops->call(m_Storage); }
+		explicit operator bool() const noexcept { return m_Ops != nullptr; }
+
+	private:
+		struct Ops {
+			void (*call)(void* storage);
+			void (*move)(void* to, void* from) noexcept;
+			void (*destroy)(void* storage) noexcept;
+		};
+
+		template<typename T>
+		static constexpr Ops InlineOps = {
+			[](void* p) { (*static_cast<T*>(p))(); },
+			[](void* to, void* from) noexcept { new (to) T(std::move(*static_cast<T*>(from))); static_cast<T*>(from)->~T(); },
+			[](void* p) noexcept { static_cast<T*>(p)->~T(); }
+		};
+
+		template<typename T>
+		static constexpr Ops HeapOps = {
+			[](void* p) { (**static_cast<T**>(p))(); },
+			[](void* to, void* from) noexcept { *static_cast<T**>(to) = *static_cast<T**>(from); },
+			[](void* p) noexcept { delete *static_cast<T**>(p); }
+		};
+
+		void Reset() noexcept
+		{
+			if (m_Ops)
+				std::exchange(m_Ops, nullptr)->destroy(m_Storage);
+		}
+
+		static constexpr size_t Size = 56;
+		alignas(std::max_align_t) unsigned char m_Storage[Size];
+		const Ops* m_Ops = nullptr;
+	};
+
+	//Fork/join handle, Run increments it and every finished job decrements it
+	struct NAPI JobCounter {
+		std::atomic<int> value = 0;
+		std::atomic<bool> failed = false;
+		std::exception_ptr error; //First exception thrown by one of the jobs, rethrown by Wait
+
+		bool Done() const noexcept { return value.load(std::memory_order_acquire) == 0; }
+	};
+
+	//Fixed pool of workers, each with its own work stealing deque.
+	//With 0 workers every job runs inline on submission, in order, for deterministic debugging.
+	class NAPI Jobs {
+	public:
+		//-1 starts one worker per core besides the calling thread, which becomes thread 0
+		static void Initialize(int workers = -1);
+		//Finishes queued jobs and joins the workers
+		static void Shutdown();
+
+		static int Workers() noexcept;
+		static bool SingleThreaded() noexcept { return Workers() == 0; }
+		//0 for the thread that called Initialize, 1..Workers for workers, -1 for any other thread
+		static int ThreadIndex() noexcept;
+
+		static void Run(JobFunction job, JobCounter* counter = nullptr);
+		//Runs other jobs while waiting, rethrows the first error of the counter's jobs
+		static void Wait(JobCounter& counter);
+
+		//Calls fn(first, last) over subranges of at most grain elements and waits for all of them
+		template<typename F>
+		static void ParallelFor(size_t begin, size_t end, size_t grain, const F& fn)
+		{
+			grain = std::max<size_t>(grain, 1);
+			if (SingleThreaded()) {
+				for (size_t i = begin; i < end; i += grain)
+					fn(i, std::min(i + grain, end));
+				return;
+			}
+
+			//Top level split runs as a job too, so an exception from fn can't leave jobs pointing at this frame
+			JobCounter counter;
+			Run([begin, end, grain, &fn, &counter]() { Split(begin, end, grain, fn, counter); }, &counter);
+			Wait(counter);
+		}
+
+	private:
+		//Halves are handed out to thieves, so big ranges spread over the workers in log steps
+		template<typename F>
+		static void Split(size_t begin, size_t end, size_t grain, const F& fn, JobCounter& counter)
+		{
+			while (end - begin > grain) {
+				size_t mid = begin + (end - begin) / 2;
+				Run([mid, end, grain, &fn, &counter]() { Split(mid, end, grain, fn, counter); }, &counter);
+				end = mid;
+			}
+			if (begin < end)
+				fn(begin, end);
+		}
+
+		static bool RunOne();
+	};
+
+	//Keeps the job system running for the lifetime of a scope, usually main.
+	//Workers have to be joined before exit, a DLL can't do that safely from its static destructors.
+	struct NAPI JobScope {
+		explicit JobScope(int workers = -1) { Jobs::Initialize(workers); }
+		~JobScope() { Jobs::Shutdown(); }
+
+		JobScope(const JobScope&) = delete;
+		JobScope& operator=(const JobScope&) = delete;
+	};
+}
@@ -0,0 +1,301 @@
+#include "pch.h"
+#include "Lighting.h"
+#include "Gfx.h"
+#include "Jobs.h"
+#include "Log.h"
+#include "Profiler.h"
+#include <spdlog/spdlog.h>
+#include <algorithm>
+#include <bit>
+#include <chrono>
+#include <cmath>
+#include <limits>
+
+#if defined(_M_X64) || defined(__SSE2__)
+#include <emmintrin.h>
+#define NGINE_SSE2
+#endif
+
+namespace {
+
+	constexpr size_t MaxLights = 0xFFFF; //Indices are 16 bit
+	constexpr unsigned int MaxTiles = 0x10000; //Hits keep the cluster within a slice in 16 bits
+	constexpr float Infinity = std::numeric_limits<float>::infinity();
+}
+
+float Ngine::LightClusters::SliceDepth(unsigned int slice) const noexcept
+{
+	return m_Settings.nearDepth * std::pow(m_Settings.farDepth / m_Settings.nearDepth, (float)slice / (float)m_Settings.slices);
+}
+
+void Ngine::LightClusters::Build(const std::vector<PointLight>& lights, const glm::mat4& view, const glm::mat4& projection, const ClusterSettings& settings)
+{
+	NGINE_ZONE("LightClusters::Build");
+	auto start = std::chrono::steady_clock::now();
+
+	if (!settings.tilesX || !settings.tilesY || !settings.slices || settings.tilesX * settings.tilesY > MaxTiles) {
+		spdlog::error("Cluster grid of {}x{}x{} is empty or has more than {} tiles per slice", settings.tilesX, settings.tilesY, settings.slices, MaxTiles);
+		throw Ngine::Exception(__LINE__, __FILE__, "Invalid cluster grid");
+	}
+	if (!(settings.nearDepth > 0.0f) || !(settings.farDepth > settings.nearDepth)) {
+		spdlog::error("Cluster depth range {} to {} is invalid", settings.nearDepth, settings.farDepth);
+		throw Ngine::Exception(__LINE__, __FILE__, "Invalid cluster depth range");
+	}
+	if (projection[2][3] != -1.0f || projection[3][3] != 0.0f) {
+		spdlog::error("Projection with P[2][3] = {} and P[3][3] = {} isn't a perspective one", projection[2][3], projection[3][3]);
+		throw Ngine::Exception(__LINE__, __FILE__, "Clustered lighting needs a perspective projection");
+	}
+
+	m_Settings = settings;
+	m_Projection = glm::vec4(projection[0][0], projection[1][1], projection[2][2], projection[3][2]);
+	m_SliceScale = (float)settings.slices / std::log(settings.farDepth / settings.nearDepth);
+
+	size_t count = lights.size();
+	if (count > MaxLights) {
+		NGINE_LOG_WARN_LIMITED(5000, "{} point lights, only the first {} are clustered", count, MaxLights);
+		count = MaxLights;
+	}
+
+	//Depth is distance in front of the camera from here on, view space looks down -z
+	auto sliceOf = [this](float depth) {
+		if (depth <= m_Settings.nearDepth)
+			return 0;
+		return std::min((int)(std::log(depth / m_Settings.nearDepth) * m_SliceScale), (int)m_Settings.slices - 1);
+	};
+
+	m_Spheres.resize(count);
+	m_SliceRange.resize(count);
+	m_Lights.resize(count * 2);
+	for (size_t i = 0; i < count; ++i) {
+		const PointLight& light = lights[i];
+		glm::vec3 p = glm::vec3(view * glm::vec4(light.position, 1.0f));
+		m_Spheres[i] = glm::vec4(p.x, p.y, -p.z, light.radius);
+		m_Lights[i * 2] = glm::vec4(p, light.radius);
+		m_Lights[i * 2 + 1] = glm::vec4(light.colour, 0.0f);
+
+		float nearest = -p.z - light.radius, furthest = -p.z + light.radius;
+		if (furthest <= 0.0f || nearest >= settings.farDepth || !(light.radius > 0.0f))
+			m_SliceRange[i] = 1u << 16; //Behind the camera or past far, first > last
+		else
+			m_SliceRange[i] = (uint32_t)sliceOf(nearest) << 16 | (uint32_t)sliceOf(furthest);
+	}
+
+	//Slices don't share anything, each fills its own lists
+	m_Slices.resize(settings.slices);
+	Ngine::Jobs::ParallelFor(0, settings.slices, 1, [this](size_t first, size_t last) {
+		for (size_t slice = first; slice < last; ++slice)
+			BinSlice((unsigned int)slice);
+		});
+
+	//Concatenated in slice order, so offsets only need the indices of the slices before
+	const size_t tiles = (size_t)settings.tilesX * settings.tilesY;
+	size_t total = 0;
+	m_Stats = Stats{ count, 0, 0, 0, 0.0 };
+	for (const Slice& slice : m_Slices) {
+		total += slice.indices.size();
+		m_Stats.overflow += slice.overflow;
+		m_Stats.maxPerCluster = std::max(m_Stats.maxPerCluster, slice.maxCount);
+	}
+
+	m_Indices.resize(total);
+	m_Clusters.resize(tiles * settings.slices * 2);
+	size_t base = 0;
+	for (unsigned int k = 0; k < settings.slices; ++k) {
+		const Slice& slice = m_Slices[k];
+		std::copy(slice.indices.begin(), slice.indices.end(), m_Indices.begin() + base);
+		uint32_t* cluster = m_Clusters.data() + k * tiles * 2;
+		for (size_t c = 0; c < tiles; ++c) {
+			cluster[c * 2] = (uint32_t)(base + slice.offsets[c]);
+			cluster[c * 2 + 1] = slice.counts[c];
+		}
+		base += slice.indices.size();
+	}
+
+	m_Stats.references = total;
+	m_Stats.ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+void Ngine::LightClusters::BinSlice(unsigned int k)
+{
+	const ClusterSettings& s = m_Settings;
+	Slice& slice = m_Slices[k];
+
+	//The first slice reaches down to the camera, nothing in front of near goes unlit
+	const float dn = k == 0 ? 0.0f : SliceDepth(k), df = SliceDepth(k + 1);
+
+	//A tile spans ndc a to b, in view space that is a * depth / P[0][0]. Take whichever end of the slice is further out.
+	const size_t columns = (s.tilesX + 3) & ~3u;
+	slice.minX.assign(columns, Infinity);
+	slice.maxX.assign(columns, -Infinity);
+	for (unsigned int x = 0; x < s.tilesX; ++x) {
+		float a = -1.0f + 2.0f * x / s.tilesX, b = -1.0f + 2.0f * (x + 1) / s.tilesX;
+		slice.minX[x] = std::min(a * dn, a * df) / m_Projection.x;
+		slice.maxX[x] = std::max(b * dn, b * df) / m_Projection.x;
+	}
+	slice.minY.resize(s.tilesY);
+	slice.maxY.resize(s.tilesY);
+	for (unsigned int y = 0; y < s.tilesY; ++y) {
+		float a = -1.0f + 2.0f * y / s.tilesY, b = -1.0f + 2.0f * (y + 1) / s.tilesY;
+		slice.minY[y] = std::min(a * dn, a * df) / m_Projection.y;
+		slice.maxY[y] = std::max(b * dn, b * df) / m_Projection.y;
+	}
+
+	const size_t tiles = (size_t)s.tilesX * s.tilesY;
+	slice.hits.clear();
+	slice.counts.assign(tiles, 0);
+	auto hit = [&slice](size_t cluster, size_t light) {
+		slice.hits.push_back((uint32_t)(cluster << 16 | light));
+		++slice.counts[cluster];
+	};
+
+	//Sphere against box, the squared distance splits into one term per axis. Depth is the same for the whole slice
+	//and y for a whole row, so a row costs one scalar test and then four columns per SSE compare.
+	for (size_t i = 0; i < m_Spheres.size(); ++i) {
+		uint32_t range = m_SliceRange[i];
+		if (k < (range >> 16) || k > (range & 0xFFFF))
+			continue;
+
+		const glm::vec4& sphere = m_Spheres[i];
+		float dz = std::max(std::max(dn - sphere.z, sphere.z - df), 0.0f);
+		float depthLeft = sphere.w * sphere.w - dz * dz;
+		if (depthLeft < 0.0f)
+			continue;
+
+		for (unsigned int y = 0; y < s.tilesY; ++y) {
+			float dy = std::max(std::max(slice.minY[y] - sphere.y, sphere.y - slice.maxY[y]), 0.0f);
+			float left = depthLeft - dy * dy;
+			if (left < 0.0f)
+				continue;
+
+			const size_t row = (size_t)y * s.tilesX;
+#ifdef NGINE_SSE2
+			const __m128 cx = _mm_set1_ps(sphere.x), limit = _mm_set1_ps(left), zero = _mm_setzero_ps();
+			for (size_t x = 0; x < columns; x += 4) {
+				__m128 below = _mm_sub_ps(_mm_loadu_ps(slice.minX.data() + x), cx);
+				__m128 above = _mm_sub_ps(cx, _mm_loadu_ps(slice.maxX.data() + x));
+				__m128 d = _mm_max_ps(_mm_max_ps(below, above), zero);
+				//Padding columns are infinitely far away and never pass
+				unsigned int mask = (unsigned int)_mm_movemask_ps(_mm_cmple_ps(_mm_mul_ps(d, d), limit));
+				while (mask) {
+					hit(row + x + std::countr_zero(mask), i);
+					mask &= mask - 1;
+				}
+			}
+#else
+			for (size_t x = 0; x < s.tilesX; ++x) {
+				float dx = std::max(std::max(slice.minX[x] - sphere.x, sphere.x - slice.maxX[x]), 0.0f);
+				if (dx * dx <= left)
+					hit(row + x, i);
+			}
+#endif
+		}
+	}
+
+	//Counting sort by cluster. Hits come in light order, so a full cluster keeps its lowest indices.
+	slice.offsets.resize(tiles);
+	slice.overflow = slice.maxCount = 0;
+	uint32_t offset = 0;
+	for (size_t c = 0; c < tiles; ++c) {
+		uint32_t count = slice.counts[c];
+		slice.maxCount = std::max<size_t>(slice.maxCount, count);
+		if (count > s.maxPerCluster) {
+			slice.overflow += count - s.maxPerCluster;
+			count = s.maxPerCluster;
+		}
+		slice.offsets[c] = offset;
+		slice.counts[c] = 0; //Filled back up below
+		offset += count;
+	}
+
+	slice.indices.resize(offset);
+	for (uint32_t h : slice.hits) {
+		uint32_t cluster = h >> 16;
+		uint32_t& filled = slice.counts[cluster];
+		uint32_t end = cluster + 1 < tiles ? slice.offsets[cluster + 1] : offset;
+		if (slice.offsets[cluster] + filled < end)
+			slice.indices[slice.offsets[cluster] + filled++] = (uint16_t)(h & 0xFFFF);
+	}
+}
+
+Ngine::ClusteredLighting::ClusteredLighting()
+{
+	for (Buffer* b : { &m_Clusters, &m_Indices, &m_Lights }) {
+		glGenBuffers(1, &b->buffer);
+		glGenTextures(1, &b->texture);
+	}
+	glGetIntegerv(GL_MAX_TEXTURE_BUFFER_SIZE, &m_MaxTexels);
+}
+
+Ngine::ClusteredLighting::~ClusteredLighting()
+{
+	for (Buffer* b : { &m_Clusters, &m_Indices, &m_Lights }) {
+		glDeleteTextures(1, &b->texture);
+		glDeleteBuffers(1, &b->buffer);
+	}
+}
+
+void Ngine::ClusteredLighting::Fill(Buffer& b, GLenum format, GLint unit, const void* data, size_t bytes)
+{
+	//Never left without storage, an empty buffer texture is incomplete
+	glBindBuffer(GL_TEXTURE_BUFFER, b.buffer);
+	glBufferData(GL_TEXTURE_BUFFER, (GLsizeiptr)std::max<size_t>(bytes, 16), nullptr, GL_STREAM_DRAW);
+	if (bytes)
+		glBufferSubData(GL_TEXTURE_BUFFER, 0, (GLsizeiptr)bytes, data);
+
+	glActiveTexture(GL_TEXTURE0 + unit);
+	glBindTexture(GL_TEXTURE_BUFFER, b.texture);
+	glTexBuffer(GL_TEXTURE_BUFFER, format, b.buffer);
+	Ngine::Gfx::CountUpload(bytes);
+}
+
+void Ngine::ClusteredLighting::Upload(const LightClusters& clusters)
+{
+	NGINE_ZONE("ClusteredLighting::Upload");
+
+	const auto& indices = clusters.Indices();
+	const auto& grid = clusters.Clusters();
+	const auto& lights = clusters.Lights();
+	size_t texels = std::max({ indices.size(), grid.size() / 2, lights.size() });
+	if (texels > (size_t)m_MaxTexels && !m_Warned) {
+		spdlog::warn("Light clusters need {} texels, the driver allows {} per buffer texture", texels, m_MaxTexels);
+		m_Warned = true;
+	}
+
+	Fill(m_Clusters, GL_RG32UI, ClusterUnit, grid.data(), grid.size() * sizeof(uint32_t));
+	Fill(m_Indices, GL_R16UI, IndexUnit, indices.data(), indices.size() * sizeof(uint16_t));
+	Fill(m_Lights, GL_RGBA32F, LightUnit, lights.data(), lights.size() * sizeof(glm::vec4));
+	glBindBuffer(GL_TEXTURE_BUFFER, 0);
+	glActiveTexture(GL_TEXTURE0);
+
+	const ClusterSettings& s = clusters.Settings();
+	GLint viewport[4];
+	glGetIntegerv(GL_VIEWPORT, viewport);
+	m_Grid = glm::ivec3(s.tilesX, s.tilesY, s.slices);
+	m_Depth = glm::vec2(s.nearDepth, clusters.SliceScale());
+	m_Projection = clusters.Projection();
+	m_Viewport = glm::vec2((float)viewport[2], (float)viewport[3]);
+	m_Ambient = clusters.ambient;
+	m_Applied.clear();
+}
+
+void Ngine::ClusteredLighting::Apply(GLuint program)
+{
+	if (!program || !m_Grid.x || std::find(m_Applied.begin(), m_Applied.end(), program) != m_Applied.end())
+		return;
+	m_Applied.push_back(program);
+
+	GLint cluster = glGetUniformLocation(program, "ClusterSmp");
+	if (cluster < 0)
+		return;
+
+	//Uniforms are per program, a missing one has location -1 and is ignored by GL
+	glUseProgram(program);
+	glUniform1i(cluster, ClusterUnit);
+	glUniform1i(glGetUniformLocation(program, "LightIndexSmp"), IndexUnit);
+	glUniform1i(glGetUniformLocation(program, "LightSmp"), LightUnit);
+	glUniform3iv(glGetUniformLocation(program, "ClusterGrid"), 1, &m_Grid[0]);
+	glUniform2fv(glGetUniformLocation(program, "ClusterDepth"), 1, &m_Depth[0]);
+	glUniform4fv(glGetUniformLocation(program, "Projection"), 1, &m_Projection[0]);
+	glUniform2fv(glGetUniformLocation(program, "Viewport"), 1, &m_Viewport[0]);
+	glUniform3fv(glGetUniformLocation(program, "Ambient"), 1, &m_Ambient[0]);
+}
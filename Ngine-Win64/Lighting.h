@@ -0,0 +1,124 @@
+#pragma once
+#include "Macro.h"
+#include <gl/glew.h>
+#include <glm/glm.hpp>
+#include <cstdint>
+#include <vector>
+
+namespace Ngine {
+
+	struct NAPI PointLight {
+		glm::vec3 position; //World space
+		float radius; //Light fades out to nothing here
+		glm::vec3 colour; //Linear, times intensity
+	};
+
+	//Froxel grid over the view: screen tiles times depth slices spaced exponentially between nearDepth and farDepth,
+	//so clusters stay roughly cube shaped at any distance
+	struct NAPI ClusterSettings {
+		unsigned int tilesX = 16, tilesY = 9;
+		unsigned int slices = 24;
+		float nearDepth = 0.5f, farDepth = 400.0f; //Anything closer falls in the first slice, further in none
+		unsigned int maxPerCluster = 128; //Lights past this are dropped from the cluster, counted as overflow
+	};
+
+	//CPU half of clustered forward lighting. Build bins the lights of a frame into the clusters their sphere touches,
+	//one job per depth slice, four clusters of a row per SSE test. A fragment then only shades the lights of its cluster.
+	//Keeps capacity, after a few frames Build doesn't allocate.
+	class NAPI LightClusters {
+	public:
+		struct Stats {
+			size_t lights;
+			size_t references; //Entries of all cluster lists
+			size_t maxPerCluster;
+			size_t overflow; //References dropped by the maxPerCluster limit
+			double ms;
+		};
+
+		//At most 65535 lights, the rest are ignored. view and projection are the camera of the frame,
+		//the projection a symmetric perspective one as made by glm::perspective.
+		void Build(const std::vector<PointLight>& lights, const glm::mat4& view, const glm::mat4& projection, const ClusterSettings& settings = ClusterSettings());
+
+		bool Empty() const noexcept { return m_Clusters.empty(); }
+		const ClusterSettings& Settings() const noexcept { return m_Settings; }
+		//P[0][0], P[1][1], P[2][2] and P[3][2] of the projection, enough to rebuild view positions from depth
+		const glm::vec4& Projection() const noexcept { return m_Projection; }
+		//Slices per unit of log(depth / nearDepth)
+		float SliceScale() const noexcept { return m_SliceScale; }
+
+		//Offset into Indices and count per cluster, x fastest then y then slice
+		const std::vector<uint32_t>& Clusters() const noexcept { return m_Clusters; }
+		const std::vector<uint16_t>& Indices() const noexcept { return m_Indices; }
+		//Two texels per light, view space position and radius, then colour
+		const std::vector<glm::vec4>& Lights() const noexcept { return m_Lights; }
+
+		glm::vec3 ambient = glm::vec3(0.05f);
+
+		Stats GetStats() const noexcept { return m_Stats; }
+
+	private:
+		//Output of one slice job, cluster offsets relative to its own indices
+		struct Slice {
+			std::vector<float> minX, maxX; //View space bounds of the columns, padded to a multiple of 4
+			std::vector<float> minY, maxY; //Of the rows
+			std::vector<uint32_t> hits; //Cluster within the slice << 16 | light
+			std::vector<uint32_t> counts, offsets;
+			std::vector<uint16_t> indices;
+			size_t overflow = 0, maxCount = 0;
+		};
+
+		void BinSlice(unsigned int slice);
+		float SliceDepth(unsigned int slice) const noexcept;
+
+		ClusterSettings m_Settings;
+		glm::vec4 m_Projection = glm::vec4(1.0f);
+		float m_SliceScale = 1.0f;
+
+		//Per light, view space sphere with depth as positive distance and the slices it reaches
+		std::vector<glm::vec4> m_Spheres;
+		std::vector<uint32_t> m_SliceRange; //First << 16 | last, empty when first > last
+		std::vector<Slice> m_Slices;
+
+		std::vector<uint32_t> m_Clusters;
+		std::vector<uint16_t> m_Indices;
+		std::vector<glm::vec4> m_Lights;
+		Stats m_Stats{};
+	};
+
+	//GL half, buffer textures with the cluster lists of the last Upload. Render thread only.
+	//Programs opt in by declaring the uniforms of Shader/TLF.glsl, others are left alone.
+	class NAPI ClusteredLighting {
+	public:
+		//Texture units of the buffers, unit 0 stays with the diffuse texture
+		static constexpr GLint ClusterUnit = 1, IndexUnit = 2, LightUnit = 3;
+
+		ClusteredLighting();
+		~ClusteredLighting();
+
+		ClusteredLighting(const ClusteredLighting&) = delete;
+		ClusteredLighting& operator=(const ClusteredLighting&) = delete;
+
+		//Once per frame before the draws, orphans last frame's buffers so the driver doesn't wait on them
+		void Upload(const LightClusters& clusters);
+		//Sets the lighting uniforms of program once per Upload, makes it current when it uses them
+		void Apply(GLuint program);
+
+	private:
+		struct Buffer {
+			GLuint buffer = 0, texture = 0;
+		};
+
+		void Fill(Buffer& buffer, GLenum format, GLint unit, const void* data, size_t bytes);
+
+		Buffer m_Clusters, m_Indices, m_Lights;
+		GLint m_MaxTexels = 0;
+		bool m_Warned = false;
+
+		glm::ivec3 m_Grid = glm::ivec3(0);
+		glm::vec2 m_Depth = glm::vec2(0.0f);
+		glm::vec4 m_Projection = glm::vec4(1.0f);
+		glm::vec2 m_Viewport = glm::vec2(1.0f);
+		glm::vec3 m_Ambient = glm::vec3(0.0f);
+		std::vector<GLuint> m_Applied; //Programs that got this Upload's uniforms
+	};
+}
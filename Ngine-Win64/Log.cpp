@@ -0,0 +1,195 @@
+#include "pch.h"
+#include "Log.h"
+#include <spdlog/sinks/stdout_color_sinks.h>
+#include <algorithm>
+#include <bit>
+#include <cstring>
+#include <memory>
+#include <thread>
+#include <vector>
+
+namespace {
+
+	//Bounded multi producer ring in front of the console sink. A caller formats its message as usual, then claims a slot
+	//with one CAS and copies the text in, no lock is taken. One writer thread hands the slots on in order.
+	class RingSink final : public spdlog::sinks::sink {
+	public:
+		RingSink(size_t capacity, std::shared_ptr<spdlog::sinks::sink> target)
+			: m_Slots(std::bit_ceil(std::max<size_t>(capacity, 2))), m_Mask(m_Slots.size() - 1), m_Target(std::move(target))
+		{
+			for (size_t i = 0; i < m_Slots.size(); ++i)
+				m_Slots[i].sequence.store(i, std::memory_order_relaxed);
+			m_Writer = std::thread([this]() { Write(); });
+		}
+
+		~RingSink() override { Stop(); }
+
+		//Writes out what is queued and joins the writer, later messages go straight to the target
+		void Stop()
+		{
+			if (m_Stopped.exchange(true))
+				return;
+			Wake();
+			m_Writer.join();
+		}
+
+		void log(const spdlog::details::log_msg& msg) override
+		{
+			if (m_Stopped.load(std::memory_order_acquire)) {
+				m_Target->log(msg);
+				return;
+			}
+
+			size_t pos = m_Tail.load(std::memory_order_relaxed);
+			Slot* slot;
+			while (true) {
+				slot = &m_Slots[pos & m_Mask];
+				intptr_t diff = (intptr_t)slot->sequence.load(std::memory_order_acquire) - (intptr_t)pos;
+				if (diff == 0 && m_Tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+					break;
+				if (diff < 0) {
+					//Full, the writer can't keep up. Dropping the newest is the only way that needs no lock,
+					//errors are rare and flush anyway so they wait for room instead.
+					if (msg.level < spdlog::level::err) {
+						m_Dropped.fetch_add(1, std::memory_order_relaxed);
+						return;
+					}
+					Wake();
+					std::this_thread::yield();
+				}
+				if (diff != 0)
+					pos = m_Tail.load(std::memory_order_relaxed);
+			}
+
+			slot->level = msg.level;
+			slot->time = msg.time;
+			slot->thread = msg.thread_id;
+			slot->length = std::min(msg.payload.size(), sizeof(slot->text));
+			memcpy(slot->text, msg.payload.data(), slot->length);
+			slot->sequence.store(pos + 1, std::memory_order_release);
+
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+			if (m_Sleeping.load(std::memory_order_relaxed))
+				Wake();
+		}
+
+		//Waits until everything queued so far is written, only errors flush so the wait is rare
+		void flush() override
+		{
+			if (!m_Stopped.load(std::memory_order_acquire)) {
+				size_t target = m_Tail.load(std::memory_order_acquire);
+				Wake();
+				while (m_Head.load(std::memory_order_acquire) < target && !m_Stopped.load(std::memory_order_acquire))
+					std::this_thread::yield();
+			}
+			m_Target->flush();
+		}
+
+		void set_pattern(const std::string& pattern) override { m_Target->set_pattern(pattern); }
+		void set_formatter(std::unique_ptr<spdlog::formatter> formatter) override { m_Target->set_formatter(std::move(formatter)); }
+
+	private:
+		struct Slot {
+			std::atomic<size_t> sequence;
+			spdlog::level::level_enum level;
+			spdlog::log_clock::time_point time;
+			size_t thread;
+			size_t length;
+			char text[Ngine::Log::MaxMessage]; //Longer messages are cut
+		};
+
+		void Wake()
+		{
+			m_Wake.fetch_add(1, std::memory_order_release);
+			m_Wake.notify_one();
+		}
+
+		bool Ready() const noexcept
+		{
+			size_t head = m_Head.load(std::memory_order_relaxed);
+			return m_Slots[head & m_Mask].sequence.load(std::memory_order_acquire) == head + 1;
+		}
+
+		void Write()
+		{
+			while (true) {
+				size_t head = m_Head.load(std::memory_order_relaxed);
+				Slot& slot = m_Slots[head & m_Mask];
+				if (slot.sequence.load(std::memory_order_acquire) == head + 1) {
+					spdlog::details::log_msg msg(slot.time, spdlog::source_loc{}, "ngine", slot.level, spdlog::string_view_t(slot.text, slot.length));
+					msg.thread_id = slot.thread;
+					m_Target->log(msg);
+					slot.sequence.store(head + m_Slots.size(), std::memory_order_release);
+					m_Head.store(head + 1, std::memory_order_release);
+					continue;
+				}
+
+				if (uint64_t dropped = m_Dropped.exchange(0, std::memory_order_relaxed)) {
+					std::string text = fmt::format("{} log messages dropped, the queue was full", dropped);
+					m_Target->log(spdlog::details::log_msg("ngine", spdlog::level::warn, text));
+				}
+
+				//A claimed slot is filled right after, don't stop between the two
+				if (m_Stopped.load(std::memory_order_acquire) && m_Head.load(std::memory_order_relaxed) == m_Tail.load(std::memory_order_acquire))
+					break;
+
+				uint32_t wake = m_Wake.load(std::memory_order_acquire);
+				m_Sleeping.store(true, std::memory_order_relaxed);
+				std::atomic_thread_fence(std::memory_order_seq_cst);
+				if (!Ready() && !m_Stopped.load(std::memory_order_acquire))
+					m_Wake.wait(wake, std::memory_order_acquire);
+				m_Sleeping.store(false, std::memory_order_relaxed);
+			}
+			m_Target->flush();
+		}
+
+		std::vector<Slot> m_Slots;
+		size_t m_Mask;
+		std::shared_ptr<spdlog::sinks::sink> m_Target;
+
+		alignas(64) std::atomic<size_t> m_Tail = 0; //Next slot to claim
+		alignas(64) std::atomic<size_t> m_Head = 0; //Next slot to write, only the writer moves it
+		std::atomic<uint64_t> m_Dropped = 0;
+		std::atomic<uint32_t> m_Wake = 0;
+		std::atomic<bool> m_Sleeping = false;
+		std::atomic<bool> m_Stopped = false;
+		std::thread m_Writer;
+	};
+
+	std::atomic<bool> async = false;
+	std::shared_ptr<RingSink> ring;
+}
+
+void Ngine::Log::Initialize(size_t queueSize)
+{
+	if (async)
+		Shutdown();
+
+	//One writer thread keeps messages in order
+	ring = std::make_shared<RingSink>(queueSize, std::make_shared<spdlog::sinks::stdout_color_sink_mt>());
+	auto logger = std::make_shared<spdlog::logger>("ngine", ring);
+	logger->set_level((spdlog::level::level_enum)NGINE_LOG_LEVEL);
+	logger->flush_on(spdlog::level::err);
+
+	spdlog::set_default_logger(logger);
+	async = true;
+}
+
+void Ngine::Log::Shutdown()
+{
+	if (!async.exchange(false))
+		return;
+
+	//Joins the writer after it emptied the queue, anyone still holding the old logger writes through directly
+	ring->Stop();
+	ring.reset();
+
+	auto logger = std::make_shared<spdlog::logger>("ngine", std::make_shared<spdlog::sinks::stdout_color_sink_mt>());
+	logger->set_level((spdlog::level::level_enum)NGINE_LOG_LEVEL);
+	spdlog::set_default_logger(logger);
+}
+
+bool Ngine::Log::Async() noexcept
+{
+	return async;
+}
@@ -0,0 +1,131 @@
+#pragma once
+#include "Macro.h"
+#include <spdlog/spdlog.h>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+//Lowest level compiled in, 0 trace, 1 debug, 2 info, 3 warn. Calls below it cost nothing, errors are always kept.
+#ifndef NGINE_LOG_LEVEL
+#ifdef NDEBUG
+#define NGINE_LOG_LEVEL 2
+#else
+#define NGINE_LOG_LEVEL 1
+#endif
+#endif
+
+namespace Ngine {
+
+	//Replaces the default spdlog logger with an asynchronous one, callers format the message and copy it into a lock-free
+	//ring that a background thread writes out. A full ring drops the new message instead of blocking the caller,
+	//the writer reports how many it lost.
+	class NAPI Log {
+	public:
+		static constexpr size_t MaxMessage = 256; //Bytes of text kept per message
+
+		//queueSize is rounded up to a power of two
+		static void Initialize(size_t queueSize = 8192);
+		//Drains the queue and goes back to a synchronous logger, so logging keeps working during static destruction
+		static void Shutdown();
+		static bool Async() noexcept;
+	};
+
+	class LogScope {
+	public:
+		explicit LogScope(size_t queueSize = 8192) { Log::Initialize(queueSize); }
+		~LogScope() { Log::Shutdown(); }
+
+		LogScope(const LogScope&) = delete;
+		LogScope& operator=(const LogScope&) = delete;
+	};
+
+	//key=value in a message, eg. NGINE_LOG_INFO("Loaded {} {}", Field("path", path), Field("ms", ms))
+	template<typename T>
+	struct LogField {
+		const char* key;
+		const T& value;
+	};
+
+	template<typename T>
+	LogField<T> Field(const char* key, const T& value) noexcept { return { key, value }; }
+
+	//Milliseconds since construction, for the ms field
+	class LogTimer {
+	public:
+		double Ms() const noexcept { return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - m_Start).count(); }
+
+	private:
+		std::chrono::steady_clock::time_point m_Start = std::chrono::steady_clock::now();
+	};
+
+	//Lets one message through per interval, counting the ones it swallowed in between
+	class LogLimiter {
+	public:
+		explicit LogLimiter(int64_t intervalMs) noexcept : m_Interval(intervalMs * 1000000) {}
+
+		bool Allow(uint64_t& suppressed) noexcept
+		{
+			int64_t now = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+			int64_t next = m_Next.load(std::memory_order_relaxed);
+			if (now < next || !m_Next.compare_exchange_strong(next, now + m_Interval, std::memory_order_relaxed)) {
+				m_Suppressed.fetch_add(1, std::memory_order_relaxed);
+				return false;
+			}
+			suppressed = m_Suppressed.exchange(0, std::memory_order_relaxed);
+			return true;
+		}
+
+	private:
+		int64_t m_Interval;
+		std::atomic<int64_t> m_Next = 0;
+		std::atomic<uint64_t> m_Suppressed = 0;
+	};
+}
+
+//Prints as key=value and takes the value's format spec, eg. {:.2f}
+template<typename T, typename Char>
+struct fmt::formatter<Ngine::LogField<T>, Char> : fmt::formatter<T, Char> {
+	template<typename FormatContext>
+	auto format(const Ngine::LogField<T>& field, FormatContext& ctx) const -> decltype(ctx.out())
+	{
+		ctx.advance_to(fmt::format_to(ctx.out(), "{}=", field.key));
+		return fmt::formatter<T, Char>::format(field.value, ctx);
+	}
+};
+
+#if NGINE_LOG_LEVEL <= 0
+#define NGINE_LOG_TRACE(...) spdlog::trace(__VA_ARGS__)
+#else
+#define NGINE_LOG_TRACE(...) (void)0
+#endif
+
+#if NGINE_LOG_LEVEL <= 1
+#define NGINE_LOG_DEBUG(...) spdlog::debug(__VA_ARGS__)
+#else
+#define NGINE_LOG_DEBUG(...) (void)0
+#endif
+
+#if NGINE_LOG_LEVEL <= 2
+#define NGINE_LOG_INFO(...) spdlog::info(__VA_ARGS__)
+#else
+#define NGINE_LOG_INFO(...) (void)0
+#endif
+
+#if NGINE_LOG_LEVEL <= 3
+#define NGINE_LOG_WARN(...) spdlog::warn(__VA_ARGS__)
+//At most one warning per intervalMs from this call site, for things that can go wrong every frame
+#define NGINE_LOG_WARN_LIMITED(intervalMs, ...) do { \
+	static Ngine::LogLimiter ngineLimiter(intervalMs); \
+	uint64_t ngineSuppressed = 0; \
+	if (ngineLimiter.Allow(ngineSuppressed)) { \
+		if (ngineSuppressed) spdlog::warn("{} similar warnings suppressed", ngineSuppressed); \
+		spdlog::warn(__VA_ARGS__); \
+	} \
+} while (0)
+#else
+#define NGINE_LOG_WARN(...) (void)0
+#define NGINE_LOG_WARN_LIMITED(intervalMs, ...) (void)0
+#endif
+
+#define NGINE_LOG_ERROR(...) spdlog::error(__VA_ARGS__)
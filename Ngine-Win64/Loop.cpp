@@ -0,0 +1,172 @@
+#include "pch.h"
+#include "Loop.h"
+#include "Memory.h"
+#include "GpuProfiler.h"
+#include "Settings.h"
+#include <algorithm>
+#include <bit>
+#include <chrono>
+#include <thread>
+
+namespace {
+
+	int64_t Now()
+	{
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+}
+
+int Ngine::FrameHistogram::Bucket(uint64_t ns) noexcept
+{
+	//Values below Sub get one bucket each, above that the top SubBits bits below the leading one pick the bucket
+	if (ns < Sub)
+		return (int)ns;
+	int exponent = 63 - std::countl_zero(ns);
+	int shift = exponent - SubBits;
+	return (shift + 1) * Sub + (int)((ns >> shift) & (Sub - 1));
+}
+
+uint64_t Ngine::FrameHistogram::Lower(int bucket) noexcept
+{
+	if (bucket < Sub)
+		return (uint64_t)bucket;
+	int shift = bucket / Sub - 1;
+	return ((uint64_t)Sub + (bucket & (Sub - 1))) << shift;
+}
+
+void Ngine::FrameHistogram::Add(uint64_t ns) noexcept
+{
+	++m_Buckets[Bucket(ns)];
+	++m_Count;
+	m_Sum += ns;
+	m_Min = std::min(m_Min, ns);
+	m_Max = std::max(m_Max, ns);
+}
+
+void Ngine::FrameHistogram::Reset() noexcept
+{
+	m_Buckets.fill(0);
+	m_Count = m_Sum = m_Max = 0;
+	m_Min = UINT64_MAX;
+}
+
+uint64_t Ngine::FrameHistogram::Percentile(double p) const noexcept
+{
+	if (m_Count == 0)
+		return 0;
+
+	uint64_t rank = (uint64_t)std::clamp(p / 100.0 * m_Count, 1.0, (double)m_Count);
+	uint64_t seen = 0;
+	for (int i = 0; i < Buckets; ++i) {
+		seen += m_Buckets[i];
+		if (seen >= rank) {
+			//Middle of the bucket, clamped so p0 and p100 report what was really measured
+			uint64_t width = i < 2 * Sub ? 1 : 1ull << (i / Sub - 1);
+			return std::clamp(Lower(i) + width / 2, m_Min, m_Max);
+		}
+	}
+	return m_Max;
+}
+
+Ngine::Loop::Loop(Window& window, LoopSettings settings) : m_Window(window), m_Settings(settings)
+{
+	if (m_Settings.tickRate <= 0 || m_Settings.maxTicksPerFrame <= 0)
+		throw Ngine::Exception(__LINE__, __FILE__, "Loop settings have illegal value");
+}
+
+void Ngine::Loop::Run(const Tick& tick, const Render& render)
+{
+	const int64_t step = 1000000000ll / m_Settings.tickRate;
+
+	Ngine::Profiler::SetThreadName("Main");
+
+	m_Accumulator = 0;
+	m_Previous = Now();
+	m_Running = true;
+
+	while (m_Running && !m_Window.ShouldClose())
+	{
+		float alpha = Advance(tick, step);
+
+		{
+			NGINE_ZONE("Loop::Render");
+			m_Window.StartRender();
+			{
+				NGINE_GPU_ZONE("Opaque");
+				render(alpha);
+			}
+			m_Window.EndRender();
+		}
+
+		//Read every frame so the cap follows runtime settings changes
+		int cap = Ngine::Settings::Get()->frameCap;
+		if (cap > 0)
+			WaitUntil(m_FrameStart + 1000000000ll / cap);
+	}
+
+	m_Running = false;
+}
+
+void Ngine::Loop::Run(const Tick& tick, const Build& build, RenderThread& renderer)
+{
+	const int64_t step = 1000000000ll / m_Settings.tickRate;
+
+	Ngine::Profiler::SetThreadName("Main");
+
+	m_Accumulator = 0;
+	m_Previous = Now();
+	m_Running = true;
+
+	while (m_Running && !m_Window.ShouldClose())
+	{
+		float alpha = Advance(tick, step);
+
+		//Blocks only while the render thread is still a whole frame behind
+		{
+			NGINE_ZONE("Loop::Build");
+			build(renderer.Begin(), alpha);
+			renderer.Submit();
+		}
+		m_Window.PollEvents();
+
+		int cap = Ngine::Settings::Get()->frameCap;
+		if (cap > 0)
+			WaitUntil(m_FrameStart + 1000000000ll / cap);
+	}
+
+	m_Running = false;
+}
+
+float Ngine::Loop::Advance(const Tick& tick, int64_t step)
+{
+	NGINE_FRAME_MARK();
+	Ngine::Memory::NextFrame();
+
+	m_FrameStart = Now();
+	int64_t elapsed = m_FrameStart - m_Previous;
+	m_Previous = m_FrameStart;
+	m_FrameTimes.Add((uint64_t)elapsed);
+
+	//Drop the time we could never catch up with, eg. after dragging the window or a breakpoint
+	m_Accumulator = std::min(m_Accumulator + elapsed, step * m_Settings.maxTicksPerFrame);
+	while (m_Accumulator >= step) {
+		NGINE_ZONE("Loop::Tick");
+		tick((double)step / 1e9);
+		m_Accumulator -= step;
+		++m_Ticks;
+	}
+
+	return (float)m_Accumulator / step;
+}
+
+void Ngine::Loop::WaitUntil(int64_t deadline)
+{
+	constexpr int64_t spin = 2000000; //Windows sleep granularity can be 1-2 ms
+
+	int64_t remaining = deadline - Now();
+	if (remaining > spin)
+		std::this_thread::sleep_for(std::chrono::nanoseconds(remaining - spin));
+
+	while (Now() < deadline)
+		std::this_thread::yield();
+}
@@ -0,0 +1,73 @@
+#pragma once
+#include "Macro.h"
+#include "RenderThread.h"
+#include <array>
+#include <cstdint>
+#include <functional>
+
+namespace Ngine {
+
+	//Log-linear histogram of durations in nanoseconds.
+	//Every power of two range is split into 128 buckets, so percentiles are within ~0.8% of the real value.
+	class NAPI FrameHistogram {
+	public:
+		void Add(uint64_t ns) noexcept;
+		void Reset() noexcept;
+
+		//p in range 0-100, returns nanoseconds
+		uint64_t Percentile(double p) const noexcept;
+		double Mean() const noexcept { return m_Count ? (double)m_Sum / m_Count : 0.0; }
+		uint64_t Min() const noexcept { return m_Count ? m_Min : 0; }
+		uint64_t Max() const noexcept { return m_Max; }
+		uint64_t Count() const noexcept { return m_Count; }
+
+	private:
+		static constexpr int SubBits = 7;
+		static constexpr int Sub = 1 << SubBits;
+		static constexpr int Buckets = (64 - SubBits + 1) * Sub;
+
+		static int Bucket(uint64_t ns) noexcept;
+		static uint64_t Lower(int bucket) noexcept;
+
+		std::array<uint32_t, Buckets> m_Buckets{};
+		uint64_t m_Count = 0, m_Sum = 0, m_Min = UINT64_MAX, m_Max = 0;
+	};
+
+	struct NAPI LoopSettings {
+		int tickRate = 60; //Simulation ticks per second
+		int maxTicksPerFrame = 8; //After a long stall the simulation slows down instead of spiraling
+	};
+
+	//Runs the simulation at a fixed rate and renders as often as vsync or the frame cap allows.
+	//render gets alpha in range 0-1, the fraction of a tick elapsed since the last one.
+	class NAPI Loop {
+	public:
+		using Tick = std::function<void(double dt)>;
+		using Render = std::function<void(float alpha)>;
+		using Build = std::function<void(FramePacket& packet, float alpha)>;
+
+		Loop(Window& window, LoopSettings settings = {});
+
+		//Returns when the window is closed or Stop is called
+		void Run(const Tick& tick, const Render& render);
+		//Same, but frames are only built here and drawn by renderer while the next tick runs
+		void Run(const Tick& tick, const Build& build, RenderThread& renderer);
+		void Stop() noexcept { m_Running = false; }
+
+		const FrameHistogram& FrameTimes() const noexcept { return m_FrameTimes; }
+		uint64_t Ticks() const noexcept { return m_Ticks; }
+
+	private:
+		//Advances the simulation by the time since the last frame, returns alpha for rendering
+		float Advance(const Tick& tick, int64_t step);
+		//Sleeps most of the remaining time, then spins since sleep is too coarse for a frame cap
+		static void WaitUntil(int64_t deadline);
+
+		Window& m_Window;
+		LoopSettings m_Settings;
+		FrameHistogram m_FrameTimes;
+		uint64_t m_Ticks = 0;
+		int64_t m_Accumulator = 0, m_Previous = 0, m_FrameStart = 0;
+		bool m_Running = false;
+	};
+}
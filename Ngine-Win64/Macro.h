@@ -7,5 +7,7 @@
 	#else
 		#define NAPI __declspec(dllimport) //If output is not DLL read contents of LIB and DLL
 	#endif
+#else
+	#define NAPI //Other platforms export everything by default
 #endif
 
@@ -0,0 +1,106 @@
+#include "pch.h"
+#include "MappedFile.h"
+#include <spdlog/spdlog.h>
+#include <utility>
+
+#if defined _WIN32 || defined _WIN64
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+Ngine::MappedFile::MappedFile(const char* path)
+{
+#if defined _WIN32 || defined _WIN64
+	HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if (file == INVALID_HANDLE_VALUE) {
+		spdlog::error("Could not open {}", path);
+		throw Ngine::Exception(__LINE__, __FILE__, "Could not open file");
+	}
+	m_File = file;
+
+	LARGE_INTEGER size;
+	GetFileSizeEx(file, &size);
+	m_Size = (size_t)size.QuadPart;
+
+	//Empty files can't be mapped, they simply stay without data
+	if (m_Size == 0)
+		return;
+
+	m_Mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (m_Mapping)
+		m_Data = (const char*)MapViewOfFile(m_Mapping, FILE_MAP_READ, 0, 0, 0);
+#else
+	int fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		spdlog::error("Could not open {}", path);
+		throw Ngine::Exception(__LINE__, __FILE__, "Could not open file");
+	}
+
+	struct stat st;
+	fstat(fd, &st);
+	m_Size = (size_t)st.st_size;
+
+	//Empty files can't be mapped, they simply stay without data
+	if (m_Size == 0) {
+		close(fd);
+		return;
+	}
+
+	void* data = mmap(nullptr, m_Size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd); //Mapping keeps its own reference to the file
+	if (data != MAP_FAILED) {
+		madvise(data, m_Size, MADV_SEQUENTIAL);
+		m_Data = (const char*)data;
+	}
+#endif
+
+	if (!m_Data) {
+		Close();
+		spdlog::error("Could not map {}", path);
+		throw Ngine::Exception(__LINE__, __FILE__, "Could not map file");
+	}
+}
+
+Ngine::MappedFile::~MappedFile()
+{
+	Close();
+}
+
+Ngine::MappedFile::MappedFile(MappedFile&& other) noexcept
+{
+	*this = std::move(other);
+}
+
+Ngine::MappedFile& Ngine::MappedFile::operator=(MappedFile&& other) noexcept
+{
+	if (this != &other) {
+		Close();
+		std::swap(m_Data, other.m_Data);
+		std::swap(m_Size, other.m_Size);
+#if defined _WIN32 || defined _WIN64
+		std::swap(m_File, other.m_File);
+		std::swap(m_Mapping, other.m_Mapping);
+#endif
+	}
+	return *this;
+}
+
+void Ngine::MappedFile::Close() noexcept
+{
+#if defined _WIN32 || defined _WIN64
+	if (m_Data) UnmapViewOfFile(m_Data);
+	if (m_Mapping) CloseHandle(m_Mapping);
+	if (m_File) CloseHandle(m_File);
+	m_File = m_Mapping = nullptr;
+#else
+	if (m_Data) munmap((void*)m_Data, m_Size);
+#endif
+	m_Data = nullptr;
+	m_Size = 0;
+}
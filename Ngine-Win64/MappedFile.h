@@ -0,0 +1,33 @@
+#pragma once
+#include "Macro.h"
+#include <string_view>
+
+namespace Ngine {
+
+	//Read-only memory mapping of a whole file, unmapped on destruction
+	class NAPI MappedFile {
+	public:
+		MappedFile() = default;
+		explicit MappedFile(const char* path);
+		~MappedFile();
+
+		MappedFile(const MappedFile&) = delete;
+		MappedFile& operator=(const MappedFile&) = delete;
+		MappedFile(MappedFile&& other) noexcept;
+		MappedFile& operator=(MappedFile&& other) noexcept;
+
+		const char* Data() const noexcept { return m_Data; }
+		size_t Size() const noexcept { return m_Size; }
+		std::string_view View() const noexcept { return std::string_view(m_Data, m_Size); }
+
+	private:
+		void Close() noexcept;
+
+		const char* m_Data = nullptr;
+		size_t m_Size = 0;
+#if defined _WIN32 || defined _WIN64
+		void* m_File = nullptr;
+		void* m_Mapping = nullptr;
+#endif
+	};
+}
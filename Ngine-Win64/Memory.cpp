@@ -0,0 +1,190 @@
+#include "pch.h"
+#include "Memory.h"
+#include <spdlog/spdlog.h>
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+
+namespace {
+
+	std::atomic<size_t> heapAllocations = 0, heapBytes = 0;
+	std::atomic<ptrdiff_t> poolObjects = 0;
+
+	//Two arenas in turns, see Memory::Frame
+	Ngine::LinearArena frames[2] = { Ngine::LinearArena(1024 * 1024), Ngine::LinearArena(1024 * 1024) };
+	int frame = 0;
+	size_t framePeak = 0;
+
+	struct Category {
+		std::atomic<size_t> bytes = 0, peak = 0, live = 0;
+		size_t frameStart = 0; //Game thread only, like NextFrame
+		std::atomic<ptrdiff_t> frameDelta = 0; //Written by NextFrame, Stats may read it from any thread
+	};
+
+	Category categories[(int)Ngine::MemoryCategory::Count];
+}
+
+Ngine::LinearArena::LinearArena(size_t blockSize) : m_BlockSize(blockSize)
+{
+}
+
+Ngine::LinearArena::~LinearArena()
+{
+	for (auto& block : m_Blocks)
+		::operator delete(block.data);
+}
+
+void Ngine::LinearArena::AddBlock(size_t size)
+{
+	m_Blocks.push_back({ (char*)::operator new(size), size });
+	Memory::CountHeap(size);
+}
+
+void* Ngine::LinearArena::do_allocate(size_t size, size_t align)
+{
+	while (m_Current < m_Blocks.size()) {
+		Block& block = m_Blocks[m_Current];
+		uintptr_t address = (uintptr_t)block.data + m_Offset;
+		size_t start = m_Offset + (((address + align - 1) & ~(uintptr_t)(align - 1)) - address);
+		if (start + size <= block.size) {
+			m_Used += start + size - m_Offset;
+			m_Peak = std::max(m_Peak, m_Used);
+			m_Offset = start + size;
+			return block.data + start;
+		}
+
+		//Blocks left over from a rewind are reused before asking the heap
+		if (++m_Current < m_Blocks.size())
+			m_Offset = 0;
+	}
+
+	AddBlock(std::max(m_BlockSize, size + align));
+	m_Offset = 0;
+	return do_allocate(size, align);
+}
+
+void Ngine::LinearArena::Reset()
+{
+	if (m_Blocks.size() > 1) {
+		size_t total = Capacity();
+		for (auto& block : m_Blocks)
+			::operator delete(block.data);
+		m_Blocks.clear();
+		AddBlock(total);
+	}
+
+	m_Current = m_Offset = m_Used = 0;
+}
+
+void Ngine::LinearArena::Rewind(const Marker& marker) noexcept
+{
+	m_Current = marker.block;
+	m_Offset = marker.offset;
+	m_Used = marker.used;
+}
+
+size_t Ngine::LinearArena::Capacity() const noexcept
+{
+	size_t total = 0;
+	for (auto& block : m_Blocks)
+		total += block.size;
+	return total;
+}
+
+Ngine::LinearArena& Ngine::Memory::Frame()
+{
+	return frames[frame];
+}
+
+void Ngine::Memory::NextFrame()
+{
+	framePeak = std::max(framePeak, frames[frame].Used());
+	frame ^= 1;
+	frames[frame].Reset();
+
+	for (auto& c : categories) {
+		size_t bytes = c.bytes.load(std::memory_order_relaxed);
+		c.frameDelta.store((ptrdiff_t)bytes - (ptrdiff_t)c.frameStart, std::memory_order_relaxed);
+		c.frameStart = bytes;
+	}
+}
+
+Ngine::LinearArena& Ngine::Memory::Scratch()
+{
+	thread_local LinearArena scratch(256 * 1024);
+	return scratch;
+}
+
+Ngine::MemoryStats Ngine::Memory::Stats()
+{
+	MemoryStats stats;
+	stats.heapAllocations = heapAllocations.load(std::memory_order_relaxed);
+	stats.heapBytes = heapBytes.load(std::memory_order_relaxed);
+	stats.frameUsed = frames[frame].Used();
+	stats.framePeak = std::max(framePeak, stats.frameUsed);
+	stats.poolObjects = (size_t)poolObjects.load(std::memory_order_relaxed);
+	return stats;
+}
+
+void Ngine::Memory::CountHeap(size_t bytes) noexcept
+{
+	heapAllocations.fetch_add(1, std::memory_order_relaxed);
+	heapBytes.fetch_add(bytes, std::memory_order_relaxed);
+}
+
+void Ngine::Memory::CountPool(ptrdiff_t objects) noexcept
+{
+	poolObjects.fetch_add(objects, std::memory_order_relaxed);
+}
+
+void Ngine::Memory::Track(MemoryCategory category, size_t bytes) noexcept
+{
+	Category& c = categories[(int)category];
+	c.live.fetch_add(1, std::memory_order_relaxed);
+	size_t now = c.bytes.fetch_add(bytes, std::memory_order_relaxed) + bytes;
+
+	size_t peak = c.peak.load(std::memory_order_relaxed);
+	while (now > peak && !c.peak.compare_exchange_weak(peak, now, std::memory_order_relaxed));
+}
+
+void Ngine::Memory::Untrack(MemoryCategory category, size_t bytes) noexcept
+{
+	Category& c = categories[(int)category];
+	c.live.fetch_sub(1, std::memory_order_relaxed);
+	c.bytes.fetch_sub(bytes, std::memory_order_relaxed);
+}
+
+Ngine::CategoryStats Ngine::Memory::Stats(MemoryCategory category) noexcept
+{
+	const Category& c = categories[(int)category];
+	return CategoryStats{ c.bytes.load(std::memory_order_relaxed), c.peak.load(std::memory_order_relaxed), c.live.load(std::memory_order_relaxed), c.frameDelta.load(std::memory_order_relaxed) };
+}
+
+const char* Ngine::Memory::Name(MemoryCategory category) noexcept
+{
+	static const char* names[] = { "Mesh CPU", "Texture staging", "GPU buffers", "GPU textures", "Programs" };
+	return names[(int)category];
+}
+
+void Ngine::Memory::LogCategories()
+{
+	for (int i = 0; i < (int)MemoryCategory::Count; ++i) {
+		CategoryStats s = Stats((MemoryCategory)i);
+		spdlog::info("{:16} {:>12} bytes {:>12} peak {:>6} live {:>+10} last frame", Name((MemoryCategory)i), s.bytes, s.peak, s.live, s.frameDelta);
+	}
+}
+
+bool Ngine::Memory::ReportLeaks()
+{
+	bool clean = true;
+	for (int i = 0; i < (int)MemoryCategory::Count; ++i) {
+		CategoryStats s = Stats((MemoryCategory)i);
+		if (s.live == 0 && s.bytes == 0)
+			continue;
+
+		spdlog::warn("{} leaked {} allocations of {} bytes", Name((MemoryCategory)i), s.live, s.bytes);
+		clean = false;
+	}
+	return clean;
+}
@@ -0,0 +1,214 @@
+#pragma once
+#include "Macro.h"
+#include <cstddef>
+#include <memory_resource>
+#include <new>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace Ngine {
+
+	//Heap traffic of engine allocators, a steady state frame leaves heapAllocations unchanged
+	struct NAPI MemoryStats {
+		size_t heapAllocations; //Blocks arenas and pools requested from the heap
+		size_t heapBytes;
+		size_t frameUsed, framePeak; //Bytes used by the current frame arena and the most any frame used
+		size_t poolObjects; //Live objects across all pools
+	};
+
+	//What engine owned memory is spent on, see Memory::Track
+	enum class MemoryCategory {
+		MeshCpu, //Vertex data meshes keep in RAM
+		TextureStaging, //Pixels read from disk on their way to the driver
+		GpuBuffer,
+		GpuTexture, //Estimated from format and dimensions
+		Program,
+		Count
+	};
+
+	struct NAPI CategoryStats {
+		size_t bytes, peak; //Current and high-water mark
+		size_t live; //Allocations not freed yet
+		ptrdiff_t frameDelta; //Change of bytes over the last completed frame
+	};
+
+	//Bump allocator, individual frees are no-ops and memory comes back all at once.
+	//Not thread safe, every thread gets its own scratch arena for that reason.
+	class NAPI LinearArena : public std::pmr::memory_resource {
+	public:
+		struct Marker {
+			size_t block, offset, used;
+		};
+
+		explicit LinearArena(size_t blockSize = 64 * 1024);
+		~LinearArena();
+
+		LinearArena(const LinearArena&) = delete;
+		LinearArena& operator=(const LinearArena&) = delete;
+
+		//Blocks chained on overflow are merged into one, so the next cycle of the same size doesn't touch the heap
+		void Reset();
+		Marker Mark() const noexcept { return { m_Current, m_Offset, m_Used }; }
+		void Rewind(const Marker& marker) noexcept;
+
+		size_t Used() const noexcept { return m_Used; }
+		size_t Peak() const noexcept { return m_Peak; }
+		size_t Capacity() const noexcept;
+
+	protected:
+		void* do_allocate(size_t size, size_t align) override;
+		void do_deallocate(void* p, size_t size, size_t align) override {}
+		bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override { return this == &other; }
+
+	private:
+		struct Block {
+			char* data;
+			size_t size;
+		};
+
+		void AddBlock(size_t size);
+
+		std::vector<Block> m_Blocks;
+		size_t m_BlockSize;
+		size_t m_Current = 0, m_Offset = 0; //Block being filled and first free byte in it
+		size_t m_Used = 0, m_Peak = 0;
+	};
+
+	class NAPI Memory {
+	public:
+		//Game thread only. Contents stay valid until the second following NextFrame,
+		//long enough for packets the render thread reads one frame late.
+		static LinearArena& Frame();
+		static void NextFrame();
+
+		//Per thread arena for loaders and jobs, take it through ScratchScope
+		static LinearArena& Scratch();
+
+		static MemoryStats Stats();
+
+		//Used by arenas and pools to keep the counters
+		static void CountHeap(size_t bytes) noexcept;
+		static void CountPool(ptrdiff_t objects) noexcept;
+
+		//Accounting by category, any thread. Untrack has to be given the size passed to Track.
+		static void Track(MemoryCategory category, size_t bytes) noexcept;
+		static void Untrack(MemoryCategory category, size_t bytes) noexcept;
+		static CategoryStats Stats(MemoryCategory category) noexcept;
+		static const char* Name(MemoryCategory category) noexcept;
+		static void LogCategories();
+		//Warns about every category with allocations still alive, call at shutdown. False when something leaked.
+		static bool ReportLeaks();
+	};
+
+	//Tracks bytes for the duration of a scope, eg. staging buffers
+	class TrackScope {
+	public:
+		TrackScope(MemoryCategory category, size_t bytes) noexcept : m_Category(category), m_Bytes(bytes) { Memory::Track(category, bytes); }
+		~TrackScope() { Memory::Untrack(m_Category, m_Bytes); }
+
+		TrackScope(const TrackScope&) = delete;
+		TrackScope& operator=(const TrackScope&) = delete;
+
+	private:
+		MemoryCategory m_Category;
+		size_t m_Bytes;
+	};
+
+	//Gives back everything allocated from the thread's scratch arena within the scope
+	class ScratchScope {
+	public:
+		ScratchScope() : m_Arena(Memory::Scratch()), m_Marker(m_Arena.Mark()) {}
+		~ScratchScope() { m_Arena.Rewind(m_Marker); }
+
+		ScratchScope(const ScratchScope&) = delete;
+		ScratchScope& operator=(const ScratchScope&) = delete;
+
+		LinearArena* Arena() noexcept { return &m_Arena; }
+
+	private:
+		LinearArena& m_Arena;
+		LinearArena::Marker m_Marker;
+	};
+
+	//Containers taking an arena, eg. ArenaVector<glm::vec3> v(scratch.Arena());
+	template<typename T>
+	using ArenaVector = std::pmr::vector<T>;
+	using ArenaString = std::pmr::string;
+
+	//Fixed size slots handed out from chunks of ChunkSize, freed slots are reused before the pool grows.
+	//Not thread safe, guard it when objects move between threads.
+	template<typename T, size_t ChunkSize = 256>
+	class Pool {
+	public:
+		Pool() = default;
+		~Pool()
+		{
+			//Objects still alive are abandoned, not destroyed
+			for (Slot* chunk : m_Chunks)
+				::operator delete(chunk, std::align_val_t(alignof(Slot)));
+		}
+
+		Pool(const Pool&) = delete;
+		Pool& operator=(const Pool&) = delete;
+
+		template<typename... Args>
+		T* Create(Args&&... args)
+		{
+			if (!m_Free)
+				Grow();
+
+			Slot* slot = m_Free;
+			m_Free = slot->next;
+			try {
+				T* obj = new (slot->storage) T(std::forward<Args>(args)...);
+				++m_Live;
+				Memory::CountPool(1);
+				return obj;
+			}
+			catch (...) {
+				slot->next = m_Free;
+				m_Free = slot;
+				throw;
+			}
+		}
+
+		void Destroy(T* obj)
+		{
+			if (!obj)
+				return;
+
+			obj->~T();
+			Slot* slot = reinterpret_cast<Slot*>(obj);
+			slot->next = m_Free;
+			m_Free = slot;
+			--m_Live;
+			Memory::CountPool(-1);
+		}
+
+		size_t Live() const noexcept { return m_Live; }
+		size_t Capacity() const noexcept { return m_Chunks.size() * ChunkSize; }
+
+	private:
+		union Slot {
+			Slot* next;
+			alignas(T) unsigned char storage[sizeof(T)];
+		};
+
+		void Grow()
+		{
+			Slot* chunk = static_cast<Slot*>(::operator new(sizeof(Slot) * ChunkSize, std::align_val_t(alignof(Slot))));
+			m_Chunks.push_back(chunk);
+			Memory::CountHeap(sizeof(Slot) * ChunkSize);
+
+			for (size_t i = ChunkSize; i-- > 0;) {
+				chunk[i].next = m_Free;
+				m_Free = &chunk[i];
+			}
+		}
+
+		std::vector<Slot*> m_Chunks;
+		Slot* m_Free = nullptr;
+		size_t m_Live = 0;
+	};
+}
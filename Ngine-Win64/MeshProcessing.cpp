@@ -0,0 +1,229 @@
+#include "pch.h"
+#include "MeshProcessing.h"
+#include "Jobs.h"
+#include "Log.h"
+#include "Profiler.h"
+#include <spdlog/spdlog.h>
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+
+namespace {
+
+	constexpr size_t Grain = 2048; //Triangles or welded verticies per job
+
+	//Angle between the two edges leaving a
+	float CornerAngle(const glm::vec3& a, const glm::vec3& b, const glm::vec3& c)
+	{
+		glm::vec3 e1 = b - a, e2 = c - a;
+		float length = glm::length(e1) * glm::length(e2);
+		if (length <= 0.0f)
+			return 0.0f;
+		return std::acos(glm::clamp(glm::dot(e1, e2) / length, -1.0f, 1.0f));
+	}
+
+	glm::vec3 AnyTangent(const glm::vec3& n)
+	{
+		glm::vec3 axis = std::abs(n.x) < 0.9f ? glm::vec3(1.0f, 0.0f, 0.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+		glm::vec3 t = glm::cross(n, axis);
+		float length = glm::length(t);
+		return length > 0.0f ? t / length : glm::vec3(1.0f, 0.0f, 0.0f);
+	}
+
+	//Corners sorted by key(corner) into order, returns where each run of equal keys starts plus the end.
+	//Keys are copied next to their corner first, so the sort compares contiguous memory instead of gathering attributes.
+	template<size_t N, typename KeyOf>
+	std::vector<uint32_t> Weld(size_t count, std::vector<uint32_t>& order, const KeyOf& keyOf)
+	{
+		NGINE_ZONE("MeshProcessing::Weld");
+
+		struct Entry {
+			std::array<float, N> key;
+			uint32_t corner;
+
+			bool operator<(const Entry& other) const noexcept { return key < other.key; }
+		};
+
+		std::vector<Entry> entries(count);
+		Ngine::Jobs::ParallelFor(0, count, Grain * 3, [&](size_t first, size_t last) {
+			for (size_t i = first; i < last; ++i)
+				entries[i] = Entry{ keyOf((uint32_t)i), (uint32_t)i };
+			});
+		std::sort(entries.begin(), entries.end());
+
+		order.resize(count);
+		std::vector<uint32_t> runs;
+		for (size_t i = 0; i < count; ++i) {
+			order[i] = entries[i].corner;
+			if (i == 0 || entries[i - 1].key != entries[i].key)
+				runs.push_back((uint32_t)i);
+		}
+		runs.push_back((uint32_t)count);
+		return runs;
+	}
+}
+
+size_t Ngine::MeshProcessing::GenerateNormals(const std::vector<glm::vec3>& verticies, std::vector<glm::vec3>& normals, float creaseDegrees)
+{
+	NGINE_ZONE("MeshProcessing::GenerateNormals");
+
+	const size_t count = verticies.size() / 3 * 3;
+	normals.resize(verticies.size(), glm::vec3(0.0f));
+
+	std::vector<uint8_t> missing(count);
+	size_t generated = 0;
+	for (size_t i = 0; i < count; ++i) {
+		missing[i] = glm::dot(normals[i], normals[i]) == 0.0f;
+		generated += missing[i];
+	}
+	if (!generated)
+		return 0;
+
+	//Unit normal of every face and the angle at each of its corners
+	std::vector<glm::vec3> faces(count / 3);
+	std::vector<float> weights(count);
+	Jobs::ParallelFor(0, count / 3, Grain, [&](size_t first, size_t last) {
+		for (size_t t = first; t < last; ++t) {
+			const glm::vec3* p = &verticies[t * 3];
+			glm::vec3 n = glm::cross(p[1] - p[0], p[2] - p[0]);
+			float length = glm::length(n);
+			faces[t] = length > 0.0f ? n / length : glm::vec3(0.0f);
+			weights[t * 3 + 0] = CornerAngle(p[0], p[1], p[2]);
+			weights[t * 3 + 1] = CornerAngle(p[1], p[2], p[0]);
+			weights[t * 3 + 2] = CornerAngle(p[2], p[0], p[1]);
+		}
+		});
+
+	std::vector<uint32_t> order;
+	std::vector<uint32_t> runs = Weld<3>(count, order, [&](uint32_t i) {
+		const glm::vec3& p = verticies[i];
+		return std::array<float, 3>{ p.x, p.y, p.z };
+		});
+
+	//Each corner only blends faces within the crease angle of its own, so hard edges stay hard from both sides
+	const float limit = std::cos(glm::radians(creaseDegrees));
+	Jobs::ParallelFor(0, runs.size() - 1, Grain, [&](size_t first, size_t last) {
+		for (size_t r = first; r < last; ++r) {
+			for (uint32_t i = runs[r]; i < runs[r + 1]; ++i) {
+				uint32_t corner = order[i];
+				if (!missing[corner])
+					continue;
+
+				const glm::vec3& face = faces[corner / 3];
+				glm::vec3 sum(0.0f);
+				for (uint32_t j = runs[r]; j < runs[r + 1]; ++j) {
+					uint32_t other = order[j];
+					if (glm::dot(face, faces[other / 3]) >= limit)
+						sum += faces[other / 3] * weights[other];
+				}
+
+				float length = glm::length(sum);
+				if (length > 0.0f)
+					normals[corner] = sum / length;
+				else
+					normals[corner] = glm::dot(face, face) > 0.0f ? face : glm::vec3(0.0f, 1.0f, 0.0f); //Degenerate all around
+			}
+		}
+		});
+
+	//Trailing verticies of an incomplete triangle
+	for (size_t i = count; i < normals.size(); ++i)
+		if (glm::dot(normals[i], normals[i]) == 0.0f) {
+			normals[i] = glm::vec3(0.0f, 1.0f, 0.0f);
+			++generated;
+		}
+
+	return generated;
+}
+
+void Ngine::MeshProcessing::GenerateTangents(const std::vector<glm::vec3>& verticies, const std::vector<glm::vec2>& uvs, const std::vector<glm::vec3>& normals, std::vector<glm::vec4>& tangents)
+{
+	NGINE_ZONE("MeshProcessing::GenerateTangents");
+
+	if (normals.size() < verticies.size()) {
+		spdlog::error("Tangents need a normal per vertex, got {} normals for {} verticies", normals.size(), verticies.size());
+		throw Ngine::Exception(__LINE__, __FILE__, "Could not generate tangents");
+	}
+
+	const size_t count = verticies.size() / 3 * 3;
+	tangents.resize(verticies.size());
+
+	if (uvs.size() < count) {
+		Jobs::ParallelFor(0, verticies.size(), Grain * 3, [&](size_t first, size_t last) {
+			for (size_t i = first; i < last; ++i)
+				tangents[i] = glm::vec4(AnyTangent(normals[i]), 1.0f);
+			});
+		return;
+	}
+
+	//Direction of increasing U for each corner, flattened onto the corner's normal and weighted by its angle
+	std::vector<glm::vec3> corners(count);
+	std::vector<uint8_t> flipped(count);
+	Jobs::ParallelFor(0, count / 3, Grain, [&](size_t first, size_t last) {
+		for (size_t t = first; t < last; ++t) {
+			const glm::vec3* p = &verticies[t * 3];
+			const glm::vec2* uv = &uvs[t * 3];
+			glm::vec3 e1 = p[1] - p[0], e2 = p[2] - p[0];
+			glm::vec2 d1 = uv[1] - uv[0], d2 = uv[2] - uv[0];
+
+			//Signed UV area, negative where the mapping is mirrored
+			float area = d1.x * d2.y - d2.x * d1.y;
+			glm::vec3 direction = area != 0.0f ? (e1 * d2.y - e2 * d1.y) / area : glm::vec3(0.0f);
+
+			const float angles[3] = { CornerAngle(p[0], p[1], p[2]), CornerAngle(p[1], p[2], p[0]), CornerAngle(p[2], p[0], p[1]) };
+			for (size_t k = 0; k < 3; ++k) {
+				const glm::vec3& n = normals[t * 3 + k];
+				glm::vec3 projected = direction - n * glm::dot(n, direction);
+				float length = glm::length(projected);
+				corners[t * 3 + k] = length > 0.0f ? projected / length * angles[k] : glm::vec3(0.0f);
+				flipped[t * 3 + k] = area < 0.0f;
+			}
+		}
+		});
+
+	//Verticies only share a tangent when position, normal, UV and mirroring all match
+	std::vector<uint32_t> order;
+	std::vector<uint32_t> runs = Weld<9>(count, order, [&](uint32_t i) {
+		const glm::vec3 &p = verticies[i], &n = normals[i];
+		const glm::vec2& uv = uvs[i];
+		return std::array<float, 9>{ p.x, p.y, p.z, n.x, n.y, n.z, uv.x, uv.y, flipped[i] ? 1.0f : 0.0f };
+		});
+
+	Jobs::ParallelFor(0, runs.size() - 1, Grain, [&](size_t first, size_t last) {
+		for (size_t r = first; r < last; ++r) {
+			glm::vec3 sum(0.0f);
+			for (uint32_t i = runs[r]; i < runs[r + 1]; ++i)
+				sum += corners[order[i]];
+
+			uint32_t corner = order[runs[r]];
+			float length = glm::length(sum);
+			glm::vec3 t = length > 0.0f ? sum / length : AnyTangent(normals[corner]);
+			glm::vec4 tangent(t, flipped[corner] ? -1.0f : 1.0f);
+			for (uint32_t i = runs[r]; i < runs[r + 1]; ++i)
+				tangents[order[i]] = tangent;
+		}
+		});
+
+	for (size_t i = count; i < tangents.size(); ++i)
+		tangents[i] = glm::vec4(AnyTangent(normals[i]), 1.0f);
+}
+
+Ngine::MeshProcessStats Ngine::MeshProcessing::Complete(const std::vector<glm::vec3>& verticies, std::vector<glm::vec2>& uvs, std::vector<glm::vec3>& normals, std::vector<glm::vec4>* tangents, float creaseDegrees)
+{
+	NGINE_ZONE("MeshProcessing::Complete");
+	Ngine::LogTimer timer;
+
+	MeshProcessStats stats{};
+	if (!uvs.empty())
+		uvs.resize(verticies.size(), glm::vec2(0.0f));
+
+	stats.generatedNormals = GenerateNormals(verticies, normals, creaseDegrees);
+	if (tangents) {
+		GenerateTangents(verticies, uvs, normals, *tangents);
+		stats.tangents = tangents->size();
+	}
+
+	stats.ms = timer.Ms();
+	return stats;
+}
@@ -0,0 +1,29 @@
+#pragma once
+#include "Macro.h"
+#include <glm/glm.hpp>
+#include <cstddef>
+#include <vector>
+
+namespace Ngine {
+
+	struct NAPI MeshProcessStats {
+		size_t generatedNormals; //Verticies that came without one
+		size_t tangents;
+		double ms;
+	};
+
+	//Fills in attributes a triangle list (3 verticies per triangle, as LoadOBJ returns them) is missing.
+	//Work is spread over triangles and welded verticies with Jobs::ParallelFor.
+	class NAPI MeshProcessing {
+	public:
+		//Angle weighted smooth normals over verticies sharing a position. Faces meeting at more than creaseDegrees don't blend.
+		//Zero length entries and entries past the end of normals are generated, the rest are kept. Returns how many were generated.
+		static size_t GenerateNormals(const std::vector<glm::vec3>& verticies, std::vector<glm::vec3>& normals, float creaseDegrees = 60.0f);
+		//MikkTSpace style frame: angle weighted, orthogonal to the vertex normal, split where the UV mapping flips.
+		//w is the bitangent sign, bitangent = w * cross(normal, tangent). Without UVs any tangent orthogonal to the normal is picked.
+		static void GenerateTangents(const std::vector<glm::vec3>& verticies, const std::vector<glm::vec2>& uvs, const std::vector<glm::vec3>& normals, std::vector<glm::vec4>& tangents);
+
+		//Leaves normals, and tangents when asked for, as long as verticies. UVs are padded with zeros unless there are none at all.
+		static MeshProcessStats Complete(const std::vector<glm::vec3>& verticies, std::vector<glm::vec2>& uvs, std::vector<glm::vec3>& normals, std::vector<glm::vec4>* tangents, float creaseDegrees = 60.0f);
+	};
+}
@@ -3,5 +3,28 @@
 #include "Macro.h"
 #include "Exception.h"
 #include "Window.h"
+#include "Resources.h"
 #include "Gfx.h"
-#include "Ini.h"
\ No newline at end of file
+#include "Ini.h"
+#include "TextureStreamer.h"
+#include "TextureCompressor.h"
+#include "TextureAtlas.h"
+#include "Settings.h"
+#include "MappedFile.h"
+#include "IniView.h"
+#include "Memory.h"
+#include "Jobs.h"
+#include "RenderThread.h"
+#include "Loop.h"
+#include "Profiler.h"
+#include "GpuProfiler.h"
+#include "Log.h"
+#include "Road.h"
+#include "Bvh.h"
+#include "Broadphase.h"
+#include "MeshProcessing.h"
+#include "AssetCooker.h"
+#include "Vfs.h"
+#include "AsyncIo.h"
+#include "VertexLayout.h"
+#include "Lighting.h"
\ No newline at end of file
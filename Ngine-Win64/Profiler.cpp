@@ -0,0 +1,185 @@
+#include "pch.h"
+#include "Profiler.h"
+#include <spdlog/spdlog.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#pragma warning(disable : 4996)
+
+namespace {
+
+	//Written only by the owning thread, Dump reads the published part while it keeps going
+	struct ThreadBuffer {
+		static constexpr uint64_t Capacity = 1 << 16;
+
+		struct Event {
+			std::atomic<const char*> name;
+			std::atomic<uint64_t> start, end;
+		};
+
+		std::string name;
+		int id;
+		std::atomic<uint64_t> count = 0;
+		Event events[Capacity];
+	};
+
+	constexpr int FrameHistory = 120;
+
+	std::mutex mutex; //Guards the buffer list, never taken while recording
+	std::vector<std::unique_ptr<ThreadBuffer>> buffers;
+	thread_local ThreadBuffer* local = nullptr;
+
+	std::atomic<uint64_t> frames[FrameHistory] = {};
+	std::atomic<uint64_t> frameCount = 0;
+
+	//First time stamp pairs with a clock reading, Dump takes the second one to get the tick rate
+	struct Epoch {
+		uint64_t ticks = Ngine::Profiler::Now();
+		std::chrono::steady_clock::time_point time = std::chrono::steady_clock::now();
+	};
+
+	Epoch& Start()
+	{
+		static Epoch epoch;
+		return epoch;
+	}
+
+	ThreadBuffer* Register(const char* name = nullptr)
+	{
+		Start();
+		auto buffer = std::make_unique<ThreadBuffer>();
+		std::lock_guard<std::mutex> lock(mutex);
+		buffer->id = (int)buffers.size() + 1;
+		buffer->name = name ? name : "Thread " + std::to_string(buffer->id);
+		buffers.push_back(std::move(buffer));
+		return buffers.back().get();
+	}
+
+	void Write(ThreadBuffer* buffer, const char* name, uint64_t start, uint64_t end) noexcept
+	{
+		uint64_t i = buffer->count.load(std::memory_order_relaxed);
+		auto& e = buffer->events[i & (ThreadBuffer::Capacity - 1)];
+		e.name.store(name, std::memory_order_relaxed);
+		e.start.store(start, std::memory_order_relaxed);
+		e.end.store(end, std::memory_order_relaxed);
+		buffer->count.store(i + 1, std::memory_order_release);
+	}
+
+	void WriteEscaped(FILE* file, const char* s)
+	{
+		for (; *s; ++s) {
+			if (*s == '"' || *s == '\\')
+				fputc('\\', file);
+			fputc(*s, file);
+		}
+	}
+}
+
+void Ngine::Profiler::Record(const char* name, uint64_t start, uint64_t end) noexcept
+{
+	if (!local)
+		local = Register();
+
+	Write(local, name, start, end);
+}
+
+int Ngine::Profiler::Track(const char* name)
+{
+	return Register(name)->id;
+}
+
+void Ngine::Profiler::Record(int track, const char* name, uint64_t start, uint64_t end)
+{
+	//Tracks get a handful of events per frame, the lock also lets any thread write them
+	std::lock_guard<std::mutex> lock(mutex);
+	if (track > 0 && track <= (int)buffers.size())
+		Write(buffers[track - 1].get(), name, start, end);
+}
+
+double Ngine::Profiler::TicksPerNanosecond()
+{
+	const Epoch& epoch = Start();
+	uint64_t nowTicks = Now();
+	auto nowTime = std::chrono::steady_clock::now();
+
+	double ns = (double)std::chrono::duration_cast<std::chrono::nanoseconds>(nowTime - epoch.time).count();
+	return ns > 0.0 ? (double)(nowTicks - epoch.ticks) / ns : 1.0;
+}
+
+void Ngine::Profiler::FrameMark() noexcept
+{
+	Start();
+	uint64_t i = frameCount.load(std::memory_order_relaxed);
+	frames[i % FrameHistory].store(Now(), std::memory_order_relaxed);
+	frameCount.store(i + 1, std::memory_order_release);
+}
+
+void Ngine::Profiler::SetThreadName(const char* name)
+{
+	if (!local)
+		local = Register();
+
+	std::lock_guard<std::mutex> lock(mutex);
+	local->name = name;
+}
+
+bool Ngine::Profiler::Dump(const char* path)
+{
+	const Epoch& epoch = Start();
+	double ticksPerUs = TicksPerNanosecond() * 1000.0;
+
+	//Oldest frame still in the history, everything recorded before it is left out
+	uint64_t marks = frameCount.load(std::memory_order_acquire);
+	uint64_t oldest = marks == 0 ? 0 : frames[marks < FrameHistory ? 0 : marks % FrameHistory].load(std::memory_order_relaxed);
+
+	FILE* file = fopen(path, "wb");
+	if (!file) {
+		spdlog::error("Could not write profile to {}", path);
+		return false;
+	}
+
+	fprintf(file, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+	fprintf(file, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"Ngine\"}}");
+
+	size_t written = 0;
+	std::lock_guard<std::mutex> lock(mutex);
+	for (const auto& buffer : buffers) {
+		fprintf(file, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"", buffer->id);
+		WriteEscaped(file, buffer->name.c_str());
+		fprintf(file, "\"}}");
+
+		uint64_t count = buffer->count.load(std::memory_order_acquire);
+		uint64_t first = count > ThreadBuffer::Capacity ? count - ThreadBuffer::Capacity : 0;
+		for (uint64_t i = first; i < count; ++i) {
+			const auto& e = buffer->events[i & (ThreadBuffer::Capacity - 1)];
+			uint64_t start = e.start.load(std::memory_order_relaxed);
+			uint64_t end = e.end.load(std::memory_order_relaxed);
+			const char* name = e.name.load(std::memory_order_relaxed);
+			if (!name || start < oldest || start < epoch.ticks || end < start)
+				continue;
+
+			fprintf(file, ",\n{\"name\":\"");
+			WriteEscaped(file, name);
+			fprintf(file, "\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}",
+				buffer->id, (start - epoch.ticks) / ticksPerUs, (end - start) / ticksPerUs);
+			++written;
+		}
+	}
+
+	for (uint64_t i = marks > FrameHistory ? marks - FrameHistory : 0; i < marks; ++i) {
+		uint64_t t = frames[i % FrameHistory].load(std::memory_order_relaxed);
+		fprintf(file, ",\n{\"name\":\"Frame\",\"ph\":\"i\",\"s\":\"g\",\"pid\":1,\"tid\":0,\"ts\":%.3f}", (t - epoch.ticks) / ticksPerUs);
+	}
+
+	fprintf(file, "\n]}\n");
+	fclose(file);
+
+	spdlog::info("Wrote {} profiler zones to {}", written, path);
+	return true;
+}
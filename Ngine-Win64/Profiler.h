@@ -0,0 +1,81 @@
+#pragma once
+#include "Macro.h"
+#include <cstdint>
+
+#if defined(_M_X64) || defined(__x86_64__)
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <x86intrin.h>
+#endif
+#define NGINE_TSC
+#else
+#include <chrono>
+#endif
+
+//Zones compile out in release builds unless NGINE_PROFILE is defined as 1
+#ifndef NGINE_PROFILE
+#ifdef NDEBUG
+#define NGINE_PROFILE 0
+#else
+#define NGINE_PROFILE 1
+#endif
+#endif
+
+namespace Ngine {
+
+	//Collects timed zones into per-thread rings and writes the last frames as a Chrome trace,
+	//open it in chrome://tracing or ui.perfetto.dev
+	class NAPI Profiler {
+	public:
+		//Time stamp counter ticks, converted to time when dumping
+		static uint64_t Now() noexcept
+		{
+#ifdef NGINE_TSC
+			return __rdtsc();
+#else
+			return (uint64_t)std::chrono::steady_clock::now().time_since_epoch().count();
+#endif
+		}
+
+		//name has to outlive the profiler, use string literals
+		static void Record(const char* name, uint64_t start, uint64_t end) noexcept;
+
+		//Track not bound to a thread, for time lines measured elsewhere such as the GPU
+		static int Track(const char* name);
+		static void Record(int track, const char* name, uint64_t start, uint64_t end);
+		//Rate of Now(), measured against the steady clock since the first zone
+		static double TicksPerNanosecond();
+
+		//Marks the start of a frame, Dump keeps zones of the last 120 frames
+		static void FrameMark() noexcept;
+		//Shown as the track name in the trace
+		static void SetThreadName(const char* name);
+
+		static bool Dump(const char* path);
+	};
+
+	class ProfileZone {
+	public:
+		explicit ProfileZone(const char* name) noexcept : m_Name(name), m_Start(Profiler::Now()) {}
+		~ProfileZone() { Profiler::Record(m_Name, m_Start, Profiler::Now()); }
+
+		ProfileZone(const ProfileZone&) = delete;
+		ProfileZone& operator=(const ProfileZone&) = delete;
+
+	private:
+		const char* m_Name;
+		uint64_t m_Start;
+	};
+}
+
+#define NGINE_ZONE_JOIN2(a, b) a##b
+#define NGINE_ZONE_JOIN(a, b) NGINE_ZONE_JOIN2(a, b)
+
+#if NGINE_PROFILE
+#define NGINE_ZONE(name) Ngine::ProfileZone NGINE_ZONE_JOIN(zone, __LINE__)(name)
+#define NGINE_FRAME_MARK() Ngine::Profiler::FrameMark()
+#else
+#define NGINE_ZONE(name)
+#define NGINE_FRAME_MARK()
+#endif
@@ -0,0 +1,177 @@
+#include "pch.h"
+#include "RenderThread.h"
+#include "Jobs.h"
+#include "Memory.h"
+#include "GpuProfiler.h"
+#include <spdlog/spdlog.h>
+#include <utility>
+
+bool Ngine::FramePacket::Visible(const Object& obj)
+{
+	//Objects without bounds are always drawn
+	if (obj.boundsMin == obj.boundsMax)
+		return true;
+
+	//Box is outside when all 8 corners lie behind the same clip plane
+	unsigned int outside = 0x3F;
+	for (int i = 0; i < 8; ++i) {
+		glm::vec3 corner((i & 1) ? obj.boundsMax.x : obj.boundsMin.x, (i & 2) ? obj.boundsMax.y : obj.boundsMin.y, (i & 4) ? obj.boundsMax.z : obj.boundsMin.z);
+		glm::vec4 clip = obj.mat.MVP * glm::vec4(corner, 1.0f);
+
+		unsigned int planes = 0;
+		if (clip.x < -clip.w) planes |= 1;
+		if (clip.x > clip.w) planes |= 2;
+		if (clip.y < -clip.w) planes |= 4;
+		if (clip.y > clip.w) planes |= 8;
+		if (clip.z < -clip.w) planes |= 16;
+		if (clip.z > clip.w) planes |= 32;
+		outside &= planes;
+	}
+	return outside == 0;
+}
+
+bool Ngine::FramePacket::Add(Object& obj)
+{
+	if (!Visible(obj)) {
+		++culled;
+		return false;
+	}
+
+	draws.push_back(obj.Command());
+	return true;
+}
+
+void Ngine::FramePacket::Add(const std::vector<Object*>& objects)
+{
+	Ngine::ArenaVector<unsigned char> visible(objects.size(), &Ngine::Memory::Frame());
+	Ngine::Jobs::ParallelFor(0, objects.size(), 256, [&](size_t first, size_t last) {
+		for (size_t i = first; i < last; ++i)
+			visible[i] = Visible(*objects[i]);
+		});
+
+	for (size_t i = 0; i < objects.size(); ++i) {
+		if (visible[i])
+			draws.push_back(objects[i]->Command());
+		else
+			++culled;
+	}
+}
+
+Ngine::RenderThread::RenderThread(Window& window) : m_Window(window)
+{
+	//A context can be current on one thread only
+	Window::ReleaseCurrent();
+	m_Thread = std::thread(&RenderThread::Run, this);
+}
+
+Ngine::RenderThread::~RenderThread()
+{
+	try {
+		Stop();
+	}
+	catch (const std::exception& e) {
+		spdlog::error("Render thread failed: {}", e.what());
+	}
+}
+
+Ngine::FramePacket& Ngine::RenderThread::Begin()
+{
+	std::unique_lock<std::mutex> lock(m_Mutex);
+	m_Cv.wait(lock, [this] { return m_Error || (m_Pending != m_Write && m_Drawing != m_Write); });
+	if (m_Error)
+		std::rethrow_exception(m_Error);
+
+	FramePacket& packet = m_Packets[m_Write];
+	packet.Clear();
+	packet.frame = m_Frame;
+	return packet;
+}
+
+void Ngine::RenderThread::Submit()
+{
+	{
+		//Waiting for the previous packet to be picked up keeps latency at one frame
+		std::unique_lock<std::mutex> lock(m_Mutex);
+		m_Cv.wait(lock, [this] { return m_Error || m_Pending < 0; });
+		if (m_Error)
+			std::rethrow_exception(m_Error);
+
+		m_Pending = m_Write;
+		m_Write ^= 1;
+		++m_Frame;
+	}
+	m_Cv.notify_all();
+}
+
+void Ngine::RenderThread::Stop()
+{
+	if (!m_Thread.joinable())
+		return;
+
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		m_Quit = true;
+	}
+	m_Cv.notify_all();
+	m_Thread.join();
+
+	//Render thread released the context before exiting, so resources can be freed here
+	m_Window.MakeCurrent();
+
+	if (m_Error)
+		std::rethrow_exception(std::exchange(m_Error, nullptr));
+}
+
+void Ngine::RenderThread::Run()
+{
+	Ngine::Profiler::SetThreadName("Render");
+	m_Window.MakeCurrent();
+
+	try {
+		ClusteredLighting lighting;
+		while (true) {
+			int index;
+			{
+				std::unique_lock<std::mutex> lock(m_Mutex);
+				m_Cv.wait(lock, [this] { return m_Quit || m_Pending >= 0; });
+				if (m_Pending < 0)
+					break; //Quit with nothing left to draw
+
+				index = m_Drawing = m_Pending;
+				m_Pending = -1;
+			}
+			m_Cv.notify_all();
+
+			{
+				NGINE_ZONE("RenderThread::Frame");
+				const FramePacket& packet = m_Packets[index];
+				m_Window.StartRender();
+				if (!packet.lighting.Empty())
+					lighting.Upload(packet.lighting);
+				{
+					NGINE_GPU_ZONE("Opaque");
+					for (const DrawCommand& cmd : packet.draws) {
+						lighting.Apply(cmd.program);
+						cmd.object->Draw(cmd);
+					}
+				}
+				m_Window.Present();
+			}
+
+			{
+				std::lock_guard<std::mutex> lock(m_Mutex);
+				m_Drawing = -1;
+				++m_Rendered;
+			}
+			m_Cv.notify_all();
+		}
+	}
+	catch (...) {
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		m_Error = std::current_exception();
+		m_Drawing = m_Pending = -1;
+		m_Cv.notify_all();
+	}
+
+	Window::ReleaseCurrent();
+}
@@ -0,0 +1,70 @@
+#pragma once
+#include "Gfx.h"
+#include "Lighting.h"
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace Ngine {
+
+	//Everything the render thread needs for one frame, built by the game thread
+	struct NAPI FramePacket {
+		uint64_t frame = 0;
+		glm::mat4 VP = glm::mat4(1.0f); //Camera of the frame
+		std::vector<DrawCommand> draws;
+		size_t culled = 0;
+		//Point lights binned for this packet's camera, Clear leaves them for the next Build
+		LightClusters lighting;
+
+		//Keeps capacity, after a few frames building a packet doesn't allocate
+		void Clear() { draws.clear(); culled = 0; };
+		//Copies current state of obj, returns false when its bounds are outside the view
+		bool Add(Object& obj);
+		//Culls on the job system, draws keep the order of objects
+		void Add(const std::vector<Object*>& objects);
+
+		static bool Visible(const Object& obj);
+	};
+
+	//Owns the GL context and draws packets while the game thread builds the next one.
+	//Game thread is never more than one frame ahead, Begin blocks until a packet is free.
+	class NAPI RenderThread {
+	public:
+		//Takes the context from the calling thread, load resources before starting
+		explicit RenderThread(Window& window);
+		//Stops the thread and hands the context back to the calling thread
+		~RenderThread();
+
+		RenderThread(const RenderThread&) = delete;
+		RenderThread& operator=(const RenderThread&) = delete;
+
+		//Returns a cleared packet to fill, rethrows errors raised on the render thread
+		FramePacket& Begin();
+		void Submit();
+		//Draws what was submitted and joins, safe to call more than once
+		void Stop();
+
+		uint64_t FramesRendered() const noexcept { return m_Rendered; }
+
+	private:
+		void Run();
+
+		Window& m_Window;
+		FramePacket m_Packets[2];
+		int m_Write = 0; //Packet the game thread fills
+		int m_Pending = -1; //Submitted and waiting for the render thread
+		int m_Drawing = -1; //Being drawn right now
+		uint64_t m_Frame = 0;
+		std::atomic<uint64_t> m_Rendered = 0;
+		bool m_Quit = false;
+		std::exception_ptr m_Error;
+
+		std::mutex m_Mutex;
+		std::condition_variable m_Cv;
+		std::thread m_Thread;
+	};
+}
@@ -0,0 +1,524 @@
+#include "pch.h"
+#include "Resources.h"
+#include "Gfx.h"
+#include "AssetCooker.h"
+#include "Memory.h"
+#include <spdlog/spdlog.h>
+#include <algorithm>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+namespace {
+
+	//Slots are reused through the free list, bumping the generation invalidates old handles
+	template<typename T>
+	struct Table {
+		struct Slot {
+			T value{};
+			std::string key;
+			uint32_t generation = 1;
+			uint32_t refs = 0;
+			size_t bytes = 0;
+		};
+
+		std::vector<Slot> slots;
+		std::vector<uint32_t> freeSlots;
+		std::unordered_map<std::string, uint32_t> byKey;
+
+		Slot* Find(uint32_t index, uint32_t generation)
+		{
+			if (index < slots.size() && slots[index].refs > 0 && slots[index].generation == generation)
+				return &slots[index];
+			return nullptr;
+		}
+
+		template<typename Tag>
+		Ngine::Handle<Tag> Acquire(const std::string& key)
+		{
+			auto it = byKey.find(key);
+			if (it == byKey.end())
+				return {};
+
+			Slot& slot = slots[it->second];
+			++slot.refs;
+			return { it->second, slot.generation };
+		}
+
+		template<typename Tag>
+		Ngine::Handle<Tag> Insert(const std::string& key, T&& value, size_t bytes)
+		{
+			uint32_t index;
+			if (!freeSlots.empty()) {
+				index = freeSlots.back();
+				freeSlots.pop_back();
+			}
+			else {
+				index = (uint32_t)slots.size();
+				slots.emplace_back();
+			}
+
+			Slot& slot = slots[index];
+			slot.value = std::move(value);
+			slot.key = key;
+			slot.refs = 1;
+			slot.bytes = bytes;
+			byKey.emplace(key, index);
+			return { index, slot.generation };
+		}
+
+		//True when this was the last reference, value and its size are then moved out for destruction
+		bool Release(uint32_t index, uint32_t generation, T& value, size_t& bytes)
+		{
+			Slot* slot = Find(index, generation);
+			if (!slot || --slot->refs > 0)
+				return false;
+
+			value = std::move(slot->value);
+			bytes = std::exchange(slot->bytes, 0);
+			byKey.erase(slot->key);
+			slot->key.clear();
+			if (++slot->generation == 0)
+				slot->generation = 1;
+			freeSlots.push_back(index);
+			return true;
+		}
+	};
+
+	std::mutex mutex;
+	Table<GLuint> textures;
+	Table<std::unique_ptr<Ngine::Mesh>> meshes;
+	Table<GLuint> programs;
+
+	//GL names waiting for the thread that owns the context
+	std::vector<GLuint> deadTextures, deadPrograms, deadBuffers, deadArrays;
+	//Released before the last CollectGarbage, deleted by the next one. Only touched by the context thread.
+	std::vector<GLuint> dyingTextures, dyingPrograms, dyingBuffers, dyingArrays;
+	//Created meshes without buffers yet, each holds a reference so the mesh can't go away mid upload
+	std::vector<Ngine::MeshRef> pendingMeshes;
+
+	bool HasExtension(const std::string& path, const char* ext)
+	{
+		std::string e = std::filesystem::path(path).extension().string();
+		std::transform(e.begin(), e.end(), e.begin(), [](char c) { return (char)std::tolower(c); });
+		return e == ext;
+	}
+
+	size_t TextureBytes(GLuint texture)
+	{
+		glBindTexture(GL_TEXTURE_2D, texture);
+
+		size_t bytes = 0;
+		for (GLint level = 0; level < 16; ++level) {
+			GLint width = 0, height = 0, compressed = GL_FALSE;
+			glGetTexLevelParameteriv(GL_TEXTURE_2D, level, GL_TEXTURE_WIDTH, &width);
+			glGetTexLevelParameteriv(GL_TEXTURE_2D, level, GL_TEXTURE_HEIGHT, &height);
+			if (width == 0 || height == 0)
+				break;
+
+			glGetTexLevelParameteriv(GL_TEXTURE_2D, level, GL_TEXTURE_COMPRESSED, &compressed);
+			if (compressed) {
+				GLint size = 0;
+				glGetTexLevelParameteriv(GL_TEXTURE_2D, level, GL_TEXTURE_COMPRESSED_IMAGE_SIZE, &size);
+				bytes += (size_t)size;
+			}
+			else {
+				bytes += (size_t)width * height * 4; //Drivers pad RGB to 4 bytes
+			}
+		}
+
+		glBindTexture(GL_TEXTURE_2D, 0);
+		return bytes;
+	}
+
+	struct MeshBuffers {
+		GLuint VAO = 0, VBO = 0, EBO = 0;
+		GLsizei count = 0;
+	};
+
+	//Only reads mesh, the names are stored by the caller
+	MeshBuffers Upload(const Ngine::Mesh& mesh)
+	{
+		MeshBuffers buffers;
+		buffers.count = (GLsizei)(mesh.indices.empty() ? mesh.verticies.size() : mesh.indices.size());
+
+		glGenVertexArrays(1, &buffers.VAO);
+		glBindVertexArray(buffers.VAO);
+
+		//Interleaved through the scratch arena, the driver keeps its own copy
+		Ngine::VertexSources sources;
+		sources.count = mesh.verticies.size();
+		sources.positions = mesh.verticies.data();
+		sources.uvs = mesh.uvs.size() == sources.count ? mesh.uvs.data() : nullptr;
+		sources.normals = mesh.normals.size() == sources.count ? mesh.normals.data() : nullptr;
+		sources.tangents = mesh.tangents.size() == sources.count ? mesh.tangents.data() : nullptr;
+
+		Ngine::ScratchScope scratch;
+		Ngine::ArenaVector<unsigned char> vertices((size_t)Ngine::MeshLayout::Stride * sources.count, scratch.Arena());
+		Ngine::MeshLayout::Interleave(sources, vertices.data());
+
+		glGenBuffers(1, &buffers.VBO);
+		glBindBuffer(GL_ARRAY_BUFFER, buffers.VBO);
+		glBufferData(GL_ARRAY_BUFFER, vertices.size(), vertices.data(), GL_STATIC_DRAW);
+		Ngine::MeshLayout::Bind(buffers.VBO);
+
+		//Element buffer binding is part of the VAO
+		if (!mesh.indices.empty()) {
+			glGenBuffers(1, &buffers.EBO);
+			glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, buffers.EBO);
+			glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(uint32_t) * mesh.indices.size(), mesh.indices.data(), GL_STATIC_DRAW);
+		}
+
+		glBindVertexArray(0);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+		Ngine::Gfx::CountUpload(vertices.size() + sizeof(uint32_t) * mesh.indices.size());
+		return buffers;
+	}
+
+	void Assign(Ngine::Mesh& mesh, const MeshBuffers& buffers)
+	{
+		mesh.VAO = buffers.VAO;
+		mesh.VBO = buffers.VBO;
+		mesh.EBO = buffers.EBO;
+		mesh.count = buffers.count;
+	}
+
+	size_t MeshCpuBytes(const Ngine::Mesh& mesh)
+	{
+		return sizeof(glm::vec3) * mesh.verticies.size() + sizeof(glm::vec2) * mesh.uvs.size() + sizeof(glm::vec3) * mesh.normals.size() + sizeof(glm::vec4) * mesh.tangents.size() + sizeof(uint32_t) * mesh.indices.size();
+	}
+
+	size_t MeshGpuBytes(const Ngine::Mesh& mesh)
+	{
+		return (size_t)Ngine::MeshLayout::Stride * mesh.verticies.size() + sizeof(uint32_t) * mesh.indices.size();
+	}
+
+	void TrackMesh(const Ngine::Mesh& mesh)
+	{
+		Ngine::Memory::Track(Ngine::MemoryCategory::MeshCpu, MeshCpuBytes(mesh));
+		Ngine::Memory::Track(Ngine::MemoryCategory::GpuBuffer, MeshGpuBytes(mesh));
+	}
+
+	//Driver side copy of the linked program, unknown without ARB_get_program_binary
+	size_t ProgramBytes(GLuint program)
+	{
+		GLint length = 0;
+		if (GLEW_ARB_get_program_binary)
+			glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+		return (size_t)length;
+	}
+
+	void Bounds(Ngine::Mesh& mesh)
+	{
+		if (mesh.verticies.empty())
+			return;
+
+		mesh.boundsMin = mesh.boundsMax = mesh.verticies.front();
+		for (const auto& v : mesh.verticies) {
+			mesh.boundsMin = glm::min(mesh.boundsMin, v);
+			mesh.boundsMax = glm::max(mesh.boundsMax, v);
+		}
+	}
+
+	void Bury(std::unique_ptr<Ngine::Mesh>& mesh)
+	{
+		if (mesh->VAO)
+			deadArrays.push_back(mesh->VAO);
+		for (GLuint buffer : { mesh->VBO, mesh->EBO })
+			if (buffer)
+				deadBuffers.push_back(buffer);
+		mesh.reset();
+	}
+}
+
+std::string Ngine::Resources::CanonicalPath(const char* path)
+{
+	std::error_code ec;
+	std::filesystem::path p = std::filesystem::weakly_canonical(std::filesystem::absolute(path, ec), ec);
+	std::string result = p.lexically_normal().generic_string();
+#if defined _WIN32 || defined _WIN64
+	std::transform(result.begin(), result.end(), result.begin(), [](char c) { return (char)std::tolower(c); });
+#endif
+	return result;
+}
+
+Ngine::TextureRef Ngine::Resources::LoadTexture(const char* path)
+{
+	std::string key = CanonicalPath(path);
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		if (auto handle = textures.Acquire<TextureTag>(key); handle.Valid())
+			return TextureRef(handle);
+	}
+
+	//Loaded without the lock, releases from other threads don't wait for disk
+	GLuint texture = HasExtension(key, ".dds") ? Gfx::LoadDDS(path) : Gfx::LoadBMP(path);
+	size_t bytes = TextureBytes(texture);
+
+	std::lock_guard<std::mutex> lock(mutex);
+	if (auto handle = textures.Acquire<TextureTag>(key); handle.Valid()) {
+		deadTextures.push_back(texture); //Another thread won the race
+		return TextureRef(handle);
+	}
+	Memory::Track(MemoryCategory::GpuTexture, bytes);
+	return TextureRef(textures.Insert<TextureTag>(key, std::move(texture), bytes));
+}
+
+Ngine::MeshRef Ngine::Resources::LoadMesh(const char* path, const char* mtlDir)
+{
+	std::string key = CanonicalPath(path) + "|" + CanonicalPath(mtlDir);
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		if (auto handle = meshes.Acquire<MeshTag>(key); handle.Valid())
+			return MeshRef(handle);
+	}
+
+	auto mesh = std::make_unique<Mesh>();
+	if (HasExtension(key.substr(0, key.find('|')), ".nmesh"))
+		AssetCooker::ReadMesh(path, *mesh);
+	else
+		Gfx::LoadOBJ(path, mtlDir, mesh->verticies, mesh->uvs, mesh->normals); //No shader reads tangents yet, don't pay for them
+	Bounds(*mesh);
+	Assign(*mesh, Upload(*mesh));
+	size_t bytes = MeshCpuBytes(*mesh) + MeshGpuBytes(*mesh);
+
+	std::lock_guard<std::mutex> lock(mutex);
+	if (auto handle = meshes.Acquire<MeshTag>(key); handle.Valid()) {
+		Bury(mesh);
+		return MeshRef(handle);
+	}
+	TrackMesh(*mesh);
+	return MeshRef(meshes.Insert<MeshTag>(key, std::move(mesh), bytes));
+}
+
+Ngine::MeshRef Ngine::Resources::CreateMesh(const std::string& key, Mesh&& mesh)
+{
+	auto owned = std::make_unique<Mesh>(std::move(mesh));
+	owned->VAO = owned->VBO = owned->EBO = 0;
+	owned->count = 0;
+	Bounds(*owned);
+	size_t bytes = MeshCpuBytes(*owned) + MeshGpuBytes(*owned);
+
+	std::lock_guard<std::mutex> lock(mutex);
+	if (auto handle = meshes.Acquire<MeshTag>(key); handle.Valid())
+		return MeshRef(handle);
+
+	TrackMesh(*owned);
+	MeshHandle handle = meshes.Insert<MeshTag>(key, std::move(owned), bytes);
+	++meshes.Find(handle.index, handle.generation)->refs;
+	pendingMeshes.push_back(MeshRef(handle));
+	return MeshRef(handle);
+}
+
+Ngine::ProgramRef Ngine::Resources::LoadProgram(const char* vpath, const char* fpath)
+{
+	std::string key = CanonicalPath(vpath) + "|" + CanonicalPath(fpath);
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		if (auto handle = programs.Acquire<ProgramTag>(key); handle.Valid())
+			return ProgramRef(handle);
+	}
+
+	GLuint program = Gfx::CompileShader(vpath, fpath);
+	size_t bytes = ProgramBytes(program);
+
+	std::lock_guard<std::mutex> lock(mutex);
+	if (auto handle = programs.Acquire<ProgramTag>(key); handle.Valid()) {
+		deadPrograms.push_back(program);
+		return ProgramRef(handle);
+	}
+	Memory::Track(MemoryCategory::Program, bytes);
+	return ProgramRef(programs.Insert<ProgramTag>(key, std::move(program), bytes));
+}
+
+GLuint Ngine::Resources::Get(TextureHandle handle)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	auto slot = textures.Find(handle.index, handle.generation);
+	return slot ? slot->value : 0;
+}
+
+const Ngine::Mesh* Ngine::Resources::Get(MeshHandle handle)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	auto slot = meshes.Find(handle.index, handle.generation);
+	return slot ? slot->value.get() : nullptr;
+}
+
+bool Ngine::Resources::Describe(MeshHandle handle, MeshState& state)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	auto slot = meshes.Find(handle.index, handle.generation);
+	if (!slot)
+		return false;
+
+	const Mesh& mesh = *slot->value;
+	state.VAO = mesh.VAO;
+	state.count = mesh.count;
+	state.indexed = mesh.EBO != 0;
+	state.boundsMin = mesh.boundsMin;
+	state.boundsMax = mesh.boundsMax;
+	return true;
+}
+
+GLuint Ngine::Resources::Get(ProgramHandle handle)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	auto slot = programs.Find(handle.index, handle.generation);
+	return slot ? slot->value : 0;
+}
+
+void Ngine::Resources::AddRef(TextureHandle handle)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	if (auto slot = textures.Find(handle.index, handle.generation))
+		++slot->refs;
+}
+
+void Ngine::Resources::AddRef(MeshHandle handle)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	if (auto slot = meshes.Find(handle.index, handle.generation))
+		++slot->refs;
+}
+
+void Ngine::Resources::AddRef(ProgramHandle handle)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	if (auto slot = programs.Find(handle.index, handle.generation))
+		++slot->refs;
+}
+
+void Ngine::Resources::Release(TextureHandle handle)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	GLuint texture;
+	size_t bytes;
+	if (textures.Release(handle.index, handle.generation, texture, bytes)) {
+		deadTextures.push_back(texture);
+		Memory::Untrack(MemoryCategory::GpuTexture, bytes);
+	}
+}
+
+void Ngine::Resources::Release(MeshHandle handle)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	std::unique_ptr<Mesh> mesh;
+	size_t bytes;
+	if (meshes.Release(handle.index, handle.generation, mesh, bytes)) {
+		Memory::Untrack(MemoryCategory::MeshCpu, MeshCpuBytes(*mesh));
+		Memory::Untrack(MemoryCategory::GpuBuffer, MeshGpuBytes(*mesh));
+		Bury(mesh);
+	}
+}
+
+void Ngine::Resources::Release(ProgramHandle handle)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	GLuint program;
+	size_t bytes;
+	if (programs.Release(handle.index, handle.generation, program, bytes)) {
+		deadPrograms.push_back(program);
+		Memory::Untrack(MemoryCategory::Program, bytes);
+	}
+}
+
+void Ngine::Resources::CollectGarbage(bool everything)
+{
+	//What died before the last call goes now, what died since waits for the next one
+	std::vector<GLuint> texturesToDelete, programsToDelete, buffersToDelete, arraysToDelete;
+	texturesToDelete.swap(dyingTextures);
+	programsToDelete.swap(dyingPrograms);
+	buffersToDelete.swap(dyingBuffers);
+	arraysToDelete.swap(dyingArrays);
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		dyingTextures.swap(deadTextures);
+		dyingPrograms.swap(deadPrograms);
+		dyingBuffers.swap(deadBuffers);
+		dyingArrays.swap(deadArrays);
+	}
+	if (everything) {
+		texturesToDelete.insert(texturesToDelete.end(), dyingTextures.begin(), dyingTextures.end());
+		programsToDelete.insert(programsToDelete.end(), dyingPrograms.begin(), dyingPrograms.end());
+		buffersToDelete.insert(buffersToDelete.end(), dyingBuffers.begin(), dyingBuffers.end());
+		arraysToDelete.insert(arraysToDelete.end(), dyingArrays.begin(), dyingArrays.end());
+		dyingTextures.clear();
+		dyingPrograms.clear();
+		dyingBuffers.clear();
+		dyingArrays.clear();
+	}
+
+	if (!texturesToDelete.empty())
+		glDeleteTextures((GLsizei)texturesToDelete.size(), texturesToDelete.data());
+	if (!buffersToDelete.empty())
+		glDeleteBuffers((GLsizei)buffersToDelete.size(), buffersToDelete.data());
+	if (!arraysToDelete.empty())
+		glDeleteVertexArrays((GLsizei)arraysToDelete.size(), arraysToDelete.data());
+	for (GLuint program : programsToDelete)
+		glDeleteProgram(program);
+}
+
+void Ngine::Resources::UploadPending(size_t budgetBytes)
+{
+	std::vector<MeshRef> batch;
+	std::vector<Mesh*> targets;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		size_t bytes = 0, taken = 0;
+		while (taken < pendingMeshes.size() && (taken == 0 || bytes < budgetBytes)) {
+			MeshHandle handle = pendingMeshes[taken++];
+			auto slot = meshes.Find(handle.index, handle.generation);
+			if (slot->refs == 1)
+				continue; //Nobody else wants it anymore, dropped without an upload
+			bytes += MeshGpuBytes(*slot->value);
+			targets.push_back(slot->value.get());
+		}
+		batch.assign(std::make_move_iterator(pendingMeshes.begin()), std::make_move_iterator(pendingMeshes.begin() + taken));
+		pendingMeshes.erase(pendingMeshes.begin(), pendingMeshes.begin() + taken);
+	}
+
+	//The held references keep the meshes alive without the lock, their geometry doesn't change after creation.
+	//Names are published under the lock, the game thread reads them through Describe.
+	std::vector<MeshBuffers> uploaded;
+	uploaded.reserve(targets.size());
+	for (Mesh* mesh : targets)
+		uploaded.push_back(Upload(*mesh));
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		for (size_t i = 0; i < targets.size(); ++i)
+			Assign(*targets[i], uploaded[i]);
+	}
+
+	//Last reference of a mesh released while it waited goes away here, Release takes the lock
+	batch.clear();
+}
+
+std::vector<Ngine::ResourceInfo> Ngine::Resources::Table()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+
+	std::vector<ResourceInfo> table;
+	auto add = [&](ResourceType type, const auto& t) {
+		for (const auto& slot : t.slots)
+			if (slot.refs > 0)
+				table.push_back({ type, slot.key, slot.refs, slot.bytes });
+	};
+	add(ResourceType::Texture, textures);
+	add(ResourceType::Mesh, meshes);
+	add(ResourceType::Program, programs);
+	return table;
+}
+
+void Ngine::Resources::LogTable()
+{
+	const char* names[] = { "texture", "mesh", "program" };
+
+	size_t total = 0;
+	for (const auto& info : Table()) {
+		spdlog::info("{:8} {:>4} refs {:>10} bytes  {}", names[(int)info.type], info.refs, info.bytes, info.key);
+		total += info.bytes;
+	}
+	spdlog::info("Resident resources take {} bytes", total);
+}
@@ -0,0 +1,155 @@
+#pragma once
+#include "Macro.h"
+#include "VertexLayout.h"
+#include <gl/glew.h>
+#include <glm/glm.hpp>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace Ngine {
+
+	//Index into a resource table plus the generation of the slot, stale handles resolve to nothing
+	template<typename Tag>
+	struct Handle {
+		uint32_t index = 0, generation = 0;
+
+		bool Valid() const noexcept { return generation != 0; }
+		bool operator==(const Handle& other) const noexcept { return index == other.index && generation == other.generation; }
+		bool operator!=(const Handle& other) const noexcept { return !(*this == other); }
+	};
+
+	struct TextureTag;
+	struct MeshTag;
+	struct ProgramTag;
+
+	using TextureHandle = Handle<TextureTag>;
+	using MeshHandle = Handle<MeshTag>;
+	using ProgramHandle = Handle<ProgramTag>;
+
+	template<typename Tag>
+	class Ref;
+
+	using TextureRef = Ref<TextureTag>;
+	using MeshRef = Ref<MeshTag>;
+	using ProgramRef = Ref<ProgramTag>;
+
+	//GPU format of meshes, 28 bytes per vertex against 48 for separate float arrays
+	using MeshLayout = VertexLayout<Position3f, UV2f, NormalPacked, TangentPacked>;
+
+	//Geometry uploaded once, interleaved in MeshLayout. Arrays left empty are uploaded as defaults.
+	struct NAPI Mesh {
+		std::vector<glm::vec3> verticies;
+		std::vector<glm::vec2> uvs;
+		std::vector<glm::vec3> normals;
+		std::vector<glm::vec4> tangents; //w is the bitangent sign
+		std::vector<uint32_t> indices; //Drawn with glDrawElements when set, cooked meshes always have them
+		glm::vec3 boundsMin = glm::vec3(0.0f), boundsMax = glm::vec3(0.0f);
+		GLuint VAO = 0, VBO = 0, EBO = 0;
+		GLsizei count = 0; //Indices, or verticies for unindexed meshes
+	};
+
+	//What drawing and culling need of a mesh, copied under the lock so it stays valid after the mesh is released
+	struct NAPI MeshState {
+		GLuint VAO = 0; //0 until UploadPending got to the mesh
+		GLsizei count = 0;
+		bool indexed = false;
+		glm::vec3 boundsMin = glm::vec3(0.0f), boundsMax = glm::vec3(0.0f);
+	};
+
+	enum class ResourceType {
+		Texture,
+		Mesh,
+		Program
+	};
+
+	struct NAPI ResourceInfo {
+		ResourceType type;
+		std::string key;
+		uint32_t refs;
+		size_t bytes; //CPU and GPU memory, estimated for textures from their levels
+	};
+
+	//Loads each file once per set of options and shares it between users.
+	//Loading needs the GL context, releasing works from any thread and GL names are freed by CollectGarbage.
+	class NAPI Resources {
+	public:
+		//DDS or BMP picked by extension
+		static TextureRef LoadTexture(const char* path);
+		//OBJ, or .nmesh written by AssetCooker
+		static MeshRef LoadMesh(const char* path, const char* mtlDir = ".");
+		static ProgramRef LoadProgram(const char* vpath, const char* fpath);
+		//Also throws when the vertex shader reads an attribute Layout doesn't have
+		template<typename Layout>
+		static ProgramRef LoadProgram(const char* vpath, const char* fpath);
+		//Takes geometry built on the CPU, from any thread. Buffers are created by UploadPending, until then the mesh isn't drawn.
+		//A key that is already resident returns the existing mesh.
+		static MeshRef CreateMesh(const std::string& key, Mesh&& mesh);
+
+		//0 or nullptr for stale handles. The mesh pointer is only safe while no other thread can release the mesh,
+		//the render thread works from Describe instead.
+		static GLuint Get(TextureHandle handle);
+		static const Mesh* Get(MeshHandle handle);
+		//False for stale handles
+		static bool Describe(MeshHandle handle, MeshState& state);
+		static GLuint Get(ProgramHandle handle);
+
+		static void AddRef(TextureHandle handle);
+		static void AddRef(MeshHandle handle);
+		static void AddRef(ProgramHandle handle);
+		static void Release(TextureHandle handle);
+		static void Release(MeshHandle handle);
+		static void Release(ProgramHandle handle);
+
+		//Deletes GL objects whose last reference is gone, call on the thread owning the context before drawing a frame.
+		//Names stay alive for one more call, a packet built before the release may still draw with them.
+		//everything skips that wait, once nothing will be drawn anymore.
+		static void CollectGarbage(bool everything = false);
+		//Uploads created meshes in order until about budgetBytes were sent, at least one per call. Same thread as above.
+		static void UploadPending(size_t budgetBytes = 4 * 1024 * 1024);
+
+		//Every resident resource with its reference count and size
+		static std::vector<ResourceInfo> Table();
+		static void LogTable();
+
+		//Absolute, with '/' separators, lower cased on Windows where paths are case insensitive
+		static std::string CanonicalPath(const char* path);
+	};
+
+	//Shared ownership of a resource, the last Ref going away queues it for destruction
+	template<typename Tag>
+	class Ref {
+	public:
+		Ref() = default;
+		Ref(const Ref& other) : m_Handle(other.m_Handle) { if (m_Handle.Valid()) Resources::AddRef(m_Handle); }
+		Ref(Ref&& other) noexcept : m_Handle(std::exchange(other.m_Handle, {})) {}
+		~Ref() { if (m_Handle.Valid()) Resources::Release(m_Handle); }
+
+		Ref& operator=(Ref other) noexcept
+		{
+			std::swap(m_Handle, other.m_Handle);
+			return *this;
+		}
+
+		Handle<Tag> Get() const noexcept { return m_Handle; }
+		operator Handle<Tag>() const noexcept { return m_Handle; }
+		explicit operator bool() const noexcept { return m_Handle.Valid(); }
+
+	private:
+		friend class Resources;
+
+		//Adopts a reference already counted by Resources
+		explicit Ref(Handle<Tag> handle) : m_Handle(handle) {}
+
+		Handle<Tag> m_Handle;
+	};
+
+	template<typename Layout>
+	ProgramRef Resources::LoadProgram(const char* vpath, const char* fpath)
+	{
+		ProgramRef program = LoadProgram(vpath, fpath);
+		Layout::Check(Get(program.Get()), vpath);
+		return program;
+	}
+}
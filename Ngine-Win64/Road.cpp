@@ -0,0 +1,307 @@
+#include "pch.h"
+#include "Road.h"
+#include "Exception.h"
+#include "Log.h"
+#include "Profiler.h"
+#include <spdlog/spdlog.h>
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <string>
+
+namespace {
+
+	constexpr float EvictScale = 1.25f; //Chunks are dropped a bit further out than they are loaded, so they don't flicker at the edge
+
+	std::atomic<uint64_t> nextId = 1; //Keeps mesh keys of different streamers apart
+
+	glm::vec3 CatmullRom(const glm::vec3& p0, const glm::vec3& p1, const glm::vec3& p2, const glm::vec3& p3, float u)
+	{
+		return 0.5f * (2.0f * p1 + (p2 - p0) * u + (2.0f * p0 - 5.0f * p1 + 4.0f * p2 - p3) * u * u + (3.0f * p1 - p0 - 3.0f * p2 + p3) * u * u * u);
+	}
+
+	glm::vec3 CatmullRomDerivative(const glm::vec3& p0, const glm::vec3& p1, const glm::vec3& p2, const glm::vec3& p3, float u)
+	{
+		return 0.5f * ((p2 - p0) + 2.0f * (2.0f * p0 - 5.0f * p1 + 4.0f * p2 - p3) * u + 3.0f * (3.0f * p1 - p0 - 3.0f * p2 + p3) * u * u);
+	}
+
+	size_t Bytes(const Ngine::Mesh& mesh)
+	{
+		//CPU copy and interleaved buffer, same as Resources counts them
+		return sizeof(glm::vec3) * (mesh.verticies.size() + mesh.normals.size()) + sizeof(glm::vec2) * mesh.uvs.size() + (size_t)Ngine::MeshLayout::Stride * mesh.verticies.size();
+	}
+}
+
+Ngine::RoadSpline::RoadSpline(std::vector<RoadPoint> points, bool closed) : m_Points(std::move(points)), m_Closed(closed)
+{
+	if (m_Points.size() < 2) {
+		spdlog::error("Road spline needs at least 2 points, got {}", m_Points.size());
+		throw Ngine::Exception(__LINE__, __FILE__, "Could not create road spline");
+	}
+
+	//Cumulative chord lengths of short steps, close enough to the arc length for placing cross-sections
+	m_Arc.reserve(Segments() * Steps + 1);
+	m_Arc.push_back(0.0f);
+	glm::vec3 previous = Position(0.0f);
+	for (int i = 1; i <= Segments() * Steps; ++i) {
+		glm::vec3 p = Position((float)i / Steps);
+		m_Arc.push_back(m_Arc.back() + glm::length(p - previous));
+		previous = p;
+	}
+}
+
+const Ngine::RoadPoint& Ngine::RoadSpline::Point(int i) const noexcept
+{
+	int n = (int)m_Points.size();
+	if (m_Closed)
+		return m_Points[((i % n) + n) % n];
+	return m_Points[std::clamp(i, 0, n - 1)];
+}
+
+glm::vec3 Ngine::RoadSpline::Position(float t) const noexcept
+{
+	int i = std::min((int)t, Segments() - 1);
+	float u = t - (float)i;
+	return CatmullRom(Point(i - 1).position, Point(i).position, Point(i + 1).position, Point(i + 2).position, u);
+}
+
+glm::vec3 Ngine::RoadSpline::Derivative(float t) const noexcept
+{
+	int i = std::min((int)t, Segments() - 1);
+	float u = t - (float)i;
+	return CatmullRomDerivative(Point(i - 1).position, Point(i).position, Point(i + 1).position, Point(i + 2).position, u);
+}
+
+Ngine::RoadSpline::Frame Ngine::RoadSpline::At(float distance) const
+{
+	float length = Length();
+	if (m_Closed)
+		distance -= std::floor(distance / length) * length;
+	distance = std::clamp(distance, 0.0f, length);
+
+	//Table step holding distance, then linear within it
+	size_t k = (size_t)(std::upper_bound(m_Arc.begin(), m_Arc.end(), distance) - m_Arc.begin());
+	k = std::clamp<size_t>(k, 1, m_Arc.size() - 1) - 1;
+	float span = m_Arc[k + 1] - m_Arc[k];
+	float t = ((float)k + (span > 0.0f ? (distance - m_Arc[k]) / span : 0.0f)) / Steps;
+
+	Frame frame;
+	frame.position = Position(t);
+	frame.tangent = Derivative(t);
+	if (glm::dot(frame.tangent, frame.tangent) < 1e-12f)
+		frame.tangent = glm::vec3(0.0f, 0.0f, 1.0f);
+	frame.tangent = glm::normalize(frame.tangent);
+
+	glm::vec3 right = glm::cross(frame.tangent, glm::vec3(0.0f, 1.0f, 0.0f));
+	if (glm::dot(right, right) < 1e-12f)
+		right = glm::vec3(1.0f, 0.0f, 0.0f); //Going straight up or down
+	right = glm::normalize(right);
+	glm::vec3 up = glm::cross(right, frame.tangent);
+
+	//Bank eases in and out between control points
+	int i = std::min((int)t, Segments() - 1);
+	float u = t - (float)i;
+	u = u * u * (3.0f - 2.0f * u);
+	float bank = Point(i).bank + (Point(i + 1).bank - Point(i).bank) * u;
+
+	float c = std::cos(bank), s = std::sin(bank);
+	frame.right = right * c - up * s;
+	frame.up = up * c + right * s;
+	return frame;
+}
+
+void Ngine::Road::BuildChunk(const RoadSpline& spline, const RoadProfile& profile, float start, float end, Mesh& mesh)
+{
+	NGINE_ZONE("Road::BuildChunk");
+
+	//Cross-section from the outer left kerb to the outer right one, as lateral offset and height
+	const float hw = profile.width * 0.5f, ko = hw + profile.kerbWidth, kh = profile.kerbHeight;
+	const glm::vec2 shape[] = { { -ko, 0.0f }, { -ko, kh }, { -hw, kh }, { -hw, 0.0f }, { hw, 0.0f }, { hw, kh }, { ko, kh }, { ko, 0.0f } };
+	constexpr int points = sizeof(shape) / sizeof(shape[0]);
+
+	const int sections = std::max(1, (int)std::ceil((end - start) / profile.step));
+	//Texture repeats every uvLength, starting V at the last whole repeat keeps it small and seamless between chunks
+	const float v0 = start - std::floor(start / profile.uvLength) * profile.uvLength;
+
+	std::vector<glm::vec3> ring(points * 2);
+	std::vector<float> v(2);
+	auto fill = [&](int slot, int section) {
+		float d = start + (end - start) * (float)section / (float)sections;
+		RoadSpline::Frame frame = spline.At(d);
+		for (int j = 0; j < points; ++j)
+			ring[slot * points + j] = frame.position + frame.right * shape[j].x + frame.up * shape[j].y;
+		v[slot] = (v0 + d - start) / profile.uvLength;
+	};
+
+	size_t count = (size_t)sections * (points - 1) * 6;
+	mesh.verticies.clear();
+	mesh.uvs.clear();
+	mesh.normals.clear();
+	mesh.verticies.reserve(count);
+	mesh.uvs.reserve(count);
+	mesh.normals.reserve(count);
+
+	fill(0, 0);
+	for (int i = 0; i < sections; ++i) {
+		fill(1, i + 1);
+		for (int j = 0; j + 1 < points; ++j) {
+			//a b across the road, c d one section further
+			glm::vec3 a = ring[j], b = ring[j + 1], c = ring[points + j], d = ring[points + j + 1];
+			float ua = (shape[j].x + ko) / (2.0f * ko), ub = (shape[j + 1].x + ko) / (2.0f * ko);
+
+			glm::vec3 n = glm::cross(b - a, c - a);
+			n = glm::dot(n, n) > 1e-12f ? glm::normalize(n) : glm::vec3(0.0f, 1.0f, 0.0f);
+
+			const glm::vec3 corners[] = { a, b, c, b, d, c };
+			const glm::vec2 uvs[] = { { ua, v[0] }, { ub, v[0] }, { ua, v[1] }, { ub, v[0] }, { ub, v[1] }, { ua, v[1] } };
+			for (int k = 0; k < 6; ++k) {
+				mesh.verticies.push_back(corners[k]);
+				mesh.uvs.push_back(uvs[k]);
+				mesh.normals.push_back(n);
+			}
+		}
+
+		std::copy(ring.begin() + points, ring.end(), ring.begin());
+		v[0] = v[1];
+	}
+}
+
+Ngine::RoadStreamer::RoadStreamer(RoadSpline spline, RoadProfile profile, GLuint program, GLuint texture, float chunkLength, float radius)
+	: m_Spline(std::move(spline)), m_Profile(profile), m_ChunkLength(chunkLength), m_Radius(radius), m_Id(nextId++)
+{
+	m_Template.program = program;
+	m_Template.texture = texture;
+	m_Template.InitMatrix();
+
+	//Bounding sphere of every chunk, wide enough for the kerbs
+	int chunks = std::max(1, (int)std::ceil(m_Spline.Length() / m_ChunkLength));
+	float margin = m_Profile.width * 0.5f + m_Profile.kerbWidth + m_Profile.kerbHeight;
+	m_Bounds.reserve(chunks);
+	for (int i = 0; i < chunks; ++i) {
+		float start = i * m_ChunkLength, end = std::min(start + m_ChunkLength, m_Spline.Length());
+		glm::vec3 lo = m_Spline.At(start).position, hi = lo;
+		for (int s = 1; s <= 8; ++s) {
+			glm::vec3 p = m_Spline.At(start + (end - start) * s / 8.0f).position;
+			lo = glm::min(lo, p);
+			hi = glm::max(hi, p);
+		}
+		m_Bounds.push_back({ (lo + hi) * 0.5f, glm::length(hi - lo) * 0.5f + margin });
+	}
+}
+
+Ngine::RoadStreamer::~RoadStreamer()
+{
+	try {
+		Jobs::Wait(m_Jobs);
+	}
+	catch (const std::exception& e) {
+		spdlog::error("Building a road chunk failed: {}", e.what());
+	}
+}
+
+float Ngine::RoadStreamer::Distance(int index, const glm::vec3& focus) const noexcept
+{
+	return std::max(0.0f, glm::length(m_Bounds[index].centre - focus) - m_Bounds[index].radius);
+}
+
+void Ngine::RoadStreamer::Build(int index)
+{
+	m_Building.push_back(index);
+	Jobs::Run([this, index]() {
+		LogTimer timer;
+		float start = index * m_ChunkLength;
+		Built built{ index };
+		Road::BuildChunk(m_Spline, m_Profile, start, std::min(start + m_ChunkLength, m_Spline.Length()), built.mesh);
+		built.ms = timer.Ms();
+
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		m_Done.push_back(std::move(built));
+		}, &m_Jobs);
+}
+
+void Ngine::RoadStreamer::Update(const glm::vec3& focus)
+{
+	NGINE_ZONE("RoadStreamer::Update");
+
+	//Surfaces a failed build here instead of at destruction
+	if (m_Jobs.failed)
+		Jobs::Wait(m_Jobs);
+
+	//The packet being drawn and the one waiting may both point at a retired chunk, two submits later neither does
+	m_Retired.erase(std::remove_if(m_Retired.begin(), m_Retired.end(), [this](const auto& chunk) { return m_Submits - chunk->retired >= 2; }), m_Retired.end());
+
+	for (auto it = m_Resident.begin(); it != m_Resident.end();) {
+		if (Distance(it->first, focus) > m_Radius * EvictScale) {
+			m_ResidentBytes -= it->second->bytes;
+			it->second->retired = m_Submits;
+			m_Retired.push_back(std::move(it->second));
+			it = m_Resident.erase(it);
+			++m_Evicted;
+		}
+		else {
+			++it;
+		}
+	}
+
+	std::vector<Built> done;
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		done.swap(m_Done);
+	}
+
+	for (Built& built : done) {
+		m_Building.erase(std::find(m_Building.begin(), m_Building.end(), built.index));
+		++m_Built;
+		m_LastMs = built.ms;
+		m_TotalMs += built.ms;
+		NGINE_LOG_DEBUG("Built road chunk {} {} {:.2f}", Field("index", built.index), Field("verticies", built.mesh.verticies.size()), Field("ms", built.ms));
+
+		//The car may have left while it was being built
+		if (Distance(built.index, focus) > m_Radius * EvictScale)
+			continue;
+
+		auto chunk = std::make_unique<Chunk>();
+		chunk->bytes = Bytes(built.mesh);
+		chunk->object = m_Template;
+		chunk->object.mesh = Resources::CreateMesh("road" + std::to_string(m_Id) + "#" + std::to_string(built.index), std::move(built.mesh));
+		chunk->object.UpdateBounds();
+		m_ResidentBytes += chunk->bytes;
+		m_Resident[built.index] = std::move(chunk);
+	}
+
+	//Nearest missing chunks first, a few at a time so a teleport doesn't flood the workers
+	std::vector<std::pair<float, int>> wanted;
+	for (int i = 0; i < (int)m_Bounds.size(); ++i) {
+		float distance = Distance(i, focus);
+		if (distance <= m_Radius && !m_Resident.count(i) && std::find(m_Building.begin(), m_Building.end(), i) == m_Building.end())
+			wanted.push_back({ distance, i });
+	}
+	std::sort(wanted.begin(), wanted.end());
+
+	const size_t limit = std::max(2, Jobs::Workers() * 2);
+	for (const auto& w : wanted) {
+		if (m_Building.size() >= limit)
+			break;
+		Build(w.second);
+	}
+}
+
+void Ngine::RoadStreamer::Submit(FramePacket& packet)
+{
+	++m_Submits;
+	for (auto& [index, chunk] : m_Resident) {
+		chunk->object.mat.MVP = packet.VP;
+		packet.Add(chunk->object);
+	}
+}
+
+Ngine::RoadStreamer::Stats Ngine::RoadStreamer::GetStats() const
+{
+	return Stats{ m_Bounds.size(), m_Resident.size(), m_Building.size(), m_ResidentBytes, m_Built, m_Evicted, m_LastMs, m_Built ? m_TotalMs / m_Built : 0.0 };
+}
+
+void Ngine::RoadStreamer::LogStats() const
+{
+	Stats s = GetStats();
+	spdlog::info("Road: {} of {} chunks resident in {} bytes, {} built in {:.2f} ms average, {} evicted", s.resident, s.chunks, s.residentBytes, s.built, s.averageBuildMs, s.evicted);
+}
@@ -0,0 +1,130 @@
+#pragma once
+#include "Gfx.h"
+#include "Jobs.h"
+#include "RenderThread.h"
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace Ngine {
+
+	//Control point of the centre line
+	struct NAPI RoadPoint {
+		glm::vec3 position;
+		float bank = 0.0f; //Radians, positive raises the left edge
+	};
+
+	//Cross-section swept along the spline, in metres
+	struct NAPI RoadProfile {
+		float width = 8.0f; //Asphalt between the kerbs
+		float kerbWidth = 0.6f, kerbHeight = 0.12f;
+		float uvLength = 8.0f; //Road covered by one repeat of the texture
+		float step = 1.0f; //Distance between cross-sections
+	};
+
+	//Catmull-Rom curve through the points, addressed by distance along it
+	class NAPI RoadSpline {
+	public:
+		struct Frame {
+			glm::vec3 position;
+			glm::vec3 tangent, right, up; //Right and up include the bank
+		};
+
+		//At least 2 points, a closed spline joins the last one back to the first
+		RoadSpline(std::vector<RoadPoint> points, bool closed);
+
+		float Length() const noexcept { return m_Arc.back(); }
+		bool Closed() const noexcept { return m_Closed; }
+		//Distances past the end wrap on closed splines and clamp on open ones
+		Frame At(float distance) const;
+
+	private:
+		static constexpr int Steps = 16; //Arc length table entries per segment
+
+		int Segments() const noexcept { return (int)m_Points.size() - (m_Closed ? 0 : 1); }
+		const RoadPoint& Point(int i) const noexcept;
+		glm::vec3 Position(float t) const noexcept;
+		glm::vec3 Derivative(float t) const noexcept;
+
+		std::vector<RoadPoint> m_Points;
+		std::vector<float> m_Arc; //Length up to every table step
+		bool m_Closed;
+	};
+
+	class NAPI Road {
+	public:
+		//Triangle list from start to end with positions, UVs and flat normals. Pure function, safe on any thread.
+		static void BuildChunk(const RoadSpline& spline, const RoadProfile& profile, float start, float end, Mesh& mesh);
+	};
+
+	//Keeps the chunks around a focus point resident. Chunks are built on the job system and
+	//uploaded by the render thread, far ones are dropped, so memory follows the radius and not the track length.
+	class NAPI RoadStreamer {
+	public:
+		struct Stats {
+			size_t chunks; //On the whole track
+			size_t resident;
+			size_t building;
+			size_t residentBytes;
+			uint64_t built, evicted; //Since construction
+			double lastBuildMs, averageBuildMs;
+		};
+
+		//Needs the context current, chunks reuse the uniform locations of program
+		RoadStreamer(RoadSpline spline, RoadProfile profile, GLuint program, GLuint texture, float chunkLength = 64.0f, float radius = 300.0f);
+		//Waits for chunks still being built
+		~RoadStreamer();
+
+		RoadStreamer(const RoadStreamer&) = delete;
+		RoadStreamer& operator=(const RoadStreamer&) = delete;
+
+		//Requests chunks near focus, adopts finished ones and evicts far ones, call once per tick on the game thread
+		void Update(const glm::vec3& focus);
+		//Adds visible resident chunks, geometry is in world space so MVP is the packet's VP
+		void Submit(FramePacket& packet);
+
+		const RoadSpline& Spline() const noexcept { return m_Spline; }
+		Stats GetStats() const;
+		void LogStats() const;
+
+	private:
+		struct Chunk {
+			Object object;
+			size_t bytes;
+			uint64_t retired; //Submits done when it was evicted
+		};
+
+		struct Built {
+			int index;
+			Mesh mesh;
+			double ms;
+		};
+
+		struct Bounds {
+			glm::vec3 centre;
+			float radius;
+		};
+
+		void Build(int index);
+		float Distance(int index, const glm::vec3& focus) const noexcept;
+
+		RoadSpline m_Spline;
+		RoadProfile m_Profile;
+		Object m_Template; //Program, texture and uniform locations shared by every chunk
+		float m_ChunkLength, m_Radius;
+		std::vector<Bounds> m_Bounds; //16 bytes per chunk
+		uint64_t m_Id;
+
+		std::map<int, std::unique_ptr<Chunk>> m_Resident; //Ordered, so draws come out the same every run
+		std::vector<std::unique_ptr<Chunk>> m_Retired; //Evicted, kept until no packet in flight points at them
+		std::vector<int> m_Building;
+		uint64_t m_Submits = 0, m_Built = 0, m_Evicted = 0;
+		size_t m_ResidentBytes = 0;
+		double m_LastMs = 0.0, m_TotalMs = 0.0;
+
+		mutable std::mutex m_Mutex; //Guards m_Done, filled by jobs
+		std::vector<Built> m_Done;
+		JobCounter m_Jobs;
+	};
+}
@@ -0,0 +1,226 @@
+#include "pch.h"
+#include "Settings.h"
+#include <spdlog/spdlog.h>
+#include <algorithm>
+#include <atomic>
+#include <filesystem>
+#include <mutex>
+#include <vector>
+
+namespace {
+
+	std::atomic<std::shared_ptr<const Ngine::EngineSettings>> current;
+	std::mutex mutex; //Serialises Load, Set, Save and the listener list
+	std::string path;
+	std::vector<std::pair<int, Ngine::Settings::Listener>> listeners;
+	int nextListener = 0;
+
+	//Values may carry trailing comments, eg. "0 #Selected device to render"
+	std::string Value(mINI::INIStructure& ini, const char* key)
+	{
+		std::string value = ini["Game"][key];
+		value = value.substr(0, value.find('#'));
+		mINI::INIStringUtil::trim(value);
+		return value;
+	}
+
+	int ParseInt(mINI::INIStructure& ini, const char* key, int fallback)
+	{
+		std::string value = Value(ini, key);
+		if (value.empty())
+			return fallback;
+
+		try {
+			size_t used;
+			int result = std::stoi(value, &used);
+			if (used == value.size())
+				return result;
+		}
+		catch (const std::exception&) {
+		}
+
+		spdlog::error("{} has illegal value: {}", key, value);
+		throw Ngine::Exception(__LINE__, __FILE__, "Configuration has illegal value");
+	}
+
+	bool ParseBool(mINI::INIStructure& ini, const char* key, bool fallback)
+	{
+		std::string value = Value(ini, key);
+		std::transform(value.begin(), value.end(), value.begin(), [](char c) { return (char)std::tolower(c); });
+
+		if (value.empty())
+			return fallback;
+		if (value == "enable" || value == "true" || value == "yes" || value == "1")
+			return true;
+		if (value == "disable" || value == "false" || value == "no" || value == "0")
+			return false;
+
+		spdlog::error("{} has illegal value: {}", key, value);
+		throw Ngine::Exception(__LINE__, __FILE__, "Configuration has illegal value");
+	}
+
+	//mINI keeps a trailing comment as part of the value, carry it over so rewritten keys keep theirs
+	void Store(mINI::INIMap<std::string>& section, const char* key, const std::string& value)
+	{
+		std::string old = section[key];
+		size_t comment = old.find('#');
+		section[key] = comment == std::string::npos ? value : value + " " + old.substr(comment);
+	}
+
+	Ngine::EngineSettings Parse(mINI::INIStructure& ini)
+	{
+		Ngine::EngineSettings s;
+		s.api = Value(ini, "API");
+		s.samples = ParseInt(ini, "Samples", s.samples);
+		s.windowed = ParseBool(ini, "Windowed", s.windowed);
+		s.width = ParseInt(ini, "Width", s.width);
+		s.height = ParseInt(ini, "Height", s.height);
+		s.gpu = ParseInt(ini, "GPU", s.gpu);
+		s.vsync = ParseBool(ini, "Vsync", s.vsync);
+		s.fullscreen = ParseBool(ini, "Fullscreen", s.fullscreen);
+		s.frameCap = ParseInt(ini, "FrameCap", s.frameCap);
+		s.workers = ParseInt(ini, "Workers", s.workers);
+		s.profileTrace = Value(ini, "ProfileTrace");
+		return s;
+	}
+
+	unsigned int Diff(const Ngine::EngineSettings& a, const Ngine::EngineSettings& b)
+	{
+		unsigned int changed = 0;
+		if (a.width != b.width || a.height != b.height) changed |= Ngine::SETTINGS_RESOLUTION;
+		if (a.vsync != b.vsync) changed |= Ngine::SETTINGS_VSYNC;
+		if (a.samples != b.samples) changed |= Ngine::SETTINGS_SAMPLES;
+		if (a.fullscreen != b.fullscreen || a.windowed != b.windowed) changed |= Ngine::SETTINGS_DISPLAY_MODE;
+		if (a.api != b.api || a.gpu != b.gpu) changed |= Ngine::SETTINGS_DEVICE;
+		if (a.frameCap != b.frameCap) changed |= Ngine::SETTINGS_FRAME_CAP;
+		if (a.workers != b.workers) changed |= Ngine::SETTINGS_WORKERS;
+		return changed;
+	}
+}
+
+void Ngine::Settings::Load(const char* ipath)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+
+	mINI::INIFile file(ipath);
+	mINI::INIStructure ini;
+	if (!file.read(ini))
+		throw Ngine::Exception(__LINE__, __FILE__, "Could not read configuration file");
+
+	auto settings = std::make_shared<const EngineSettings>(Parse(ini));
+	Validate(*settings);
+
+	path = ipath;
+	current.store(settings);
+}
+
+std::shared_ptr<const Ngine::EngineSettings> Ngine::Settings::Get()
+{
+	auto settings = current.load();
+	if (!settings) {
+		Load("Game.ini");
+		settings = current.load();
+	}
+	return settings;
+}
+
+void Ngine::Settings::Set(const EngineSettings& settings)
+{
+	Validate(settings);
+
+	unsigned int changed;
+	std::vector<std::pair<int, Listener>> notify;
+	auto next = std::make_shared<const EngineSettings>(settings);
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		auto previous = current.load();
+		changed = previous ? Diff(*previous, settings) : ~0u;
+		current.store(next);
+		notify = listeners;
+	}
+
+	if (changed == 0)
+		return;
+
+	//Called outside the lock so listeners may read or even change settings themselves
+	for (auto& [id, listener] : notify)
+		listener(*next, changed);
+}
+
+int Ngine::Settings::Subscribe(Listener listener)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	listeners.emplace_back(nextListener, std::move(listener));
+	return nextListener++;
+}
+
+void Ngine::Settings::Unsubscribe(int id)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	listeners.erase(std::remove_if(listeners.begin(), listeners.end(), [id](const auto& l) { return l.first == id; }), listeners.end());
+}
+
+void Ngine::Settings::Save()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+
+	auto settings = current.load();
+	if (!settings || path.empty())
+		return;
+
+	mINI::INIFile file(path);
+	mINI::INIStructure ini;
+	if (!file.read(ini))
+		throw Ngine::Exception(__LINE__, __FILE__, "Could not read configuration file");
+
+	//Touch only keys whose typed value differs, rewritten ones keep their trailing comments
+	EngineSettings stored = Parse(ini);
+	auto& game = ini["Game"];
+	if (stored.api != settings->api) Store(game, "API", settings->api);
+	if (stored.samples != settings->samples) Store(game, "Samples", std::to_string(settings->samples));
+	if (stored.windowed != settings->windowed) Store(game, "Windowed", settings->windowed ? "true" : "false");
+	if (stored.width != settings->width) Store(game, "Width", std::to_string(settings->width));
+	if (stored.height != settings->height) Store(game, "Height", std::to_string(settings->height));
+	if (stored.gpu != settings->gpu) Store(game, "GPU", std::to_string(settings->gpu));
+	if (stored.vsync != settings->vsync) Store(game, "Vsync", settings->vsync ? "enable" : "disable");
+	if (stored.fullscreen != settings->fullscreen) Store(game, "Fullscreen", settings->fullscreen ? "enable" : "disable");
+	if (stored.frameCap != settings->frameCap) Store(game, "FrameCap", std::to_string(settings->frameCap));
+	if (stored.workers != settings->workers) Store(game, "Workers", std::to_string(settings->workers));
+	if (stored.profileTrace != settings->profileTrace) Store(game, "ProfileTrace", settings->profileTrace);
+
+	//Lazy write into a copy, then swap it in so a crash never leaves a half written file
+	std::string temp = path + ".tmp";
+	std::error_code ec;
+	std::filesystem::copy_file(path, temp, std::filesystem::copy_options::overwrite_existing, ec);
+	if (ec || !mINI::INIFile(temp).write(ini, true)) {
+		spdlog::error("Could not write {}", temp);
+		throw Ngine::Exception(__LINE__, __FILE__, "Could not write configuration file");
+	}
+
+	std::filesystem::rename(temp, path, ec);
+	if (ec) {
+		spdlog::error("Could not replace {}: {}", path, ec.message());
+		throw Ngine::Exception(__LINE__, __FILE__, "Could not write configuration file");
+	}
+}
+
+void Ngine::Settings::Validate(const EngineSettings& settings)
+{
+	if (settings.api != "OpenGL")
+		throw Ngine::Exception(__LINE__, __FILE__, "API has illegal value");
+
+	if (settings.width <= 0 || settings.height <= 0)
+		throw Ngine::Exception(__LINE__, __FILE__, "Resolution has illegal value");
+
+	if (settings.samples < 0 || settings.samples > 16 || (settings.samples & (settings.samples - 1)) != 0)
+		throw Ngine::Exception(__LINE__, __FILE__, "Samples has illegal value");
+
+	if (settings.gpu < 0)
+		throw Ngine::Exception(__LINE__, __FILE__, "GPU has illegal value");
+
+	if (settings.frameCap < 0)
+		throw Ngine::Exception(__LINE__, __FILE__, "FrameCap has illegal value");
+
+	if (settings.workers < -1)
+		throw Ngine::Exception(__LINE__, __FILE__, "Workers has illegal value");
+}
@@ -0,0 +1,57 @@
+#pragma once
+#include "Macro.h"
+#include <functional>
+#include <memory>
+#include <string>
+
+namespace Ngine {
+
+	//Typed copy of the [Game] section of Game.ini
+	struct NAPI EngineSettings {
+		std::string api = "OpenGL";
+		int samples = 4; //MSAA samples, 0 disables multisampling
+		bool windowed = true;
+		int width = 1280, height = 720;
+		int gpu = 0; //Selected device to render
+		bool vsync = true;
+		bool fullscreen = false;
+		int frameCap = 0; //Frames per second, 0 leaves pacing to vsync
+		int workers = -1; //Job threads besides the main one, -1 one per core, 0 runs jobs inline
+		std::string profileTrace; //Profiling builds write zones here on exit and on F12, empty writes nothing
+	};
+
+	//Bits passed to listeners telling which group of values changed
+	enum SettingsChange : unsigned int {
+		SETTINGS_RESOLUTION = 1 << 0,
+		SETTINGS_VSYNC = 1 << 1,
+		SETTINGS_SAMPLES = 1 << 2,
+		SETTINGS_DISPLAY_MODE = 1 << 3, //Fullscreen or windowed
+		SETTINGS_DEVICE = 1 << 4, //API or GPU, both need a restart
+		SETTINGS_FRAME_CAP = 1 << 5,
+		SETTINGS_WORKERS = 1 << 6 //Takes effect after restart
+	};
+
+	//Parses the configuration once and shares it with every subsystem.
+	//Readers get an immutable snapshot, so Get is safe and cheap from any thread.
+	class NAPI Settings {
+	public:
+		using Listener = std::function<void(const EngineSettings& settings, unsigned int changed)>;
+
+		//Throws if the file is missing or holds illegal values
+		static void Load(const char* path = "Game.ini");
+
+		//Loads Game.ini on first use when Load was never called
+		static std::shared_ptr<const EngineSettings> Get();
+
+		//Validates and publishes new values, listeners run on the calling thread
+		static void Set(const EngineSettings& settings);
+
+		static int Subscribe(Listener listener);
+		static void Unsubscribe(int id);
+
+		//Writes changed keys back preserving formatting, the file is replaced in one step
+		static void Save();
+
+		static void Validate(const EngineSettings& settings);
+	};
+}
@@ -0,0 +1,344 @@
+#include "pch.h"
+#include "TextureAtlas.h"
+#include "TextureCompressor.h"
+#include "Memory.h"
+#include "Log.h"
+#include "IniView.h"
+#include "Vfs.h"
+#include <spdlog/spdlog.h>
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <filesystem>
+#include <map>
+#include <sstream>
+
+#pragma warning(disable : 4996)
+
+namespace {
+
+	//Manifest keys are case insensitive, match what mINI does to section names
+	std::string NormalizePath(std::string path)
+	{
+		std::replace(path.begin(), path.end(), '\\', '/');
+		std::transform(path.begin(), path.end(), path.begin(), [](char c) { return (char)std::tolower(c); });
+		return path;
+	}
+
+	//Every texture of a group shares size and block format so they can live in one array
+	struct Group {
+		unsigned int width, height;
+		Ngine::BCFormat format;
+		bool packed;
+		std::vector<Ngine::Image> layers;
+	};
+
+	struct Placement {
+		std::string path;
+		size_t group;
+		int layer;
+		float scale[2], offset[2];
+	};
+
+	bool HasAlpha(const Ngine::Image& img)
+	{
+		for (size_t i = 3; i < img.rgba.size(); i += 4) {
+			if (img.rgba[i] != 255)
+				return true;
+		}
+		return false;
+	}
+
+	//Copies src to (x, y) on the page and replicates its border pixels into the gutter
+	void Blit(Ngine::Image& page, const Ngine::Image& src, unsigned int x, unsigned int y, unsigned int gutter)
+	{
+		for (int py = -(int)gutter; py < (int)(src.height + gutter); ++py) {
+			int sy = std::min(std::max(py, 0), (int)src.height - 1);
+			for (int px = -(int)gutter; px < (int)(src.width + gutter); ++px) {
+				int sx = std::min(std::max(px, 0), (int)src.width - 1);
+				std::memcpy(&page.rgba[((size_t)(y + py) * page.width + (x + px)) * 4], &src.rgba[((size_t)sy * src.width + sx) * 4], 4);
+			}
+		}
+	}
+
+	//Level k narrows the gutter to gutter >> k texels, past the last level that keeps one the neighbours bleed in
+	size_t GutterLevels(unsigned int gutter)
+	{
+		size_t levels = 1;
+		while (gutter >> levels)
+			++levels;
+		return levels;
+	}
+
+	std::string LayerFile(size_t group, size_t layer)
+	{
+		return "array" + std::to_string(group) + "_" + std::to_string(layer) + ".dds";
+	}
+}
+
+Ngine::TextureAtlas::~TextureAtlas()
+{
+	if (!m_Arrays.empty())
+		glDeleteTextures((GLsizei)m_Arrays.size(), m_Arrays.data());
+	for (size_t bytes : m_ArrayBytes)
+		Memory::Untrack(MemoryCategory::GpuTexture, bytes);
+}
+
+void Ngine::TextureAtlas::Cook(const std::vector<std::string>& sources, const char* manifestPath, const AtlasCookSettings& settings)
+{
+	spdlog::info("Cooking {} textures into {}", sources.size(), manifestPath);
+
+	struct Source {
+		std::string path;
+		Image img;
+		BCFormat format;
+	};
+
+	std::vector<Source> small, large;
+	for (const auto& path : sources) {
+		Source s{ path, TextureCompressor::LoadBMP(path.c_str()), BCFormat::BC1 };
+		s.format = HasAlpha(s.img) ? BCFormat::BC3 : BCFormat::BC1;
+
+		unsigned int padded = ((std::max(s.img.width, s.img.height) + 2 * settings.gutter) + 3) & ~3u;
+		if (std::max(s.img.width, s.img.height) <= settings.maxPackedDim && padded <= settings.pageSize)
+			small.push_back(std::move(s));
+		else
+			large.push_back(std::move(s));
+	}
+
+	std::vector<Group> groups;
+	std::vector<Placement> placements;
+
+	//Shelf packing, tallest first so every shelf wastes as little height as possible
+	std::stable_sort(small.begin(), small.end(), [](const Source& a, const Source& b) { return a.img.height > b.img.height; });
+	for (BCFormat format : { BCFormat::BC1, BCFormat::BC3 }) {
+		size_t group = groups.size();
+		unsigned int cursorX = 0, cursorY = 0, shelf = 0;
+
+		for (const auto& s : small) {
+			if (s.format != format)
+				continue;
+
+			if (groups.size() == group)
+				groups.push_back({ settings.pageSize, settings.pageSize, format, true, {} });
+
+			//Rectangles start on block boundaries so no BC block mixes two textures
+			unsigned int w = (s.img.width + 2 * settings.gutter + 3) & ~3u;
+			unsigned int h = (s.img.height + 2 * settings.gutter + 3) & ~3u;
+
+			if (cursorX + w > settings.pageSize) {
+				cursorX = 0;
+				cursorY += shelf;
+				shelf = 0;
+			}
+			if (groups[group].layers.empty() || cursorY + h > settings.pageSize) {
+				Image page;
+				page.width = page.height = settings.pageSize;
+				page.rgba.assign((size_t)settings.pageSize * settings.pageSize * 4, 0);
+				groups[group].layers.push_back(std::move(page));
+				cursorX = cursorY = shelf = 0;
+			}
+
+			Blit(groups[group].layers.back(), s.img, cursorX + settings.gutter, cursorY + settings.gutter, settings.gutter);
+
+			float page = (float)settings.pageSize;
+			placements.push_back({ s.path, group, (int)groups[group].layers.size() - 1,
+				{ s.img.width / page, s.img.height / page },
+				{ (cursorX + settings.gutter) / page, (cursorY + settings.gutter) / page } });
+
+			cursorX += w;
+			shelf = std::max(shelf, h);
+		}
+	}
+
+	//Larger textures of equal size and format become layers of a plain array
+	std::map<std::tuple<unsigned int, unsigned int, BCFormat>, size_t> arrays;
+	for (auto& s : large) {
+		auto key = std::make_tuple(s.img.width, s.img.height, s.format);
+		auto it = arrays.find(key);
+		if (it == arrays.end()) {
+			it = arrays.emplace(key, groups.size()).first;
+			groups.push_back({ s.img.width, s.img.height, s.format, false, {} });
+		}
+
+		Group& g = groups[it->second];
+		placements.push_back({ s.path, it->second, (int)g.layers.size(), { 1.0f, 1.0f }, { 0.0f, 0.0f } });
+		g.layers.push_back(std::move(s.img));
+	}
+
+	std::filesystem::path dir = std::filesystem::path(manifestPath).parent_path();
+
+	mINI::INIStructure ini;
+	ini["atlas"]["arrays"] = std::to_string(groups.size());
+
+	for (size_t g = 0; g < groups.size(); ++g) {
+		std::string section = "array:" + std::to_string(g);
+		ini[section]["layers"] = std::to_string(groups[g].layers.size());
+		ini[section]["packed"] = groups[g].packed ? "1" : "0";
+		if (groups[g].packed)
+			ini[section]["gutter"] = std::to_string(settings.gutter);
+
+		for (size_t l = 0; l < groups[g].layers.size(); ++l) {
+			std::vector<Image> chain = TextureCompressor::BuildMipChain(groups[g].layers[l]);
+			if (groups[g].packed)
+				chain.resize(std::min(chain.size(), GutterLevels(settings.gutter)));
+
+			std::vector<std::vector<unsigned char>> levels;
+			for (const auto& level : chain)
+				levels.push_back(TextureCompressor::Encode(level, groups[g].format));
+
+			std::string file = LayerFile(g, l);
+			TextureCompressor::WriteDDS((dir / file).string().c_str(), levels, groups[g].width, groups[g].height, groups[g].format);
+			ini[section]["layer" + std::to_string(l)] = file;
+		}
+
+		spdlog::info("Array {}: {} {}x{} layers{}", g, groups[g].layers.size(), groups[g].width, groups[g].height, groups[g].packed ? " (packed)" : "");
+	}
+
+	for (const auto& p : placements) {
+		std::string section = NormalizePath(p.path);
+		ini[section]["array"] = std::to_string(p.group);
+		ini[section]["layer"] = std::to_string(p.layer);
+		ini[section]["scale"] = std::to_string(p.scale[0]) + " " + std::to_string(p.scale[1]);
+		ini[section]["offset"] = std::to_string(p.offset[0]) + " " + std::to_string(p.offset[1]);
+	}
+
+	mINI::INIFile file(manifestPath);
+	if (!file.generate(ini, true)) {
+		spdlog::error("Could not write {}", manifestPath);
+		throw Ngine::Exception(__LINE__, __FILE__, "Could not write atlas manifest");
+	}
+}
+
+void Ngine::TextureAtlas::Load(const char* manifestPath)
+{
+	LogTimer timer;
+
+	//Read through the VFS like the layers it lists
+	if (!Vfs::Exists(manifestPath))
+		throw Ngine::Exception(__LINE__, __FILE__, "Could not read atlas manifest");
+	IniView ini(manifestPath);
+
+	std::filesystem::path dir = std::filesystem::path(manifestPath).parent_path();
+	size_t first = m_Arrays.size();
+	int count = std::stoi(std::string(ini.Get("atlas", "arrays")));
+
+	for (int g = 0; g < count; ++g) {
+		std::string section = "array:" + std::to_string(g);
+		int layers = std::stoi(std::string(ini.Get(section, "layers")));
+
+		std::vector<std::string> files;
+		std::vector<DDSInfo> infos;
+		for (int l = 0; l < layers; ++l) {
+			files.push_back((dir / std::string(ini.Get(section, "layer" + std::to_string(l)))).string());
+			infos.push_back(Gfx::ReadDDSInfo(files.back().c_str()));
+
+			const DDSInfo& a = infos.front();
+			const DDSInfo& b = infos.back();
+			if (a.width != b.width || a.height != b.height || a.format != b.format || a.mips.size() != b.mips.size()) {
+				spdlog::error("{} does not match the other layers of its array", files.back());
+				throw Ngine::Exception(__LINE__, __FILE__, "Could not handle texture file");
+			}
+		}
+
+		GLuint textureID;
+		glGenTextures(1, &textureID);
+		glBindTexture(GL_TEXTURE_2D_ARRAY, textureID);
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+		//Allocate every level for all layers first, then fill them layer by layer
+		const DDSInfo& info = infos.front();
+		size_t arrayBytes = 0;
+		for (size_t level = 0; level < info.mips.size(); ++level) {
+			const DDSInfo::Mip& mip = info.mips[level];
+			glCompressedTexImage3D(GL_TEXTURE_2D_ARRAY, (GLint)level, info.format, mip.width, mip.height, layers, 0, mip.size * layers, NULL);
+			arrayBytes += (size_t)mip.size * layers;
+		}
+
+		//Layers are uploaded from their mapping
+		for (int l = 0; l < layers; ++l) {
+			VfsFile file;
+			if (!Vfs::TryOpen(files[l].c_str(), file)) {
+				spdlog::error("Could not open {}", files[l]);
+				throw Ngine::Exception(__LINE__, __FILE__, "Could not open texture file");
+			}
+			TrackScope staging(MemoryCategory::TextureStaging, file.Decompressed() ? file.Size() : 0);
+
+			for (size_t level = 0; level < info.mips.size(); ++level) {
+				const DDSInfo::Mip& mip = infos[l].mips[level];
+				//Opened a second time, the file may have changed since its header was parsed
+				if ((size_t)mip.offset + mip.size > file.Size()) {
+					spdlog::error("{} is corrupted", files[l]);
+					throw Ngine::Exception(__LINE__, __FILE__, "Could not handle texture file");
+				}
+				glCompressedTexSubImage3D(GL_TEXTURE_2D_ARRAY, (GLint)level, 0, 0, l, mip.width, mip.height, 1, info.format, mip.size, file.Data() + mip.offset);
+				Ngine::Gfx::CountUpload(mip.size);
+			}
+		}
+
+		//Packed pages must not wrap into their neighbours, whole layers keep repeating
+		bool packed = ini.Get(section, "packed") == "1";
+		GLint wrap = packed ? GL_CLAMP_TO_EDGE : GL_REPEAT;
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, wrap);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, wrap);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+		//Manifests cooked before the gutter was recorded used the default one and kept every level
+		size_t levels = info.mips.size();
+		if (packed) {
+			unsigned int gutter = ini.Has(section, "gutter") ? (unsigned int)std::stoi(std::string(ini.Get(section, "gutter"))) : AtlasCookSettings().gutter;
+			levels = std::min(levels, GutterLevels(gutter));
+		}
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, (GLint)levels - 1);
+
+		m_Arrays.push_back(textureID);
+		m_ArrayBytes.push_back(arrayBytes);
+		Memory::Track(MemoryCategory::GpuTexture, arrayBytes);
+	}
+
+	for (const auto& values : ini) {
+		std::string section = NormalizePath(std::string(values.Name()));
+		if (section == "atlas" || section.rfind("array:", 0) == 0)
+			continue;
+
+		AtlasEntry e;
+		e.texture = m_Arrays[first + std::stoi(std::string(values.Get("array")))];
+		e.layer = std::stoi(std::string(values.Get("layer")));
+		std::istringstream(std::string(values.Get("scale"))) >> e.scale.x >> e.scale.y;
+		std::istringstream(std::string(values.Get("offset"))) >> e.offset.x >> e.offset.y;
+		m_Entries[section] = e;
+	}
+
+	NGINE_LOG_INFO("Loaded texture atlas {} {} {} {:.2f}", Field("path", manifestPath), Field("textures", m_Entries.size()), Field("arrays", m_Arrays.size() - first), Field("ms", timer.Ms()));
+}
+
+const Ngine::AtlasEntry* Ngine::TextureAtlas::Find(const char* path) const
+{
+	auto it = m_Entries.find(NormalizePath(path));
+	return it == m_Entries.end() ? nullptr : &it->second;
+}
+
+bool Ngine::TextureAtlas::Apply(Object& obj, const char* path) const
+{
+	const AtlasEntry* e = Find(path);
+	if (!e)
+		return false;
+
+	obj.texture = e->texture;
+	obj.layer = e->layer;
+
+	if (e->scale.x == 1.0f && e->scale.y == 1.0f)
+		return true;
+
+	//Packed rectangles can't repeat, tiling UVs would sample the neighbours
+	bool tiled = false;
+	for (auto& uv : obj.uvs) {
+		tiled = tiled || uv.x < 0.0f || uv.x > 1.0f || uv.y < 0.0f || uv.y > 1.0f;
+		uv = uv * e->scale + e->offset;
+	}
+
+	if (tiled)
+		NGINE_LOG_WARN_LIMITED(1000, "{} is packed into an atlas but used with UVs outside 0..1", path);
+
+	return true;
+}
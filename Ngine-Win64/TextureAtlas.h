@@ -0,0 +1,48 @@
+#pragma once
+#include "Gfx.h"
+#include <string>
+#include <unordered_map>
+
+namespace Ngine {
+
+	//Where a source texture ended up after cooking
+	struct NAPI AtlasEntry {
+		GLuint texture; //GL_TEXTURE_2D_ARRAY shared with every other entry of the same group
+		int layer;
+		glm::vec2 scale, offset; //Applied to the original UVs, identity for whole layers
+	};
+
+	struct NAPI AtlasCookSettings {
+		unsigned int pageSize = 2048;
+		unsigned int maxPackedDim = 512; //Bigger textures get a whole array layer
+		unsigned int gutter = 4; //Edge pixels replicated around packed rectangles against mip bleeding
+	};
+
+	//Groups textures into GL_TEXTURE_2D_ARRAY objects so many meshes share one bind.
+	//Same sized textures become layers, small ones are rectangle packed into atlas pages first.
+	class NAPI TextureAtlas {
+	public:
+		TextureAtlas() = default;
+		~TextureAtlas();
+
+		TextureAtlas(const TextureAtlas&) = delete;
+		TextureAtlas operator=(const TextureAtlas&) = delete;
+
+		//Cook time, writes BC compressed layers next to the manifest
+		static void Cook(const std::vector<std::string>& sources, const char* manifestPath, const AtlasCookSettings& settings = AtlasCookSettings());
+
+		//Runtime, uploads every array listed in the manifest
+		void Load(const char* manifestPath);
+		const AtlasEntry* Find(const char* path) const;
+
+		//Points obj at the shared array and remaps its UVs into the packed rectangle
+		bool Apply(Object& obj, const char* path) const;
+
+		size_t ArrayCount() const noexcept { return m_Arrays.size(); }
+
+	private:
+		std::vector<GLuint> m_Arrays;
+		std::vector<size_t> m_ArrayBytes; //Tracked as GPU texture memory
+		std::unordered_map<std::string, AtlasEntry> m_Entries;
+	};
+}
@@ -0,0 +1,529 @@
+#include "pch.h"
+#include "TextureCompressor.h"
+#include "Gfx.h"
+#include "Jobs.h"
+#include <spdlog/spdlog.h>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+#if defined(_M_X64) || defined(__SSE2__)
+#include <emmintrin.h>
+#define NGINE_SSE2
+#endif
+
+#define FOURCC_DXT1 0x31545844 // Equivalent to "DXT1" in ASCII
+#define FOURCC_DXT5 0x35545844 // Equivalent to "DXT5" in ASCII
+
+#pragma warning(disable : 4996)
+
+namespace {
+
+	struct SrgbTable {
+		float toLinear[256];
+
+		SrgbTable() {
+			for (int i = 0; i < 256; ++i) {
+				float c = i / 255.0f;
+				toLinear[i] = c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+			}
+		}
+	};
+
+	const SrgbTable srgb;
+
+	unsigned char LinearToSrgb(float v)
+	{
+		v = std::min(std::max(v, 0.0f), 1.0f);
+		float s = v <= 0.0031308f ? v * 12.92f : 1.055f * std::pow(v, 1.0f / 2.4f) - 0.055f;
+		return (unsigned char)(s * 255.0f + 0.5f);
+	}
+
+	//One 2:1 reduction with the separable (1 3 3 1) / 8 tent, edges are clamped
+	void Downsample(const std::vector<float>& src, unsigned int w, unsigned int h, std::vector<float>& dst, unsigned int dw, unsigned int dh)
+	{
+		static const float taps[4] = { 1.0f / 8.0f, 3.0f / 8.0f, 3.0f / 8.0f, 1.0f / 8.0f };
+
+		std::vector<float> tmp((size_t)dw * h * 4);
+		for (unsigned int y = 0; y < h; ++y) {
+			for (unsigned int x = 0; x < dw; ++x) {
+				float acc[4] = {};
+				for (int t = 0; t < 4; ++t) {
+					int sx = std::min(std::max((int)(2 * x) - 1 + t, 0), (int)w - 1);
+					const float* p = &src[((size_t)y * w + sx) * 4];
+					for (int c = 0; c < 4; ++c)
+						acc[c] += p[c] * taps[t];
+				}
+				std::memcpy(&tmp[((size_t)y * dw + x) * 4], acc, sizeof(acc));
+			}
+		}
+
+		dst.assign((size_t)dw * dh * 4, 0.0f);
+		for (unsigned int y = 0; y < dh; ++y) {
+			for (int t = 0; t < 4; ++t) {
+				int sy = std::min(std::max((int)(2 * y) - 1 + t, 0), (int)h - 1);
+				const float* row = &tmp[(size_t)sy * dw * 4];
+				float* out = &dst[(size_t)y * dw * 4];
+				for (unsigned int i = 0; i < dw * 4; ++i)
+					out[i] += row[i] * taps[t];
+			}
+		}
+	}
+
+	//Pixels of one 4x4 block in SoA layout so four of them fit a SSE register
+	struct Block {
+		float r[16], g[16], b[16];
+		unsigned char a[16];
+	};
+
+	void FetchBlock(const Ngine::Image& img, unsigned int bx, unsigned int by, Block& block)
+	{
+		for (unsigned int i = 0; i < 16; ++i) {
+			//Replicate edge pixels for blocks hanging over the image border
+			unsigned int x = std::min(bx * 4 + (i & 3), img.width - 1);
+			unsigned int y = std::min(by * 4 + (i >> 2), img.height - 1);
+			const unsigned char* p = &img.rgba[((size_t)y * img.width + x) * 4];
+			block.r[i] = p[0];
+			block.g[i] = p[1];
+			block.b[i] = p[2];
+			block.a[i] = p[3];
+		}
+	}
+
+	unsigned short To565(const float c[3])
+	{
+		int r = (int)std::lround(std::min(std::max(c[0], 0.0f), 255.0f) * 31.0f / 255.0f);
+		int g = (int)std::lround(std::min(std::max(c[1], 0.0f), 255.0f) * 63.0f / 255.0f);
+		int b = (int)std::lround(std::min(std::max(c[2], 0.0f), 255.0f) * 31.0f / 255.0f);
+		return (unsigned short)((r << 11) | (g << 5) | b);
+	}
+
+	void From565(unsigned short c, float out[3])
+	{
+		int r = (c >> 11) & 31, g = (c >> 5) & 63, b = c & 31;
+		out[0] = (float)((r << 3) | (r >> 2));
+		out[1] = (float)((g << 2) | (g >> 4));
+		out[2] = (float)((b << 3) | (b >> 2));
+	}
+
+	//Nearest palette entry for every pixel, returns the summed squared error
+	float SelectIndices(const Block& block, const float palette[4][3], unsigned int indices[16])
+	{
+#ifdef NGINE_SSE2
+		__m128 total = _mm_setzero_ps();
+		for (int i = 0; i < 16; i += 4) {
+			__m128 r = _mm_loadu_ps(block.r + i);
+			__m128 g = _mm_loadu_ps(block.g + i);
+			__m128 b = _mm_loadu_ps(block.b + i);
+
+			__m128 best = _mm_set1_ps(std::numeric_limits<float>::max());
+			__m128i bestIndex = _mm_setzero_si128();
+			for (int p = 0; p < 4; ++p) {
+				__m128 dr = _mm_sub_ps(r, _mm_set1_ps(palette[p][0]));
+				__m128 dg = _mm_sub_ps(g, _mm_set1_ps(palette[p][1]));
+				__m128 db = _mm_sub_ps(b, _mm_set1_ps(palette[p][2]));
+				__m128 d = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dr, dr), _mm_mul_ps(dg, dg)), _mm_mul_ps(db, db));
+
+				__m128i less = _mm_castps_si128(_mm_cmplt_ps(d, best));
+				bestIndex = _mm_or_si128(_mm_andnot_si128(less, bestIndex), _mm_and_si128(less, _mm_set1_epi32(p)));
+				best = _mm_min_ps(d, best);
+			}
+
+			_mm_storeu_si128((__m128i*)(indices + i), bestIndex);
+			total = _mm_add_ps(total, best);
+		}
+
+		float sums[4];
+		_mm_storeu_ps(sums, total);
+		return sums[0] + sums[1] + sums[2] + sums[3];
+#else
+		float total = 0.0f;
+		for (int i = 0; i < 16; ++i) {
+			float best = std::numeric_limits<float>::max();
+			for (unsigned int p = 0; p < 4; ++p) {
+				float dr = block.r[i] - palette[p][0], dg = block.g[i] - palette[p][1], db = block.b[i] - palette[p][2];
+				float d = dr * dr + dg * dg + db * db;
+				if (d < best) {
+					best = d;
+					indices[i] = p;
+				}
+			}
+			total += best;
+		}
+		return total;
+#endif
+	}
+
+	float EvaluateEndpoints(const Block& block, unsigned short c0, unsigned short c1, unsigned int indices[16])
+	{
+		float palette[4][3];
+		From565(c0, palette[0]);
+		From565(c1, palette[1]);
+		for (int c = 0; c < 3; ++c) {
+			palette[2][c] = (2.0f * palette[0][c] + palette[1][c]) / 3.0f;
+			palette[3][c] = (palette[0][c] + 2.0f * palette[1][c]) / 3.0f;
+		}
+		return SelectIndices(block, palette, indices);
+	}
+
+	void EncodeColor(const Block& block, unsigned char* out)
+	{
+		float mean[3] = {};
+		for (int i = 0; i < 16; ++i) {
+			mean[0] += block.r[i];
+			mean[1] += block.g[i];
+			mean[2] += block.b[i];
+		}
+		for (float& m : mean)
+			m /= 16.0f;
+
+		float cov[6] = {};
+		for (int i = 0; i < 16; ++i) {
+			float d[3] = { block.r[i] - mean[0], block.g[i] - mean[1], block.b[i] - mean[2] };
+			cov[0] += d[0] * d[0]; cov[1] += d[0] * d[1]; cov[2] += d[0] * d[2];
+			cov[3] += d[1] * d[1]; cov[4] += d[1] * d[2]; cov[5] += d[2] * d[2];
+		}
+
+		//Principal axis of the colours through a few rounds of power iteration
+		float axis[3] = { 1.0f, 1.0f, 1.0f };
+		for (int it = 0; it < 4; ++it) {
+			float n[3] = {
+				cov[0] * axis[0] + cov[1] * axis[1] + cov[2] * axis[2],
+				cov[1] * axis[0] + cov[3] * axis[1] + cov[4] * axis[2],
+				cov[2] * axis[0] + cov[4] * axis[1] + cov[5] * axis[2]
+			};
+			float len = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+			if (len < 1e-6f)
+				break;
+			for (int c = 0; c < 3; ++c)
+				axis[c] = n[c] / len;
+		}
+
+		float tmin = std::numeric_limits<float>::max(), tmax = -tmin;
+		for (int i = 0; i < 16; ++i) {
+			float t = (block.r[i] - mean[0]) * axis[0] + (block.g[i] - mean[1]) * axis[1] + (block.b[i] - mean[2]) * axis[2];
+			tmin = std::min(tmin, t);
+			tmax = std::max(tmax, t);
+		}
+
+		//Inset the endpoints slightly, extremes are usually outliers
+		float inset = (tmax - tmin) / 16.0f;
+		float e0[3], e1[3];
+		for (int c = 0; c < 3; ++c) {
+			e0[c] = mean[c] + axis[c] * (tmax - inset);
+			e1[c] = mean[c] + axis[c] * (tmin + inset);
+		}
+
+		unsigned short c0 = To565(e0), c1 = To565(e1);
+		unsigned int indices[16];
+		float error = EvaluateEndpoints(block, c0, c1, indices);
+
+		//One least squares refit of the endpoints against the chosen indices
+		static const float weights[4] = { 1.0f, 0.0f, 2.0f / 3.0f, 1.0f / 3.0f };
+		float aa = 0.0f, ab = 0.0f, bb = 0.0f, ax[3] = {}, bx[3] = {};
+		for (int i = 0; i < 16; ++i) {
+			float a = weights[indices[i]], b = 1.0f - a;
+			float p[3] = { block.r[i], block.g[i], block.b[i] };
+			aa += a * a; ab += a * b; bb += b * b;
+			for (int c = 0; c < 3; ++c) {
+				ax[c] += a * p[c];
+				bx[c] += b * p[c];
+			}
+		}
+
+		float det = aa * bb - ab * ab;
+		if (std::fabs(det) > 1e-6f) {
+			float f0[3], f1[3];
+			for (int c = 0; c < 3; ++c) {
+				f0[c] = (bb * ax[c] - ab * bx[c]) / det;
+				f1[c] = (aa * bx[c] - ab * ax[c]) / det;
+			}
+
+			unsigned short r0 = To565(f0), r1 = To565(f1);
+			unsigned int refined[16];
+			float refinedError = EvaluateEndpoints(block, r0, r1, refined);
+			if (refinedError < error) {
+				c0 = r0;
+				c1 = r1;
+				std::memcpy(indices, refined, sizeof(refined));
+			}
+		}
+
+		//Four colour mode needs c0 > c1, swapping the endpoints mirrors the indices
+		if (c0 < c1) {
+			std::swap(c0, c1);
+			for (unsigned int& i : indices)
+				i ^= 1;
+		}
+		else if (c0 == c1) {
+			for (unsigned int& i : indices)
+				i = 0;
+		}
+
+		unsigned int bits = 0;
+		for (int i = 0; i < 16; ++i)
+			bits |= indices[i] << (2 * i);
+
+		out[0] = (unsigned char)(c0 & 0xFF);
+		out[1] = (unsigned char)(c0 >> 8);
+		out[2] = (unsigned char)(c1 & 0xFF);
+		out[3] = (unsigned char)(c1 >> 8);
+		std::memcpy(out + 4, &bits, 4);
+	}
+
+	void EncodeAlpha(const Block& block, unsigned char* out)
+	{
+		unsigned char a0 = *std::max_element(block.a, block.a + 16);
+		unsigned char a1 = *std::min_element(block.a, block.a + 16);
+
+		//a0 > a1 selects the eight level mode
+		float levels[8] = { (float)a0, (float)a1 };
+		for (int i = 2; i < 8; ++i)
+			levels[i] = ((8 - i) * a0 + (i - 1) * a1) / 7.0f;
+
+		unsigned long long bits = 0;
+		if (a0 != a1) {
+			for (int i = 0; i < 16; ++i) {
+				unsigned long long best = 0;
+				float bestDist = std::numeric_limits<float>::max();
+				for (unsigned long long l = 0; l < 8; ++l) {
+					float d = std::fabs(levels[l] - block.a[i]);
+					if (d < bestDist) {
+						bestDist = d;
+						best = l;
+					}
+				}
+				bits |= best << (3 * i);
+			}
+		}
+
+		out[0] = a0;
+		out[1] = a1;
+		for (int i = 0; i < 6; ++i)
+			out[2 + i] = (unsigned char)(bits >> (8 * i));
+	}
+
+	void DecodeColor(const unsigned char* in, bool allowPunchThrough, unsigned char out[16][4])
+	{
+		unsigned short c0 = (unsigned short)(in[0] | (in[1] << 8));
+		unsigned short c1 = (unsigned short)(in[2] | (in[3] << 8));
+		unsigned int bits;
+		std::memcpy(&bits, in + 4, 4);
+
+		float palette[4][4];
+		From565(c0, palette[0]);
+		From565(c1, palette[1]);
+		palette[0][3] = palette[1][3] = palette[2][3] = palette[3][3] = 255.0f;
+		for (int c = 0; c < 3; ++c) {
+			if (c0 > c1 || !allowPunchThrough) {
+				palette[2][c] = (2.0f * palette[0][c] + palette[1][c]) / 3.0f;
+				palette[3][c] = (palette[0][c] + 2.0f * palette[1][c]) / 3.0f;
+			}
+			else {
+				palette[2][c] = (palette[0][c] + palette[1][c]) / 2.0f;
+				palette[3][c] = 0.0f;
+			}
+		}
+		if (c0 <= c1 && allowPunchThrough)
+			palette[3][3] = 0.0f;
+
+		for (int i = 0; i < 16; ++i) {
+			const float* p = palette[(bits >> (2 * i)) & 3];
+			for (int c = 0; c < 4; ++c)
+				out[i][c] = (unsigned char)(p[c] + 0.5f);
+		}
+	}
+
+	void DecodeAlpha(const unsigned char* in, unsigned char out[16][4])
+	{
+		unsigned int a0 = in[0], a1 = in[1];
+		unsigned int levels[8] = { a0, a1 };
+		if (a0 > a1) {
+			for (unsigned int i = 2; i < 8; ++i)
+				levels[i] = ((8 - i) * a0 + (i - 1) * a1) / 7;
+		}
+		else {
+			for (unsigned int i = 2; i < 6; ++i)
+				levels[i] = ((6 - i) * a0 + (i - 1) * a1) / 5;
+			levels[6] = 0;
+			levels[7] = 255;
+		}
+
+		unsigned long long bits = 0;
+		for (int i = 0; i < 6; ++i)
+			bits |= (unsigned long long)in[2 + i] << (8 * i);
+
+		for (int i = 0; i < 16; ++i)
+			out[i][3] = (unsigned char)levels[(bits >> (3 * i)) & 7];
+	}
+
+	void WriteU32(unsigned char* p, unsigned int v)
+	{
+		std::memcpy(p, &v, 4);
+	}
+}
+
+Ngine::Image Ngine::TextureCompressor::LoadBMP(const char* ipath)
+{
+	unsigned int channels;
+	Image img;
+	std::vector<unsigned char> bgr = Gfx::ReadBMP(ipath, img.width, img.height, channels);
+
+	img.rgba.resize((size_t)img.width * img.height * 4);
+	for (size_t i = 0, n = (size_t)img.width * img.height; i < n; ++i) {
+		const unsigned char* p = &bgr[i * channels];
+		unsigned char* q = &img.rgba[i * 4];
+		q[0] = p[2];
+		q[1] = p[1];
+		q[2] = p[0];
+		q[3] = channels == 4 ? p[3] : 255;
+	}
+
+	return img;
+}
+
+std::vector<Ngine::Image> Ngine::TextureCompressor::BuildMipChain(const Image& top)
+{
+	std::vector<Image> chain{ top };
+
+	//Filter in linear light, averaging sRGB values darkens every level
+	unsigned int w = top.width, h = top.height;
+	std::vector<float> level((size_t)w * h * 4), next;
+	for (size_t i = 0; i < (size_t)w * h; ++i) {
+		for (int c = 0; c < 3; ++c)
+			level[i * 4 + c] = srgb.toLinear[top.rgba[i * 4 + c]];
+		level[i * 4 + 3] = top.rgba[i * 4 + 3] / 255.0f;
+	}
+
+	while (w > 1 || h > 1) {
+		unsigned int dw = std::max(w / 2, 1u), dh = std::max(h / 2, 1u);
+		Downsample(level, w, h, next, dw, dh);
+
+		Image img;
+		img.width = dw;
+		img.height = dh;
+		img.rgba.resize((size_t)dw * dh * 4);
+		for (size_t i = 0; i < (size_t)dw * dh; ++i) {
+			for (int c = 0; c < 3; ++c)
+				img.rgba[i * 4 + c] = LinearToSrgb(next[i * 4 + c]);
+			img.rgba[i * 4 + 3] = (unsigned char)(std::min(std::max(next[i * 4 + 3], 0.0f), 1.0f) * 255.0f + 0.5f);
+		}
+		chain.push_back(std::move(img));
+
+		level.swap(next);
+		w = dw;
+		h = dh;
+	}
+
+	return chain;
+}
+
+std::vector<unsigned char> Ngine::TextureCompressor::Encode(const Image& img, BCFormat format)
+{
+	unsigned int blocksX = (img.width + 3) / 4, blocksY = (img.height + 3) / 4;
+	unsigned int blockSize = format == BCFormat::BC1 ? 8 : 16;
+	std::vector<unsigned char> out((size_t)blocksX * blocksY * blockSize);
+
+	//One row of a 1024 wide level is 256 blocks, enough work to be worth a job
+	Ngine::Jobs::ParallelFor(0, blocksY, 1, [&](size_t first, size_t last) {
+		Block block;
+		for (unsigned int by = (unsigned int)first; by < last; ++by) {
+			for (unsigned int bx = 0; bx < blocksX; ++bx) {
+				unsigned char* dst = &out[((size_t)by * blocksX + bx) * blockSize];
+				FetchBlock(img, bx, by, block);
+				if (format == BCFormat::BC3) {
+					EncodeAlpha(block, dst);
+					dst += 8;
+				}
+				EncodeColor(block, dst);
+			}
+		}
+		});
+
+	return out;
+}
+
+Ngine::Image Ngine::TextureCompressor::Decode(const unsigned char* blocks, unsigned int width, unsigned int height, BCFormat format)
+{
+	Image img;
+	img.width = width;
+	img.height = height;
+	img.rgba.resize((size_t)width * height * 4);
+
+	unsigned int blocksX = (width + 3) / 4, blocksY = (height + 3) / 4;
+	unsigned int blockSize = format == BCFormat::BC1 ? 8 : 16;
+
+	unsigned char pixels[16][4];
+	for (unsigned int by = 0; by < blocksY; ++by) {
+		for (unsigned int bx = 0; bx < blocksX; ++bx) {
+			const unsigned char* src = blocks + ((size_t)by * blocksX + bx) * blockSize;
+			if (format == BCFormat::BC3) {
+				DecodeColor(src + 8, false, pixels);
+				DecodeAlpha(src, pixels);
+			}
+			else {
+				DecodeColor(src, true, pixels);
+			}
+
+			for (unsigned int i = 0; i < 16; ++i) {
+				unsigned int x = bx * 4 + (i & 3), y = by * 4 + (i >> 2);
+				if (x < width && y < height)
+					std::memcpy(&img.rgba[((size_t)y * width + x) * 4], pixels[i], 4);
+			}
+		}
+	}
+
+	return img;
+}
+
+double Ngine::TextureCompressor::PSNR(const Image& reference, const Image& test, bool withAlpha)
+{
+	if (reference.width != test.width || reference.height != test.height)
+		throw Ngine::Exception(__LINE__, __FILE__, "Could not compare images of different size");
+
+	int channels = withAlpha ? 4 : 3;
+	double sum = 0.0;
+	for (size_t i = 0; i < reference.rgba.size(); i += 4) {
+		for (int c = 0; c < channels; ++c) {
+			double d = (double)reference.rgba[i + c] - (double)test.rgba[i + c];
+			sum += d * d;
+		}
+	}
+
+	double mse = sum / ((double)reference.width * reference.height * channels);
+	if (mse == 0.0)
+		return std::numeric_limits<double>::infinity();
+	return 10.0 * std::log10(255.0 * 255.0 / mse);
+}
+
+void Ngine::TextureCompressor::WriteDDS(const char* opath, const std::vector<std::vector<unsigned char>>& levels, unsigned int width, unsigned int height, BCFormat format)
+{
+	unsigned char header[124] = {};
+	WriteU32(header + 0, 124); //dwSize
+	WriteU32(header + 4, 0x1 | 0x2 | 0x4 | 0x1000 | 0x20000 | 0x80000); //CAPS | HEIGHT | WIDTH | PIXELFORMAT | MIPMAPCOUNT | LINEARSIZE
+	WriteU32(header + 8, height);
+	WriteU32(header + 12, width);
+	WriteU32(header + 16, levels.empty() ? 0 : (unsigned int)levels.front().size());
+	WriteU32(header + 24, (unsigned int)levels.size());
+	WriteU32(header + 72, 32); //Pixel format size
+	WriteU32(header + 76, 0x4); //DDPF_FOURCC
+	WriteU32(header + 80, format == BCFormat::BC1 ? FOURCC_DXT1 : FOURCC_DXT5);
+	WriteU32(header + 104, 0x1000 | 0x400000 | 0x8); //TEXTURE | MIPMAP | COMPLEX
+
+	FILE* fp = fopen(opath, "wb");
+	if (fp == NULL) {
+		spdlog::error("Could not open {}", opath);
+		throw Ngine::Exception(__LINE__, __FILE__, "Could not open texture file");
+	}
+
+	bool ok = fwrite("DDS ", 1, 4, fp) == 4 && fwrite(header, 1, sizeof(header), fp) == sizeof(header);
+	for (const auto& level : levels)
+		ok = ok && fwrite(level.data(), 1, level.size(), fp) == level.size();
+	fclose(fp);
+
+	if (!ok) {
+		spdlog::error("Could not write {}", opath);
+		throw Ngine::Exception(__LINE__, __FILE__, "Could not write texture file");
+	}
+}
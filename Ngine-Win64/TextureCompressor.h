@@ -0,0 +1,35 @@
+#pragma once
+#include "Macro.h"
+#include <vector>
+
+namespace Ngine {
+
+	//8-bit sRGB RGBA pixels, rows kept in the order they were read (bottom first for BMP input)
+	struct NAPI Image {
+		unsigned int width = 0, height = 0;
+		std::vector<unsigned char> rgba;
+	};
+
+	enum class BCFormat {
+		BC1, //DXT1, opaque colour at 4 bits per pixel
+		BC3 //DXT5, colour plus interpolated alpha at 8 bits per pixel
+	};
+
+	//Offline BC1/BC3 encoder producing DDS files readable by Gfx::LoadDDS
+	class NAPI TextureCompressor {
+	public:
+		static Image LoadBMP(const char* ipath);
+
+		//Full chain down to 1x1, filtered in linear space and stored back as sRGB
+		static std::vector<Image> BuildMipChain(const Image& top);
+
+		//Compresses img into 4x4 blocks, rows of blocks are spread over the job system
+		static std::vector<unsigned char> Encode(const Image& img, BCFormat format);
+		static Image Decode(const unsigned char* blocks, unsigned int width, unsigned int height, BCFormat format);
+
+		//Peak signal to noise ratio in dB over RGB, plus alpha when withAlpha is set
+		static double PSNR(const Image& reference, const Image& test, bool withAlpha);
+
+		static void WriteDDS(const char* opath, const std::vector<std::vector<unsigned char>>& levels, unsigned int width, unsigned int height, BCFormat format);
+	};
+}
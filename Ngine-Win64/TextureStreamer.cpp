@@ -0,0 +1,448 @@
+#include "pch.h"
+#include "TextureStreamer.h"
+#include "Memory.h"
+#include "Log.h"
+#include "Vfs.h"
+#include <spdlog/spdlog.h>
+#include <algorithm>
+#include <cmath>
+
+#pragma warning(disable : 4996)
+
+Ngine::TextureStreamer::TextureStreamer(size_t budgetBytes, size_t uploadBytesPerFrame) : m_Budget(budgetBytes), m_UploadPerFrame(uploadBytesPerFrame)
+{
+}
+
+Ngine::TextureStreamer::~TextureStreamer()
+{
+	WaitForReads();
+	for (auto& arrival : m_Inbox->ready)
+		Discard(arrival);
+
+	for (auto& [path, source] : m_Sources)
+		AsyncIo::Close(source.file);
+
+	for (auto& [id, e] : m_Textures) {
+		for (size_t level = e.residentLevel; level < e.info.mips.size(); ++level)
+			Memory::Untrack(MemoryCategory::GpuTexture, e.info.mips[level].size);
+		glDeleteTextures(1, &id);
+	}
+}
+
+GLuint Ngine::TextureStreamer::Load(const char* ipath)
+{
+	LogTimer timer;
+
+	Entry e;
+	e.info = Gfx::ReadDDSInfo(ipath);
+	e.path = ipath;
+
+	//Find the first level small enough to be always resident
+	unsigned int last = (unsigned int)e.info.mips.size() - 1;
+	e.coarseLevel = last;
+	for (unsigned int level = 0; level <= last; ++level) {
+		if (e.info.mips[level].width <= CoarseDim && e.info.mips[level].height <= CoarseDim) {
+			e.coarseLevel = level;
+			break;
+		}
+	}
+
+	e.residentLevel = last + 1; //Nothing uploaded yet
+	e.wantedLevel = e.coarseLevel;
+	e.lastUsed = m_Frame;
+	e.requestFrame = 0;
+	e.reading = false;
+	e.sourceOpen = false;
+
+	VfsLocation location;
+	e.async = Vfs::Locate(ipath, location);
+	e.source = location.file;
+	e.sourceOffset = e.async ? location.offset : 0;
+
+	GLuint textureID;
+	glGenTextures(1, &textureID);
+	glBindTexture(GL_TEXTURE_2D, textureID);
+
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, (GLint)last);
+
+	//Coarse levels first, smallest to largest, so the texture is complete after every upload
+	try {
+		for (int level = (int)last; level >= (int)e.coarseLevel; --level)
+			UploadLevel(textureID, e, level);
+	}
+	catch (...) {
+		//Not in m_Textures yet, nothing else would ever give back what the levels before the failing one took
+		for (size_t level = e.residentLevel; level < e.info.mips.size(); ++level) {
+			m_Resident -= e.info.mips[level].size;
+			Memory::Untrack(MemoryCategory::GpuTexture, e.info.mips[level].size);
+		}
+		glDeleteTextures(1, &textureID);
+		throw;
+	}
+
+	NGINE_LOG_INFO("Streaming texture {} {} {} {:.2f}", Field("path", ipath), Field("levels", e.info.mips.size()), Field("resident", last + 1 - e.coarseLevel), Field("ms", timer.Ms()));
+	m_Textures.emplace(textureID, std::move(e));
+	return textureID;
+}
+
+void Ngine::TextureStreamer::Release(GLuint texture)
+{
+	auto it = m_Textures.find(texture);
+	if (it == m_Textures.end())
+		return;
+
+	Entry& e = it->second;
+	if (e.reading) {
+		//Its read could still land in the inbox, wait for it and throw it away
+		WaitForReads();
+		std::lock_guard<std::mutex> lock(m_Inbox->mutex);
+		auto& ready = m_Inbox->ready;
+		for (auto& arrival : ready)
+			if (arrival.id == texture)
+				Discard(arrival);
+		ready.erase(std::remove_if(ready.begin(), ready.end(), [texture](const Arrival& a) { return a.id == texture; }), ready.end());
+	}
+	//No read of this texture is in flight anymore, others sharing the file keep it open
+	CloseSource(e);
+
+	for (size_t level = e.residentLevel; level < e.info.mips.size(); ++level) {
+		m_Resident -= e.info.mips[level].size;
+		Memory::Untrack(MemoryCategory::GpuTexture, e.info.mips[level].size);
+	}
+
+	glDeleteTextures(1, &texture);
+	m_Textures.erase(it);
+}
+
+void Ngine::TextureStreamer::RequestLevel(GLuint texture, unsigned int level)
+{
+	auto it = m_Textures.find(texture);
+	if (it == m_Textures.end())
+		return;
+
+	Entry& e = it->second;
+	level = std::min(level, (unsigned int)e.info.mips.size() - 1);
+
+	//Several objects can share a texture, the finest request of the frame wins
+	if (e.requestFrame != m_Frame) {
+		e.wantedLevel = level;
+		e.requestFrame = m_Frame;
+	}
+	else {
+		e.wantedLevel = std::min(e.wantedLevel, level);
+	}
+
+	e.lastUsed = m_Frame;
+}
+
+void Ngine::TextureStreamer::RequestForObject(const Object& obj, int viewportHeight)
+{
+	auto it = m_Textures.find(obj.texture);
+	if (it == m_Textures.end())
+		return;
+
+	glm::vec3 center = (obj.boundsMin + obj.boundsMax) * 0.5f;
+	float radius = glm::length(obj.boundsMax - obj.boundsMin) * 0.5f;
+
+	glm::vec4 c = obj.mat.MVP * glm::vec4(center, 1.0f);
+	if (c.w <= 0.0f)
+		return; //Behind the camera, keep whatever is resident
+
+	//Project the bounding sphere radius along each model axis and keep the widest one
+	float extent = 0.0f;
+	for (int axis = 0; axis < 3; ++axis) {
+		glm::vec3 offset(0.0f);
+		offset[axis] = radius;
+
+		glm::vec4 p = obj.mat.MVP * glm::vec4(center + offset, 1.0f);
+		if (p.w <= 0.0f)
+			continue;
+
+		float dx = p.x / p.w - c.x / c.w;
+		float dy = p.y / p.w - c.y / c.w;
+		extent = std::max(extent, std::sqrt(dx * dx + dy * dy));
+	}
+
+	//NDC spans two units over the viewport so the radius extent equals the covered fraction of the screen
+	float pixels = std::max(extent * (float)viewportHeight, 1.0f);
+
+	const DDSInfo::Mip& top = it->second.info.mips.front();
+	float texels = (float)std::max(top.width, top.height);
+	unsigned int level = pixels >= texels ? 0 : (unsigned int)std::floor(std::log2(texels / pixels));
+
+	RequestLevel(obj.texture, level);
+}
+
+void Ngine::TextureStreamer::Update()
+{
+	m_Uploaded = 0;
+	m_Evicted = 0;
+
+	std::vector<std::pair<GLuint, Entry*>> pending;
+	for (auto& [id, e] : m_Textures) {
+		if (e.requestFrame == m_Frame && e.wantedLevel < e.residentLevel)
+			pending.emplace_back(id, &e);
+	}
+
+	//Serve the textures furthest from what they want first
+	std::sort(pending.begin(), pending.end(), [](const auto& a, const auto& b) {
+		return a.second->residentLevel - a.second->wantedLevel > b.second->residentLevel - b.second->wantedLevel;
+		});
+
+	const bool async = AsyncIo::Running();
+	if (async)
+		ReceiveLevels();
+
+	size_t requested = 0;
+	for (auto& [id, e] : pending) {
+		//One level in flight per texture, they have to arrive coarse to fine anyway
+		if (async && e->async) {
+			if (!e->reading && e->wantedLevel < e->residentLevel && requested < m_UploadPerFrame) {
+				requested += e->info.mips[e->residentLevel - 1].size;
+				ReadLevel(id, *e, e->residentLevel - 1);
+			}
+			continue;
+		}
+
+		while (e->wantedLevel < e->residentLevel && m_Uploaded < m_UploadPerFrame) {
+			unsigned int level = e->residentLevel - 1;
+
+			//Only textures unused this frame may give way, otherwise visible objects would ping-pong
+			if (!MakeRoom(e->info.mips[level].size, m_Frame))
+				break;
+
+			UploadLevel(id, *e, level);
+		}
+	}
+	if (async)
+		AsyncIo::Submit();
+
+	//Budget may have been lowered, trim everything including textures used this frame
+	MakeRoom(0, m_Frame + 1);
+
+	++m_Frame;
+}
+
+size_t Ngine::TextureStreamer::PendingRequests() const noexcept
+{
+	size_t count = 0;
+	for (const auto& [id, e] : m_Textures) {
+		if (e.requestFrame + 1 >= m_Frame && e.wantedLevel < e.residentLevel)
+			++count;
+	}
+	return count;
+}
+
+Ngine::TextureStreamer::Stats Ngine::TextureStreamer::GetStats() const noexcept
+{
+	Stats stats;
+	stats.residentBytes = m_Resident;
+	stats.budgetBytes = m_Budget;
+	stats.pendingRequests = PendingRequests();
+	stats.textures = m_Textures.size();
+	stats.uploadedBytes = m_Uploaded;
+	stats.evictedBytes = m_Evicted;
+	return stats;
+}
+
+void Ngine::TextureStreamer::UploadLevel(GLuint id, Entry& e, unsigned int level)
+{
+	const DDSInfo::Mip& mip = e.info.mips[level];
+
+	//Mapped, only the pages of this level are read. Packs store DDS uncompressed so this stays a view.
+	VfsFile file;
+	if (!Vfs::TryOpen(e.path.c_str(), file)) {
+		spdlog::error("Could not open {}", e.path);
+		throw Ngine::Exception(__LINE__, __FILE__, "Could not open texture file");
+	}
+	TrackScope staging(MemoryCategory::TextureStaging, file.Decompressed() ? file.Size() : 0);
+
+	if ((size_t)mip.offset + mip.size > file.Size()) {
+		spdlog::error("{} is corrupted", e.path);
+		throw Ngine::Exception(__LINE__, __FILE__, "Could not handle texture file");
+	}
+
+	Upload(id, e, level, file.Data() + mip.offset);
+}
+
+void Ngine::TextureStreamer::Upload(GLuint id, Entry& e, unsigned int level, const char* data)
+{
+	const DDSInfo::Mip& mip = e.info.mips[level];
+
+	glBindTexture(GL_TEXTURE_2D, id);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	glCompressedTexImage2D(GL_TEXTURE_2D, level, e.info.format, mip.width, mip.height, 0, mip.size, data);
+	Ngine::Gfx::CountUpload(mip.size);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, (GLint)level);
+
+	e.residentLevel = level;
+	m_Resident += mip.size;
+	Memory::Track(MemoryCategory::GpuTexture, mip.size);
+	m_Uploaded += mip.size;
+}
+
+void Ngine::TextureStreamer::ReadLevel(GLuint id, Entry& e, unsigned int level)
+{
+	const DDSInfo::Mip& mip = e.info.mips[level];
+	const IoFile& file = OpenSource(e);
+
+	Arrival arrival{ id, level, mip.size, (char*)(mip.size <= AsyncIo::BufferSize() ? AsyncIo::AcquireBuffer() : nullptr) };
+	if (!arrival.data) {
+		arrival.heap.resize(mip.size);
+		arrival.data = arrival.heap.data();
+	}
+	Memory::Track(MemoryCategory::TextureStaging, mip.size);
+
+	//Vector data stays put when the arrival is moved into the inbox
+	auto pending = std::make_shared<Arrival>(std::move(arrival));
+	AsyncIo::Read(file, e.sourceOffset + mip.offset, mip.size, pending->data, [inbox = m_Inbox, pending](const IoResult& result) {
+		pending->read = result.read;
+		pending->error = result.error;
+		std::lock_guard<std::mutex> lock(inbox->mutex);
+		inbox->ready.push_back(std::move(*pending));
+		}, &m_Reads);
+	e.reading = true;
+}
+
+void Ngine::TextureStreamer::ReceiveLevels()
+{
+	std::vector<Arrival> arrived;
+	{
+		std::lock_guard<std::mutex> lock(m_Inbox->mutex);
+		arrived.swap(m_Inbox->ready);
+	}
+
+	std::vector<Arrival> later;
+	for (size_t i = 0; i < arrived.size(); ++i) {
+		Arrival& arrival = arrived[i];
+		Entry& e = m_Textures.at(arrival.id);
+		const DDSInfo::Mip& mip = e.info.mips[arrival.level];
+		if (arrival.error || arrival.read != arrival.size) {
+			spdlog::error("Could not read level {} of {}, error {}", arrival.level, e.path, arrival.error);
+			//Nothing is left holding a buffer or a texture stuck reading when the caller carries on
+			for (size_t j = i; j < arrived.size(); ++j) {
+				m_Textures.at(arrived[j].id).reading = false;
+				Discard(arrived[j]);
+			}
+			for (auto& deferred : later) {
+				m_Textures.at(deferred.id).reading = false;
+				Discard(deferred);
+			}
+			throw Ngine::Exception(__LINE__, __FILE__, "Could not read texture file");
+		}
+
+		//Evicted below the level meanwhile, or nobody wants it any more
+		if (arrival.level + 1 != e.residentLevel || e.requestFrame + 1 < m_Frame) {
+			e.reading = false;
+			Discard(arrival);
+			continue;
+		}
+
+		if (m_Uploaded >= m_UploadPerFrame || !MakeRoom(mip.size, m_Frame)) {
+			later.push_back(std::move(arrival));
+			continue;
+		}
+		if (arrival.level + 1 != e.residentLevel) {
+			//Made room out of its own levels
+			e.reading = false;
+			Discard(arrival);
+			continue;
+		}
+
+		Upload(arrival.id, e, arrival.level, arrival.data);
+		e.reading = false;
+		Discard(arrival);
+	}
+
+	if (!later.empty()) {
+		std::lock_guard<std::mutex> lock(m_Inbox->mutex);
+		auto& ready = m_Inbox->ready;
+		ready.insert(ready.begin(), std::make_move_iterator(later.begin()), std::make_move_iterator(later.end()));
+	}
+}
+
+void Ngine::TextureStreamer::Discard(Arrival& arrival)
+{
+	if (arrival.heap.empty())
+		AsyncIo::ReleaseBuffer(arrival.data);
+	Memory::Untrack(MemoryCategory::TextureStaging, arrival.size);
+	arrival.data = nullptr;
+	arrival.heap.clear();
+}
+
+const Ngine::IoFile& Ngine::TextureStreamer::OpenSource(Entry& e)
+{
+	Source& source = m_Sources[e.source];
+	if (!source.file.Valid())
+		source.file = AsyncIo::Open(e.source.c_str());
+	if (!e.sourceOpen) {
+		++source.users;
+		e.sourceOpen = true;
+	}
+	return source.file;
+}
+
+void Ngine::TextureStreamer::CloseSource(Entry& e)
+{
+	if (!e.sourceOpen)
+		return;
+	e.sourceOpen = false;
+
+	auto it = m_Sources.find(e.source);
+	if (it != m_Sources.end() && --it->second.users == 0) {
+		AsyncIo::Close(it->second.file);
+		m_Sources.erase(it);
+	}
+}
+
+void Ngine::TextureStreamer::WaitForReads()
+{
+	AsyncIo::Submit();
+	Jobs::Wait(m_Reads);
+}
+
+void Ngine::TextureStreamer::DropLevel(GLuint id, Entry& e)
+{
+	unsigned int level = e.residentLevel;
+	const DDSInfo::Mip& mip = e.info.mips[level];
+
+	glBindTexture(GL_TEXTURE_2D, id);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, (GLint)level + 1);
+
+	//Respecifying the level with zero size lets the driver release its storage
+	glCompressedTexImage2D(GL_TEXTURE_2D, level, e.info.format, 0, 0, 0, 0, NULL);
+
+	e.residentLevel = level + 1;
+	m_Resident -= mip.size;
+	Memory::Untrack(MemoryCategory::GpuTexture, mip.size);
+	m_Evicted += mip.size;
+}
+
+bool Ngine::TextureStreamer::MakeRoom(size_t bytes, unsigned long long olderThan)
+{
+	while (m_Resident + bytes > m_Budget) {
+		GLuint victimID = 0;
+		Entry* victim = nullptr;
+
+		//Least recently used texture that still has something above its coarse levels
+		for (auto& [id, e] : m_Textures) {
+			if (e.lastUsed >= olderThan || e.residentLevel >= e.coarseLevel)
+				continue;
+			if (!victim || e.lastUsed < victim->lastUsed) {
+				victimID = id;
+				victim = &e;
+			}
+		}
+
+		if (!victim)
+			return false;
+
+		DropLevel(victimID, *victim);
+	}
+
+	return true;
+}
@@ -0,0 +1,108 @@
+#pragma once
+#include "AsyncIo.h"
+#include "Gfx.h"
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace Ngine {
+
+	//Streams DDS mip levels in and out of GPU memory.
+	//Textures start with their coarse mips only, finer levels are uploaded when objects using them
+	//grow on screen and the least recently used textures lose their top levels when over budget.
+	//While AsyncIo runs finer levels are read in the background and uploaded by a later Update.
+	class NAPI TextureStreamer {
+	public:
+		struct Stats {
+			size_t residentBytes;
+			size_t budgetBytes;
+			size_t pendingRequests; //Textures that want finer levels than they have
+			size_t textures;
+			size_t uploadedBytes; //During last Update
+			size_t evictedBytes; //During last Update
+		};
+
+		//Levels with both sides at or below this size are uploaded immediately on Load
+		static constexpr unsigned int CoarseDim = 128;
+
+		TextureStreamer(size_t budgetBytes, size_t uploadBytesPerFrame = 4 * 1024 * 1024);
+		~TextureStreamer();
+
+		TextureStreamer(const TextureStreamer&) = delete;
+		TextureStreamer operator=(const TextureStreamer&) = delete;
+
+		GLuint Load(const char* ipath);
+		void Release(GLuint texture);
+
+		//Ask for mip level to become resident, lower level means finer detail
+		void RequestLevel(GLuint texture, unsigned int level);
+		//Derive wanted level from how many pixels obj covers on screen
+		void RequestForObject(const Object& obj, int viewportHeight);
+
+		//Uploads pending levels and enforces the budget, call once per frame on the GL thread
+		void Update();
+
+		void SetBudget(size_t budgetBytes) { m_Budget = budgetBytes; }
+		size_t ResidentBytes() const noexcept { return m_Resident; }
+		size_t PendingRequests() const noexcept;
+		Stats GetStats() const noexcept;
+
+	private:
+		struct Entry {
+			DDSInfo info;
+			std::string path;
+			unsigned int residentLevel; //Finest level currently on the GPU
+			unsigned int coarseLevel; //Never evicted below this one
+			unsigned int wantedLevel;
+			unsigned long long lastUsed, requestFrame;
+			std::string source; //Loose file or the pack holding it
+			uint64_t sourceOffset;
+			bool async; //Stored where a positioned read can get at it
+			bool reading;
+			bool sourceOpen; //Holds a use of m_Sources[source]
+		};
+
+		//One handle per file read from, every texture in a pack shares it
+		struct Source {
+			IoFile file;
+			size_t users = 0;
+		};
+
+		//Level read in the background, waiting for Update
+		struct Arrival {
+			GLuint id;
+			unsigned int level;
+			size_t size;
+			char* data; //Registered I/O buffer or heap
+			std::vector<char> heap;
+			size_t read;
+			int error;
+		};
+
+		struct Inbox {
+			std::mutex mutex;
+			std::vector<Arrival> ready;
+		};
+
+		void UploadLevel(GLuint id, Entry& e, unsigned int level);
+		void Upload(GLuint id, Entry& e, unsigned int level, const char* data);
+		void ReadLevel(GLuint id, Entry& e, unsigned int level);
+		void ReceiveLevels();
+		void Discard(Arrival& arrival);
+		const IoFile& OpenSource(Entry& e);
+		void CloseSource(Entry& e);
+		void WaitForReads();
+		void DropLevel(GLuint id, Entry& e);
+		bool MakeRoom(size_t bytes, unsigned long long olderThan);
+
+		std::unordered_map<GLuint, Entry> m_Textures;
+		std::unordered_map<std::string, Source> m_Sources;
+		size_t m_Budget, m_UploadPerFrame;
+		size_t m_Resident = 0, m_Uploaded = 0, m_Evicted = 0;
+		unsigned long long m_Frame = 1;
+		std::shared_ptr<Inbox> m_Inbox = std::make_shared<Inbox>(); //Shared with the read callbacks
+		JobCounter m_Reads;
+	};
+}
@@ -0,0 +1,66 @@
+#include "pch.h"
+#include "VertexLayout.h"
+#include <spdlog/spdlog.h>
+#include <cstring>
+#include <string>
+
+void Ngine::VertexInputs::BindLocations(GLuint program)
+{
+	for (GLuint location = 0; location < VertexSemanticCount; ++location)
+		glBindAttribLocation(program, location, VertexSemantics[location].name);
+}
+
+uint32_t Ngine::VertexInputs::Read(GLuint program, const char* name)
+{
+	GLint count = 0, maxLength = 0;
+	glGetProgramiv(program, GL_ACTIVE_ATTRIBUTES, &count);
+	glGetProgramiv(program, GL_ACTIVE_ATTRIBUTE_MAX_LENGTH, &maxLength);
+
+	uint32_t mask = 0;
+	std::string input((size_t)maxLength + 1, '\0');
+	for (GLint i = 0; i < count; ++i) {
+		GLsizei length = 0;
+		GLint size = 0;
+		GLenum type = 0;
+		glGetActiveAttrib(program, (GLuint)i, (GLsizei)input.size(), &length, &size, &type, input.data());
+		const char* attribute = input.c_str();
+		if (std::strncmp(attribute, "gl_", 3) == 0)
+			continue;
+
+		GLuint semantic = 0;
+		while (semantic < VertexSemanticCount && std::strcmp(attribute, VertexSemantics[semantic].name) != 0)
+			++semantic;
+		if (semantic == VertexSemanticCount) {
+			spdlog::error("{} reads vertex input {}, which is not a vertex semantic", name, attribute);
+			throw Ngine::Exception(__LINE__, __FILE__, "Unknown vertex input");
+		}
+
+		if (type != VertexSemantics[semantic].shaderType) {
+			spdlog::error("{} declares vertex input {} with GL type {:#x} instead of {:#x}", name, attribute, type, VertexSemantics[semantic].shaderType);
+			throw Ngine::Exception(__LINE__, __FILE__, "Vertex input has the wrong type");
+		}
+
+		GLint location = glGetAttribLocation(program, attribute);
+		if (location != (GLint)semantic) {
+			spdlog::error("{} has vertex input {} at location {} instead of {}", name, attribute, location, semantic);
+			throw Ngine::Exception(__LINE__, __FILE__, "Vertex input at the wrong location");
+		}
+
+		mask |= 1u << semantic;
+	}
+	return mask;
+}
+
+void Ngine::VertexInputs::Require(GLuint program, uint32_t provided, const char* name, const char* layout)
+{
+	uint32_t missing = Read(program, name) & ~provided;
+	if (!missing)
+		return;
+
+	std::string inputs;
+	for (GLuint semantic = 0; semantic < VertexSemanticCount; ++semantic)
+		if (missing & (1u << semantic))
+			inputs += std::string(inputs.empty() ? "" : ", ") + VertexSemantics[semantic].name;
+	spdlog::error("{} reads {}, missing from the {}", name, inputs, layout);
+	throw Ngine::Exception(__LINE__, __FILE__, "Program doesn't match vertex layout");
+}
@@ -0,0 +1,233 @@
+#pragma once
+#include "Macro.h"
+#include <gl/glew.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/packing.hpp>
+#include <array>
+#include <bit>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <type_traits>
+#include <utility>
+
+namespace Ngine {
+
+	//What an attribute means to the shaders, the value is its location.
+	//Programs get the locations bound by input name before linking, so shaders don't declare them.
+	enum class VertexSemantic : GLuint {
+		Position = 0,
+		Colour = 1,
+		UV = 2,
+		Normal = 3,
+		Tangent = 4
+	};
+
+	constexpr GLuint VertexSemanticCount = 5;
+
+	//Vertex shader input name and GLSL type of each semantic, in location order
+	struct NAPI VertexSemanticInfo {
+		const char* name;
+		GLenum shaderType;
+	};
+
+	constexpr VertexSemanticInfo VertexSemantics[VertexSemanticCount] = {
+		{ "vPos", GL_FLOAT_VEC3 },
+		{ "vCol", GL_FLOAT_VEC3 },
+		{ "vUV", GL_FLOAT_VEC2 },
+		{ "vNormal", GL_FLOAT_VEC3 },
+		{ "vTangent", GL_FLOAT_VEC4 }
+	};
+
+	//Storage types besides float and the integer types, the shader always sees floats
+	struct Half {
+		uint16_t bits;
+	};
+	//GL_INT_2_10_10_10_REV, signed normalized xyz in 10 bits each and w in 2, for normals and tangents
+	struct Snorm1010102 {
+		uint32_t bits;
+	};
+
+	template<typename T>
+	struct VertexStorage;
+
+	template<> struct VertexStorage<float> { static constexpr GLenum type = GL_FLOAT; };
+	template<> struct VertexStorage<Half> { static constexpr GLenum type = GL_HALF_FLOAT; };
+	template<> struct VertexStorage<int8_t> { static constexpr GLenum type = GL_BYTE; };
+	template<> struct VertexStorage<uint8_t> { static constexpr GLenum type = GL_UNSIGNED_BYTE; };
+	template<> struct VertexStorage<int16_t> { static constexpr GLenum type = GL_SHORT; };
+	template<> struct VertexStorage<uint16_t> { static constexpr GLenum type = GL_UNSIGNED_SHORT; };
+	template<> struct VertexStorage<Snorm1010102> { static constexpr GLenum type = GL_INT_2_10_10_10_REV; };
+
+	//One attribute: N components of T per vertex. Integers are normalized by default, [-1, 1] or [0, 1] in the shader.
+	template<VertexSemantic S, typename T, GLint N, bool Normalized = std::is_integral_v<T>>
+	struct VertexAttribute {
+		static constexpr bool packed = std::is_same_v<T, Snorm1010102>;
+		static_assert(N >= 1 && N <= 4, "Attributes have 1 to 4 components");
+		static_assert(!packed || N == 4, "Packed attributes always have 4 components");
+
+		static constexpr VertexSemantic semantic = S;
+		static constexpr GLint components = N;
+		static constexpr GLenum type = VertexStorage<T>::type;
+		static constexpr GLboolean normalized = Normalized || packed ? GL_TRUE : GL_FALSE;
+		static constexpr size_t size = packed ? sizeof(T) : sizeof(T) * N;
+
+		static void Store(const glm::vec4& v, unsigned char* dst) noexcept
+		{
+			if constexpr (packed) {
+				uint32_t bits = glm::packSnorm3x10_1x2(v);
+				std::memcpy(dst, &bits, sizeof(bits));
+			}
+			else {
+				T out[N];
+				for (GLint i = 0; i < N; ++i)
+					out[i] = Convert(v[i]);
+				std::memcpy(dst, out, size);
+			}
+		}
+
+	private:
+		static T Convert(float value) noexcept
+		{
+			if constexpr (std::is_same_v<T, float>) {
+				return value;
+			}
+			else if constexpr (std::is_same_v<T, Half>) {
+				return Half{ glm::packHalf1x16(value) };
+			}
+			else if constexpr (Normalized) {
+				constexpr float max = (float)std::numeric_limits<T>::max();
+				constexpr float min = std::is_signed_v<T> ? -1.0f : 0.0f;
+				return (T)std::lround(glm::clamp(value, min, 1.0f) * max);
+			}
+			else {
+				return (T)std::lround(value);
+			}
+		}
+	};
+
+	//Common formats
+	using Position3f = VertexAttribute<VertexSemantic::Position, float, 3>;
+	using Colour3f = VertexAttribute<VertexSemantic::Colour, float, 3>;
+	using Colour4ub = VertexAttribute<VertexSemantic::Colour, uint8_t, 4>;
+	using UV2f = VertexAttribute<VertexSemantic::UV, float, 2>;
+	using UV2h = VertexAttribute<VertexSemantic::UV, Half, 2>; //Only for UVs that stay within a few repeats
+	using Normal3f = VertexAttribute<VertexSemantic::Normal, float, 3>;
+	using NormalPacked = VertexAttribute<VertexSemantic::Normal, Snorm1010102, 4>;
+	using Tangent4f = VertexAttribute<VertexSemantic::Tangent, float, 4>;
+	using TangentPacked = VertexAttribute<VertexSemantic::Tangent, Snorm1010102, 4>; //w keeps the bitangent sign exactly
+
+	//CPU side arrays a vertex buffer is built from, one entry per vertex. Missing ones are filled with defaults.
+	struct NAPI VertexSources {
+		size_t count = 0;
+		const glm::vec3* positions = nullptr;
+		const glm::vec3* colours = nullptr;
+		const glm::vec2* uvs = nullptr;
+		const glm::vec3* normals = nullptr;
+		const glm::vec4* tangents = nullptr; //w is the bitangent sign
+
+		template<VertexSemantic S>
+		glm::vec4 Get(size_t i) const noexcept
+		{
+			if constexpr (S == VertexSemantic::Position)
+				return glm::vec4(positions ? positions[i] : glm::vec3(0.0f), 1.0f);
+			else if constexpr (S == VertexSemantic::Colour)
+				return glm::vec4(colours ? colours[i] : glm::vec3(1.0f), 1.0f);
+			else if constexpr (S == VertexSemantic::UV)
+				return glm::vec4(uvs ? uvs[i] : glm::vec2(0.0f), 0.0f, 0.0f);
+			else if constexpr (S == VertexSemantic::Normal)
+				return glm::vec4(normals ? normals[i] : glm::vec3(0.0f, 1.0f, 0.0f), 0.0f);
+			else
+				return tangents ? tangents[i] : glm::vec4(1.0f, 0.0f, 0.0f, 1.0f);
+		}
+	};
+
+	//Attribute of a layout as plain data, for logging and checks that don't need the types
+	struct NAPI VertexAttributeInfo {
+		VertexSemantic semantic;
+		GLint components;
+		GLenum type;
+		GLboolean normalized;
+		GLuint offset;
+	};
+
+	//Reflection of linked programs against the semantic table
+	class NAPI VertexInputs {
+	public:
+		//Call between attaching the shaders and glLinkProgram
+		static void BindLocations(GLuint program);
+		//Semantics the program reads as a bit mask. Throws for inputs that aren't a semantic, have its wrong type
+		//or ended up at another location, eg. through a layout qualifier.
+		static uint32_t Read(GLuint program, const char* name);
+		//Throws when the program reads a semantic missing from provided
+		static void Require(GLuint program, uint32_t provided, const char* name, const char* layout);
+	};
+
+	//Interleaved vertex format from a list of attributes. Offsets and stride are computed at compile time,
+	//every attribute starts 4 byte aligned as drivers want it.
+	template<typename... Attributes>
+	struct VertexLayout {
+		static constexpr size_t Count = sizeof...(Attributes);
+		static_assert(Count > 0, "A layout needs at least one attribute");
+
+		static constexpr uint32_t Mask = ((1u << (GLuint)Attributes::semantic) | ...);
+		static_assert(std::popcount(Mask) == Count, "A semantic can appear only once per layout");
+
+		template<VertexSemantic S>
+		static constexpr bool Has = (Mask >> (GLuint)S) & 1u;
+
+		static constexpr std::array<GLuint, Count> Offsets = []() {
+			std::array<GLuint, Count> offsets{};
+			constexpr size_t sizes[] = { Attributes::size... };
+			GLuint offset = 0;
+			for (size_t i = 0; i < Count; ++i) {
+				offsets[i] = offset;
+				offset = (GLuint)((offset + sizes[i] + 3) & ~size_t(3));
+			}
+			return offsets;
+		}();
+		static constexpr GLsizei Stride = []() {
+			constexpr size_t sizes[] = { Attributes::size... };
+			return (GLsizei)((Offsets[Count - 1] + sizes[Count - 1] + 3) & ~size_t(3));
+		}();
+
+		static constexpr std::array<VertexAttributeInfo, Count> Info = []() {
+			std::array<VertexAttributeInfo, Count> info{};
+			size_t i = 0;
+			((info[i] = { Attributes::semantic, Attributes::components, Attributes::type, Attributes::normalized, Offsets[i] }, ++i), ...);
+			return info;
+		}();
+
+		//Writes sources.count verticies, Stride bytes each
+		static void Interleave(const VertexSources& sources, void* dst) noexcept
+		{
+			Interleave(sources, (unsigned char*)dst, std::index_sequence_for<Attributes...>());
+		}
+
+		//Points the attributes of the bound VAO into buffer, which holds interleaved verticies from its start
+		static void Bind(GLuint buffer)
+		{
+			glBindBuffer(GL_ARRAY_BUFFER, buffer);
+			for (const VertexAttributeInfo& a : Info) {
+				glEnableVertexAttribArray((GLuint)a.semantic);
+				glVertexAttribPointer((GLuint)a.semantic, a.components, a.type, a.normalized, Stride, (const void*)(uintptr_t)a.offset);
+			}
+		}
+
+		//Throws when program reads an attribute this layout doesn't have
+		static void Check(GLuint program, const char* name, const char* layout = "vertex layout")
+		{
+			VertexInputs::Require(program, Mask, name, layout);
+		}
+
+	private:
+		template<size_t... I>
+		static void Interleave(const VertexSources& sources, unsigned char* dst, std::index_sequence<I...>) noexcept
+		{
+			for (size_t v = 0; v < sources.count; ++v, dst += Stride)
+				(Attributes::Store(sources.template Get<Attributes::semantic>(v), dst + Offsets[I]), ...);
+		}
+	};
+}
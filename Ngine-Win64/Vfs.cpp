@@ -0,0 +1,558 @@
+#include "pch.h"
+#include "Vfs.h"
+#include "Jobs.h"
+#include "Log.h"
+#include "Profiler.h"
+#include <spdlog/spdlog.h>
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <shared_mutex>
+
+#pragma warning(disable : 4996)
+
+namespace fs = std::filesystem;
+
+namespace {
+
+	constexpr char PackMagic[4] = { 'N', 'P', 'A', 'K' };
+	constexpr uint32_t PackVersion = 1;
+	constexpr uint64_t Alignment = 16; //Of every entry, so mapped data can be read in place
+
+	constexpr int HashBits = 14; //Match finder table of the compressor
+	constexpr size_t MinMatch = 4;
+	constexpr size_t MaxOffset = 65535;
+	constexpr size_t LastLiterals = 5; //Matches end this far before the input does, as in LZ4
+
+	enum EntryFlags : uint32_t {
+		Compressed = 1
+	};
+
+	struct PackHeader {
+		char magic[4];
+		uint32_t version;
+		uint32_t entryCount;
+		uint32_t namesSize;
+		uint64_t tableOffset; //Entries, followed by their names
+		uint64_t reserved;
+	};
+
+	//Sorted by hash and then name
+	struct PackEntry {
+		uint64_t hash;
+		uint64_t offset;
+		uint64_t size, storedSize;
+		uint32_t nameOffset, nameSize;
+		uint32_t flags;
+		uint32_t reserved;
+	};
+
+	struct MountedPack {
+		std::shared_ptr<const Ngine::VfsPack> pack;
+		std::string prefix; //Normalised mount point with a trailing '/', empty for the root
+	};
+
+	std::shared_mutex mutex; //Mounting is rare, opens only read the list
+	std::vector<MountedPack> mounts;
+#ifdef _DEBUG
+	std::atomic<bool> looseOverride = true;
+#else
+	std::atomic<bool> looseOverride = false;
+#endif
+	std::atomic<uint64_t> packedOpens = 0, looseOpens = 0, decompressedBytes = 0;
+
+	uint64_t Fnv(std::string_view text)
+	{
+		uint64_t hash = 14695981039346656037ull;
+		for (char c : text) {
+			hash ^= (unsigned char)c;
+			hash *= 1099511628211ull;
+		}
+		return hash;
+	}
+
+	void WriteLength(std::vector<char>& out, size_t length)
+	{
+		for (; length >= 255; length -= 255)
+			out.push_back((char)255);
+		out.push_back((char)length);
+	}
+
+	//LZ4 block format: token with literal and match length nibbles, literals, 16-bit offset, longer lengths in extra bytes.
+	//Greedy with a single hash probe, which is what LZ4's fast mode does too.
+	std::vector<char> Compress(const char* src, size_t size)
+	{
+		std::vector<char> out;
+		out.reserve(size / 2 + 16);
+		std::vector<uint32_t> table((size_t)1 << HashBits, UINT32_MAX);
+
+		const size_t limit = size > 12 ? size - 12 : 0; //Last match starts at least 12 bytes before the end
+		size_t i = 0, anchor = 0;
+		while (i < limit) {
+			uint32_t sequence, candidate;
+			std::memcpy(&sequence, src + i, 4);
+			uint32_t& slot = table[(sequence * 2654435761u) >> (32 - HashBits)];
+			size_t match = slot;
+			slot = (uint32_t)i;
+
+			if (match == UINT32_MAX || i - match > MaxOffset || (std::memcpy(&candidate, src + match, 4), candidate != sequence)) {
+				++i;
+				continue;
+			}
+
+			size_t length = MinMatch;
+			while (i + length < size - LastLiterals && src[match + length] == src[i + length])
+				++length;
+
+			size_t literals = i - anchor;
+			out.push_back((char)((std::min<size_t>(literals, 15) << 4) | std::min<size_t>(length - MinMatch, 15)));
+			if (literals >= 15)
+				WriteLength(out, literals - 15);
+			out.insert(out.end(), src + anchor, src + i);
+
+			size_t offset = i - match;
+			out.push_back((char)(offset & 0xFF));
+			out.push_back((char)(offset >> 8));
+			if (length - MinMatch >= 15)
+				WriteLength(out, length - MinMatch - 15);
+
+			i += length;
+			anchor = i;
+		}
+
+		//Last sequence carries literals only
+		size_t literals = size - anchor;
+		out.push_back((char)(std::min<size_t>(literals, 15) << 4));
+		if (literals >= 15)
+			WriteLength(out, literals - 15);
+		out.insert(out.end(), src + anchor, src + size);
+		return out;
+	}
+
+	//False for malformed input or when the output doesn't come out exactly dstSize bytes long
+	bool Decompress(const char* source, size_t srcSize, char* dst, size_t dstSize)
+	{
+		const unsigned char* src = (const unsigned char*)source;
+		size_t ip = 0, op = 0;
+
+		auto readLength = [&](size_t& length) {
+			if (length != 15)
+				return true;
+			unsigned char b;
+			do {
+				if (ip >= srcSize)
+					return false;
+				b = src[ip++];
+				length += b;
+			} while (b == 255);
+			return true;
+		};
+
+		while (ip < srcSize) {
+			unsigned int token = src[ip++];
+
+			size_t literals = token >> 4;
+			if (!readLength(literals) || literals > srcSize - ip || literals > dstSize - op)
+				return false;
+			std::memcpy(dst + op, src + ip, literals);
+			ip += literals;
+			op += literals;
+			if (ip == srcSize)
+				break;
+
+			if (srcSize - ip < 2)
+				return false;
+			size_t offset = src[ip] | ((size_t)src[ip + 1] << 8);
+			ip += 2;
+
+			size_t length = token & 15;
+			if (!readLength(length))
+				return false;
+			length += MinMatch;
+			if (offset == 0 || offset > op || length > dstSize - op)
+				return false;
+
+			//Byte by byte, matches may overlap what they produce
+			for (size_t k = 0; k < length; ++k)
+				dst[op + k] = dst[op - offset + k];
+			op += length;
+		}
+		return op == dstSize;
+	}
+
+	bool HasExtension(const std::string& name, const std::vector<std::string>& extensions)
+	{
+		std::string e = Ngine::Vfs::NormalPath(fs::path(name).extension().string().c_str());
+		for (const auto& extension : extensions)
+			if (e == Ngine::Vfs::NormalPath(extension.c_str()))
+				return true;
+		return false;
+	}
+
+	bool OpenLoose(const char* path, Ngine::MappedFile& loose, const char*& data, size_t& size)
+	{
+		std::error_code ec;
+		if (!fs::is_regular_file(path, ec))
+			return false;
+
+		loose = Ngine::MappedFile(path);
+		data = loose.Data();
+		size = loose.Size();
+		looseOpens.fetch_add(1, std::memory_order_relaxed);
+		return true;
+	}
+}
+
+namespace Ngine {
+
+	struct VfsPack {
+		std::string path;
+		MappedFile file;
+		const PackEntry* entries;
+		const char* names;
+		uint32_t count;
+
+		const PackEntry* Find(std::string_view name) const noexcept
+		{
+			const uint64_t hash = Fnv(name);
+			const PackEntry* it = std::lower_bound(entries, entries + count, hash, [](const PackEntry& e, uint64_t h) { return e.hash < h; });
+			for (; it != entries + count && it->hash == hash; ++it)
+				if (std::string_view(names + it->nameOffset, it->nameSize) == name)
+					return it;
+			return nullptr;
+		}
+	};
+}
+
+namespace {
+
+	//Newest mount first
+	const PackEntry* FindPacked(const std::string& name, std::shared_ptr<const Ngine::VfsPack>& pack)
+	{
+		std::shared_lock<std::shared_mutex> lock(mutex);
+		for (const auto& m : mounts) {
+			if (name.compare(0, m.prefix.size(), m.prefix) != 0)
+				continue;
+			if (const PackEntry* entry = m.pack->Find(std::string_view(name).substr(m.prefix.size()))) {
+				pack = m.pack;
+				return entry;
+			}
+		}
+		return nullptr;
+	}
+
+	bool LooseSize(const char* path, uint64_t& size)
+	{
+		std::error_code ec;
+		if (!fs::is_regular_file(path, ec))
+			return false;
+		size = fs::file_size(path, ec);
+		return !ec;
+	}
+}
+
+std::string Ngine::Vfs::NormalPath(const char* path)
+{
+	std::string result = fs::path(path).lexically_normal().generic_string();
+	std::transform(result.begin(), result.end(), result.begin(), [](char c) { return (char)(c >= 'A' && c <= 'Z' ? c + ('a' - 'A') : c); });
+	return result;
+}
+
+bool Ngine::Vfs::Mount(const char* packPath, const char* mountPoint)
+{
+	std::error_code ec;
+	if (!fs::is_regular_file(packPath, ec))
+		return false;
+
+	auto pack = std::make_shared<VfsPack>();
+	pack->path = packPath;
+	pack->file = MappedFile(packPath);
+
+	const MappedFile& file = pack->file;
+	PackHeader header;
+	bool valid = file.Size() >= sizeof(header);
+	if (valid) {
+		std::memcpy(&header, file.Data(), sizeof(header));
+		valid = std::memcmp(header.magic, PackMagic, sizeof(PackMagic)) == 0 && header.version == PackVersion &&
+			header.tableOffset % alignof(PackEntry) == 0 && header.tableOffset <= file.Size() &&
+			(file.Size() - header.tableOffset) / sizeof(PackEntry) >= header.entryCount &&
+			file.Size() - header.tableOffset - (uint64_t)header.entryCount * sizeof(PackEntry) >= header.namesSize;
+	}
+	if (!valid) {
+		spdlog::error("{} is not a version {} pack", packPath, PackVersion);
+		throw Ngine::Exception(__LINE__, __FILE__, "Could not mount pack");
+	}
+
+	pack->entries = (const PackEntry*)(file.Data() + header.tableOffset);
+	pack->names = file.Data() + header.tableOffset + (size_t)header.entryCount * sizeof(PackEntry);
+	pack->count = header.entryCount;
+
+	//Checked once here, lookups then trust the table
+	for (uint32_t i = 0; i < pack->count; ++i) {
+		const PackEntry& e = pack->entries[i];
+		if ((uint64_t)e.nameOffset + e.nameSize > header.namesSize || e.offset > header.tableOffset || header.tableOffset - e.offset < e.storedSize ||
+			(!(e.flags & Compressed) && e.storedSize != e.size) || (i > 0 && pack->entries[i - 1].hash > e.hash)) {
+			spdlog::error("{} has a corrupt entry table", packPath);
+			throw Ngine::Exception(__LINE__, __FILE__, "Could not mount pack");
+		}
+	}
+
+	MountedPack m{ std::move(pack) };
+	if (mountPoint && *mountPoint) {
+		m.prefix = NormalPath(mountPoint);
+		if (m.prefix == ".." || m.prefix.starts_with("../")) {
+			spdlog::error("Mount point {} is above the working directory", mountPoint);
+			throw Ngine::Exception(__LINE__, __FILE__, "Could not mount pack");
+		}
+		if (m.prefix.back() != '/')
+			m.prefix += '/';
+	}
+
+	NGINE_LOG_INFO("Mounted pack {} {} {}", Field("path", packPath), Field("mountPoint", m.prefix), Field("entries", header.entryCount));
+
+	std::unique_lock<std::shared_mutex> lock(mutex);
+	mounts.insert(mounts.begin(), std::move(m));
+	return true;
+}
+
+void Ngine::Vfs::UnmountAll()
+{
+	std::unique_lock<std::shared_mutex> lock(mutex);
+	mounts.clear();
+}
+
+void Ngine::Vfs::SetLooseOverride(bool enabled) noexcept
+{
+	looseOverride.store(enabled, std::memory_order_relaxed);
+}
+
+bool Ngine::Vfs::LooseOverride() noexcept
+{
+	return looseOverride.load(std::memory_order_relaxed);
+}
+
+bool Ngine::Vfs::TryOpen(const char* path, VfsFile& file)
+{
+	file = VfsFile();
+	if (LooseOverride() && OpenLoose(path, file.m_Loose, file.m_Data, file.m_Size))
+		return true;
+
+	std::shared_ptr<const VfsPack> pack;
+	const PackEntry* entry = FindPacked(NormalPath(path), pack);
+	if (!entry)
+		return !LooseOverride() && OpenLoose(path, file.m_Loose, file.m_Data, file.m_Size);
+
+	const char* stored = pack->file.Data() + entry->offset;
+	if (entry->flags & Compressed) {
+		NGINE_ZONE("Vfs::Decompress");
+		file.m_Buffer.resize((size_t)entry->size);
+		if (!Decompress(stored, (size_t)entry->storedSize, file.m_Buffer.data(), file.m_Buffer.size())) {
+			spdlog::error("{} in {} is corrupt", path, pack->path);
+			throw Ngine::Exception(__LINE__, __FILE__, "Could not decompress packed file");
+		}
+		file.m_Data = file.m_Buffer.data();
+		decompressedBytes.fetch_add(entry->size, std::memory_order_relaxed);
+	}
+	else {
+		file.m_Data = stored;
+	}
+	file.m_Size = (size_t)entry->size;
+	file.m_Pack = std::move(pack);
+	packedOpens.fetch_add(1, std::memory_order_relaxed);
+	return true;
+}
+
+Ngine::VfsFile Ngine::Vfs::Open(const char* path)
+{
+	VfsFile file;
+	if (!TryOpen(path, file)) {
+		spdlog::error("Could not open {}", path);
+		throw Ngine::Exception(__LINE__, __FILE__, "Could not open file");
+	}
+	return file;
+}
+
+bool Ngine::Vfs::Locate(const char* path, VfsLocation& location)
+{
+	if (LooseOverride() && LooseSize(path, location.size)) {
+		location.file = path;
+		location.offset = 0;
+		return true;
+	}
+
+	std::shared_ptr<const VfsPack> pack;
+	const PackEntry* entry = FindPacked(NormalPath(path), pack);
+	if (!entry) {
+		if (LooseOverride() || !LooseSize(path, location.size))
+			return false;
+		location.file = path;
+		location.offset = 0;
+		return true;
+	}
+	if (entry->flags & Compressed)
+		return false;
+
+	location.file = pack->path;
+	location.offset = entry->offset;
+	location.size = entry->size;
+	return true;
+}
+
+bool Ngine::Vfs::Exists(const char* path)
+{
+	std::error_code ec;
+	if (fs::is_regular_file(path, ec))
+		return true;
+
+	std::string name = NormalPath(path);
+	std::shared_lock<std::shared_mutex> lock(mutex);
+	for (const auto& m : mounts)
+		if (name.compare(0, m.prefix.size(), m.prefix) == 0 && m.pack->Find(std::string_view(name).substr(m.prefix.size())))
+			return true;
+	return false;
+}
+
+Ngine::PackStats Ngine::Vfs::Pack(const char* directory, const char* packPath, const PackSettings& settings)
+{
+	NGINE_ZONE("Vfs::Pack");
+	Ngine::LogTimer timer;
+
+	struct Source {
+		std::string name; //Normalised, relative to directory
+		fs::path path;
+		uint64_t hash;
+		std::vector<char> compressed; //Empty when stored as it is
+		size_t size = 0;
+	};
+
+	fs::path root = fs::weakly_canonical(fs::absolute(directory));
+	fs::path output = fs::weakly_canonical(fs::absolute(packPath));
+	fs::path temp = output;
+	temp += ".tmp";
+	if (!fs::is_directory(root)) {
+		spdlog::error("Directory {} not found", directory);
+		throw Ngine::Exception(__LINE__, __FILE__, "Could not find directory to pack");
+	}
+
+	std::vector<Source> sources;
+	for (const auto& it : fs::recursive_directory_iterator(root)) {
+		if (!it.is_regular_file() || it.path() == output || it.path() == temp)
+			continue;
+		std::string file = it.path().filename().string();
+		if (std::find(settings.exclude.begin(), settings.exclude.end(), file) != settings.exclude.end())
+			continue;
+
+		Source source;
+		source.name = NormalPath(fs::relative(it.path(), root).generic_string().c_str());
+		source.path = it.path();
+		source.hash = Fnv(source.name);
+		sources.push_back(std::move(source));
+	}
+	std::sort(sources.begin(), sources.end(), [](const Source& a, const Source& b) { return a.hash != b.hash ? a.hash < b.hash : a.name < b.name; });
+
+	for (size_t i = 1; i < sources.size(); ++i) {
+		if (sources[i].name == sources[i - 1].name) {
+			spdlog::error("{} and {} differ only in case", sources[i - 1].path.string(), sources[i].path.string());
+			throw Ngine::Exception(__LINE__, __FILE__, "Could not pack directory");
+		}
+	}
+
+	//Compression is kept only when it saves at least an eighth
+	Jobs::ParallelFor(0, sources.size(), 1, [&](size_t first, size_t last) {
+		for (size_t i = first; i < last; ++i) {
+			Source& source = sources[i];
+			MappedFile file(source.path.string().c_str());
+			source.size = file.Size();
+			if (!settings.compress || file.Size() == 0 || HasExtension(source.name, settings.storeRaw))
+				continue;
+
+			std::vector<char> compressed = Compress(file.Data(), file.Size());
+			if (compressed.size() <= file.Size() - file.Size() / 8)
+				source.compressed = std::move(compressed);
+		}
+		});
+
+	FILE* fp = fopen(temp.string().c_str(), "wb");
+	if (fp == NULL) {
+		spdlog::error("Could not open {}", temp.string());
+		throw Ngine::Exception(__LINE__, __FILE__, "Could not open pack file");
+	}
+
+	PackStats stats{};
+	std::vector<PackEntry> entries;
+	std::string names;
+	uint64_t offset = 0;
+	const char zeros[Alignment] = {};
+	bool ok = true;
+	auto write = [&](const void* data, size_t size) {
+		ok = ok && (size == 0 || fwrite(data, 1, size, fp) == size);
+		offset += size;
+	};
+	auto pad = [&](uint64_t alignment) { write(zeros, (size_t)((alignment - offset % alignment) % alignment)); };
+
+	//Filled in once the table is written
+	PackHeader header{};
+	write(&header, sizeof(header));
+
+	for (const Source& source : sources) {
+		pad(Alignment);
+
+		PackEntry e{};
+		e.hash = source.hash;
+		e.offset = offset;
+		e.size = source.size;
+		e.nameOffset = (uint32_t)names.size();
+		e.nameSize = (uint32_t)source.name.size();
+		names += source.name;
+
+		if (!source.compressed.empty()) {
+			e.flags = Compressed;
+			e.storedSize = source.compressed.size();
+			write(source.compressed.data(), source.compressed.size());
+			++stats.compressed;
+		}
+		else {
+			//Read again rather than holding every file mapped until here
+			MappedFile file(source.path.string().c_str());
+			e.storedSize = e.size = file.Size();
+			write(file.Data(), file.Size());
+		}
+
+		stats.bytes += (size_t)e.size;
+		stats.storedBytes += (size_t)e.storedSize;
+		entries.push_back(e);
+	}
+
+	pad(alignof(PackEntry));
+	std::memcpy(header.magic, PackMagic, sizeof(PackMagic));
+	header.version = PackVersion;
+	header.entryCount = (uint32_t)entries.size();
+	header.namesSize = (uint32_t)names.size();
+	header.tableOffset = offset;
+	write(entries.data(), sizeof(PackEntry) * entries.size());
+	write(names.data(), names.size());
+	ok = ok && fseek(fp, 0, SEEK_SET) == 0 && fwrite(&header, sizeof(header), 1, fp) == 1;
+	ok = fclose(fp) == 0 && ok;
+
+	std::error_code ec;
+	if (ok)
+		fs::rename(temp, output, ec);
+	if (!ok || ec) {
+		fs::remove(temp, ec);
+		spdlog::error("Could not write {}", output.string());
+		throw Ngine::Exception(__LINE__, __FILE__, "Could not write pack file");
+	}
+
+	stats.files = entries.size();
+	stats.ms = timer.Ms();
+	NGINE_LOG_INFO("Packed {} into {} {} {} {} {} {:.1f}", Field("directory", directory), Field("pack", packPath), Field("files", stats.files),
+		Field("compressed", stats.compressed), Field("bytes", stats.bytes), Field("storedBytes", stats.storedBytes), Field("ms", stats.ms));
+	return stats;
+}
+
+Ngine::VfsStats Ngine::Vfs::Stats() noexcept
+{
+	return VfsStats{ packedOpens.load(std::memory_order_relaxed), looseOpens.load(std::memory_order_relaxed), decompressedBytes.load(std::memory_order_relaxed) };
+}
@@ -0,0 +1,92 @@
+#pragma once
+#include "MappedFile.h"
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace Ngine {
+
+	struct VfsPack;
+
+	//Contents of one file: a view into a mounted pack, a decompressed copy of a packed entry or a mapped loose file
+	class NAPI VfsFile {
+	public:
+		VfsFile() = default;
+
+		const char* Data() const noexcept { return m_Data; }
+		size_t Size() const noexcept { return m_Size; }
+		std::string_view View() const noexcept { return std::string_view(m_Data, m_Size); }
+		bool Packed() const noexcept { return (bool)m_Pack; }
+		//Owns a heap copy instead of pointing into a mapping
+		bool Decompressed() const noexcept { return !m_Buffer.empty(); }
+
+	private:
+		friend class Vfs;
+
+		const char* m_Data = nullptr;
+		size_t m_Size = 0;
+		MappedFile m_Loose;
+		std::vector<char> m_Buffer;
+		std::shared_ptr<const VfsPack> m_Pack; //Keeps the mapping alive after Unmount
+	};
+
+	struct NAPI PackSettings {
+		bool compress = true;
+		//Extensions stored as they are. DDS is already block compressed and streamed a mip range at a time.
+		std::vector<std::string> storeRaw = { ".dds" };
+		//File names left out of the pack
+		std::vector<std::string> exclude;
+	};
+
+	struct NAPI PackStats {
+		size_t files, compressed;
+		size_t bytes, storedBytes; //Of all entries before and after compression
+		double ms;
+	};
+
+	//Totals since start
+	struct NAPI VfsStats {
+		uint64_t packedOpens, looseOpens;
+		uint64_t decompressedBytes;
+	};
+
+	//Where the bytes of a file sit on disk, for reading them without a mapping
+	struct NAPI VfsLocation {
+		std::string file; //Loose file or the pack holding it
+		uint64_t offset, size;
+	};
+
+	//Read-only virtual file system over packs and loose files.
+	//A pack is one memory mapped file with a table of entries sorted by path hash, entries are 16 byte aligned
+	//and optionally LZ4 block compressed. Mounting maps it once, opening a stored entry is a binary search
+	//and a pointer. Paths are matched case insensitively after normalisation, relative to the mount point.
+	//Files no pack has are read from disk, and with loose override on a file on disk also wins over the packs.
+	class NAPI Vfs {
+	public:
+		//False when the pack doesn't exist, throws when it is corrupt. Later mounts are searched first.
+		static bool Mount(const char* packPath, const char* mountPoint = "");
+		static void UnmountAll();
+
+		//On by default in debug builds, so edited assets show up without repacking
+		static void SetLooseOverride(bool enabled) noexcept;
+		static bool LooseOverride() noexcept;
+
+		//Throws when neither a pack nor the disk has the file
+		static VfsFile Open(const char* path);
+		//Same without throwing for missing files, corrupt entries still throw
+		static bool TryOpen(const char* path, VfsFile& file);
+		static bool Exists(const char* path);
+		//Same lookup as TryOpen. False when the file is missing or compressed in its pack.
+		static bool Locate(const char* path, VfsLocation& location);
+
+		//Packs every file under directory with paths relative to it, written to a temp file and renamed
+		static PackStats Pack(const char* directory, const char* packPath, const PackSettings& settings = PackSettings());
+
+		//'/' separators, lower cased ASCII, no "." or ".." parts except leading ".." of a path above the working directory.
+		//Pack entries never start with "..", so such a path can only be found loose.
+		static std::string NormalPath(const char* path);
+		static VfsStats Stats() noexcept;
+	};
+}
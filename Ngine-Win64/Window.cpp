@@ -1,30 +1,70 @@
 #include "pch.h"
 #include "Window.h"
+#include "Resources.h"
+#include "Memory.h"
+#include "GpuProfiler.h"
+#include <spdlog/spdlog.h>
 
-Ngine::Window::Window(int width, int height, const char* title)
+Ngine::Window::Window(int width, int height, const char* title, WindowMode mode)
+	: m_Headless(mode == WindowMode::Headless), m_Width(width), m_Height(height)
 {
-	mINI::INIFile file("Game.ini");
-	mINI::INIStructure ini;
-	if(!file.read(ini))
-		throw Ngine::Exception(__LINE__, __FILE__, "Could not read configuration file");
-	
-	if(ini["Game"]["API"] != "OpenGL")
-		throw Ngine::Exception(__LINE__, __FILE__, "API has illegal value");
+	//Configuration is already validated, API included
+	auto settings = Ngine::Settings::Get();
 
+#ifdef GLFW_PLATFORM_NULL
+	//Null platform needs no display server at all, GLFW 3.4 and newer
+	glfwInitHint(GLFW_PLATFORM, m_Headless ? GLFW_PLATFORM_NULL : GLFW_ANY_PLATFORM);
+#endif
 	if (!glfwInit())
 		throw Ngine::Exception(__LINE__, __FILE__, "Could not initialize GLFW library");
 	
-	glfwWindowHint(GLFW_SAMPLES, std::stoi(ini["Game"]["Samples"]));
-	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
-	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3); //Set opengl version to 3.3
-	glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
-	glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+	//glfwInit resets window hints, they are set again after starting over on another platform
+	auto hints = [&]() {
+		glfwWindowHint(GLFW_SAMPLES, m_Headless ? 0 : settings->samples); //Offscreen target is single sampled
+		glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+		glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3); //Set opengl version to 3.3
+		glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+		glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+		glfwWindowHint(GLFW_VISIBLE, m_Headless ? GLFW_FALSE : GLFW_TRUE);
+	};
+	hints();
 
-	m_Wptr = glfwCreateWindow(width, height, title, nullptr, nullptr);
+	if (m_Headless) {
+		//Software OSMesa first, EGL covers drivers that offer surfaceless contexts
+		glfwWindowHint(GLFW_CONTEXT_CREATION_API, GLFW_OSMESA_CONTEXT_API);
+		m_Wptr = glfwCreateWindow(width, height, title, nullptr, nullptr);
+		if (!m_Wptr) {
+			glfwWindowHint(GLFW_CONTEXT_CREATION_API, GLFW_EGL_CONTEXT_API);
+			m_Wptr = glfwCreateWindow(width, height, title, nullptr, nullptr);
+		}
+		//Stock Windows has neither, a hidden window on the native platform still renders offscreen
+		if (!m_Wptr) {
+#ifdef GLFW_PLATFORM_NULL
+			glfwTerminate();
+			glfwInitHint(GLFW_PLATFORM, GLFW_ANY_PLATFORM);
+			if (!glfwInit())
+				throw Ngine::Exception(__LINE__, __FILE__, "Could not initialize GLFW library");
+			hints();
+#endif
+			spdlog::warn("No OSMesa or EGL context, headless mode uses a hidden window");
+			glfwWindowHint(GLFW_CONTEXT_CREATION_API, GLFW_NATIVE_CONTEXT_API);
+			m_Wptr = glfwCreateWindow(width, height, title, nullptr, nullptr);
+		}
+	}
+	else {
+		glfwWindowHint(GLFW_CONTEXT_CREATION_API, GLFW_NATIVE_CONTEXT_API);
+		m_Wptr = glfwCreateWindow(width, height, title, nullptr, nullptr);
+	}
 	if(!m_Wptr)
 		throw Ngine::Exception(__LINE__, __FILE__, "Could not create window");
 
 	glfwMakeContextCurrent(m_Wptr);
+	if (!m_Headless) {
+		glfwSwapInterval(settings->vsync ? 1 : 0);
+
+		if (settings->fullscreen)
+			ApplyDisplayMode(*settings);
+	}
 
 	glewExperimental = true; //Enable Opengl experimental functions
 
@@ -36,21 +76,200 @@ Ngine::Window::Window(int width, int height, const char* title)
 	glEnable(GL_DEPTH_TEST);
 
 	glDepthFunc(GL_LESS);
+
+	if (m_Headless)
+		CreateOffscreen();
+
+#if NGINE_PROFILE
+	Ngine::GpuProfiler::Initialize();
+#endif
+
+	//Settings::Set may run on any thread, only note what changed
+	m_Listener = Ngine::Settings::Subscribe([this](const EngineSettings&, unsigned int changed) {
+		m_SettingsChanged.fetch_or(changed, std::memory_order_release);
+		});
 }
 
 Ngine::Window::~Window()
 {
+	Ngine::Settings::Unsubscribe(m_Listener);
+	Ngine::Resources::CollectGarbage(true);
+
+	//Resources still referenced here outlive their context
+	Ngine::Memory::LogCategories();
+	Ngine::Memory::ReportLeaks();
+#if NGINE_PROFILE
+	Ngine::GpuProfiler::LogAverages();
+	Ngine::GpuProfiler::Shutdown();
+	if (const std::string& trace = Ngine::Settings::Get()->profileTrace; !trace.empty())
+		Ngine::Profiler::Dump(trace.c_str());
+#endif
+	if (m_Headless) {
+		glDeleteFramebuffers(1, &m_Fbo);
+		glDeleteRenderbuffers(1, &m_Color);
+		glDeleteRenderbuffers(1, &m_Depth);
+	}
 	glfwDestroyWindow(m_Wptr);
 	glfwTerminate();
 }
 
 void Ngine::Window::StartRender()
 {
+	NGINE_ZONE("Window::StartRender");
+
+	unsigned int pending = m_Pending.exchange(0, std::memory_order_acquire);
+	if (pending & PENDING_SWAP_INTERVAL)
+		glfwSwapInterval(m_SwapInterval.load(std::memory_order_relaxed));
+	if (pending & PENDING_VIEWPORT)
+		glViewport(0, 0, m_ViewportWidth.load(std::memory_order_relaxed), m_ViewportHeight.load(std::memory_order_relaxed));
+
+	Ngine::Resources::CollectGarbage();
+	Ngine::Resources::UploadPending();
+
+	if (m_Headless)
+		glBindFramebuffer(GL_FRAMEBUFFER, m_Fbo);
+
+#if NGINE_PROFILE
+	Ngine::GpuProfiler::BeginFrame();
+#endif
+	NGINE_GPU_ZONE("Clear");
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT); //Clear back buffer data
 }
 
 void Ngine::Window::EndRender()
 {
-	glfwSwapBuffers(m_Wptr); //Move back buffer to front and display it on screen
+	Present();
+	PollEvents();
+}
+
+void Ngine::Window::Present()
+{
+	NGINE_ZONE("Window::Present");
+	NGINE_GPU_ZONE("Present");
+	if (m_Headless)
+		glFlush(); //Nothing to show, just hand the frame to the GPU
+	else
+		glfwSwapBuffers(m_Wptr); //Move back buffer to front and display it on screen
+}
+
+void Ngine::Window::PollEvents()
+{
+	NGINE_ZONE("Window::PollEvents");
 	glfwPollEvents(); //Check for any input
+
+	//Several Set calls since the last poll are applied once, with the latest values
+	if (unsigned int changed = m_SettingsChanged.exchange(0, std::memory_order_acquire))
+		OnSettingsChanged(*Ngine::Settings::Get(), changed);
+
+#if NGINE_PROFILE
+	//F12 writes the last frames of zones, on press only
+	bool dump = glfwGetKey(m_Wptr, GLFW_KEY_F12) == GLFW_PRESS;
+	if (dump && !m_DumpKey) {
+		if (const std::string& trace = Ngine::Settings::Get()->profileTrace; !trace.empty())
+			Ngine::Profiler::Dump(trace.c_str());
+	}
+	m_DumpKey = dump;
+#endif
+}
+
+void Ngine::Window::MakeCurrent()
+{
+	glfwMakeContextCurrent(m_Wptr);
+}
+
+void Ngine::Window::ReleaseCurrent()
+{
+	glfwMakeContextCurrent(nullptr);
 }
+
+std::vector<unsigned char> Ngine::Window::ReadPixels()
+{
+	//Back buffer is undefined after a swap, windowed callers read before Present
+	int width = m_Width, height = m_Height;
+	if (!m_Headless)
+		glfwGetFramebufferSize(m_Wptr, &width, &height);
+
+	std::vector<unsigned char> pixels((size_t)width * height * 4);
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, m_Fbo);
+	glPixelStorei(GL_PACK_ALIGNMENT, 1);
+	glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+	return pixels;
+}
+
+uint64_t Ngine::Window::FrameHash()
+{
+	uint64_t hash = 14695981039346656037ull;
+	for (unsigned char c : ReadPixels()) {
+		hash ^= c;
+		hash *= 1099511628211ull;
+	}
+	return hash;
+}
+
+void Ngine::Window::CreateOffscreen()
+{
+	glGenRenderbuffers(1, &m_Color);
+	glBindRenderbuffer(GL_RENDERBUFFER, m_Color);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, m_Width, m_Height);
+
+	glGenRenderbuffers(1, &m_Depth);
+	glBindRenderbuffer(GL_RENDERBUFFER, m_Depth);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, m_Width, m_Height);
+
+	glGenFramebuffers(1, &m_Fbo);
+	glBindFramebuffer(GL_FRAMEBUFFER, m_Fbo);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, m_Color);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, m_Depth);
+
+	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+		spdlog::error("Offscreen framebuffer of {}x{} is incomplete", m_Width, m_Height);
+		throw Ngine::Exception(__LINE__, __FILE__, "Could not create offscreen framebuffer");
+	}
+
+	glViewport(0, 0, m_Width, m_Height);
+}
+
+
+void Ngine::Window::OnSettingsChanged(const EngineSettings& settings, unsigned int changed)
+{
+	//Offscreen target keeps the size it was created with
+	if (m_Headless)
+		return;
+
+	//Runs on the main thread while the context may belong to the render thread
+	if (changed & SETTINGS_VSYNC) {
+		m_SwapInterval.store(settings.vsync ? 1 : 0, std::memory_order_relaxed);
+		m_Pending.fetch_or(PENDING_SWAP_INTERVAL, std::memory_order_release);
+	}
+
+	if (changed & (SETTINGS_DISPLAY_MODE | SETTINGS_RESOLUTION)) {
+		if (settings.fullscreen)
+			ApplyDisplayMode(settings);
+		else if (changed & SETTINGS_DISPLAY_MODE)
+			glfwSetWindowMonitor(m_Wptr, nullptr, 100, 100, settings.width, settings.height, GLFW_DONT_CARE);
+		else
+			glfwSetWindowSize(m_Wptr, settings.width, settings.height);
+
+		int width, height;
+		glfwGetFramebufferSize(m_Wptr, &width, &height);
+		m_ViewportWidth.store(width, std::memory_order_relaxed);
+		m_ViewportHeight.store(height, std::memory_order_relaxed);
+		m_Pending.fetch_or(PENDING_VIEWPORT, std::memory_order_release);
+	}
+
+	//Default framebuffer and context can't be changed on a live window
+	if (changed & (SETTINGS_SAMPLES | SETTINGS_DEVICE))
+		spdlog::warn("Samples, API and GPU changes take effect after restart");
+}
+
+void Ngine::Window::ApplyDisplayMode(const EngineSettings& settings)
+{
+	GLFWmonitor* monitor = glfwGetPrimaryMonitor();
+	const GLFWvidmode* mode = glfwGetVideoMode(monitor);
+
+	//Windowed fullscreen keeps the desktop mode, exclusive fullscreen switches to the configured resolution
+	if (settings.windowed)
+		glfwSetWindowMonitor(m_Wptr, monitor, 0, 0, mode->width, mode->height, mode->refreshRate);
+	else
+		glfwSetWindowMonitor(m_Wptr, monitor, 0, 0, settings.width, settings.height, GLFW_DONT_CARE);
+}
\ No newline at end of file
@@ -1,12 +1,22 @@
 #pragma once
 #include "Macro.h"
+#include "Settings.h"
 #include <gl/glew.h>
 #include <GLFW/glfw3.h>
+#include <atomic>
+#include <cstdint>
+#include <vector>
 
 namespace Ngine {
+
+	enum class WindowMode {
+		Windowed, //Fullscreen too, as configured
+		Headless //No display needed, renders into an offscreen framebuffer, eg. for benchmarks and CI
+	};
+
 	class NAPI Window {
 	public:
-		Window(int width, int height, const char* title);
+		Window(int width, int height, const char* title, WindowMode mode = WindowMode::Windowed);
 		~Window();
 
 		//Delete ability to copy class since we will only provide one window for our game
@@ -15,10 +25,43 @@ namespace Ngine {
 
 		inline bool ShouldClose() const noexcept { return glfwWindowShouldClose(m_Wptr); }
 		void StartRender();
-		void EndRender();
+		void EndRender(); //Present and PollEvents in one call for single threaded games
+
+		void Present(); //Thread owning the context
+		void PollEvents(); //Main thread only
+
+		//Moves the GL context between the main thread and a render thread
+		void MakeCurrent();
+		static void ReleaseCurrent();
+
+		bool Headless() const noexcept { return m_Headless; }
+		int Width() const noexcept { return m_Width; }
+		int Height() const noexcept { return m_Height; }
+
+		//RGBA rows of the last rendered frame, bottom row first. Waits for the GPU, thread owning the context only.
+		std::vector<unsigned char> ReadPixels();
+		//FNV-1a of ReadPixels, for spotting visual changes between runs
+		uint64_t FrameHash();
 
 	private:
+		//Runtime edits of the configuration, applied by PollEvents since GLFW requires the main thread
+		void OnSettingsChanged(const EngineSettings& settings, unsigned int changed);
+		void ApplyDisplayMode(const EngineSettings& settings);
+
+		//Context state changes wait here until the thread owning the context starts a frame
+		enum Pending : unsigned int { PENDING_SWAP_INTERVAL = 1 << 0, PENDING_VIEWPORT = 1 << 1 };
+
+		void CreateOffscreen();
+
 		GLFWwindow* m_Wptr;
+		int m_Listener;
+		bool m_Headless;
+		int m_Width, m_Height;
+		GLuint m_Fbo = 0, m_Color = 0, m_Depth = 0; //Headless render target
+		std::atomic<unsigned int> m_Pending = 0;
+		std::atomic<unsigned int> m_SettingsChanged = 0; //SettingsChange bits since the last PollEvents
+		std::atomic<int> m_SwapInterval = 0, m_ViewportWidth = 0, m_ViewportHeight = 0;
+		bool m_DumpKey = false; //F12 state of the previous poll
 	}; 
 }
 
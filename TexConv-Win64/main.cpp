@@ -0,0 +1,78 @@
+#include "pch.h"
+#include <Ngine.hpp>
+#include <charconv>
+#include <chrono>
+#include <cstring>
+#include <spdlog/spdlog.h>
+
+//Offline BMP to BC1/BC3 DDS converter
+//Rows keep BMP order so the output is a drop-in replacement for LoadBMP with unchanged UVs
+int main(int argc, char** argv) try {
+	if (argc < 3) {
+		printf("Usage: %s <input.bmp> <output.dds> [bc1|bc3] [threads]\n", argv[0]);
+		printf("       %s --atlas <manifest.ini> <input.bmp>...\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	//Pack textures into shared arrays and atlas pages, see Ngine::TextureAtlas
+	if (strcmp(argv[1], "--atlas") == 0) {
+		Ngine::JobScope jobs;
+		std::vector<std::string> sources(argv + 3, argv + argc);
+		Ngine::TextureAtlas::Cook(sources, argv[2]);
+		return EXIT_SUCCESS;
+	}
+
+	Ngine::BCFormat format = Ngine::BCFormat::BC1;
+	if (argc > 3) {
+		if (strcmp(argv[3], "bc3") == 0)
+			format = Ngine::BCFormat::BC3;
+		else if (strcmp(argv[3], "bc1") != 0)
+			throw Ngine::Exception(__LINE__, __FILE__, "Unknown block format");
+	}
+
+	//Calling thread works too, so N threads means N - 1 workers
+	int threads = 0;
+	if (argc > 4) {
+		auto [end, error] = std::from_chars(argv[4], argv[4] + strlen(argv[4]), threads);
+		if (error != std::errc() || *end)
+			throw Ngine::Exception(__LINE__, __FILE__, "Thread count is not a number");
+	}
+	Ngine::JobScope jobs(threads > 0 ? threads - 1 : -1);
+
+	auto start = std::chrono::steady_clock::now();
+
+	Ngine::Image source = Ngine::TextureCompressor::LoadBMP(argv[1]);
+	std::vector<Ngine::Image> chain = Ngine::TextureCompressor::BuildMipChain(source);
+
+	auto filtered = std::chrono::steady_clock::now();
+
+	std::vector<std::vector<unsigned char>> levels;
+	for (const auto& level : chain)
+		levels.push_back(Ngine::TextureCompressor::Encode(level, format));
+
+	auto encoded = std::chrono::steady_clock::now();
+
+	Ngine::TextureCompressor::WriteDDS(argv[2], levels, source.width, source.height, format);
+
+	//Quality is measured against the filtered level the block data was made from
+	size_t compressedBytes = 0;
+	for (size_t i = 0; i < chain.size(); ++i) {
+		Ngine::Image decoded = Ngine::TextureCompressor::Decode(levels[i].data(), chain[i].width, chain[i].height, format);
+		double psnr = Ngine::TextureCompressor::PSNR(chain[i], decoded, format == Ngine::BCFormat::BC3);
+		spdlog::info("Mip {} {}x{}: {} bytes, PSNR {:.2f} dB", i, chain[i].width, chain[i].height, levels[i].size(), psnr);
+		compressedBytes += levels[i].size();
+	}
+
+	size_t sourceBytes = (size_t)source.width * source.height * 3;
+	spdlog::info("{} -> {}: {} bytes instead of {} bytes uncompressed without mipmaps",
+		argv[1], argv[2], compressedBytes, sourceBytes);
+	spdlog::info("Mip chain built in {} ms, encoded in {} ms",
+		std::chrono::duration_cast<std::chrono::milliseconds>(filtered - start).count(),
+		std::chrono::duration_cast<std::chrono::milliseconds>(encoded - filtered).count());
+
+	return EXIT_SUCCESS;
+}
+catch (const Ngine::Exception& e) {
+	printf("%s", e.what());
+	return EXIT_FAILURE;
+}